@@ -0,0 +1,108 @@
+#include "c_flight_path.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QTextStream>
+
+//------------------------------------------------------------------------------
+static QTextStream&
+operator<<( QTextStream& stream, const QVector3D& v )
+{
+    return stream << v.x() << " " << v.y() << " " << v.z();
+}
+
+//------------------------------------------------------------------------------
+static QTextStream&
+operator>>( QTextStream& stream, QVector3D& v )
+{
+    float x, y, z;
+    stream >> x >> y >> z;
+    v = QVector3D( x, y, z );
+    return stream;
+}
+
+//------------------------------------------------------------------------------
+CFlightPath::CFlightPath()
+{
+}
+
+//------------------------------------------------------------------------------
+CFlightPath::Sample
+CFlightPath::sample( float t ) const
+{
+    if ( m_samples.isEmpty() )
+        return Sample();
+
+    // Samples are sorted by time, find the pair around t
+    int hi = 0;
+    while ( hi < m_samples.size() && m_samples.at( hi ).time < t )
+        ++hi;
+    if ( hi == 0 )
+        return m_samples.first();
+    if ( hi == m_samples.size() )
+        return m_samples.last();
+
+    const Sample& a = m_samples.at( hi - 1 );
+    const Sample& b = m_samples.at( hi );
+    const float span = b.time - a.time;
+    const float s = span > 0.0f ? ( t - a.time ) / span : 1.0f;
+
+    Sample result = b;
+    result.time = t;
+    result.position = a.position + ( b.position - a.position ) * s;
+    result.viewCenter = a.viewCenter + ( b.viewCenter - a.viewCenter ) * s;
+    result.upVector = ( a.upVector + ( b.upVector - a.upVector ) * s ).normalized();
+    return result;
+}
+
+//------------------------------------------------------------------------------
+bool
+CFlightPath::save( const QString& fileName ) const
+{
+    QFile file( fileName );
+    if ( !file.open( QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text ) )
+    {
+        qWarning() << "Could not write flight path" << fileName << file.errorString();
+        return false;
+    }
+
+    QTextStream stream( &file );
+    for ( int i = 0; i < m_samples.size(); ++i )
+    {
+        const Sample& s = m_samples.at( i );
+        stream << s.time << " " << s.position << " " << s.viewCenter << " " << s.upVector
+               << " " << s.velocity << " " << s.panRate << " " << s.tiltRate << "\n";
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+bool
+CFlightPath::load( const QString& fileName )
+{
+    QFile file( fileName );
+    if ( !file.open( QIODevice::ReadOnly | QIODevice::Text ) )
+    {
+        qWarning() << "Could not read flight path" << fileName << file.errorString();
+        return false;
+    }
+
+    m_samples.clear();
+    QTextStream stream( &file );
+    while ( !stream.atEnd() )
+    {
+        const QString line = stream.readLine();
+        if ( line.isEmpty() )
+            continue;
+
+        QString copy = line;
+        QTextStream fields( &copy );
+        Sample s;
+        fields >> s.time >> s.position >> s.viewCenter >> s.upVector
+               >> s.velocity >> s.panRate >> s.tiltRate;
+        m_samples.append( s );
+    }
+    return !m_samples.isEmpty();
+}
+
+//------------------------------------------------------------------------------
@@ -0,0 +1,52 @@
+#ifndef C_FLIGHT_PATH_H
+#define C_FLIGHT_PATH_H
+
+#include <QString>
+#include <QVector>
+#include <QVector3D>
+
+/**
+  A recorded camera trajectory, together with the motion input that was
+  active at each frame, so that flights can be replayed for measurements.
+  */
+class CFlightPath
+{
+public:
+    class Sample
+    {
+    public:
+        Sample()
+            : time( 0.0f ),
+              panRate( 0.0f ),
+              tiltRate( 0.0f )
+        {
+        }
+
+        float time;
+        QVector3D position;
+        QVector3D viewCenter;
+        QVector3D upVector;
+        QVector3D velocity;
+        float panRate;
+        float tiltRate;
+    };
+
+    CFlightPath();
+
+    void clear() { m_samples.clear(); }
+    void append( const Sample& sample ) { m_samples.append( sample ); }
+
+    bool isEmpty() const { return m_samples.isEmpty(); }
+    float duration() const { return m_samples.isEmpty() ? 0.0f : m_samples.last().time; }
+
+    // Interpolates the camera state at time t, relative to the first sample
+    Sample sample( float t ) const;
+
+    bool save( const QString& fileName ) const;
+    bool load( const QString& fileName );
+
+private:
+    QVector<Sample> m_samples;
+};
+
+#endif // C_FLIGHT_PATH_H
@@ -0,0 +1,241 @@
+#include "c_gpu_feedback.h"
+#include "c_stats.h"
+
+#include <QDebug>
+#include <QOpenGLFunctions_4_3_Core>
+
+namespace
+{
+    const int groupSize = 64;
+
+    // Counts ahead of the lists in the list buffer
+    const int headerWords = 4;
+}
+
+//------------------------------------------------------------------------------
+CGpuFeedback::CGpuFeedback()
+    : m_funcs( NULL ),
+      m_compact(),
+      m_slotCount( 0 ),
+      m_nodeCapacity( 0 ),
+      m_nodeCount( 0 ),
+      m_usageBuffer( 0 ),
+      m_requestBuffer( 0 ),
+      m_listBuffer( 0 ),
+      m_next( 0 ),
+      m_oldest( 0 ),
+      m_pending( 0 ),
+      m_droppedFrames( 0 ),
+      m_droppedStat( CStats::instance().counter( "feedback.droppedFrames" ) )
+{
+}
+
+//------------------------------------------------------------------------------
+CGpuFeedback::~CGpuFeedback()
+{
+    destroy();
+}
+
+//------------------------------------------------------------------------------
+void
+CGpuFeedback::create( QOpenGLFunctions_4_3_Core* funcs, int slotCount )
+{
+    destroy();
+    m_funcs = funcs;
+    m_slotCount = slotCount;
+
+    m_compact = QOpenGLShaderProgramPtr( new QOpenGLShaderProgram );
+    if ( !m_compact->addShaderFromSourceFile( QOpenGLShader::Compute, "shaders/feedback_compact.comp" ) )
+        qCritical() << QObject::tr( "Could not compile compute shader. Log:" ) << m_compact->log();
+    if ( !m_compact->link() )
+        qCritical() << QObject::tr( "Could not link shader program. Log:" ) << m_compact->log();
+
+    QVector<GLuint> zeros( slotCount, 0 );
+    m_funcs->glGenBuffers( 1, &m_usageBuffer );
+    m_funcs->glBindBuffer( GL_SHADER_STORAGE_BUFFER, m_usageBuffer );
+    m_funcs->glBufferData( GL_SHADER_STORAGE_BUFFER, slotCount * sizeof( GLuint ), zeros.constData(), GL_DYNAMIC_COPY );
+
+    // The node flags grow with the tree, see bind()
+    m_funcs->glGenBuffers( 1, &m_requestBuffer );
+
+    m_funcs->glGenBuffers( 1, &m_listBuffer );
+    m_funcs->glBindBuffer( GL_SHADER_STORAGE_BUFFER, m_listBuffer );
+    m_funcs->glBufferData( GL_SHADER_STORAGE_BUFFER, listBytes(), NULL, GL_DYNAMIC_COPY );
+    m_funcs->glBindBuffer( GL_SHADER_STORAGE_BUFFER, 0 );
+
+    for ( int i = 0; i < latency; ++i )
+    {
+        m_funcs->glGenBuffers( 1, &m_readbacks[i].buffer );
+        m_funcs->glBindBuffer( GL_COPY_WRITE_BUFFER, m_readbacks[i].buffer );
+        m_funcs->glBufferData( GL_COPY_WRITE_BUFFER, listBytes(), NULL, GL_STREAM_READ );
+    }
+    m_funcs->glBindBuffer( GL_COPY_WRITE_BUFFER, 0 );
+}
+
+//------------------------------------------------------------------------------
+void
+CGpuFeedback::destroy()
+{
+    if ( !isCreated() )
+        return;
+
+    for ( int i = 0; i < latency; ++i )
+    {
+        if ( m_readbacks[i].fence )
+            m_funcs->glDeleteSync( m_readbacks[i].fence );
+        m_funcs->glDeleteBuffers( 1, &m_readbacks[i].buffer );
+        m_readbacks[i] = CReadback();
+    }
+    m_funcs->glDeleteBuffers( 1, &m_usageBuffer );
+    m_funcs->glDeleteBuffers( 1, &m_requestBuffer );
+    m_funcs->glDeleteBuffers( 1, &m_listBuffer );
+    m_usageBuffer = 0;
+    m_requestBuffer = 0;
+    m_listBuffer = 0;
+    m_nodeCapacity = 0;
+    m_nodeCount = 0;
+    m_next = 0;
+    m_oldest = 0;
+    m_pending = 0;
+    m_compact.clear();
+}
+
+//------------------------------------------------------------------------------
+void
+CGpuFeedback::bind( int nodeCount, GLuint usageBinding, GLuint requestBinding )
+{
+    // Growing drops the flags of the frame drawn last, which were already
+    // compacted and cleared
+    if ( nodeCount > m_nodeCapacity )
+    {
+        m_nodeCapacity = qMax( nodeCount, 2 * m_nodeCapacity );
+        QVector<GLuint> zeros( m_nodeCapacity, 0 );
+        m_funcs->glBindBuffer( GL_SHADER_STORAGE_BUFFER, m_requestBuffer );
+        m_funcs->glBufferData( GL_SHADER_STORAGE_BUFFER, m_nodeCapacity * sizeof( GLuint ),
+                               zeros.constData(), GL_DYNAMIC_COPY );
+        m_funcs->glBindBuffer( GL_SHADER_STORAGE_BUFFER, 0 );
+    }
+    m_nodeCount = nodeCount;
+
+    m_funcs->glBindBufferBase( GL_SHADER_STORAGE_BUFFER, usageBinding, m_usageBuffer );
+    m_funcs->glBindBufferBase( GL_SHADER_STORAGE_BUFFER, requestBinding, m_requestBuffer );
+}
+
+//------------------------------------------------------------------------------
+void
+CGpuFeedback::endFrame( int frame, const QVector<CNodeKey>& keys )
+{
+    // Nobody read the frame this buffer holds in time
+    CReadback& readback = m_readbacks[m_next];
+    if ( readback.fence )
+    {
+        m_funcs->glDeleteSync( readback.fence );
+        readback.fence = 0;
+        m_oldest = ( m_oldest + 1 ) % latency;
+        --m_pending;
+        ++m_droppedFrames;
+        m_droppedStat->add( 1 );
+    }
+
+    const GLuint zero[headerWords] = { 0, 0, 0, 0 };
+    m_funcs->glBindBuffer( GL_SHADER_STORAGE_BUFFER, m_listBuffer );
+    m_funcs->glBufferSubData( GL_SHADER_STORAGE_BUFFER, 0, sizeof( zero ), zero );
+    m_funcs->glBindBuffer( GL_SHADER_STORAGE_BUFFER, 0 );
+
+    // The flags were written by the fragment shaders of the draws
+    m_funcs->glMemoryBarrier( GL_SHADER_STORAGE_BARRIER_BIT );
+    m_compact->bind();
+    m_compact->setUniformValue( "slotCount", m_slotCount );
+    m_compact->setUniformValue( "nodeCount", m_nodeCount );
+    m_compact->setUniformValue( "maxRequests", int( maxRequests ) );
+    m_funcs->glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 0, m_usageBuffer );
+    m_funcs->glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 1, m_requestBuffer );
+    m_funcs->glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 2, m_listBuffer );
+    const int items = qMax( m_slotCount, m_nodeCount );
+    m_funcs->glDispatchCompute( ( items + groupSize - 1 ) / groupSize, 1, 1 );
+    m_compact->release();
+
+    // Copy on the GPU, then fence; the copy is what read() maps later
+    m_funcs->glMemoryBarrier( GL_BUFFER_UPDATE_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT );
+    m_funcs->glBindBuffer( GL_COPY_READ_BUFFER, m_listBuffer );
+    m_funcs->glBindBuffer( GL_COPY_WRITE_BUFFER, readback.buffer );
+    m_funcs->glCopyBufferSubData( GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, listBytes() );
+    m_funcs->glBindBuffer( GL_COPY_READ_BUFFER, 0 );
+    m_funcs->glBindBuffer( GL_COPY_WRITE_BUFFER, 0 );
+
+    readback.fence = m_funcs->glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+    readback.frame = frame;
+    readback.keys = keys;
+    m_next = ( m_next + 1 ) % latency;
+    ++m_pending;
+}
+
+//------------------------------------------------------------------------------
+bool
+CGpuFeedback::read( CFeedbackFrame& feedback )
+{
+    if ( m_pending == 0 )
+        return false;
+
+    // A zero timeout only asks; flushing makes sure the fence gets there
+    CReadback& readback = m_readbacks[m_oldest];
+    const GLenum status = m_funcs->glClientWaitSync( readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0 );
+    if ( status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED )
+        return false;
+
+    m_funcs->glDeleteSync( readback.fence );
+    readback.fence = 0;
+    m_oldest = ( m_oldest + 1 ) % latency;
+    --m_pending;
+
+    feedback.frame = readback.frame;
+    feedback.usedSlots.clear();
+    feedback.requests.clear();
+    feedback.droppedRequests = 0;
+
+    m_funcs->glBindBuffer( GL_COPY_READ_BUFFER, readback.buffer );
+    const GLuint* words = static_cast<const GLuint*>(
+        m_funcs->glMapBufferRange( GL_COPY_READ_BUFFER, 0, listBytes(), GL_MAP_READ_BIT ) );
+    if ( words )
+    {
+        const int used = qMin( int( words[0] ), m_slotCount );
+        const int requests = int( words[1] );
+        const GLuint* usedList = words + headerWords;
+        const GLuint* requestList = usedList + m_slotCount;
+
+        feedback.usedSlots.resize( used );
+        for ( int i = 0; i < used; ++i )
+            feedback.usedSlots[i] = int( usedList[i] );
+
+        // Bit 8 asks for the node itself, bits 0..7 for its children
+        const QVector<CNodeKey>& keys = readback.keys;
+        for ( int i = 0; i < qMin( requests, int( maxRequests ) ); ++i )
+        {
+            const int node = int( requestList[2 * i] );
+            const GLuint bits = requestList[2 * i + 1];
+            if ( node >= keys.size() )
+                continue;
+            if ( bits & 0x100u )
+                feedback.requests.append( keys.at( node ) );
+            for ( int c = 0; c < 8; ++c )
+            {
+                if ( bits & ( 1u << c ) )
+                    feedback.requests.append( keys.at( node ).child( c ) );
+            }
+        }
+        feedback.droppedRequests = qMax( requests - int( maxRequests ), 0 );
+        m_funcs->glUnmapBuffer( GL_COPY_READ_BUFFER );
+    }
+    m_funcs->glBindBuffer( GL_COPY_READ_BUFFER, 0 );
+    readback.keys.clear();
+    return true;
+}
+
+//------------------------------------------------------------------------------
+int
+CGpuFeedback::listBytes() const
+{
+    return int( ( headerWords + m_slotCount + 2 * maxRequests ) * sizeof( GLuint ) );
+}
+
+//------------------------------------------------------------------------------
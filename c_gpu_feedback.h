@@ -0,0 +1,116 @@
+#ifndef C_GPU_FEEDBACK_H
+#define C_GPU_FEEDBACK_H
+
+#include "c_node_key.h"
+#include "material.h"
+
+#include <QVector>
+
+class CStatsCounter;
+class QOpenGLFunctions_4_3_Core;
+
+/**
+  What the marcher needed in one frame: the pool slots it sampled and the
+  nodes it wanted but found neither produced nor resident.
+  */
+class CFeedbackFrame
+{
+public:
+    CFeedbackFrame()
+        : frame( -1 ),
+          droppedRequests( 0 )
+    {
+    }
+
+    int frame;
+    QVector<int> usedSlots;
+    QVector<CNodeKey> requests;
+
+    // Requests beyond the capacity of the list, left for a later frame
+    int droppedRequests;
+};
+
+/**
+  Lets the GPU tell the loader which bricks and nodes it needed, without
+  the CPU ever waiting for it.
+
+  While drawing, the marcher sets one flag per pool slot it sampled and,
+  per node of the node buffer, bits 0..7 for children it wanted to descend
+  into that the tree does not hold yet and bit 8 for a brick of the node
+  itself that is missing. After the draws a compute pass compacts the
+  flags into two lists and clears them for the next frame. The lists are
+  copied into one of a ring of read back buffers and fenced.
+
+  read() hands out the frames whose fence has passed, oldest first, and
+  returns false right away otherwise, so the lists arrive latency frames
+  late at most. A frame still pending when its buffer comes round again
+  is dropped.
+  */
+class CGpuFeedback
+{
+public:
+    enum
+    {
+        latency = 3,
+        maxRequests = 4096
+    };
+
+    CGpuFeedback();
+    ~CGpuFeedback();
+
+    void create( QOpenGLFunctions_4_3_Core* funcs, int slotCount );
+    void destroy();
+    bool isCreated() const { return m_listBuffer != 0; }
+
+    // Makes room for the flags of nodeCount nodes and binds the flag
+    // buffers for the draws
+    void bind( int nodeCount, GLuint usageBinding, GLuint requestBinding );
+
+    // After the draws of the frame. keys is the key of each node of the
+    // node buffer the frame was drawn with.
+    void endFrame( int frame, const QVector<CNodeKey>& keys );
+
+    // The oldest frame that arrived, without waiting for the GPU
+    bool read( CFeedbackFrame& feedback );
+
+    int droppedFrameCount() const { return m_droppedFrames; }
+
+private:
+    class CReadback
+    {
+    public:
+        CReadback()
+            : buffer( 0 ),
+              fence( 0 ),
+              frame( -1 )
+        {
+        }
+
+        GLuint buffer;
+        GLsync fence;
+        int frame;
+        QVector<CNodeKey> keys;
+    };
+
+    int listBytes() const;
+
+    QOpenGLFunctions_4_3_Core* m_funcs;
+    QOpenGLShaderProgramPtr m_compact;
+    int m_slotCount;
+    int m_nodeCapacity;
+    int m_nodeCount;
+
+    GLuint m_usageBuffer;
+    GLuint m_requestBuffer;
+    GLuint m_listBuffer;
+
+    // Frames are written to m_next and read from m_oldest
+    CReadback m_readbacks[latency];
+    int m_next;
+    int m_oldest;
+    int m_pending;
+    int m_droppedFrames;
+    CStatsCounter* m_droppedStat;
+};
+
+#endif // C_GPU_FEEDBACK_H
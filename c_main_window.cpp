@@ -1,15 +1,22 @@
 #include "c_main_window.h"
+#include "c_stats.h"
 
 #include <QCoreApplication>
+#include <QDebug>
 #include <QKeyEvent>
 #include <QOpenGLContext>
 #include <QTimer>
 
 //------------------------------------------------------------------------------
-CMainWindow::CMainWindow( QScreen* screen )
+CMainWindow::CMainWindow( CBrickPool::SlotOrder slotOrder, CBrickPool::Storage storage, QScreen* screen )
     : QWindow( screen ),
       m_scene( new CVoxelScene( this ) ),
-      m_leftButtonPressed( false )
+      m_leftButtonPressed( false ),
+      m_statsTimer( NULL ),
+      m_frameCount( CStats::instance().counter( "frame.count" ) ),
+      m_frameInterval( CStats::instance().histogram( "frame.intervalMilliseconds" ) ),
+      m_updateTime( CStats::instance().histogram( "frame.updateMilliseconds" ) ),
+      m_renderTime( CStats::instance().histogram( "frame.renderMilliseconds" ) )
 {
     // Tell Qt we will use OpenGL for this window
     setSurfaceType( OpenGLSurface );
@@ -35,6 +42,8 @@ CMainWindow::CMainWindow( QScreen* screen )
     // Setup our scene
     m_context->makeCurrent( this );
     m_scene->setContext( m_context );
+    m_scene->setPoolSlotOrder( slotOrder );
+    m_scene->setPoolStorage( storage );
     initializeGL();
 
     // Make sure we tell OpenGL about new window sizes
@@ -66,6 +75,7 @@ CMainWindow::paintGL()
 
     // Do the rendering (to the back buffer)
     m_scene->render();
+    m_statsOverlay.render( width(), height() );
 
     // Swap front/back buffers
     m_context->swapBuffers( this );
@@ -83,9 +93,45 @@ CMainWindow::resizeGL()
 void
 CMainWindow::updateScene()
 {
+    // The scene update streams bricks to the GPU
+    m_context->makeCurrent( this );
+
+    // Time between frames, and the CPU side of the update and the draw
+    if ( m_frameTimer.isValid() )
+        m_frameInterval->record( m_frameTimer.nsecsElapsed() / 1.0e6 );
+    m_frameTimer.start();
+    m_frameCount->add();
+
     float time = m_time.elapsed() / 1000.0f;
+    QElapsedTimer timer;
+    timer.start();
     m_scene->update( time );
+    m_updateTime->record( timer.nsecsElapsed() / 1.0e6 );
+
+    timer.restart();
     paintGL();
+    m_renderTime->record( timer.nsecsElapsed() / 1.0e6 );
+}
+
+//------------------------------------------------------------------------------
+void
+CMainWindow::setStatsFile( const QString& fileName, int seconds )
+{
+    m_statsFile = fileName;
+    if ( !m_statsTimer )
+    {
+        m_statsTimer = new QTimer( this );
+        connect( m_statsTimer, SIGNAL( timeout() ), this, SLOT( writeStats() ) );
+    }
+    m_statsTimer->start( qMax( seconds, 1 ) * 1000 );
+}
+
+//------------------------------------------------------------------------------
+void
+CMainWindow::writeStats()
+{
+    if ( !CStats::instance().writeJson( m_statsFile ) )
+        qWarning() << "Could not write statistics to" << m_statsFile;
 }
 
 //------------------------------------------------------------------------------
@@ -128,51 +174,129 @@ CMainWindow::keyPressEvent( QKeyEvent* e )
             break;
 
         case Qt::Key_Plus:
+            m_scene->setPixelError( m_scene->pixelError() * 1.25f );
             break;
 
         case Qt::Key_Minus:
+            m_scene->setPixelError( m_scene->pixelError() / 1.25f );
             break;
 
         case Qt::Key_Home:
+            m_scene->edit( CVoxelEdit::Sphere, CVoxelEdit::Add );
             break;
 
         case Qt::Key_End:
+            m_scene->edit( CVoxelEdit::Sphere, CVoxelEdit::Remove );
             break;
 
         case Qt::Key_BracketLeft:
+            m_scene->setBrushRadius( m_scene->brushRadius() / 1.25f );
             break;
 
         case Qt::Key_BracketRight:
+            m_scene->setBrushRadius( m_scene->brushRadius() * 1.25f );
             break;
 
         case Qt::Key_Comma:
+            m_scene->edit( CVoxelEdit::Box, CVoxelEdit::Add );
             break;
 
         case Qt::Key_Period:
+            m_scene->edit( CVoxelEdit::Box, CVoxelEdit::Remove );
+            break;
+
+        case Qt::Key_T:
+            m_scene->setTransferFunctionEnabled( !m_scene->isTransferFunctionEnabled() );
+            break;
+
+        case Qt::Key_G:
+            m_scene->setGpuFeedback( !m_scene->gpuFeedback() );
+            break;
+
+        case Qt::Key_P:
+            m_scene->setSequencePlaying( !m_scene->sequencePlaying() );
+            break;
+
+        case Qt::Key_Tab:
+            // Select the next control point of the transfer function
+            m_scene->selectTransferPoint( ( m_scene->selectedTransferPoint() + 1 )
+                                          % m_scene->transferFunction().pointCount() );
+            break;
+
+        case Qt::Key_Left:
+            m_scene->moveTransferPoint( -0.01f, 0.0f );
+            break;
+
+        case Qt::Key_Right:
+            m_scene->moveTransferPoint( 0.01f, 0.0f );
+            break;
+
+        case Qt::Key_Up:
+            m_scene->moveTransferPoint( 0.0f, 0.02f );
+            break;
+
+        case Qt::Key_Down:
+            m_scene->moveTransferPoint( 0.0f, -0.02f );
             break;
 
         case Qt::Key_F1:
+            m_statsOverlay.setVisible( !m_statsOverlay.isVisible() );
             break;
 
         case Qt::Key_F2:
+            if ( m_scene->isRecording() )
+                m_scene->stopRecording( QStringLiteral( "flight.path" ) );
+            else
+                m_scene->startRecording();
             break;
 
         case Qt::Key_F3:
+            m_scene->startPlayback( QStringLiteral( "flight.path" ) );
             break;
 
         case Qt::Key_F4:
+            m_scene->setPrefetchEnabled( !m_scene->isPrefetchEnabled() );
             break;
 
         case Qt::Key_F5:
+        {
+            // Cycle through growing numbers of asset copies
+            const int counts[] = { 0, 64, 1024, 4096 };
+            int i = 0;
+            while ( i < 3 && counts[i] != m_scene->instanceCount() )
+                ++i;
+            m_scene->setInstanceCount( counts[( i + 1 ) % 4] );
             break;
+        }
 
         case Qt::Key_F6:
+            m_scene->setTraceInstances( !m_scene->traceInstances() );
             break;
 
         case Qt::Key_F7:
+            // Cycle through no culling, frustum, frustum and occlusion
+            m_scene->setCullingMode( CVoxelScene::CullingMode( ( m_scene->cullingMode() + 1 ) % 3 ) );
             break;
 
         case Qt::Key_F8:
+            // Cycle through one view, a stereo pair and a cube map
+            m_scene->setViewMode( CVoxelScene::ViewMode( ( m_scene->viewMode() + 1 ) % 3 ) );
+            break;
+
+        case Qt::Key_F9:
+            m_scene->startViewBenchmark();
+            break;
+
+        case Qt::Key_F10:
+            m_scene->setDistanceLeaping( !m_scene->distanceLeaping() );
+            break;
+
+        case Qt::Key_F11:
+            m_scene->startEmptySpaceBenchmark();
+            break;
+
+        case Qt::Key_F12:
+            m_scene->setOccupancySkipping( !m_scene->occupancySkipping() );
             break;
 
         default:
@@ -1,19 +1,34 @@
 #ifndef C_MAIN_WINDOW_H
 #define C_MAIN_WINDOW_H
 
+#include <QElapsedTimer>
 #include <QWindow>
 #include <QTime>
 
+#include "c_stats_overlay.h"
 #include "c_voxel_scene.h"
 
+class CStatsCounter;
+class CStatsHistogram;
 class QOpenGLContext;
+class QTimer;
 
 class CMainWindow : public QWindow
 {
     Q_OBJECT
 
 public:
-    CMainWindow( QScreen* screen = 0 );
+    // The pool layout is fixed once the scene is initialised, which the
+    // constructor does
+    explicit CMainWindow( CBrickPool::SlotOrder slotOrder = CBrickPool::MortonSlots,
+                          CBrickPool::Storage storage = CBrickPool::TextureStorage, QScreen* screen = 0 );
+
+    bool openVolume( const QString& fileName ) { return m_scene->openVolume( fileName ); }
+    bool connectBrickServer( const QString& name ) { return m_scene->connectBrickServer( name ); }
+
+    // Rewrites fileName with a JSON snapshot of the statistics every so
+    // many seconds, for monitoring long running installations
+    void setStatsFile( const QString& fileName, int seconds );
 
 private:
     void initializeGL();
@@ -22,6 +37,7 @@ protected slots:
     void resizeGL();
     void paintGL();
     void updateScene();
+    void writeStats();
 
 protected:
     void keyPressEvent( QKeyEvent* e );
@@ -37,6 +53,15 @@ private:
     QPoint m_prevPos;
     QPoint m_pos;
     QTime m_time;
+
+    CStatsOverlay m_statsOverlay;
+    QString m_statsFile;
+    QTimer* m_statsTimer;
+    QElapsedTimer m_frameTimer;
+    CStatsCounter* m_frameCount;
+    CStatsHistogram* m_frameInterval;
+    CStatsHistogram* m_updateTime;
+    CStatsHistogram* m_renderTime;
 };
 
 #endif // C_MAIN_WINDOW_H
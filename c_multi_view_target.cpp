@@ -0,0 +1,116 @@
+#include "c_multi_view_target.h"
+
+#include <QOpenGLFunctions_4_3_Core>
+
+//------------------------------------------------------------------------------
+CMultiViewTarget::CMultiViewTarget()
+    : m_funcs( NULL ),
+      m_layout( Stereo ),
+      m_width( 0 ),
+      m_height( 0 ),
+      m_framebuffer( 0 )
+{
+}
+
+//------------------------------------------------------------------------------
+CMultiViewTarget::~CMultiViewTarget()
+{
+    destroy();
+}
+
+//------------------------------------------------------------------------------
+void
+CMultiViewTarget::create( QOpenGLFunctions_4_3_Core* funcs, Layout layout, int width, int height )
+{
+    destroy();
+    m_funcs = funcs;
+    m_layout = layout;
+    m_width = width;
+    m_height = layout == Cubemap ? width : height;
+
+    const QOpenGLTexture::Target target = layout == Stereo ? QOpenGLTexture::Target2DArray
+                                                           : QOpenGLTexture::TargetCubeMap;
+    m_colorTexture = TexturePtr( new QOpenGLTexture( target ) );
+    m_colorTexture->setAutoMipMapGenerationEnabled( false );
+    m_colorTexture->setSize( m_width, m_height );
+    if ( layout == Stereo )
+        m_colorTexture->setLayers( layerCount() );
+    m_colorTexture->setFormat( QOpenGLTexture::RGBA8_UNorm );
+    m_colorTexture->allocateStorage();
+
+    m_depthTexture = TexturePtr( new QOpenGLTexture( target ) );
+    m_depthTexture->setAutoMipMapGenerationEnabled( false );
+    m_depthTexture->setSize( m_width, m_height );
+    if ( layout == Stereo )
+        m_depthTexture->setLayers( layerCount() );
+    m_depthTexture->setFormat( QOpenGLTexture::D24 );
+    m_depthTexture->allocateStorage();
+
+    m_funcs->glGenFramebuffers( 1, &m_framebuffer );
+
+    SamplerPtr sampler( new Sampler );
+    sampler->create();
+    sampler->setMinificationFilter( GL_LINEAR );
+    sampler->setMagnificationFilter( GL_LINEAR );
+    sampler->setWrapMode( Sampler::DirectionR, GL_CLAMP_TO_EDGE );
+    sampler->setWrapMode( Sampler::DirectionS, GL_CLAMP_TO_EDGE );
+    sampler->setWrapMode( Sampler::DirectionT, GL_CLAMP_TO_EDGE );
+
+    m_preview = MaterialPtr( new Material );
+    m_preview->setShaders( "shaders/preview.vert",
+                           layout == Stereo ? "shaders/stereo_preview.frag" : "shaders/cubemap_preview.frag" );
+    m_preview->setTextureUnitConfiguration( 0, m_colorTexture, sampler, QByteArrayLiteral( "layers" ) );
+}
+
+//------------------------------------------------------------------------------
+void
+CMultiViewTarget::destroy()
+{
+    if ( m_framebuffer )
+        m_funcs->glDeleteFramebuffers( 1, &m_framebuffer );
+    m_framebuffer = 0;
+    m_colorTexture.clear();
+    m_depthTexture.clear();
+    m_preview.clear();
+}
+
+//------------------------------------------------------------------------------
+void
+CMultiViewTarget::bindLayer( int layer )
+{
+    m_funcs->glBindFramebuffer( GL_FRAMEBUFFER, m_framebuffer );
+    if ( m_layout == Stereo )
+    {
+        m_funcs->glFramebufferTextureLayer( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                            m_colorTexture->textureId(), 0, layer );
+        m_funcs->glFramebufferTextureLayer( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                                            m_depthTexture->textureId(), 0, layer );
+    }
+    else
+    {
+        // Cube map faces are attached one by one before OpenGL 4.5
+        const GLenum face = GL_TEXTURE_CUBE_MAP_POSITIVE_X + layer;
+        m_funcs->glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, face,
+                                         m_colorTexture->textureId(), 0 );
+        m_funcs->glFramebufferTexture2D( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, face,
+                                         m_depthTexture->textureId(), 0 );
+    }
+    m_funcs->glViewport( 0, 0, m_width, m_height );
+}
+
+//------------------------------------------------------------------------------
+void
+CMultiViewTarget::release()
+{
+    m_funcs->glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+}
+
+//------------------------------------------------------------------------------
+void
+CMultiViewTarget::present()
+{
+    m_preview->bind();
+    m_funcs->glDrawArrays( GL_TRIANGLES, 0, 3 );
+}
+
+//------------------------------------------------------------------------------
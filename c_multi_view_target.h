@@ -0,0 +1,59 @@
+#ifndef C_MULTI_VIEW_TARGET_H
+#define C_MULTI_VIEW_TARGET_H
+
+#include "material.h"
+
+#include <QOpenGLTexture>
+
+class QOpenGLFunctions_4_3_Core;
+
+/**
+  Layered render target for several views of one frame: a two layer array
+  for the eyes of a stereo pair, or a cube map for a light probe. Each view
+  renders into its own layer, and present() shows all of them in the
+  window: side by side for stereo, unwrapped into a panorama for cube maps.
+  */
+class CMultiViewTarget
+{
+public:
+    enum Layout
+    {
+        Stereo,
+        Cubemap
+    };
+
+    CMultiViewTarget();
+    ~CMultiViewTarget();
+
+    void create( QOpenGLFunctions_4_3_Core* funcs, Layout layout, int width, int height );
+    void destroy();
+
+    bool isCreated() const { return m_framebuffer != 0; }
+    Layout layout() const { return m_layout; }
+    int layerCount() const { return m_layout == Stereo ? 2 : 6; }
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+
+    TexturePtr colorTexture() const { return m_colorTexture; }
+
+    // Directs rendering into one layer, with the viewport covering it
+    void bindLayer( int layer );
+    void release();
+
+    // Draws the layers over the window with a full screen triangle; a
+    // vertex array object must be bound
+    void present();
+
+private:
+    QOpenGLFunctions_4_3_Core* m_funcs;
+    Layout m_layout;
+    int m_width;
+    int m_height;
+
+    TexturePtr m_colorTexture;
+    TexturePtr m_depthTexture;
+    GLuint m_framebuffer;
+    MaterialPtr m_preview;
+};
+
+#endif // C_MULTI_VIEW_TARGET_H
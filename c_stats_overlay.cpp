@@ -0,0 +1,56 @@
+#include "c_stats_overlay.h"
+#include "c_stats.h"
+
+#include <QFont>
+#include <QOpenGLPaintDevice>
+#include <QPainter>
+
+//------------------------------------------------------------------------------
+CStatsOverlay::CStatsOverlay()
+    : m_device(),
+      m_lines(),
+      m_visible( false )
+{
+}
+
+//------------------------------------------------------------------------------
+CStatsOverlay::~CStatsOverlay()
+{
+}
+
+//------------------------------------------------------------------------------
+void
+CStatsOverlay::render( int width, int height )
+{
+    if ( !m_visible )
+        return;
+
+    if ( !m_refresh.isValid() || m_refresh.elapsed() > 250 )
+    {
+        m_lines = CStats::instance().summary();
+        m_refresh.start();
+    }
+
+    if ( !m_device )
+        m_device.reset( new QOpenGLPaintDevice );
+    m_device->setSize( QSize( width, height ) );
+
+    QPainter painter( m_device.data() );
+    QFont font( "Monospace", 9 );
+    font.setStyleHint( QFont::TypeWriter );
+    painter.setFont( font );
+
+    const int lineHeight = painter.fontMetrics().height();
+    const int margin = 8;
+    int textWidth = 0;
+    for ( int i = 0; i < m_lines.size(); ++i )
+        textWidth = qMax( textWidth, painter.fontMetrics().width( m_lines.at( i ) ) );
+
+    painter.fillRect( QRect( margin, margin, textWidth + 2 * margin, m_lines.size() * lineHeight + 2 * margin ),
+                      QColor( 0, 0, 0, 160 ) );
+    painter.setPen( Qt::white );
+    for ( int i = 0; i < m_lines.size(); ++i )
+        painter.drawText( 2 * margin, 2 * margin + i * lineHeight + painter.fontMetrics().ascent(), m_lines.at( i ) );
+}
+
+//------------------------------------------------------------------------------
@@ -0,0 +1,34 @@
+#ifndef C_STATS_OVERLAY_H
+#define C_STATS_OVERLAY_H
+
+#include <QElapsedTimer>
+#include <QScopedPointer>
+#include <QStringList>
+
+class QOpenGLPaintDevice;
+
+/**
+  Draws the statistics registry as text over the top left corner of the
+  window. The text is refreshed a few times per second, so the numbers
+  stay readable and formatting them costs nothing per frame.
+  */
+class CStatsOverlay
+{
+public:
+    CStatsOverlay();
+    ~CStatsOverlay();
+
+    void setVisible( bool b ) { m_visible = b; }
+    bool isVisible() const { return m_visible; }
+
+    // Paints into the current context's default framebuffer
+    void render( int width, int height );
+
+private:
+    QScopedPointer<QOpenGLPaintDevice> m_device;
+    QStringList m_lines;
+    QElapsedTimer m_refresh;
+    bool m_visible;
+};
+
+#endif // C_STATS_OVERLAY_H
@@ -1,12 +1,16 @@
 #include "c_voxel_scene.h"
 #include "camera.h"
+#include "c_stats.h"
 
 #include <string.h>
 
+#include <QDebug>
+#include <QElapsedTimer>
 #include <QImage>
 #include <QGLWidget>
 #include <QOpenGLContext>
 #include <QOpenGLFunctions_4_3_Core>
+#include <QThread>
 
 #define _USE_MATH_DEFINES
 #include <math.h>
@@ -14,6 +18,49 @@
 //------------------------------------------------------------------------------
 const float degToRad = float( M_PI / 180.0 );
 
+// Frames of each mode in the view benchmark; the first ones let the cache
+// settle after the switch
+const int benchmarkWarmupFrames = 60;
+const int benchmarkMeasuredFrames = 240;
+
+// Longest a sequence frame is held for its bricks in view, in seconds
+const float maxSequenceHold = 0.5f;
+
+//------------------------------------------------------------------------------
+// Picks the instances that need a level of detail pass of their own. An
+// instance is never larger than its world box, so when even the largest box
+// of a subtree projects a root voxel below the pixel error, its instances
+// want nothing but the shared root brick.
+class CInstanceViewSelector
+{
+public:
+    CInstanceViewSelector( const QVector3D& eye, float pixelScale, float pixelError, const CFrustum& frustum )
+        : m_eye( eye ),
+          m_scale( pixelScale / ( pixelError * VoxelConfig::brickEdge ) ),
+          m_frustum( frustum )
+    {
+    }
+
+    bool enter( const CBounds& bounds ) const
+    {
+        if ( m_frustum.classify( bounds.min, bounds.max ) == CFrustum::Outside )
+            return false;
+
+        const QVector3D e = bounds.extent();
+        const float size = qMax( qMax( e.x(), e.y() ), e.z() );
+        return size * m_scale > qMax( bounds.distance( m_eye ), 1.0e-6f );
+    }
+
+    void instance( int i ) { selected.append( i ); }
+
+    QVector<int> selected;
+
+private:
+    QVector3D m_eye;
+    float m_scale;
+    CFrustum m_frustum;
+};
+
 //------------------------------------------------------------------------------
 CVoxelScene::CVoxelScene( QObject* parent )
     : AbstractScene( parent ),
@@ -22,20 +69,150 @@ CVoxelScene::CVoxelScene( QObject* parent )
       m_viewCenterFixed( false ),
       m_panAngle( 0.0f ),
       m_tiltAngle( 0.0f ),
+      m_panRate( 0.0f ),
+      m_tiltRate( 0.0f ),
+      m_predictedCamera( new Camera( this ) ),
+      m_pixelError( 1.0f ),
+      m_touchedBricks( 0 ),
+      m_touchedFrames( 0 ),
+      m_prefetchEnabled( true ),
+      m_prefetchLookAhead( 0.3f ),
+      m_flightPath(),
+      m_recording( false ),
+      m_playing( false ),
+      m_flightStart( 0.0f ),
       m_modelMatrix(),
+      m_transferFunction(),
+      m_transferTexture(),
+      m_transferFunctionEnabled( false ),
+      m_transferPoint( 1 ),
+      m_classifiedRevision( -1 ),
+      m_producer(),
+      m_fileProducer(),
+      m_remoteProducer(),
+      m_hostCache(),
+      m_cachedProducer( &m_producer, &m_hostCache ),
+      m_editor( &m_cachedProducer ),
+      m_pendingEdits(),
+      m_brushRadius( 8.0f ),
+      m_brushDistance( 60.0f ),
+      m_brickPool(),
+      m_nodeTree(),
+      m_scheduler( &m_editor, &m_brickPool, &m_nodeTree ),
+      m_traversal( &m_nodeTree, &m_brickPool, &m_scheduler ),
+      m_nodeBuffer( 0 ),
+      m_frame( 0 ),
+      m_gpuFeedback( false ),
+      m_feedback(),
+      m_feedbackRequests(),
+      m_sequencePlaying( true ),
+      m_sequenceStart( 0.0f ),
+      m_sequenceShown( 0.0f ),
+      m_viewMode( MonoView ),
+      m_viewTarget(),
+      m_eyeSeparation( 0.0f ),
+      m_cubemapSize( 512 ),
+      m_benchmarkMode( -1 ),
+      m_benchmarkFrame( 0 ),
+      m_benchmarkRestoreMode( MonoView ),
+      m_distanceLeaping( true ),
+      m_occupancySkipping( true ),
+      m_emptySpacePhase( -1 ),
+      m_emptySpaceFrame( 0 ),
+      m_emptySpaceRestore( 0 ),
+      m_rayStatsBuffer( 0 ),
+      m_cullingMode( FrustumCulling ),
+      m_instances(),
+      m_instanceBuffer( 0 ),
+      m_instanceBvh(),
+      m_bvhNodeBuffer( 0 ),
+      m_bvhIndexBuffer( 0 ),
+      m_traceInstances( false ),
+      m_timerQueriesIssued( 0 ),
+      m_gpuTimeStat( CStats::instance().histogram( "frame.gpuMilliseconds" ) ),
+      m_poolHitStat( CStats::instance().counter( "pool.hits" ) ),
+      m_poolMissStat( CStats::instance().counter( "pool.misses" ) ),
+      m_poolSlotStat( CStats::instance().gauge( "pool.usedSlots" ) ),
+      m_poolDedupStat( CStats::instance().gauge( "pool.bricksPerSlot" ) ),
+      m_visitedStat( CStats::instance().gauge( "traversal.visited" ) ),
+      m_culledStat( CStats::instance().gauge( "traversal.culled" ) ),
+      m_occludedStat( CStats::instance().gauge( "traversal.occluded" ) ),
+      m_emptyStat( CStats::instance().gauge( "traversal.empty" ) ),
+      m_feedbackLatencyStat( CStats::instance().histogram( "feedback.latencyFrames" ) ),
+      m_feedbackRequestStat( CStats::instance().counter( "feedback.requests" ) ),
+      m_invisibleStat( CStats::instance().gauge( "tree.invisible" ) ),
+      m_classifyTimeStat( CStats::instance().histogram( "transfer.classifyMicroseconds" ) ),
+      m_editTimeStat( CStats::instance().histogram( "edit.milliseconds" ) ),
+      m_editBrickStat( CStats::instance().histogram( "edit.bricks" ) ),
+      m_sequenceFrameStat( CStats::instance().gauge( "sequence.frame" ) ),
+      m_sequenceSkipStat( CStats::instance().counter( "sequence.skippedFrames" ) ),
+      m_sequenceChangeStat( CStats::instance().histogram( "sequence.changedBricks" ) ),
+      m_poolBrickStat( CStats::instance().gauge( "pool.bricks" ) ),
+      m_gpuMemoryStat( CStats::instance().gauge( "gpu.memoryBytes" ) ),
+      m_instanceStat( CStats::instance().gauge( "instances.count" ) ),
+      m_bvhNodeStat( CStats::instance().gauge( "instances.bvhNodes" ) ),
+      m_bvhBuildTimeStat( CStats::instance().histogram( "instances.bvhBuildMilliseconds" ) ),
       m_time( 0.0f ),
       m_metersToUnits( 0.5f ), // 500 units == 10 km => 0.05 units/m
+      m_volumeSize( 1024.0f ),
       m_funcs( NULL )
 {
     m_modelMatrix.setToIdentity();
+    m_instances.append( m_modelMatrix );
+    m_eyeSeparation = 0.064f * m_metersToUnits;
+    m_timerQueries[0] = m_timerQueries[1] = 0;
+
+    // Pre-integrated segments of two voxels look like single voxel steps
+    // of the transfer function, at half the samples
+    m_transferFunction.setSegmentLength( 2.0f );
+    for ( int i = 0; i < 6; ++i )
+    {
+        m_viewCameras.append( new Camera( this ) );
+        m_predictedViewCameras.append( new Camera( this ) );
+    }
 
     // Initialize the camera position and orientation
-    const float height( 10.0 );
+    const float height( 100.0 );
     m_camera->setPosition( QVector3D( 0.0f, height, 0.0f ) );
     m_camera->setViewCenter( QVector3D( 1.0f, height, 1.0f ) );
     m_camera->setUpVector( QVector3D( 0.0f, 1.0f, 0.0f ) );
 }
 
+//------------------------------------------------------------------------------
+bool
+CVoxelScene::openVolume( const QString& fileName )
+{
+    QScopedPointer<CFileBrickProducer> producer( new CFileBrickProducer );
+    if ( !producer->open( fileName ) )
+        return false;
+
+    m_fileProducer.reset( producer.take() );
+    m_cachedProducer.setBase( m_fileProducer.data() );
+    m_transferFunctionEnabled = true;
+    m_sequenceStart = m_time;
+
+    // Workers block on their reads, the async reader merges and queues them
+    m_scheduler.setThreadCount( 4 * QThread::idealThreadCount() );
+    m_hostCache.clear();
+    m_hostCache.resetStatistics();
+    return true;
+}
+
+//------------------------------------------------------------------------------
+bool
+CVoxelScene::connectBrickServer( const QString& name )
+{
+    QScopedPointer<CRemoteBrickProducer> producer( new CRemoteBrickProducer( &m_producer ) );
+    if ( !producer->connectToServer( name ) )
+        return false;
+
+    m_remoteProducer.reset( producer.take() );
+    m_cachedProducer.setBase( m_remoteProducer.data() );
+    m_hostCache.clear();
+    m_hostCache.resetStatistics();
+    return true;
+}
+
 //------------------------------------------------------------------------------
 void
 CVoxelScene::initialise()
@@ -53,40 +230,106 @@ CVoxelScene::initialise()
     prepareTextures();
     prepareVertexBuffers();
     prepareVertexArrayObject();
+    prepareRenderState();
+}
 
-    // Enable depth testing
-    glEnable( GL_DEPTH_TEST );
-    glEnable( GL_CULL_FACE );
+//------------------------------------------------------------------------------
+void
+CVoxelScene::setPoolSlotOrder( CBrickPool::SlotOrder order )
+{
+    if ( m_brickPool.isCreated() )
+    {
+        qWarning() << "The pool slot order can only be set before the scene is initialised";
+        return;
+    }
+    m_brickPool.setSlotOrder( order );
+}
 
-    glClearColor( 0.65f, 0.77f, 1.0f, 1.0f );
+//------------------------------------------------------------------------------
+void
+CVoxelScene::setPoolStorage( CBrickPool::Storage storage )
+{
+    if ( m_brickPool.isCreated() )
+    {
+        qWarning() << "The pool storage can only be set before the scene is initialised";
+        return;
+    }
+    m_brickPool.setStorage( storage );
 }
 
 //------------------------------------------------------------------------------
 void
 CVoxelScene::update( float t )
 {
+    // The volume is the unit cube, centered below the camera
     m_modelMatrix.setToIdentity();
+    m_modelMatrix.translate( -0.5f * m_volumeSize, 0.0f, -0.5f * m_volumeSize );
+    m_modelMatrix.scale( m_volumeSize );
+    if ( m_instances.setTransform( 0, m_modelMatrix ) )
+    {
+        if ( m_instanceBvh.isEmpty() )
+        {
+            buildInstanceBvh();
+        }
+        else
+        {
+            m_instanceBvh.setBounds( 0, m_instances.bounds( 0 ) );
+            m_instanceBvh.refit();
+        }
+    }
 
     // Store the time
     const float dt = t - m_time;
     m_time = t;
 
-    // Update the camera position and orientation
-    Camera::CameraTranslationOption option = m_viewCenterFixed
-                                           ? Camera::DontTranslateViewCenter
-                                           : Camera::TranslateViewCenter;
-    m_camera->translate( m_v * dt * m_metersToUnits, option );
-
-    if ( !qFuzzyIsNull( m_panAngle ) )
+    if ( m_playing )
+    {
+        playback();
+    }
+    else
     {
-        m_camera->pan( m_panAngle, QVector3D( 0.0f, 1.0f, 0.0f ) );
-        m_panAngle = 0.0f;
+        // Update the camera position and orientation
+        Camera::CameraTranslationOption option = m_viewCenterFixed
+                                               ? Camera::DontTranslateViewCenter
+                                               : Camera::TranslateViewCenter;
+        m_camera->translate( m_v * dt * m_metersToUnits, option );
+
+        // Smoothed angular rates, for predicting where the camera looks next
+        if ( dt > 0.0f )
+        {
+            m_panRate += 0.3f * ( m_panAngle / dt - m_panRate );
+            m_tiltRate += 0.3f * ( m_tiltAngle / dt - m_tiltRate );
+        }
+
+        if ( !qFuzzyIsNull( m_panAngle ) )
+        {
+            m_camera->pan( m_panAngle, QVector3D( 0.0f, 1.0f, 0.0f ) );
+            m_panAngle = 0.0f;
+        }
+
+        if ( !qFuzzyIsNull( m_tiltAngle ) )
+        {
+            m_camera->tilt( m_tiltAngle );
+            m_tiltAngle = 0.0f;
+        }
+
+        if ( m_recording )
+            record();
     }
 
-    if ( !qFuzzyIsNull( m_tiltAngle ) )
+    updateSequence();
+
+    QElapsedTimer timer;
+    timer.start();
+    updateBricks();
+    if ( m_benchmarkMode >= 0 )
+        updateViewBenchmark( timer.nsecsElapsed() / 1.0e6 );
+    if ( m_emptySpacePhase >= 0 && m_emptySpaceFrame > benchmarkWarmupFrames )
     {
-        m_camera->tilt( m_tiltAngle );
-        m_tiltAngle = 0.0f;
+        EmptySpaceCost& cost = m_emptySpaceCosts[m_emptySpacePhase];
+        cost.cpuMilliseconds += timer.nsecsElapsed() / 1.0e6;
+        cost.visited += m_traversal.visitedCount();
+        ++cost.cpuFrames;
     }
 }
 
@@ -94,30 +337,372 @@ CVoxelScene::update( float t )
 void
 CVoxelScene::render()
 {
-    glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+    const QVector<Camera*> cameras = frameCameras( false );
 
+    // The statistics overlay paints into the same context between frames
+    prepareRenderState();
     m_material->bind();
     QOpenGLShaderProgramPtr shader = m_material->shader();
     shader->bind();
 
-    // Pass in the usual transformation matrices
-    QMatrix4x4 viewMatrix = m_camera->viewMatrix();
-    QMatrix4x4 modelViewMatrix = viewMatrix * m_modelMatrix;
-    QMatrix3x3 worldNormalMatrix = m_modelMatrix.normalMatrix();
-    QMatrix3x3 normalMatrix = modelViewMatrix.normalMatrix();
-    QMatrix4x4 mvp = m_camera->projectionMatrix() * modelViewMatrix;
-    shader->setUniformValue( "modelMatrix", m_modelMatrix );
-    shader->setUniformValue( "modelViewMatrix", modelViewMatrix );
-    shader->setUniformValue( "worldNormalMatrix", worldNormalMatrix );
-    shader->setUniformValue( "normalMatrix", normalMatrix );
-    shader->setUniformValue( "mvp", mvp );
+    // Instance transforms come from a storage buffer, the fragment shader
+    // casts rays through each instance in the unit cube space of the asset
+    shader->setUniformValue( "lodScale", m_pixelError / viewInfo( cameras.first(), 0 ).pixelScale );
+    shader->setUniformValue( "fogDensity", 4.0f / m_volumeSize );
+    shader->setUniformValue( "traceInstances", m_traceInstances );
+    shader->setUniformValue( "transferFunction", m_transferFunctionEnabled );
+    shader->setUniformValue( "transferStep", m_transferFunction.segmentLength() );
+    if ( m_transferFunction.isDirty() )
+        uploadTransferTable();
+    m_funcs->glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 0, m_nodeBuffer );
+    m_funcs->glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 1, m_instanceBuffer );
+    m_funcs->glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 2, m_bvhNodeBuffer );
+    m_funcs->glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 3, m_bvhIndexBuffer );
+    if ( m_brickPool.storage() == CBrickPool::BlockStorage )
+        m_funcs->glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 7, m_brickPool.blockBuffer() );
 
-    // Render the quad as a patch
+    // Rays and samples are only counted while the empty space benchmark runs
+    shader->setUniformValue( "distanceLeaping", m_distanceLeaping );
+    shader->setUniformValue( "occupancySkipping", m_occupancySkipping );
+    shader->setUniformValue( "countSamples", m_emptySpacePhase >= 0 );
+    if ( m_emptySpacePhase >= 0 )
+    {
+        const GLuint zero[2] = { 0, 0 };
+        m_funcs->glBindBuffer( GL_SHADER_STORAGE_BUFFER, m_rayStatsBuffer );
+        m_funcs->glBufferSubData( GL_SHADER_STORAGE_BUFFER, 0, sizeof( zero ), zero );
+        m_funcs->glBindBuffer( GL_SHADER_STORAGE_BUFFER, 0 );
+    }
+    m_funcs->glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 4, m_rayStatsBuffer );
+    shader->setUniformValue( "feedback", m_gpuFeedback );
+    if ( m_gpuFeedback )
+        m_feedback.bind( m_gpuNodes.size(), 5, 6 );
+
+    m_funcs->glBeginQuery( GL_TIME_ELAPSED, m_timerQueries[m_frame & 1] );
+    if ( m_viewMode == MonoView )
+    {
+        glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+        renderView( m_camera );
+    }
+    else
     {
+        const CMultiViewTarget::Layout layout = m_viewMode == StereoView ? CMultiViewTarget::Stereo
+                                                                         : CMultiViewTarget::Cubemap;
+        const int width = layout == CMultiViewTarget::Stereo ? int( m_viewportSize.x() ) / 2 : m_cubemapSize;
+        const int height = int( targetHeight() );
+        if ( !m_viewTarget.isCreated() || m_viewTarget.layout() != layout
+          || m_viewTarget.width() != width || m_viewTarget.height() != height )
+        {
+            m_viewTarget.create( m_funcs, layout, width, height );
+        }
+
+        // Each view into its own layer, then all of them into the window
+        shader->setUniformValue( "viewportSize", QVector2D( float( width ), float( height ) ) );
+        for ( int i = 0; i < cameras.size(); ++i )
+        {
+            m_viewTarget.bindLayer( i );
+            glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+            renderView( cameras.at( i ) );
+        }
+        m_viewTarget.release();
+        shader->setUniformValue( "viewportSize", m_viewportSize );
+
+        glViewport( 0, 0, int( m_viewportSize.x() ), int( m_viewportSize.y() ) );
+        glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
         QOpenGLVertexArrayObject::Binder binder( &m_vao );
-        //shader->setPatchVertexCount( 1 );
-        glDrawArrays( GL_TRIANGLES, 0, 6 );
+        m_viewTarget.present();
+    }
+    m_funcs->glEndQuery( GL_TIME_ELAPSED );
+    ++m_timerQueriesIssued;
+    if ( m_gpuFeedback )
+        m_feedback.endFrame( m_frame, m_gpuNodeKeys );
+
+    updateStatistics();
+    if ( m_emptySpacePhase >= 0 )
+        updateEmptySpaceBenchmark();
+}
+
+//------------------------------------------------------------------------------
+void
+CVoxelScene::renderView( const Camera* camera )
+{
+    QOpenGLShaderProgramPtr shader = m_material->shader();
+    const QMatrix4x4 viewProjection = camera->projectionMatrix() * camera->viewMatrix();
+    shader->setUniformValue( "viewProjection", viewProjection );
+    shader->setUniformValue( "inverseViewProjection", viewProjection.inverted() );
+    shader->setUniformValue( "eyeWorld", camera->position() );
+
+    // Either one box per instance, or a single triangle over the screen
+    // whose rays walk the instance hierarchy
+    QOpenGLVertexArrayObject::Binder binder( &m_vao );
+    if ( m_traceInstances )
+        m_funcs->glDrawArrays( GL_TRIANGLES, 0, 3 );
+    else
+        m_funcs->glDrawArraysInstanced( GL_TRIANGLES, 0, 36, m_instances.count() );
+}
+
+//------------------------------------------------------------------------------
+QVector<Camera*>
+CVoxelScene::frameCameras( bool predicted )
+{
+    Camera* base = predicted ? m_predictedCamera : m_camera;
+    if ( m_viewMode == MonoView )
+        return QVector<Camera*>() << base;
+
+    const QVector<Camera*>& cameras = predicted ? m_predictedViewCameras : m_viewCameras;
+    const int count = m_viewMode == StereoView ? 2 : 6;
+    for ( int i = 0; i < count; ++i )
+        setupViewCamera( cameras.at( i ), base, i );
+    return cameras.mid( 0, count );
+}
+
+//------------------------------------------------------------------------------
+void
+CVoxelScene::setupViewCamera( Camera* camera, const Camera* base, int view ) const
+{
+    if ( m_viewMode == StereoView )
+    {
+        // Parallel eyes either side of the camera
+        const QVector3D right = QVector3D::crossProduct( base->viewVector(), base->upVector() ).normalized();
+        const QVector3D offset = right * ( ( view == 0 ? -0.5f : 0.5f ) * m_eyeSeparation );
+        camera->setPosition( base->position() + offset );
+        camera->setViewCenter( base->viewCenter() + offset );
+        camera->setUpVector( base->upVector() );
+        camera->setPerspectiveProjection( base->fieldOfView(), 0.5f * m_viewportSize.x() / m_viewportSize.y(),
+                                          base->nearPlane(), base->farPlane() );
+        return;
+    }
+
+    // Faces in the order and orientation OpenGL expects them in a cube map
+    const QVector3D directions[6] = {
+        QVector3D( 1, 0, 0 ), QVector3D( -1, 0, 0 ), QVector3D( 0, 1, 0 ),
+        QVector3D( 0, -1, 0 ), QVector3D( 0, 0, 1 ), QVector3D( 0, 0, -1 )
+    };
+    const QVector3D ups[6] = {
+        QVector3D( 0, -1, 0 ), QVector3D( 0, -1, 0 ), QVector3D( 0, 0, 1 ),
+        QVector3D( 0, 0, -1 ), QVector3D( 0, -1, 0 ), QVector3D( 0, -1, 0 )
+    };
+    camera->setPosition( base->position() );
+    camera->setViewCenter( base->position() + directions[view] );
+    camera->setUpVector( ups[view] );
+    camera->setPerspectiveProjection( 90.0f, 1.0f, base->nearPlane(), base->farPlane() );
+}
+
+//------------------------------------------------------------------------------
+float
+CVoxelScene::targetHeight() const
+{
+    return m_viewMode == CubemapView ? float( m_cubemapSize ) : m_viewportSize.y();
+}
+
+//------------------------------------------------------------------------------
+void
+CVoxelScene::startViewBenchmark()
+{
+    for ( int i = 0; i < 3; ++i )
+        m_viewCosts[i] = ViewCost();
+    m_benchmarkRestoreMode = m_viewMode;
+    m_benchmarkMode = MonoView;
+    m_benchmarkFrame = 0;
+    m_viewMode = MonoView;
+}
+
+//------------------------------------------------------------------------------
+void
+CVoxelScene::updateViewBenchmark( double cpuMilliseconds )
+{
+    ViewCost& cost = m_viewCosts[m_benchmarkMode];
+    if ( ++m_benchmarkFrame > benchmarkWarmupFrames )
+    {
+        cost.cpuMilliseconds += cpuMilliseconds;
+        cost.visited += m_traversal.visitedCount();
+        cost.requests += m_scheduler.requestCount();
+        ++cost.frames;
+    }
+    if ( m_benchmarkFrame < benchmarkWarmupFrames + benchmarkMeasuredFrames )
+        return;
+
+    m_benchmarkFrame = 0;
+    if ( ++m_benchmarkMode <= CubemapView )
+    {
+        m_viewMode = ViewMode( m_benchmarkMode );
+        return;
+    }
+
+    const char* names[3] = { "mono", "stereo", "cubemap" };
+    const int views[3] = { 1, 2, 6 };
+    const ViewCost& mono = m_viewCosts[MonoView];
+    for ( int i = 0; i < 3; ++i )
+    {
+        const ViewCost& c = m_viewCosts[i];
+        const double cpu = c.cpuMilliseconds / qMax( c.frames, 1 );
+        const double gpu = c.gpuMilliseconds / qMax( c.gpuFrames, 1 );
+        qDebug() << names[i] << views[i] << "views:"
+                 << cpu << "ms CPU," << gpu << "ms GPU,"
+                 << c.visited / qMax( c.frames, 1 ) << "nodes visited,"
+                 << c.requests / qMax( c.frames, 1 ) << "requests per frame;"
+                 << cpu / qMax( mono.cpuMilliseconds / qMax( mono.frames, 1 ), 1.0e-6 ) << "x CPU,"
+                 << gpu / qMax( mono.gpuMilliseconds / qMax( mono.gpuFrames, 1 ), 1.0e-6 ) << "x GPU of one view";
+    }
+    m_benchmarkMode = -1;
+    m_viewMode = m_benchmarkRestoreMode;
+}
+
+//------------------------------------------------------------------------------
+void
+CVoxelScene::setOccupancySkipping( bool b )
+{
+    m_occupancySkipping = b;
+    m_traversal.setOccupancySkipping( b );
+}
+
+//------------------------------------------------------------------------------
+void
+CVoxelScene::startEmptySpaceBenchmark()
+{
+    for ( int i = 0; i < 4; ++i )
+        m_emptySpaceCosts[i] = EmptySpaceCost();
+    m_emptySpaceRestore = ( m_occupancySkipping ? 1 : 0 ) | ( m_distanceLeaping ? 2 : 0 );
+    m_emptySpacePhase = 0;
+    m_emptySpaceFrame = 0;
+    setOccupancySkipping( false );
+    m_distanceLeaping = false;
+}
+
+//------------------------------------------------------------------------------
+void
+CVoxelScene::updateEmptySpaceBenchmark()
+{
+    // Reading the counters back waits for the frame, which is fine while
+    // measuring; the timer query covers the draws only
+    EmptySpaceCost& cost = m_emptySpaceCosts[m_emptySpacePhase];
+    if ( ++m_emptySpaceFrame > benchmarkWarmupFrames )
+    {
+        GLuint counts[2] = { 0, 0 };
+        m_funcs->glMemoryBarrier( GL_BUFFER_UPDATE_BARRIER_BIT );
+        m_funcs->glBindBuffer( GL_SHADER_STORAGE_BUFFER, m_rayStatsBuffer );
+        m_funcs->glGetBufferSubData( GL_SHADER_STORAGE_BUFFER, 0, sizeof( counts ), counts );
+        m_funcs->glBindBuffer( GL_SHADER_STORAGE_BUFFER, 0 );
+        cost.rays += counts[0];
+        cost.samples += counts[1];
+        ++cost.frames;
+    }
+    if ( m_emptySpaceFrame < benchmarkWarmupFrames + benchmarkMeasuredFrames )
+        return;
+
+    // Phase bit 0 skips empty occupancy cells, bit 1 leaps by distance
+    m_emptySpaceFrame = 0;
+    if ( ++m_emptySpacePhase < 4 )
+    {
+        setOccupancySkipping( m_emptySpacePhase & 1 );
+        m_distanceLeaping = m_emptySpacePhase & 2;
+        return;
+    }
+
+    const char* names[4] = { "nothing", "occupancy", "distance", "occupancy and distance" };
+    const EmptySpaceCost& plain = m_emptySpaceCosts[0];
+    const double plainSamples = plain.samples / qMax( plain.rays, 1.0 );
+    const double plainGpu = plain.gpuMilliseconds / qMax( plain.gpuFrames, 1 );
+    const double plainCpu = plain.cpuMilliseconds / qMax( plain.cpuFrames, 1 );
+    for ( int i = 0; i < 4; ++i )
+    {
+        const EmptySpaceCost& c = m_emptySpaceCosts[i];
+        const double samples = c.samples / qMax( c.rays, 1.0 );
+        const double gpu = c.gpuMilliseconds / qMax( c.gpuFrames, 1 );
+        const double cpu = c.cpuMilliseconds / qMax( c.cpuFrames, 1 );
+        qDebug() << "Skipping" << names[i] << "-" << samples << "samples per ray," << gpu << "ms GPU,"
+                 << cpu << "ms CPU," << c.visited / qMax( c.cpuFrames, 1 ) << "nodes visited per frame;"
+                 << samples / qMax( plainSamples, 1.0e-6 ) << "x the samples,"
+                 << gpu / qMax( plainGpu, 1.0e-6 ) << "x GPU," << cpu / qMax( plainCpu, 1.0e-6 ) << "x CPU";
+    }
+
+    // One word per node in the tree and one in the node buffer
+    const qint64 occupancyBytes = qint64( m_nodeTree.nodeCount() + m_gpuNodes.size() ) * sizeof( quint64 );
+    qDebug() << "Occupancy words take" << occupancyBytes / 1024.0 << "KB, the brick pool"
+             << m_brickPool.memoryBytes() / ( 1024.0 * 1024.0 ) << "MB";
+
+    m_emptySpacePhase = -1;
+    setOccupancySkipping( m_emptySpaceRestore & 1 );
+    m_distanceLeaping = m_emptySpaceRestore & 2;
+}
+
+//------------------------------------------------------------------------------
+void
+CVoxelScene::setInstanceCount( int copies )
+{
+    m_instances.clear();
+    m_instances.append( m_modelMatrix );
+
+    // Scatter the copies over the middle of the terrain, each resting on it
+    // and turned its own way
+    const int perRow = int( ceilf( sqrtf( float( copies ) ) ) );
+    const float spacing = 0.6f * m_volumeSize / qMax( perRow, 1 );
+    const float scale = 0.5f * spacing;
+    for ( int i = 0; i < copies; ++i )
+    {
+        const float x = ( ( i % perRow ) - 0.5f * ( perRow - 1 ) ) * spacing;
+        const float z = ( ( i / perRow ) - 0.5f * ( perRow - 1 ) ) * spacing;
+        const float ground = m_fileProducer ? 0.0f
+                           : m_producer.height( x / m_volumeSize + 0.5f, z / m_volumeSize + 0.5f ) * m_volumeSize;
+
+        QMatrix4x4 model;
+        model.translate( x, ground, z );
+        model.rotate( float( ( i * 137 ) % 360 ), 0.0f, 1.0f, 0.0f );
+        model.scale( scale );
+        model.translate( -0.5f, -0.04f, -0.5f );
+        m_instances.append( model );
+    }
+
+    buildInstanceBvh();
+}
+
+//------------------------------------------------------------------------------
+void
+CVoxelScene::buildInstanceBvh()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    QVector<CBounds> bounds( m_instances.count() );
+    for ( int i = 0; i < bounds.size(); ++i )
+        bounds[i] = m_instances.bounds( i );
+    m_instanceBvh.build( bounds );
+
+    m_instanceStat->set( bounds.size() );
+    m_bvhNodeStat->set( m_instanceBvh.nodeCount() );
+    m_bvhBuildTimeStat->record( timer.nsecsElapsed() / 1.0e6 );
+}
+
+//------------------------------------------------------------------------------
+void
+CVoxelScene::updateStatistics()
+{
+    // The other query was issued last frame and is usually done by now
+    if ( m_timerQueriesIssued < 2 )
+        return;
+
+    const GLuint query = m_timerQueries[( m_frame + 1 ) & 1];
+    GLuint available = 0;
+    m_funcs->glGetQueryObjectuiv( query, GL_QUERY_RESULT_AVAILABLE, &available );
+    if ( !available )
+        return;
+
+    GLuint64 nanoseconds = 0;
+    m_funcs->glGetQueryObjectui64v( query, GL_QUERY_RESULT, &nanoseconds );
+    m_gpuTimeStat->record( nanoseconds / 1.0e6 );
+    if ( m_benchmarkMode >= 0 && m_benchmarkFrame > benchmarkWarmupFrames )
+    {
+        m_viewCosts[m_benchmarkMode].gpuMilliseconds += nanoseconds / 1.0e6;
+        ++m_viewCosts[m_benchmarkMode].gpuFrames;
+    }
+    if ( m_emptySpacePhase >= 0 && m_emptySpaceFrame > benchmarkWarmupFrames )
+    {
+        m_emptySpaceCosts[m_emptySpacePhase].gpuMilliseconds += nanoseconds / 1.0e6;
+        ++m_emptySpaceCosts[m_emptySpacePhase].gpuFrames;
     }
+
+    m_gpuMemoryStat->set( double( m_brickPool.memoryBytes()
+                                  + qint64( m_gpuNodes.size() ) * sizeof( CGpuNode )
+                                  + qint64( m_gpuInstances.size() ) * sizeof( CGpuInstance ) ) );
 }
 
 //------------------------------------------------------------------------------
@@ -142,8 +727,9 @@ CVoxelScene::resize( int w, int h )
     m_viewportMatrix.setColumn( 2, QVector4D( 0.0f, 0.0f, 1.0f, 0.0f ) );
     m_viewportMatrix.setColumn( 3, QVector4D( w2, h2, 0.0f, 1.0f ) );
 
-    // We need the viewport size to calculate tessellation levels
+    // We need the viewport size to reconstruct the view rays
     QOpenGLShaderProgramPtr shader = m_material->shader();
+    shader->bind();
     shader->setUniformValue( "viewportSize", m_viewportSize );
 
     // The geometry shader also needs the viewport matrix
@@ -157,99 +743,90 @@ CVoxelScene::prepareShaders()
     m_material = MaterialPtr( new Material );
     m_material->setShaders( "shaders/gigavoxels.vert",
                             "shaders/gigavoxels.frag" );
+
+    QOpenGLShaderProgramPtr shader = m_material->shader();
+    shader->bind();
+    shader->setUniformValue( "brickEdge", VoxelConfig::brickEdge );
+    shader->setUniformValue( "brickBorder", VoxelConfig::brickBorder );
+    shader->setUniformValue( "poolSlotsPerAxis", VoxelConfig::poolSlotsPerAxis );
+    shader->setUniformValue( "poolMortonOrder", m_brickPool.slotOrder() == CBrickPool::MortonSlots );
+    shader->setUniformValue( "compressedPool", m_brickPool.storage() == CBrickPool::BlockStorage );
 }
 
 //------------------------------------------------------------------------------
 void
 CVoxelScene::prepareTextures()
 {
-    {
-        SamplerPtr sampler( new Sampler );
-        sampler->create();
-        sampler->setMinificationFilter( GL_LINEAR );
-        sampler->setMagnificationFilter( GL_LINEAR );
-        sampler->setWrapMode( Sampler::DirectionR, GL_REPEAT );
-        sampler->setWrapMode( Sampler::DirectionS, GL_REPEAT );
-        sampler->setWrapMode( Sampler::DirectionT, GL_REPEAT );
-
-        m_funcs->glActiveTexture( GL_TEXTURE0 );
-        TexturePtr brick( new QOpenGLTexture( QOpenGLTexture::Target3D ) );
-        brick->setAutoMipMapGenerationEnabled( false );
-        const int width( 4 ), height( width ), depth( width );
-        brick->setSize( width, height, depth );
-        brick->setFormat( QOpenGLTexture::R8_UNorm );
-        brick->allocateStorage();
-        quint8 brick_data[depth][height][width] = {
-            {
-                {0xff, 0, 0, 0}
-              , { 0, 0, 0, 0}
-              , { 0, 0, 0, 0}
-              , { 0, 0, 0, 0}
-            }
-          , {
-                { 0, 0, 0, 0}
-              , { 0, 0, 0, 0}
-              , { 0, 0, 0, 0}
-              , {-1, 0, 0, 0}
-            }
-          , {
-                { 0, 0, 0, 0}
-              , { 0, 0, 0, 0}
-              , {-1,-1, 0, 0}
-              , {-1,-1, 0, 0}
-            }
-          , {
-                { 0, 0, 0, 0}
-              , {-1,-1,-1, 0}
-              , {-1,-1,-1, 0}
-              , {-1,-1,-1, 0}
-            }
-        };
-        brick->setData( QOpenGLTexture::Red, QOpenGLTexture::UInt8, brick_data );
-        m_material->setTextureUnitConfiguration( 0, brick, sampler, QByteArrayLiteral( "brick_texture" ) );
-    }
-
-    {
-        SamplerPtr sampler( new Sampler );
-        sampler->create();
-        sampler->setWrapMode( Sampler::DirectionS, GL_REPEAT );
-        sampler->setWrapMode( Sampler::DirectionT, GL_REPEAT );
-        sampler->setMinificationFilter( GL_LINEAR );
-        sampler->setMagnificationFilter( GL_LINEAR );
-
-        m_funcs->glActiveTexture( GL_TEXTURE1 );
-        TexturePtr test( new QOpenGLTexture( QOpenGLTexture::Target2D ) );
-        test->setAutoMipMapGenerationEnabled( false );
-        const int width( 2 ), height( width );
-        test->setSize( width, height );
-        test->setFormat( QOpenGLTexture::RGBA8_UNorm );
-        test->allocateStorage();
-        quint32 test_data[width * height] = {
-            0x00000000, 0xffff0000
-          , 0xff00ff00, 0xff0000ff
-        };
-        test->setData( QOpenGLTexture::RGBA, QOpenGLTexture::UInt8, test_data );
-        test->bind();
-        m_material->setTextureUnitConfiguration( 1, test, sampler, QByteArrayLiteral( "test_texture" ) );
-    }
+    SamplerPtr sampler( new Sampler );
+    sampler->create();
+    sampler->setMinificationFilter( GL_LINEAR );
+    sampler->setMagnificationFilter( GL_LINEAR );
+    sampler->setWrapMode( Sampler::DirectionR, GL_CLAMP_TO_EDGE );
+    sampler->setWrapMode( Sampler::DirectionS, GL_CLAMP_TO_EDGE );
+    sampler->setWrapMode( Sampler::DirectionT, GL_CLAMP_TO_EDGE );
 
+    // All resident bricks live side by side in one 3D texture, or one
+    // storage buffer when compressed
     m_funcs->glActiveTexture( GL_TEXTURE0 );
+    m_brickPool.create( m_funcs );
+    m_material->setTextureUnitConfiguration( 0, m_brickPool.texture(), sampler, QByteArrayLiteral( "brick_pool" ) );
+    m_material->setTextureUnitConfiguration( 1, m_brickPool.colorTexture(), sampler, QByteArrayLiteral( "color_pool" ) );
+    m_material->setTextureUnitConfiguration( 2, m_brickPool.normalTexture(), sampler, QByteArrayLiteral( "normal_pool" ) );
+
+    // The pre-integrated transfer function, uploaded when it changes
+    m_transferTexture = TexturePtr( new QOpenGLTexture( QOpenGLTexture::Target2D ) );
+    m_transferTexture->setAutoMipMapGenerationEnabled( false );
+    m_transferTexture->setSize( CTransferFunction::tableSize, CTransferFunction::tableSize );
+    m_transferTexture->setFormat( QOpenGLTexture::RGBA16F );
+    m_transferTexture->allocateStorage();
+    m_material->setTextureUnitConfiguration( 3, m_transferTexture, sampler, QByteArrayLiteral( "transfer_table" ) );
+
+    // The node tree and the instances are read by the shaders from storage
+    // buffers
+    m_funcs->glGenBuffers( 1, &m_nodeBuffer );
+    m_funcs->glGenBuffers( 1, &m_instanceBuffer );
+    m_funcs->glGenBuffers( 1, &m_bvhNodeBuffer );
+    m_funcs->glGenBuffers( 1, &m_bvhIndexBuffer );
+
+    // Ray and sample counters of the empty space benchmark
+    m_funcs->glGenBuffers( 1, &m_rayStatsBuffer );
+    m_funcs->glBindBuffer( GL_SHADER_STORAGE_BUFFER, m_rayStatsBuffer );
+    m_funcs->glBufferData( GL_SHADER_STORAGE_BUFFER, 2 * sizeof( GLuint ), NULL, GL_DYNAMIC_READ );
+    m_funcs->glBindBuffer( GL_SHADER_STORAGE_BUFFER, 0 );
+    m_funcs->glGenQueries( 2, m_timerQueries );
+
+    // What the rays needed, for the loader
+    m_feedback.create( m_funcs, m_brickPool.slotCount() );
 }
 
 //------------------------------------------------------------------------------
 void
 CVoxelScene::prepareVertexBuffers()
 {
-    float quad[6*2] = {
-       -1.0f,-1.0f, 1.0f,-1.0f
-      , 1.0f, 1.0f, 1.0f, 1.0f
-      ,-1.0f, 1.0f,-1.0f,-1.0f
+    // The unit cube, counter-clockwise seen from outside
+    const float corners[8][3] = {
+        { 0, 0, 0 }, { 1, 0, 0 }, { 0, 1, 0 }, { 1, 1, 0 },
+        { 0, 0, 1 }, { 1, 0, 1 }, { 0, 1, 1 }, { 1, 1, 1 }
     };
-    m_quad_buffer.create();
-    m_quad_buffer.setUsagePattern( QOpenGLBuffer::StaticDraw );
-    m_quad_buffer.bind();
-    m_quad_buffer.allocate( quad, sizeof( quad ) );
-    m_quad_buffer.release();
+    const int faces[6][4] = {
+        { 0, 2, 3, 1 }, { 4, 5, 7, 6 }, // -z, +z
+        { 0, 4, 6, 2 }, { 1, 3, 7, 5 }, // -x, +x
+        { 0, 1, 5, 4 }, { 2, 6, 7, 3 }  // -y, +y
+    };
+    float cube[36*3];
+    float* out = cube;
+    for ( int f = 0; f < 6; ++f )
+    {
+        const int triangles[6] = { 0, 1, 2, 0, 2, 3 };
+        for ( int v = 0; v < 6; ++v )
+            for ( int c = 0; c < 3; ++c )
+                *out++ = corners[faces[f][triangles[v]]][c];
+    }
+    m_cube_buffer.create();
+    m_cube_buffer.setUsagePattern( QOpenGLBuffer::StaticDraw );
+    m_cube_buffer.bind();
+    m_cube_buffer.allocate( cube, sizeof( cube ) );
+    m_cube_buffer.release();
 }
 
 //------------------------------------------------------------------------------
@@ -262,10 +839,425 @@ CVoxelScene::prepareVertexArrayObject()
         QOpenGLVertexArrayObject::Binder binder( &m_vao );
         QOpenGLShaderProgramPtr shader = m_material->shader();
         shader->bind();
-        m_quad_buffer.bind();
+        m_cube_buffer.bind();
         shader->enableAttributeArray( "in_position" );
-        shader->setAttributeBuffer( "in_position", GL_FLOAT, 0, 2 );
+        shader->setAttributeBuffer( "in_position", GL_FLOAT, 0, 3 );
+    }
+}
+
+//------------------------------------------------------------------------------
+void
+CVoxelScene::prepareRenderState()
+{
+    // Enable depth testing
+    glEnable( GL_DEPTH_TEST );
+    glEnable( GL_CULL_FACE );
+
+    // Instances are drawn as the back faces of their boxes, so that rays
+    // still start when the camera is inside one. The shader writes
+    // premultiplied colour over the sky.
+    glCullFace( GL_FRONT );
+    glEnable( GL_BLEND );
+    glBlendFunc( GL_ONE, GL_ONE_MINUS_SRC_ALPHA );
+
+    glClearColor( 0.65f, 0.77f, 1.0f, 1.0f );
+}
+
+//------------------------------------------------------------------------------
+void
+CVoxelScene::updateBricks()
+{
+    ++m_frame;
+
+    // Edits patch the resident bricks right away, so they show this frame
+    for ( int i = 0; i < m_pendingEdits.size(); ++i )
+    {
+        m_editor.apply( m_pendingEdits.at( i ), &m_nodeTree, &m_brickPool, &m_scheduler, m_frame );
+        m_editTimeStat->record( m_editor.lastMilliseconds() );
+        m_editBrickStat->record( m_editor.lastBrickCount() );
+    }
+    m_pendingEdits.clear();
+    updateClassification();
+
+    // Gather the requests of every view of the frame in one shared pass,
+    // then service as many as the budget allows
+    QVector<CViewInfo> views;
+    const QVector<Camera*> cameras = frameCameras( false );
+    for ( int i = 0; i < cameras.size(); ++i )
+        views += instanceViews( cameras.at( i ) );
+
+    m_scheduler.beginFrame( m_frame );
+    if ( m_gpuFeedback && m_feedback.isCreated() )
+    {
+        applyFeedback();
+    }
+    else
+    {
+        m_traversal.run( views, m_frame );
+        m_touchedBricks += m_traversal.touchedCount();
+        ++m_touchedFrames;
+        m_poolHitStat->add( m_traversal.touchedCount() );
+        m_poolMissStat->add( m_traversal.missedCount() );
+        m_visitedStat->set( m_traversal.visitedCount() );
+    }
+    if ( m_prefetchEnabled )
+    {
+        predictCamera();
+        QVector<CViewInfo> predicted;
+        const QVector<Camera*> predictedCameras = frameCameras( true );
+        for ( int i = 0; i < predictedCameras.size(); ++i )
+            predicted += instanceViews( predictedCameras.at( i ) );
+        m_traversal.prefetch( predicted );
+    }
+    m_scheduler.update();
+
+    m_culledStat->set( m_traversal.culledCount() );
+    m_occludedStat->set( m_traversal.occludedCount() );
+    m_emptyStat->set( m_traversal.emptyCount() );
+    m_poolSlotStat->set( m_brickPool.usedSlotCount() );
+    m_poolBrickStat->set( m_brickPool.brickCount() );
+    m_poolDedupStat->set( double( m_brickPool.brickCount() ) / qMax( m_brickPool.usedSlotCount(), 1 ) );
+
+    if ( m_nodeTree.isDirty() )
+    {
+        m_nodeTree.flatten( m_gpuNodes, &m_gpuNodeKeys );
+        m_invisibleStat->set( m_nodeTree.invisibleCount() );
+        m_funcs->glBindBuffer( GL_SHADER_STORAGE_BUFFER, m_nodeBuffer );
+        m_funcs->glBufferData( GL_SHADER_STORAGE_BUFFER,
+                               m_gpuNodes.size() * sizeof( CGpuNode ),
+                               m_gpuNodes.constData(), GL_DYNAMIC_DRAW );
+        m_funcs->glBindBuffer( GL_SHADER_STORAGE_BUFFER, 0 );
+    }
+    else if ( m_nodeTree.isVisibilityDirty() )
+    {
+        // Only the nodes whose visibility flipped go up again
+        QVector<QPair<int, int> > changed;
+        m_nodeTree.updateVisibility( m_gpuNodes, m_gpuNodeKeys, changed );
+        m_invisibleStat->set( m_nodeTree.invisibleCount() );
+        m_funcs->glBindBuffer( GL_SHADER_STORAGE_BUFFER, m_nodeBuffer );
+        for ( int i = 0; i < changed.size(); ++i )
+        {
+            m_funcs->glBufferSubData( GL_SHADER_STORAGE_BUFFER,
+                                      changed.at( i ).first * sizeof( CGpuNode ),
+                                      changed.at( i ).second * sizeof( CGpuNode ),
+                                      m_gpuNodes.constData() + changed.at( i ).first );
+        }
+        m_funcs->glBindBuffer( GL_SHADER_STORAGE_BUFFER, 0 );
+    }
+
+    if ( m_instances.isDirty() )
+    {
+        m_instances.flatten( m_gpuInstances );
+        m_funcs->glBindBuffer( GL_SHADER_STORAGE_BUFFER, m_instanceBuffer );
+        m_funcs->glBufferData( GL_SHADER_STORAGE_BUFFER,
+                               m_gpuInstances.size() * sizeof( CGpuInstance ),
+                               m_gpuInstances.constData(), GL_DYNAMIC_DRAW );
+        m_funcs->glBindBuffer( GL_SHADER_STORAGE_BUFFER, 0 );
+    }
+
+    if ( m_instanceBvh.isDirty() )
+    {
+        const QVector<CGpuBvhNode>& nodes = m_instanceBvh.nodes();
+        const QVector<qint32>& indices = m_instanceBvh.indices();
+        m_funcs->glBindBuffer( GL_SHADER_STORAGE_BUFFER, m_bvhNodeBuffer );
+        m_funcs->glBufferData( GL_SHADER_STORAGE_BUFFER, nodes.size() * sizeof( CGpuBvhNode ),
+                               nodes.constData(), GL_DYNAMIC_DRAW );
+        m_funcs->glBindBuffer( GL_SHADER_STORAGE_BUFFER, m_bvhIndexBuffer );
+        m_funcs->glBufferData( GL_SHADER_STORAGE_BUFFER, indices.size() * sizeof( qint32 ),
+                               indices.constData(), GL_DYNAMIC_DRAW );
+        m_funcs->glBindBuffer( GL_SHADER_STORAGE_BUFFER, 0 );
+        m_instanceBvh.clearDirty();
+    }
+}
+
+//------------------------------------------------------------------------------
+QVector<CViewInfo>
+CVoxelScene::instanceViews( const Camera* camera ) const
+{
+    // The terrain always gets its pass, which also keeps the root requested
+    // for every instance that is skipped
+    QVector<CViewInfo> views;
+    views.append( viewInfo( camera, 0 ) );
+
+    const CFrustum frustum = m_cullingMode == NoCulling ? CFrustum() : CFrustum( camera->viewProjectionMatrix() );
+    CInstanceViewSelector selector( camera->position(), views.first().pixelScale, m_pixelError, frustum );
+    m_instanceBvh.traverse( selector );
+    for ( int i = 0; i < selector.selected.size(); ++i )
+    {
+        const int instance = selector.selected.at( i );
+        if ( instance != 0 )
+            views.append( viewInfo( camera, instance ) );
+    }
+    return views;
+}
+
+//------------------------------------------------------------------------------
+CViewInfo
+CVoxelScene::viewInfo( const Camera* camera, int instance ) const
+{
+    CViewInfo view;
+    view.eye = m_instances.inverseTransform( instance ) * camera->position();
+    view.pixelScale = targetHeight() / ( 2.0f * tanf( 0.5f * camera->fieldOfView() * degToRad ) );
+    view.pixelError = m_pixelError;
+    view.maxLevel = m_editor.maxLevel();
+    if ( m_cullingMode != NoCulling )
+        view.setCulling( camera->viewProjectionMatrix(), m_instances.transform( instance ) );
+    return view;
+}
+
+//------------------------------------------------------------------------------
+void
+CVoxelScene::setCullingMode( CullingMode mode )
+{
+    m_cullingMode = mode;
+    m_traversal.setOcclusionCulling( mode == OcclusionCulling );
+}
+
+//------------------------------------------------------------------------------
+void
+CVoxelScene::moveTransferPoint( float value, float opacity )
+{
+    CTransferPoint point = m_transferFunction.point( m_transferPoint );
+    point.value += value;
+    point.opacity += opacity;
+    m_transferFunction.setPoint( m_transferPoint, point );
+}
+
+//------------------------------------------------------------------------------
+void
+CVoxelScene::uploadTransferTable()
+{
+    // Only the entries the last changes reached
+    const QVector<QRect> rects = m_transferFunction.update();
+    const int n = CTransferFunction::tableSize;
+    m_transferTexture->bind();
+    m_funcs->glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
+    m_funcs->glPixelStorei( GL_UNPACK_ROW_LENGTH, n );
+    for ( int i = 0; i < rects.size(); ++i )
+    {
+        const QRect& r = rects.at( i );
+        m_funcs->glTexSubImage2D( GL_TEXTURE_2D, 0, r.x(), r.y(), r.width(), r.height(), GL_RGBA, GL_FLOAT,
+                                  m_transferFunction.table() + 4 * ( r.y() * n + r.x() ) );
     }
+    m_funcs->glPixelStorei( GL_UNPACK_ROW_LENGTH, 0 );
+}
+
+//------------------------------------------------------------------------------
+void
+CVoxelScene::setSequencePlaying( bool b )
+{
+    // Carry on from the frame shown
+    if ( b && !m_sequencePlaying && m_fileProducer )
+        m_sequenceStart = m_time - float( m_fileProducer->frame() ) / qMax( m_fileProducer->framesPerSecond(), 1 );
+    m_sequencePlaying = b;
+}
+
+//------------------------------------------------------------------------------
+void
+CVoxelScene::updateSequence()
+{
+    if ( !m_fileProducer || m_fileProducer->frameCount() < 2 || !m_sequencePlaying )
+        return;
+
+    // The bricks of a frame appear as they are produced. The next frame
+    // waits until the ones in view are in, so that a slow disk drops frames
+    // instead of mixing ever more of them. A pool too full to take them
+    // all would hold it forever, hence the limit.
+    const int count = m_fileProducer->frameCount();
+    const int current = m_fileProducer->frame();
+    const int target = int( ( m_time - m_sequenceStart ) * m_fileProducer->framesPerSecond() ) % count;
+    if ( target == current )
+        return;
+    if ( m_scheduler.visibleRefreshCount() > 0 && m_time - m_sequenceShown < maxSequenceHold )
+        return;
+
+    QVector<CNodeKey> changed;
+    m_fileProducer->setFrame( target, &changed );
+    m_scheduler.refresh( changed );
+    m_sequenceShown = m_time;
+
+    m_sequenceFrameStat->set( target );
+    m_sequenceSkipStat->add( ( target - current + count ) % count - 1 );
+    m_sequenceChangeStat->record( changed.size() );
+}
+
+//------------------------------------------------------------------------------
+void
+CVoxelScene::applyFeedback()
+{
+    // Everything that arrived since last frame, without waiting for the GPU
+    CFeedbackFrame feedback;
+    int touched = 0;
+    while ( m_feedback.read( feedback ) )
+    {
+        // Slots may have changed hands since; touching them just keeps
+        // them a little longer
+        for ( int i = 0; i < feedback.usedSlots.size(); ++i )
+            m_brickPool.touch( feedback.usedSlots.at( i ), m_frame );
+        touched += feedback.usedSlots.size();
+        m_feedbackRequests = feedback.requests;
+        m_feedbackLatencyStat->record( m_frame - feedback.frame );
+    }
+
+    // Some requests were served while they were on their way back
+    const CViewInfo view = viewInfo( m_camera, 0 );
+    int missed = 0;
+    for ( int i = 0; i < m_feedbackRequests.size(); ++i )
+    {
+        const CNodeKey& key = m_feedbackRequests.at( i );
+        const CNodeInfo* info = m_nodeTree.find( key );
+        if ( int( key.level ) > view.maxLevel || ( info && ( info->constant || info->brickSlot >= 0 ) ) )
+            continue;
+        m_scheduler.request( key, view.screenSpaceError( key ) );
+        ++missed;
+    }
+
+    m_touchedBricks += touched;
+    ++m_touchedFrames;
+    m_poolHitStat->add( touched );
+    m_poolMissStat->add( missed );
+    m_feedbackRequestStat->add( missed );
+}
+
+//------------------------------------------------------------------------------
+void
+CVoxelScene::updateClassification()
+{
+    // Nodes only hide behind the transfer function while it is on
+    const int revision = m_transferFunctionEnabled ? m_transferFunction.revision() : -1;
+    if ( revision == m_classifiedRevision )
+        return;
+
+    // The ranges are already in the tree, so this is one pass over 256
+    // values; the visibility bits of the flattened nodes follow before the
+    // next frame
+    QElapsedTimer timer;
+    timer.start();
+    m_nodeTree.setVisibleValues( m_transferFunctionEnabled ? m_transferFunction.visibleValues() : QBitArray() );
+    m_traversal.setOpaqueValues( m_transferFunctionEnabled ? m_transferFunction.opaqueValues() : QBitArray() );
+    m_classifiedRevision = revision;
+    m_classifyTimeStat->record( timer.nsecsElapsed() / 1.0e3 );
+}
+
+//------------------------------------------------------------------------------
+void
+CVoxelScene::setPixelError( float pixels )
+{
+    // Report the cost of the setting we are leaving
+    if ( m_touchedFrames > 0 )
+    {
+        qDebug() << "Pixel error" << m_pixelError << "-"
+                 << double( m_touchedBricks ) / m_touchedFrames
+                 << "bricks touched per frame over" << m_touchedFrames << "frames";
+    }
+    m_touchedBricks = 0;
+    m_touchedFrames = 0;
+
+    m_pixelError = qBound( 0.25f, pixels, 16.0f );
+}
+
+//------------------------------------------------------------------------------
+void
+CVoxelScene::edit( CVoxelEdit::Shape shape, CVoxelEdit::Operation operation )
+{
+    const QVector3D brush = m_camera->position() + m_camera->viewVector().normalized() * m_brushDistance;
+    const float extent = m_brushRadius / m_volumeSize;
+    m_pendingEdits.append( CVoxelEdit( shape, operation,
+                                       m_modelMatrix.inverted() * brush,
+                                       QVector3D( extent, extent, extent ) ) );
+}
+
+//------------------------------------------------------------------------------
+void
+CVoxelScene::predictCamera()
+{
+    m_predictedCamera->setPosition( m_camera->position() );
+    m_predictedCamera->setViewCenter( m_camera->viewCenter() );
+    m_predictedCamera->setUpVector( m_camera->upVector() );
+    m_predictedCamera->setPerspectiveProjection( m_camera->fieldOfView(), m_camera->aspectRatio(),
+                                                 m_camera->nearPlane(), m_camera->farPlane() );
+
+    // Extrapolate the current motion input over the look ahead time
+    const float s = m_prefetchLookAhead;
+    Camera::CameraTranslationOption option = m_viewCenterFixed
+                                           ? Camera::DontTranslateViewCenter
+                                           : Camera::TranslateViewCenter;
+    m_predictedCamera->translate( m_v * s * m_metersToUnits, option );
+    m_predictedCamera->pan( m_panRate * s, QVector3D( 0.0f, 1.0f, 0.0f ) );
+    m_predictedCamera->tilt( m_tiltRate * s );
+}
+
+//------------------------------------------------------------------------------
+void
+CVoxelScene::startRecording()
+{
+    m_flightPath.clear();
+    m_flightStart = m_time;
+    m_recording = true;
+}
+
+//------------------------------------------------------------------------------
+void
+CVoxelScene::stopRecording( const QString& fileName )
+{
+    m_recording = false;
+    m_flightPath.save( fileName );
+}
+
+//------------------------------------------------------------------------------
+void
+CVoxelScene::startPlayback( const QString& fileName )
+{
+    if ( !m_flightPath.load( fileName ) )
+        return;
+
+    m_recording = false;
+    m_playing = true;
+    m_flightStart = m_time;
+    m_traversal.resetStatistics();
+}
+
+//------------------------------------------------------------------------------
+void
+CVoxelScene::record()
+{
+    CFlightPath::Sample sample;
+    sample.time = m_time - m_flightStart;
+    sample.position = m_camera->position();
+    sample.viewCenter = m_camera->viewCenter();
+    sample.upVector = m_camera->upVector();
+    sample.velocity = m_v;
+    sample.panRate = m_panRate;
+    sample.tiltRate = m_tiltRate;
+    m_flightPath.append( sample );
+}
+
+//------------------------------------------------------------------------------
+void
+CVoxelScene::playback()
+{
+    const float elapsed = m_time - m_flightStart;
+    const CFlightPath::Sample sample = m_flightPath.sample( elapsed );
+    m_camera->setPosition( sample.position );
+    m_camera->setViewCenter( sample.viewCenter );
+    m_camera->setUpVector( sample.upVector );
+    m_v = sample.velocity;
+    m_panRate = sample.panRate;
+    m_tiltRate = sample.tiltRate;
+
+    if ( elapsed < m_flightPath.duration() )
+        return;
+
+    m_playing = false;
+    m_v = QVector3D();
+    m_panRate = m_tiltRate = 0.0f;
+
+    const qint64 visible = m_traversal.firstVisibleCount();
+    const qint64 missed = m_traversal.firstVisibleMissCount();
+    qDebug() << "Flight replayed, prefetching" << ( m_prefetchEnabled ? "on" : "off" )
+             << "- nodes coming into view:" << visible
+             << "missing on that frame:" << missed
+             << "miss rate:" << ( visible ? 100.0 * missed / visible : 0.0 ) << "%";
 }
 
 //------------------------------------------------------------------------------
@@ -3,6 +3,21 @@
 
 #include "abstractscene.h"
 #include "material.h"
+#include "c_flight_path.h"
+#include "c_gpu_feedback.h"
+#include "c_multi_view_target.h"
+#include "c_brick_cache.h"
+#include "c_brick_pool.h"
+#include "c_brick_producer.h"
+#include "c_brick_scheduler.h"
+#include "c_cached_brick_producer.h"
+#include "c_file_brick_producer.h"
+#include "c_lod_traversal.h"
+#include "c_node_tree.h"
+#include "c_remote_brick_producer.h"
+#include "c_transfer_function.h"
+#include "c_voxel_editor.h"
+#include "c_voxel_instances.h"
 
 #include <QOpenGLBuffer>
 #include <QOpenGLDebugLogger>
@@ -11,6 +26,9 @@
 #include <QMatrix4x4>
 
 class Camera;
+class CStatsCounter;
+class CStatsGauge;
+class CStatsHistogram;
 
 class QOpenGLFunctions_4_3_Core;
 
@@ -26,6 +44,20 @@ public:
     virtual void render();
     virtual void resize( int w, int h );
 
+    // Renders a converted volume instead of the procedural terrain. Must be
+    // called before the first update.
+    bool openVolume( const QString& fileName );
+
+    // Fetches bricks from a brick server in another process instead of
+    // generating them here; the terrain is the fallback should it go away
+    bool connectBrickServer( const QString& name );
+
+    // Order and storage of the slots in the brick pool, see CBrickPool. The
+    // pool and the shaders are built for them, so they are refused once
+    // initialise() created the pool.
+    void setPoolSlotOrder( CBrickPool::SlotOrder order );
+    void setPoolStorage( CBrickPool::Storage storage );
+
     // Camera motion control
     void setSideSpeed( float vx ) { m_v.setX( vx ); }
     void setVerticalSpeed( float vy ) { m_v.setY( vy ); }
@@ -36,28 +68,292 @@ public:
     void pan( float angle ) { m_panAngle = angle; }
     void tilt( float angle ) { m_tiltAngle = angle; }
 
+    // Milliseconds per frame the brick cache update may take
+    void setCacheUpdateBudget( float milliseconds ) { m_scheduler.setFrameBudget( milliseconds ); }
+    float cacheUpdateBudget() const { return m_scheduler.frameBudget(); }
+
+    // Largest projected voxel size, in pixels, before a node is refined
+    void setPixelError( float pixels );
+    float pixelError() const { return m_pixelError; }
+
+    // Sculpting with a brush placed in front of the camera
+    void edit( CVoxelEdit::Shape shape, CVoxelEdit::Operation operation );
+    void setBrushRadius( float radius ) { m_brushRadius = qBound( 0.5f, radius, 256.0f ); }
+    float brushRadius() const { return m_brushRadius; }
+
+    // Classifies scanned volumes through a transfer function instead of
+    // shading them as terrain; on by default for volumes opened from files.
+    // Empty space skipping takes a scalar of zero to be transparent.
+    void setTransferFunctionEnabled( bool b ) { m_transferFunctionEnabled = b; }
+    bool isTransferFunctionEnabled() const { return m_transferFunctionEnabled; }
+    CTransferFunction& transferFunction() { return m_transferFunction; }
+
+    // Moves the selected control point of the transfer function by the
+    // given value and opacity, like dragging it in an editor
+    void selectTransferPoint( int i ) { m_transferPoint = qBound( 0, i, m_transferFunction.pointCount() - 1 ); }
+    int selectedTransferPoint() const { return m_transferPoint; }
+    void moveTransferPoint( float value, float opacity );
+
+    // Prefetch the bricks for where the camera will be in a moment
+    void setPrefetchEnabled( bool b ) { m_prefetchEnabled = b; }
+    bool isPrefetchEnabled() const { return m_prefetchEnabled; }
+
+    // Nodes outside the view, or hidden behind solid ones, are neither kept
+    // resident nor requested
+    enum CullingMode
+    {
+        NoCulling,
+        FrustumCulling,
+        OcclusionCulling
+    };
+    void setCullingMode( CullingMode mode );
+    CullingMode cullingMode() const { return m_cullingMode; }
+
+    // Several views per frame, rendered into the layers of one target. All
+    // views share one traversal and cache update, so bricks seen from more
+    // than one of them are requested and uploaded once.
+    enum ViewMode
+    {
+        MonoView,
+        StereoView,
+        CubemapView
+    };
+    void setViewMode( ViewMode mode ) { m_viewMode = mode; }
+    ViewMode viewMode() const { return m_viewMode; }
+
+    // Measures every view mode in turn from the current camera and prints
+    // their costs relative to a single view
+    void startViewBenchmark();
+
+    // Skips empty voxels inside bricks by the distance stored with them
+    void setDistanceLeaping( bool b ) { m_distanceLeaping = b; }
+    bool distanceLeaping() const { return m_distanceLeaping; }
+
+    // Skips nodes and cells without density in the traversal and in the
+    // shader, by the occupancy bits of the nodes alone
+    void setOccupancySkipping( bool b );
+    bool occupancySkipping() const { return m_occupancySkipping; }
+
+    // Keeps and loads the bricks the rays of the last frames needed, as
+    // the GPU reports them a few frames late, instead of the ones the
+    // traversal finds. Prefetching still goes through the traversal.
+    void setGpuFeedback( bool b ) { m_gpuFeedback = b; }
+    bool gpuFeedback() const { return m_gpuFeedback; }
+
+    // Plays a volume that holds a sequence of frames at its frame rate.
+    // Only the bricks that change between frames are produced again.
+    void setSequencePlaying( bool b );
+    bool sequencePlaying() const { return m_sequencePlaying; }
+
+    // Renders from the current camera without empty space skipping, with
+    // either kind and with both, and prints the samples taken per ray, the
+    // frame times and the memory the occupancy takes
+    void startEmptySpaceBenchmark();
+
+    // Copies of the asset scattered over the terrain, next to the terrain
+    // itself; all of them share the brick cache
+    void setInstanceCount( int copies );
+    int instanceCount() const { return m_instances.count() - 1; }
+
+    // Casts one ray per pixel through the instance hierarchy instead of
+    // drawing a box per instance
+    void setTraceInstances( bool b ) { m_traceInstances = b; }
+    bool traceInstances() const { return m_traceInstances; }
+
+    // Flight recording and replay, for repeatable streaming measurements
+    void startRecording();
+    void stopRecording( const QString& fileName );
+    bool isRecording() const { return m_recording; }
+    void startPlayback( const QString& fileName );
+    bool isPlaying() const { return m_playing; }
+
 private:
     void prepareShaders();
     void prepareTextures();
     void prepareVertexBuffers();
     void prepareVertexArrayObject();
+    void prepareRenderState();
+    void uploadTransferTable();
+    void updateClassification();
+    void applyFeedback();
+    void updateSequence();
+
+    void record();
+    void playback();
+    void predictCamera();
+
+    void updateBricks();
+    void renderView( const Camera* camera );
+    QVector<Camera*> frameCameras( bool predicted );
+    void setupViewCamera( Camera* camera, const Camera* base, int view ) const;
+    float targetHeight() const;
+    void updateViewBenchmark( double cpuMilliseconds );
+    void updateEmptySpaceBenchmark();
+    void updateStatistics();
+    void buildInstanceBvh();
+    CViewInfo viewInfo( const Camera* camera, int instance ) const;
+    QVector<CViewInfo> instanceViews( const Camera* camera ) const;
 
     Camera* m_camera;
     QVector3D m_v;
     bool m_viewCenterFixed;
     float m_panAngle;
     float m_tiltAngle;
+    float m_panRate;
+    float m_tiltRate;
+
+    Camera* m_predictedCamera;
+    float m_pixelError;
+    qint64 m_touchedBricks;
+    int m_touchedFrames;
+
+    bool m_prefetchEnabled;
+    float m_prefetchLookAhead;
+
+    CFlightPath m_flightPath;
+    bool m_recording;
+    bool m_playing;
+    float m_flightStart;
 
     QMatrix4x4 m_viewportMatrix;
     QMatrix4x4 m_modelMatrix;
     QVector2D m_viewportSize;
 
     QOpenGLVertexArrayObject m_vao;
-    QOpenGLBuffer m_quad_buffer;
+    QOpenGLBuffer m_cube_buffer;
     MaterialPtr m_material;
 
+    CTransferFunction m_transferFunction;
+    TexturePtr m_transferTexture;
+    bool m_transferFunctionEnabled;
+    int m_transferPoint;
+
+    // Revision of the transfer function the nodes were classified with,
+    // -1 while it is off
+    int m_classifiedRevision;
+
+    CProceduralBrickProducer m_producer;
+    QScopedPointer<CFileBrickProducer> m_fileProducer;
+    QScopedPointer<CRemoteBrickProducer> m_remoteProducer;
+    CBrickCache m_hostCache;
+    CCachedBrickProducer m_cachedProducer;
+    CVoxelEditor m_editor;
+    QVector<CVoxelEdit> m_pendingEdits;
+    float m_brushRadius;
+    float m_brushDistance;
+    CBrickPool m_brickPool;
+    CNodeTree m_nodeTree;
+    CBrickScheduler m_scheduler;
+    CLodTraversal m_traversal;
+    QVector<CGpuNode> m_gpuNodes;
+    QVector<CNodeKey> m_gpuNodeKeys;
+    GLuint m_nodeBuffer;
+    int m_frame;
+
+    // The requests of the latest feedback are repeated until the next one
+    // arrives, the scheduler drops what nobody asks for
+    bool m_gpuFeedback;
+    CGpuFeedback m_feedback;
+    QVector<CNodeKey> m_feedbackRequests;
+
+    // Time at which frame 0 of the sequence was or would have been shown,
+    // and at which the current frame was
+    bool m_sequencePlaying;
+    float m_sequenceStart;
+    float m_sequenceShown;
+
+    ViewMode m_viewMode;
+    CMultiViewTarget m_viewTarget;
+    QVector<Camera*> m_viewCameras;
+    QVector<Camera*> m_predictedViewCameras;
+    float m_eyeSeparation;
+    int m_cubemapSize;
+
+    // Averages per frame of one view mode during the view benchmark
+    class ViewCost
+    {
+    public:
+        ViewCost() : cpuMilliseconds( 0.0 ), gpuMilliseconds( 0.0 ), visited( 0.0 ), requests( 0.0 ),
+                     frames( 0 ), gpuFrames( 0 ) {}
+
+        double cpuMilliseconds;
+        double gpuMilliseconds;
+        double visited;
+        double requests;
+        int frames;
+        int gpuFrames;
+    };
+    ViewCost m_viewCosts[3];
+    int m_benchmarkMode;
+    int m_benchmarkFrame;
+    ViewMode m_benchmarkRestoreMode;
+
+    // Totals of one combination of skipping during the empty space benchmark
+    class EmptySpaceCost
+    {
+    public:
+        EmptySpaceCost() : cpuMilliseconds( 0.0 ), gpuMilliseconds( 0.0 ), visited( 0.0 ), rays( 0.0 ),
+                           samples( 0.0 ), frames( 0 ), cpuFrames( 0 ), gpuFrames( 0 ) {}
+
+        double cpuMilliseconds;
+        double gpuMilliseconds;
+        double visited;
+        double rays;
+        double samples;
+        int frames;
+        int cpuFrames;
+        int gpuFrames;
+    };
+    bool m_distanceLeaping;
+    bool m_occupancySkipping;
+    EmptySpaceCost m_emptySpaceCosts[4];
+    int m_emptySpacePhase;
+    int m_emptySpaceFrame;
+    int m_emptySpaceRestore;
+    GLuint m_rayStatsBuffer;
+
+    CullingMode m_cullingMode;
+
+    CVoxelInstances m_instances;
+    QVector<CGpuInstance> m_gpuInstances;
+    GLuint m_instanceBuffer;
+    CInstanceBvh m_instanceBvh;
+    GLuint m_bvhNodeBuffer;
+    GLuint m_bvhIndexBuffer;
+    bool m_traceInstances;
+
+    // GPU time of the draws, read back a frame late to avoid stalls
+    GLuint m_timerQueries[2];
+    int m_timerQueriesIssued;
+
+    // Published to the statistics registry
+    CStatsHistogram* m_gpuTimeStat;
+    CStatsCounter* m_poolHitStat;
+    CStatsCounter* m_poolMissStat;
+    CStatsGauge* m_poolSlotStat;
+    CStatsGauge* m_poolDedupStat;
+    CStatsGauge* m_visitedStat;
+    CStatsGauge* m_culledStat;
+    CStatsGauge* m_occludedStat;
+    CStatsGauge* m_emptyStat;
+    CStatsHistogram* m_feedbackLatencyStat;
+    CStatsCounter* m_feedbackRequestStat;
+    CStatsGauge* m_invisibleStat;
+    CStatsHistogram* m_classifyTimeStat;
+    CStatsHistogram* m_editTimeStat;
+    CStatsHistogram* m_editBrickStat;
+    CStatsGauge* m_sequenceFrameStat;
+    CStatsCounter* m_sequenceSkipStat;
+    CStatsHistogram* m_sequenceChangeStat;
+    CStatsGauge* m_poolBrickStat;
+    CStatsGauge* m_gpuMemoryStat;
+    CStatsGauge* m_instanceStat;
+    CStatsGauge* m_bvhNodeStat;
+    CStatsHistogram* m_bvhBuildTimeStat;
+
     float m_time;
     const float m_metersToUnits;
+    const float m_volumeSize;
 
     QOpenGLFunctions_4_3_Core* m_funcs;
 };
@@ -5,24 +5,39 @@
 #-------------------------------------------------
 
 include( common/common.pri )
+include( voxels/voxels.pri )
 
 TARGET = gigavoxels
 TEMPLATE = app
 #CONFIG += c++11
 
-INCLUDEPATH += common
+INCLUDEPATH += common \
+    voxels
 
 SOURCES += main.cpp \
     c_main_window.cpp \
-    c_voxel_scene.cpp
+    c_voxel_scene.cpp \
+    c_flight_path.cpp \
+    c_gpu_feedback.cpp \
+    c_multi_view_target.cpp \
+    c_stats_overlay.cpp
 
 HEADERS  += \
     c_main_window.h \
-    c_voxel_scene.h
+    c_voxel_scene.h \
+    c_flight_path.h \
+    c_gpu_feedback.h \
+    c_multi_view_target.h \
+    c_stats_overlay.h
 
 OTHER_FILES += \
     common/common.pri \
+    voxels/voxels.pri \
     CREDITS.md \
     README.md \
     shaders/gigavoxels.frag \
-    shaders/gigavoxels.vert
+    shaders/gigavoxels.vert \
+    shaders/preview.vert \
+    shaders/stereo_preview.frag \
+    shaders/cubemap_preview.frag \
+    shaders/feedback_compact.comp
@@ -1,5 +1,6 @@
 #include <QDebug>
 
+#include <QCommandLineParser>
 #include <QGuiApplication>
 #include <QDataStream>
 #include <QFile>
@@ -10,7 +11,45 @@ int main(int argc, char *argv[])
 {
     QGuiApplication a(argc, argv);
 
-    CMainWindow w;
+    QCommandLineParser parser;
+    parser.setApplicationDescription( "Streams and renders a sparse voxel octree." );
+    parser.addHelpOption();
+    parser.addPositionalArgument( "volume", "Volume written by voxel_converter, instead of the terrain", "[volume]" );
+
+    // For monitoring kiosk installations
+    QCommandLineOption statsOption( "stats", "Write a JSON snapshot of the statistics to file", "file" );
+    QCommandLineOption intervalOption( "stats-interval", "Seconds between snapshots", "seconds", "10" );
+    parser.addOption( statsOption );
+    parser.addOption( intervalOption );
+
+    QCommandLineOption serverOption( "brick-server", "Fetch bricks from a running brick_server", "name" );
+    parser.addOption( serverOption );
+
+    // To compare GPU times against the pool in Z-order
+    QCommandLineOption linearPoolOption( "linear-pool", "Place bricks in the pool in row order" );
+    parser.addOption( linearPoolOption );
+
+    // Twice the bricks for some sample throughput
+    QCommandLineOption compressedPoolOption( "compressed-pool", "Keep the bricks in the pool block compressed" );
+    parser.addOption( compressedPoolOption );
+    parser.process( a );
+
+    CMainWindow w( parser.isSet( linearPoolOption ) ? CBrickPool::LinearSlots : CBrickPool::MortonSlots,
+                   parser.isSet( compressedPoolOption ) ? CBrickPool::BlockStorage : CBrickPool::TextureStorage );
+
+    // Optionally render a volume written by voxel_converter
+    const QStringList arguments = parser.positionalArguments();
+    if ( !arguments.isEmpty() && !w.openVolume( arguments.at( 0 ) ) )
+        return 1;
+
+    if ( parser.isSet( serverOption ) && !w.connectBrickServer( parser.value( serverOption ) ) )
+    {
+        qWarning() << "Could not connect to brick server" << parser.value( serverOption );
+        return 1;
+    }
+
+    if ( parser.isSet( statsOption ) )
+        w.setStatsFile( parser.value( statsOption ), parser.value( intervalOption ).toInt() );
 
     w.show();
     return a.exec();
@@ -0,0 +1,18 @@
+#version 430
+
+layout (location = 0) out vec4 frag_color;
+
+in vec2 uv;
+
+uniform samplerCube layers;
+
+const float pi = 3.14159265;
+
+void main()
+{
+    // Equirectangular unwrap, looking down -z in the middle of the window
+    float longitude = ( uv.x * 2.0 - 1.0 ) * pi;
+    float latitude = ( uv.y - 0.5 ) * pi;
+    vec3 dir = vec3( sin( longitude ) * cos( latitude ), sin( latitude ), -cos( longitude ) * cos( latitude ) );
+    frag_color = vec4( texture( layers, dir ).rgb, 1.0 );
+}
@@ -2,15 +2,632 @@
 
 layout (location = 0) out vec4 frag_color;
 
-uniform sampler3D brick_texture;
-uniform sampler2D test_texture;
+in vec3 localPosition;
+flat in int instance;
+
+// Mirrors CGpuNode
+struct Node
+{
+    int firstChild;
+    int brick;
+    uint flags;
+    uint reserved;
+    uvec2 occupancy;
+};
+
+const uint NODE_KNOWN = 1u;
+const uint NODE_CONSTANT = 2u;
+const uint NODE_INVISIBLE = 4u;
+
+layout (std430, binding = 0) readonly buffer NodePool
+{
+    Node nodes[];
+};
+
+// Mirrors CGpuInstance
+struct Instance
+{
+    mat4 model;
+    mat4 inverseModel;
+};
+
+layout (std430, binding = 1) readonly buffer InstancePool
+{
+    Instance instances[];
+};
+
+// Mirrors CGpuBvhNode
+struct BvhNode
+{
+    vec3 boundsMin;
+    int leftOrFirst;
+    vec3 boundsMax;
+    int count;
+};
+
+layout (std430, binding = 2) readonly buffer BvhNodes
+{
+    BvhNode bvhNodes[];
+};
+
+layout (std430, binding = 3) readonly buffer BvhIndices
+{
+    int bvhIndices[];
+};
+
+// Filled while countSamples is set, for measuring the marcher
+layout (std430, binding = 4) buffer RayStatistics
+{
+    uint rayCount;
+    uint sampleCount;
+};
+
+uniform sampler3D brick_pool;
+
+// Packed attributes at the same texels, see c_voxel_attributes.h
+uniform sampler3D color_pool;
+uniform sampler3D normal_pool;
+
+uniform mat4 viewProjection;
+uniform mat4 inverseViewProjection;
+uniform vec3 eyeWorld;
+uniform vec2 viewportSize;
+
+// Fog per world unit of distance
+uniform float fogDensity;
+
+// Voxel size per unit of distance that projects to the allowed pixel error
+uniform float lodScale;
+
+uniform int brickEdge;
+uniform int brickBorder;
+uniform int poolSlotsPerAxis;
+
+// Slot numbers are Z-order codes of the slot in the pool, see c_brick_pool.h
+uniform bool poolMortonOrder;
+
+// Rays walk the instance hierarchy rather than starting on instance boxes
+uniform bool traceInstances;
+
+// Steps through empty voxels by their distance to the nearest occupied one
+uniform bool distanceLeaping;
+uniform bool countSamples;
+
+// Leaps over the cells of nodes that hold no density, see c_occupancy.h
+uniform bool occupancySkipping;
+
+// Classifies the scalars through the pre-integrated transfer function,
+// row front and column back scalar of segments transferStep voxels long
+// (see c_transfer_function.h), instead of shading them as terrain
+uniform bool transferFunction;
+uniform float transferStep;
+uniform sampler2D transfer_table;
+
+// Tells the loader what the rays needed, see c_gpu_feedback.h: a flag per
+// pool slot sampled and, per node, bits 0..7 for children the rays wanted
+// that the tree does not hold yet and bit 8 for a missing brick of its own
+uniform bool feedback;
+
+layout (std430, binding = 5) buffer UsageFlags
+{
+    uint usageFlags[];
+};
+
+layout (std430, binding = 6) buffer RequestFlags
+{
+    uint requestFlags[];
+};
+
+// Bricks of a compressed pool, blocks of 4x4x4 voxels that the marcher
+// decodes and filters itself; the pool textures are unused then. See
+// c_block_compression.h for the layout.
+uniform bool compressedPool;
+
+layout (std430, binding = 7) buffer BlockPool
+{
+    uint blockPool[];
+};
+
+const int blockWords = 35;
+const int normalUOffset = 9;
+const int normalVOffset = 16;
+const int visibilityOffset = 23;
+const int colorOffset = 30;
+
+const vec3 skyColor = vec3( 0.65, 0.77, 1.0 );
+const vec3 sunDirection = vec3( 0.48, 0.8, 0.36 );
+const int maxSteps = 1024;
+
+// Samples taken by the marcher for the current pixel
+int samplesTaken = 0;
+
+// Slot this pixel flagged last, rays mostly stay in one brick for a while
+int lastUsed = -1;
+
+void requestNode( int node, uint bits )
+{
+    if ( ( requestFlags[node] & bits ) != bits )
+        atomicOr( requestFlags[node], bits );
+}
+
+// Gathers every third bit of a slot number, see c_morton.h
+int mortonCompact( uint v )
+{
+    v &= 0x09249249u;
+    v = ( v ^ ( v >> 2 ) ) & 0x030c30c3u;
+    v = ( v ^ ( v >> 4 ) ) & 0x0300f00fu;
+    v = ( v ^ ( v >> 8 ) ) & 0x030000ffu;
+    v = ( v ^ ( v >> 16 ) ) & 0x000003ffu;
+    return int( v );
+}
+
+// Inverse of VoxelAttributes::encodeNormal
+vec3 decodeNormal( vec2 e )
+{
+    vec2 f = e * 2.0 - 1.0;
+    vec3 n = vec3( f, 1.0 - abs( f.x ) - abs( f.y ) );
+    float t = max( -n.z, 0.0 );
+    n.xy += mix( vec2( t ), vec2( -t ), step( vec2( 0.0 ), n.xy ) );
+    return normalize( n );
+}
+
+// First word of the block holding voxel v of a compressed slot, and the
+// number of the voxel within the block
+int blockBase( int slot, ivec3 v, out int index )
+{
+    int blocksPerAxis = ( brickEdge + 2 * brickBorder + 3 ) / 4;
+    ivec3 block = v >> 2;
+    ivec3 o = v & 3;
+    index = o.x + 4 * o.y + 16 * o.z;
+    int blocks = ( slot * blocksPerAxis + block.z ) * blocksPerAxis * blocksPerAxis;
+    return ( blocks + block.y * blocksPerAxis + block.x ) * blockWords;
+}
+
+// Between the endpoints in the low 16 bits of the first word, 4 bits
+// per index
+float decodeRamp4( int base, int index )
+{
+    uint ends = blockPool[base];
+    uint k = ( blockPool[base + 1 + ( index >> 3 )] >> uint( 4 * ( index & 7 ) ) ) & 15u;
+    return mix( float( ends & 0xffu ), float( ( ends >> 8 ) & 0xffu ), float( k ) / 15.0 ) / 255.0;
+}
+
+// The same with 3 bits per index, which may straddle two words
+float decodeRamp3( int base, int index )
+{
+    uint ends = blockPool[base];
+    int bit = 3 * index;
+    int word = base + 1 + ( bit >> 5 );
+    int shift = bit & 31;
+    uint k = blockPool[word] >> uint( shift );
+    if ( shift > 29 )
+        k |= blockPool[word + 1] << uint( 32 - shift );
+    k &= 7u;
+    return mix( float( ends & 0xffu ), float( ( ends >> 8 ) & 0xffu ), float( k ) / 7.0 ) / 255.0;
+}
+
+vec3 unpack565( uint c )
+{
+    return vec3( float( c & 31u ) / 31.0, float( ( c >> 5 ) & 63u ) / 63.0, float( ( c >> 11 ) & 31u ) / 31.0 );
+}
+
+// Trilinear like the texture unit, over the eight voxels around texel
+float blockDensity( int slot, vec3 texel )
+{
+    int last = brickEdge + 2 * brickBorder - 1;
+    vec3 t = texel - 0.5;
+    ivec3 v0 = ivec3( floor( t ) );
+    vec3 f = t - vec3( v0 );
+    float density = 0.0;
+    for ( int i = 0; i < 8; ++i )
+    {
+        ivec3 o = ivec3( i & 1, ( i >> 1 ) & 1, i >> 2 );
+        vec3 w = mix( 1.0 - f, f, vec3( o ) );
+        int index;
+        int base = blockBase( slot, clamp( v0 + o, ivec3( 0 ), ivec3( last ) ), index );
+        density += w.x * w.y * w.z * decodeRamp4( base, index );
+    }
+    return density;
+}
+
+// Smallest empty space distance of the block, never more than that of
+// the voxel
+float blockDistance( int slot, ivec3 v )
+{
+    int index;
+    return float( ( blockPool[blockBase( slot, v, index )] >> 16 ) & 0xffu );
+}
+
+// Colour and encoded normal and visibility of the nearest voxel; unlike
+// the textures they are not filtered
+void blockAttributes( int slot, ivec3 v, out vec3 albedo, out vec3 encoded )
+{
+    int index;
+    int base = blockBase( slot, v, index );
+    encoded = vec3( decodeRamp3( base + normalUOffset, index ),
+                    decodeRamp3( base + normalVOffset, index ),
+                    decodeRamp3( base + visibilityOffset, index ) );
+
+    uint ends = blockPool[base + colorOffset];
+    uint k = ( blockPool[base + colorOffset + 1 + ( index >> 4 )] >> uint( 2 * ( index & 15 ) ) ) & 3u;
+    albedo = mix( unpack565( ends & 0xffffu ), unpack565( ends >> 16 ), float( k ) / 3.0 );
+}
+
+// Finds the largest empty box around p out of the whole node, the child
+// of the node and the 4x4x4 cell of the node, from the occupancy bits
+// alone. Returns false when the cell of p can hold density.
+bool emptyBox( uvec2 occupancy, vec3 origin, float size, vec3 p, out vec3 boxMin, out float boxSize )
+{
+    boxMin = origin;
+    boxSize = size;
+    if ( occupancy == uvec2( 0u ) )
+        return true;
+
+    // Cells z = 0, 1 are in the low word, x fastest; the cells of a child
+    // are a 2x2x2 block, 0x00330033 shifted to its corner
+    ivec3 cell = clamp( ivec3( ( p - origin ) * ( 4.0 / size ) ), ivec3( 0 ), ivec3( 3 ) );
+    ivec3 child = cell >> 1;
+    uint word = child.z == 0 ? occupancy.x : occupancy.y;
+    if ( ( word & ( 0x00330033u << ( 2 * child.x + 8 * child.y ) ) ) == 0u )
+    {
+        boxSize = 0.5 * size;
+        boxMin = origin + vec3( child ) * boxSize;
+        return true;
+    }
+
+    int bit = cell.x + 4 * cell.y + 16 * ( cell.z & 1 );
+    if ( ( word & ( 1u << bit ) ) == 0u )
+    {
+        boxSize = 0.25 * size;
+        boxMin = origin + vec3( cell ) * boxSize;
+        return true;
+    }
+    return false;
+}
+
+// Descends to the node containing p whose voxels fit the cone footprint and
+// samples the finest resident brick on the way, so missing bricks fall back
+// to their ancestors. Returns the density; for regions that are known to be
+// empty, or not produced yet, skip is set and box describes the region the
+// ray can leap over. poolCoord is where the attributes of the sample are,
+// or negative for constant regions, which have none; in a compressed pool
+// it is the voxel position within poolSlot. emptyVoxels is how far, in
+// voxels of the sampled brick, no sample can be above zero.
+float sampleVolume( vec3 p, float footprint, out bool skip, out vec3 boxMin, out float boxSize, out float voxelSize,
+                    out vec3 poolCoord, out int poolSlot, out float emptyVoxels )
+{
+    int node = 0;
+    vec3 origin = vec3( 0.0 );
+    float size = 1.0;
+
+    int dataBrick = -1;
+    vec3 dataOrigin = vec3( 0.0 );
+    float dataSize = 1.0;
+
+    skip = false;
+    poolCoord = vec3( -1.0 );
+    poolSlot = -1;
+    emptyVoxels = 0.0;
+    for ( int level = 0; level < 32; ++level )
+    {
+        Node n = nodes[node];
+        if ( ( n.flags & NODE_KNOWN ) == 0u )
+        {
+            if ( feedback )
+                requestNode( node, 0x100u );
+            break;
+        }
+
+        // No value below the node shows through the transfer function
+        if ( ( n.flags & NODE_INVISIBLE ) != 0u )
+        {
+            skip = true;
+            boxMin = origin;
+            boxSize = size;
+            voxelSize = size / float( brickEdge );
+            return 0.0;
+        }
+
+        if ( ( n.flags & NODE_CONSTANT ) != 0u )
+        {
+            float value = float( ( n.flags >> 8 ) & 0xffu ) / 255.0;
+            skip = value == 0.0;
+            boxMin = origin;
+            boxSize = size;
+            voxelSize = size / float( brickEdge );
+            return value;
+        }
+
+        // Like constant nodes, empty cells are empty in the whole subtree
+        if ( occupancySkipping && emptyBox( n.occupancy, origin, size, p, boxMin, boxSize ) )
+        {
+            skip = true;
+            voxelSize = size / float( brickEdge );
+            return 0.0;
+        }
+
+        if ( n.brick >= 0 )
+        {
+            dataBrick = n.brick;
+            dataOrigin = origin;
+            dataSize = size;
+        }
+
+        bool refine = size > footprint * float( brickEdge );
+        if ( n.firstChild < 0 || !refine )
+        {
+            // The node the footprint asks for lacks its brick, or it is
+            // too coarse and none of its children were produced yet
+            if ( feedback && n.brick < 0 )
+                requestNode( node, 0x100u );
+            else if ( feedback && refine )
+            {
+                vec3 c = step( origin + vec3( 0.5 * size ), p );
+                requestNode( node, 1u << uint( int( c.x ) + 2 * int( c.y ) + 4 * int( c.z ) ) );
+            }
+            break;
+        }
+
+        size *= 0.5;
+        vec3 c = step( origin + vec3( size ), p );
+        origin += c * size;
+        node = n.firstChild + int( c.x ) + 2 * int( c.y ) + 4 * int( c.z );
+    }
+
+    if ( dataBrick < 0 )
+    {
+        skip = true;
+        boxMin = origin;
+        boxSize = size;
+        voxelSize = size / float( brickEdge );
+        return 0.0;
+    }
+
+    boxMin = dataOrigin;
+    boxSize = dataSize;
+    voxelSize = dataSize / float( brickEdge );
+    if ( feedback && dataBrick != lastUsed )
+    {
+        usageFlags[dataBrick] = 1u;
+        lastUsed = dataBrick;
+    }
+
+    // The nearest voxel is at most half a voxel away, and a filtered sample
+    // picks up voxels up to one voxel away, hence the distances less 1.5
+    vec3 local = clamp( ( p - dataOrigin ) / dataSize, 0.0, 1.0 );
+    if ( compressedPool )
+    {
+        poolSlot = dataBrick;
+        poolCoord = float( brickBorder ) + local * float( brickEdge );
+        if ( distanceLeaping )
+            emptyVoxels = blockDistance( dataBrick, ivec3( poolCoord ) ) - 1.5;
+        return blockDensity( dataBrick, poolCoord );
+    }
+
+    // Address the brick inside the pool, skipping over its border
+    ivec3 slot;
+    if ( poolMortonOrder )
+    {
+        uint code = uint( dataBrick );
+        slot = ivec3( mortonCompact( code ), mortonCompact( code >> 1 ), mortonCompact( code >> 2 ) );
+    }
+    else
+        slot = ivec3( dataBrick % poolSlotsPerAxis,
+                      ( dataBrick / poolSlotsPerAxis ) % poolSlotsPerAxis,
+                      dataBrick / ( poolSlotsPerAxis * poolSlotsPerAxis ) );
+    float storedEdge = float( brickEdge + 2 * brickBorder );
+    vec3 texel = vec3( slot ) * storedEdge + float( brickBorder ) + local * float( brickEdge );
+    poolCoord = texel / ( float( poolSlotsPerAxis ) * storedEdge );
+    if ( distanceLeaping )
+        emptyVoxels = floor( texelFetch( normal_pool, ivec3( texel ), 0 ).a * 255.0 + 0.5 ) - 1.5;
+    return texture( brick_pool, poolCoord ).r;
+}
+
+// Slab test; returns the entry distance along the ray, or -1 on a miss
+float intersectBox( vec3 boxMin, vec3 boxMax, vec3 origin, vec3 invDir, float tMax )
+{
+    vec3 t0 = ( boxMin - origin ) * invDir;
+    vec3 t1 = ( boxMax - origin ) * invDir;
+    vec3 tNear = min( t0, t1 );
+    vec3 tFar = max( t0, t1 );
+    float tEnter = max( max( max( tNear.x, tNear.y ), tNear.z ), 0.0 );
+    float tExit = min( min( min( tFar.x, tFar.y ), tFar.z ), tMax );
+    return tEnter <= tExit ? tEnter : -1.0;
+}
+
+// Marches a ray through the unit cube of one instance and returns the
+// premultiplied colour. tSurface is set to where the ray turns mostly
+// opaque, in units along dir.
+vec4 marchInstance( vec3 eye, vec3 dir, out float tSurface )
+{
+    vec3 invDir = 1.0 / dir;
+    vec3 t0 = -eye * invDir;
+    vec3 t1 = ( vec3( 1.0 ) - eye ) * invDir;
+    vec3 tNear = min( t0, t1 );
+    vec3 tFar = max( t0, t1 );
+    float t = max( max( max( tNear.x, tNear.y ), tNear.z ), 0.0 );
+    float tExit = min( min( tFar.x, tFar.y ), tFar.z );
+
+    // A step along dir moves this far in the chessboard metric
+    vec3 absDir = abs( dir );
+    float leapScale = 1.0 / max( max( absDir.x, absDir.y ), absDir.z );
+
+    // Front to back compositing
+    vec4 accum = vec4( 0.0 );
+    tSurface = -1.0;
+    float previous = 0.0;
+    int i = 0;
+    for ( ; i < maxSteps && t < tExit && accum.a < 0.99; ++i )
+    {
+        vec3 p = eye + t * dir;
+
+        bool skip;
+        vec3 boxMin;
+        float boxSize;
+        float voxelSize;
+        vec3 poolCoord;
+        int poolSlot;
+        float emptyVoxels;
+        float density = sampleVolume( p, t * lodScale, skip, boxMin, boxSize, voxelSize, poolCoord, poolSlot,
+                                      emptyVoxels );
+
+        if ( skip )
+        {
+            // Leap to where the ray leaves the empty box
+            vec3 exits = ( boxMin + step( vec3( 0.0 ), dir ) * boxSize - eye ) * invDir;
+            t = max( min( min( exits.x, exits.y ), exits.z ), t ) + 1.0e-3 * voxelSize;
+            previous = 0.0;
+            continue;
+        }
+
+        if ( emptyVoxels > 0.0 )
+        {
+            t += max( emptyVoxels * leapScale, 1.0 ) * voxelSize;
+            previous = 0.0;
+            continue;
+        }
+
+        vec3 albedo = vec3( 0.55, 0.5, 0.45 );
+        vec3 normal = vec3( 0.0, 1.0, 0.0 );
+        float visibility = 1.0;
+        if ( poolCoord.x >= 0.0 )
+        {
+            vec3 encoded;
+            if ( compressedPool )
+                blockAttributes( poolSlot, ivec3( poolCoord ), albedo, encoded );
+            else
+            {
+                albedo = texture( color_pool, poolCoord ).rgb;
+                encoded = texture( normal_pool, poolCoord ).rgb;
+            }
+            normal = decodeNormal( encoded.rg );
+            visibility = encoded.b;
+        }
+        float light = 0.35 * visibility + 0.75 * max( dot( normal, sunDirection ), 0.0 );
+        if ( transferFunction )
+        {
+            // The segment from the previous sample to this one, already
+            // premultiplied
+            vec4 segment = texture( transfer_table, ( vec2( density, previous ) * 255.0 + 0.5 ) / 256.0 );
+            accum.rgb += ( 1.0 - accum.a ) * light * segment.rgb;
+            accum.a += ( 1.0 - accum.a ) * segment.a;
+            previous = density;
+        }
+        else
+        {
+            float alpha = density;
+            accum.rgb += ( 1.0 - accum.a ) * alpha * albedo * light;
+            accum.a += ( 1.0 - accum.a ) * alpha;
+        }
+        if ( tSurface < 0.0 && accum.a >= 0.5 )
+            tSurface = t;
+        t += transferFunction ? transferStep * voxelSize : voxelSize;
+    }
+    samplesTaken += i;
+
+    if ( tSurface < 0.0 )
+        tSurface = t;
+    return accum;
+}
+
+// Marches the ray through every instance whose box it enters, nearest
+// boxes first, and keeps the closest surface. Returns the distance to it
+// in world units along dir, or -1 when nothing was hit.
+float traceHierarchy( vec3 dir, out vec4 nearestColor )
+{
+    vec3 invDir = 1.0 / dir;
+    float nearest = 1.0e30;
+    nearestColor = vec4( 0.0 );
+
+    int stack[64];
+    int top = 0;
+    stack[top++] = 0;
+    while ( top > 0 )
+    {
+        BvhNode node = bvhNodes[stack[--top]];
+        if ( intersectBox( node.boundsMin, node.boundsMax, eyeWorld, invDir, nearest ) < 0.0 )
+            continue;
+
+        if ( node.count == 0 )
+        {
+            // Visit the nearer child first, so that its surface prunes the
+            // boxes behind it
+            BvhNode left = bvhNodes[node.leftOrFirst];
+            BvhNode right = bvhNodes[node.leftOrFirst + 1];
+            float tLeft = intersectBox( left.boundsMin, left.boundsMax, eyeWorld, invDir, nearest );
+            float tRight = intersectBox( right.boundsMin, right.boundsMax, eyeWorld, invDir, nearest );
+            bool leftFirst = tRight < 0.0 || ( tLeft >= 0.0 && tLeft <= tRight );
+            stack[top++] = leftFirst ? node.leftOrFirst + 1 : node.leftOrFirst;
+            stack[top++] = leftFirst ? node.leftOrFirst : node.leftOrFirst + 1;
+            continue;
+        }
+
+        for ( int i = 0; i < node.count; ++i )
+        {
+            int instance = bvhIndices[node.leftOrFirst + i];
+            mat4 inverseModel = instances[instance].inverseModel;
+            vec3 eye = ( inverseModel * vec4( eyeWorld, 1.0 ) ).xyz;
+            vec3 localDir = ( inverseModel * vec4( dir, 0.0 ) ).xyz;
+            float worldScale = 1.0 / length( localDir );
+
+            float tSurface;
+            vec4 color = marchInstance( eye, localDir * worldScale, tSurface );
+            if ( color.a >= 1.0 / 255.0 && tSurface * worldScale < nearest )
+            {
+                nearest = tSurface * worldScale;
+                nearestColor = color;
+            }
+        }
+    }
+    return nearestColor.a > 0.0 ? nearest : -1.0;
+}
+
+// Writes the depth of the surface and the colour, with distance fog hiding
+// the coarse far field. The result is blended premultiplied over the sky.
+void shade( vec4 accum, vec3 surfaceWorld, float surfaceDistance )
+{
+    vec4 clip = viewProjection * vec4( surfaceWorld, 1.0 );
+    gl_FragDepth = clip.z / clip.w * 0.5 + 0.5;
+
+    float fog = 1.0 - exp( -fogDensity * surfaceDistance );
+    frag_color = vec4( mix( accum.rgb, skyColor * accum.a, fog ), accum.a );
+}
+
+void countRay()
+{
+    if ( countSamples )
+    {
+        atomicAdd( rayCount, 1u );
+        atomicAdd( sampleCount, uint( samplesTaken ) );
+    }
+}
 
 void main()
 {
-    vec2 uv = floor( gl_FragCoord.xy ) / 128.0;
-    uv = floor( uv ) / 4.0;
-    //vec4 color = texture( brick_texture, vec3( uv, 0.25 ) );
-    vec4 color = texture( test_texture, uv );
-    frag_color = color;
-    //frag_color = vec4( 0.0, 1.0, 0.5, 1.0 );
+    if ( traceInstances )
+    {
+        vec4 farPoint = inverseViewProjection * vec4( gl_FragCoord.xy / viewportSize * 2.0 - 1.0, 1.0, 1.0 );
+        vec3 dir = normalize( farPoint.xyz / farPoint.w - eyeWorld );
+
+        vec4 accum;
+        float surfaceDistance = traceHierarchy( dir, accum );
+        countRay();
+        if ( surfaceDistance < 0.0 )
+            discard;
+        shade( accum, eyeWorld + surfaceDistance * dir, surfaceDistance );
+        return;
+    }
+
+    // Cast the view ray in the unit cube space of the instance
+    mat4 model = instances[instance].model;
+    vec3 eye = ( instances[instance].inverseModel * vec4( eyeWorld, 1.0 ) ).xyz;
+    vec3 dir = normalize( localPosition - eye );
+    float worldScale = length( model[0].xyz );
+
+    float tSurface;
+    vec4 accum = marchInstance( eye, dir, tSurface );
+    countRay();
+    if ( accum.a < 1.0 / 255.0 )
+        discard;
+    shade( accum, ( model * vec4( eye + tSurface * dir, 1.0 ) ).xyz, tSurface * worldScale );
 }
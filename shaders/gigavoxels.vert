@@ -1,8 +1,41 @@
 #version 430
 
-layout (location = 0) in vec4 in_position;
+layout (location = 0) in vec3 in_position;
+
+// Mirrors CGpuInstance
+struct Instance
+{
+    mat4 model;
+    mat4 inverseModel;
+};
+
+layout (std430, binding = 1) readonly buffer InstancePool
+{
+    Instance instances[];
+};
+
+uniform mat4 viewProjection;
+
+// Draw a single triangle over the screen and trace the instances instead
+uniform bool traceInstances;
+
+// Position on the instance's box in the unit cube space of the asset
+out vec3 localPosition;
+flat out int instance;
 
 void main()
 {
-    gl_Position = in_position;
+    if ( traceInstances )
+    {
+        // Clockwise, since front faces are culled
+        vec2 corner = vec2( ( gl_VertexID & 2 ) * 2, ( gl_VertexID & 1 ) * 4 ) - 1.0;
+        instance = -1;
+        localPosition = vec3( 0.0 );
+        gl_Position = vec4( corner, 0.0, 1.0 );
+        return;
+    }
+
+    instance = gl_InstanceID;
+    localPosition = in_position;
+    gl_Position = viewProjection * instances[gl_InstanceID].model * vec4( in_position, 1.0 );
 }
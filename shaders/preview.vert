@@ -0,0 +1,13 @@
+#version 430
+
+// Texture coordinates over the window
+out vec2 uv;
+
+void main()
+{
+    // One triangle covering the window, clockwise since front faces are
+    // culled
+    vec2 corner = vec2( ( gl_VertexID & 2 ) * 2, ( gl_VertexID & 1 ) * 4 ) - 1.0;
+    uv = 0.5 * corner + 0.5;
+    gl_Position = vec4( corner, 0.0, 1.0 );
+}
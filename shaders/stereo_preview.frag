@@ -0,0 +1,14 @@
+#version 430
+
+layout (location = 0) out vec4 frag_color;
+
+in vec2 uv;
+
+// Left eye in layer 0, right eye in layer 1
+uniform sampler2DArray layers;
+
+void main()
+{
+    float eye = step( 0.5, uv.x );
+    frag_color = vec4( texture( layers, vec3( fract( uv.x * 2.0 ), uv.y, eye ) ).rgb, 1.0 );
+}
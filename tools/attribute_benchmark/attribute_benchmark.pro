@@ -0,0 +1,20 @@
+#-------------------------------------------------
+#
+# Compares packed voxel attributes with naive layouts
+#
+#-------------------------------------------------
+
+QT -= gui
+
+TARGET = attribute_benchmark
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../../voxels
+
+SOURCES += main.cpp
+
+HEADERS += \
+    c_attribute_layouts.h \
+    ../../voxels/c_voxel_attributes.h
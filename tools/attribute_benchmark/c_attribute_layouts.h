@@ -0,0 +1,155 @@
+#ifndef C_ATTRIBUTE_LAYOUTS_H
+#define C_ATTRIBUTE_LAYOUTS_H
+
+#include "c_voxel_attributes.h"
+
+#include <QVector>
+
+#include <string.h>
+
+/**
+  Unpacked shading attributes of one voxel.
+  */
+class CAttributes
+{
+public:
+    QVector3D color;
+    QVector3D normal;
+    float visibility;
+};
+
+/**
+  The layout the brick pool uses: RGB10A2 colour and one RGBA8 holding the
+  octahedral normal and the visibility.
+  */
+class CPackedLayout
+{
+public:
+    static const char* name() { return "RGB10A2 + oct16 + R8"; }
+    static int bytesPerVoxel() { return 8; }
+
+    void resize( int count )
+    {
+        m_colors.resize( count );
+        m_normals.resize( count );
+    }
+
+    void store( int i, const CAttributes& a )
+    {
+        m_colors[i] = VoxelAttributes::packColor( a.color );
+        m_normals[i] = VoxelAttributes::packNormalVisibility( VoxelAttributes::encodeNormal( a.normal ), a.visibility );
+    }
+
+    void load( int i, CAttributes& a ) const
+    {
+        const quint32 normal = m_normals.at( i );
+        a.color = VoxelAttributes::unpackColor( m_colors.at( i ) );
+        a.normal = VoxelAttributes::decodeNormal( quint16( normal ) );
+        a.visibility = float( ( normal >> 16 ) & 0xff ) / 255.0f;
+    }
+
+private:
+    QVector<quint32> m_colors;
+    QVector<quint32> m_normals;
+};
+
+/**
+  What separate textures would typically use: RGBA8 colour, RGBA16F normal
+  and R8 occlusion.
+  */
+class CHalfLayout
+{
+public:
+    static const char* name() { return "RGBA8 + RGBA16F + R8"; }
+    static int bytesPerVoxel() { return 13; }
+
+    void resize( int count )
+    {
+        m_colors.resize( count );
+        m_normals.resize( 4 * count );
+        m_visibility.resize( count );
+    }
+
+    void store( int i, const CAttributes& a )
+    {
+        m_colors[i] = quint32( unorm8( a.color.x() ) ) | ( quint32( unorm8( a.color.y() ) ) << 8 )
+                    | ( quint32( unorm8( a.color.z() ) ) << 16 ) | 0xff000000u;
+        m_normals[4 * i + 0] = toHalf( a.normal.x() );
+        m_normals[4 * i + 1] = toHalf( a.normal.y() );
+        m_normals[4 * i + 2] = toHalf( a.normal.z() );
+        m_normals[4 * i + 3] = 0;
+        m_visibility[i] = unorm8( a.visibility );
+    }
+
+    void load( int i, CAttributes& a ) const
+    {
+        const quint32 color = m_colors.at( i );
+        a.color = QVector3D( float( color & 0xff ), float( ( color >> 8 ) & 0xff ), float( ( color >> 16 ) & 0xff ) ) / 255.0f;
+        a.normal = QVector3D( fromHalf( m_normals.at( 4 * i ) ), fromHalf( m_normals.at( 4 * i + 1 ) ),
+                              fromHalf( m_normals.at( 4 * i + 2 ) ) );
+        a.visibility = m_visibility.at( i ) / 255.0f;
+    }
+
+private:
+    static quint8 unorm8( float v ) { return quint8( qBound( 0.0f, v, 1.0f ) * 255.0f + 0.5f ); }
+
+    // IEEE half precision, enough for values in [-1, 1]
+    static quint16 toHalf( float v )
+    {
+        quint32 bits;
+        memcpy( &bits, &v, 4 );
+        const quint32 sign = ( bits >> 16 ) & 0x8000u;
+        const int exponent = int( ( bits >> 23 ) & 0xff ) - 127 + 15;
+        if ( exponent <= 0 )
+            return quint16( sign );
+        const quint32 mantissa = ( bits & 0x7fffffu ) + 0x1000u;
+        return quint16( sign | ( ( quint32( exponent ) << 10 ) + ( mantissa >> 13 ) ) );
+    }
+
+    static float fromHalf( quint16 h )
+    {
+        const quint32 sign = quint32( h & 0x8000u ) << 16;
+        const quint32 exponent = ( h >> 10 ) & 0x1f;
+        const quint32 bits = exponent == 0 ? sign : sign | ( ( exponent - 15 + 127 ) << 23 ) | ( quint32( h & 0x3ffu ) << 13 );
+        float v;
+        memcpy( &v, &bits, 4 );
+        return v;
+    }
+
+    QVector<quint32> m_colors;
+    QVector<quint16> m_normals;
+    QVector<quint8> m_visibility;
+};
+
+/**
+  Full precision: RGB32F colour, RGB32F normal and R32F occlusion.
+  */
+class CFloatLayout
+{
+public:
+    static const char* name() { return "RGB32F + RGB32F + R32F"; }
+    static int bytesPerVoxel() { return 28; }
+
+    void resize( int count ) { m_values.resize( 7 * count ); }
+
+    void store( int i, const CAttributes& a )
+    {
+        float* v = m_values.data() + 7 * i;
+        v[0] = a.color.x();  v[1] = a.color.y();  v[2] = a.color.z();
+        v[3] = a.normal.x(); v[4] = a.normal.y(); v[5] = a.normal.z();
+        v[6] = a.visibility;
+    }
+
+    void load( int i, CAttributes& a ) const
+    {
+        const float* v = m_values.constData() + 7 * i;
+        a.color = QVector3D( v[0], v[1], v[2] );
+        a.normal = QVector3D( v[3], v[4], v[5] );
+        a.visibility = v[6];
+    }
+
+private:
+    QVector<float> m_values;
+};
+
+#endif // C_ATTRIBUTE_LAYOUTS_H
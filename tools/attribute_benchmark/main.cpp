@@ -0,0 +1,136 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QTextStream>
+
+#include "c_attribute_layouts.h"
+
+namespace
+{
+    quint32
+    hash( quint32 x )
+    {
+        x = ( x ^ 61u ) ^ ( x >> 16 );
+        x *= 9u;
+        x ^= x >> 4;
+        x *= 0x27d4eb2du;
+        return x ^ ( x >> 15 );
+    }
+
+    float
+    unit( quint32 x )
+    {
+        return float( hash( x ) >> 8 ) / 16777216.0f;
+    }
+
+    // Reproducible attributes, so errors can be measured without keeping
+    // the originals around
+    CAttributes
+    reference( int i )
+    {
+        CAttributes a;
+        const quint32 seed = quint32( i ) * 8u;
+        a.color = QVector3D( unit( seed ), unit( seed + 1 ), unit( seed + 2 ) );
+        const float z = 2.0f * unit( seed + 3 ) - 1.0f;
+        const float phi = 6.2831853f * unit( seed + 4 );
+        const float r = sqrtf( qMax( 1.0f - z * z, 0.0f ) );
+        a.normal = QVector3D( r * cosf( phi ), r * sinf( phi ), z );
+        a.visibility = unit( seed + 5 );
+        return a;
+    }
+
+    template<class Layout>
+    void
+    measure( int voxels, int samples, QTextStream& out )
+    {
+        Layout layout;
+        layout.resize( voxels );
+
+        QElapsedTimer timer;
+        timer.start();
+        for ( int i = 0; i < voxels; ++i )
+            layout.store( i, reference( i ) );
+        const double encodeSeconds = timer.nsecsElapsed() / 1.0e9;
+
+        // Accuracy over a subset
+        float colorError = 0.0f;
+        float normalError = 0.0f;
+        const int step = qMax( voxels / 100000, 1 );
+        for ( int i = 0; i < voxels; i += step )
+        {
+            const CAttributes expected = reference( i );
+            CAttributes a;
+            layout.load( i, a );
+            const QVector3D dc = a.color - expected.color;
+            colorError = qMax( colorError, qMax( qMax( fabsf( dc.x() ), fabsf( dc.y() ) ), fabsf( dc.z() ) ) );
+            const float cosine = QVector3D::dotProduct( a.normal.normalized(), expected.normal );
+            normalError = qMax( normalError, acosf( qBound( -1.0f, cosine, 1.0f ) ) * 57.2957795f );
+        }
+
+        // Sequential and scattered reads, like coherent and incoherent rays
+        float checksum = 0.0f;
+        timer.restart();
+        for ( int s = 0; s < samples; ++s )
+        {
+            CAttributes a;
+            layout.load( s % voxels, a );
+            checksum += a.color.x() + a.normal.y() + a.visibility;
+        }
+        const double sequentialSeconds = timer.nsecsElapsed() / 1.0e9;
+
+        quint32 seed = 1u;
+        timer.restart();
+        for ( int s = 0; s < samples; ++s )
+        {
+            seed = seed * 1664525u + 1013904223u;
+            CAttributes a;
+            layout.load( int( ( seed >> 4 ) % quint32( voxels ) ), a );
+            checksum += a.color.x() + a.normal.y() + a.visibility;
+        }
+        const double randomSeconds = timer.nsecsElapsed() / 1.0e9;
+
+        out << QString( "%1 %2 %3 %4 %5 %6 %7 %8\n" )
+               .arg( Layout::name(), -24 )
+               .arg( Layout::bytesPerVoxel(), 6 )
+               .arg( double( voxels ) * Layout::bytesPerVoxel() / ( 1024.0 * 1024.0 ), 9, 'f', 1 )
+               .arg( voxels / encodeSeconds / 1.0e6, 10, 'f', 1 )
+               .arg( samples / sequentialSeconds / 1.0e6, 10, 'f', 1 )
+               .arg( samples / randomSeconds / 1.0e6, 10, 'f', 1 )
+               .arg( colorError, 9, 'f', 4 )
+               .arg( normalError, 9, 'f', 3 );
+        out.flush();
+
+        // Printing the checksum keeps the loads from being optimised away
+        if ( checksum == -1.0f )
+            out << checksum;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription( "Compares packed voxel attributes with naive layouts." );
+    parser.addHelpOption();
+
+    // The default is a quarter of the brick pool
+    QCommandLineOption voxelOption( "voxels", "Voxels per layout", "count", "8192000" );
+    QCommandLineOption sampleOption( "samples", "Reads per access pattern", "count", "20000000" );
+    parser.addOption( voxelOption );
+    parser.addOption( sampleOption );
+    parser.process( a );
+
+    const int voxels = qMax( parser.value( voxelOption ).toInt(), 1 );
+    const int samples = qMax( parser.value( sampleOption ).toInt(), 1 );
+
+    QTextStream out( stdout );
+    out << QString( "%1 %2 %3 %4 %5 %6 %7 %8\n" )
+           .arg( "layout", -24 ).arg( "B/vox", 6 ).arg( "MB", 9 ).arg( "Menc/s", 10 )
+           .arg( "Mseq/s", 10 ).arg( "Mrand/s", 10 ).arg( "max col", 9 ).arg( "max deg", 9 );
+
+    measure<CPackedLayout>( voxels, samples, out );
+    measure<CHalfLayout>( voxels, samples, out );
+    measure<CFloatLayout>( voxels, samples, out );
+    return 0;
+}
@@ -0,0 +1,31 @@
+#-------------------------------------------------
+#
+# Stand-in out of process brick server that
+# generates the procedural terrain, see
+# c_brick_protocol.h
+#
+#-------------------------------------------------
+
+QT += network concurrent
+
+TARGET = brick_server
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../../voxels
+
+SOURCES += main.cpp \
+    c_brick_server.cpp \
+    ../../voxels/c_brick_producer.cpp \
+    ../../voxels/c_voxel_attributes.cpp \
+    ../../voxels/c_occupancy.cpp \
+    ../../voxels/c_brick_protocol.cpp
+
+HEADERS += \
+    c_brick_server.h \
+    ../../voxels/c_content_hash.h \
+    ../../voxels/c_brick_producer.h \
+    ../../voxels/c_voxel_attributes.h \
+    ../../voxels/c_occupancy.h \
+    ../../voxels/c_brick_protocol.h
@@ -0,0 +1,212 @@
+#include "c_brick_server.h"
+
+#include <QDebug>
+#include <QLocalSocket>
+#include <QThread>
+#include <QtConcurrentMap>
+
+#include <string.h>
+
+namespace
+{
+    const quint32 slotBytes = VoxelConfig::storedBrickVoxels * sizeof( CBrick::Voxel );
+
+    // Bricks produced in one go; more wait for the next round
+    const int maxBatch = 256;
+
+    class CProduceBrick
+    {
+    public:
+        CProduceBrick( const CBrickProducer* producer, int latency )
+            : m_producer( producer ),
+              m_latency( latency )
+        {
+        }
+
+        template <class T>
+        void operator()( T& item ) const
+        {
+            if ( m_latency > 0 )
+                QThread::usleep( m_latency );
+            m_producer->produce( item.brick );
+        }
+
+    private:
+        const CBrickProducer* m_producer;
+        int m_latency;
+    };
+}
+
+//------------------------------------------------------------------------------
+CBrickServer::CBrickServer()
+    : m_slotCount( 1024 ),
+      m_latency( 0 )
+{
+}
+
+//------------------------------------------------------------------------------
+bool
+CBrickServer::listen( const QString& name )
+{
+    // Segments and sockets left behind by a crashed server are reclaimed
+    m_ring.setKey( name + ".ring" );
+    const int size = m_slotCount * slotBytes;
+    if ( !m_ring.create( size ) && m_ring.error() == QSharedMemory::AlreadyExists )
+    {
+        if ( m_ring.attach() )
+            m_ring.detach();
+        m_ring.create( size );
+    }
+    if ( !m_ring.isAttached() )
+    {
+        m_error = "Could not create the brick ring: " + m_ring.errorString();
+        return false;
+    }
+
+    QLocalServer::removeServer( name );
+    if ( !m_server.listen( name ) )
+    {
+        m_error = "Could not listen on " + name + ": " + m_server.errorString();
+        return false;
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void
+CBrickServer::serve()
+{
+    while ( true )
+    {
+        if ( !m_server.waitForNewConnection( -1 ) )
+            continue;
+
+        QLocalSocket* socket = m_server.nextPendingConnection();
+        if ( !socket )
+            continue;
+
+        qDebug() << "Viewer connected";
+        serveClient( socket );
+        qDebug() << "Viewer disconnected";
+        delete socket;
+    }
+}
+
+//------------------------------------------------------------------------------
+void
+CBrickServer::serveClient( QLocalSocket* socket )
+{
+    m_freeSlots.clear();
+    for ( int i = 0; i < m_slotCount; ++i )
+        m_freeSlots.enqueue( quint32( i ) );
+    m_queued.clear();
+    m_held.clear();
+
+    BrickProtocol::CHello hello;
+    hello.slotCount = quint32( m_slotCount );
+    hello.slotBytes = slotBytes;
+    hello.maxLevel = quint32( m_producer.maxLevel() );
+    hello.ringKey = m_ring.key();
+    if ( !BrickProtocol::write( socket, BrickProtocol::encode( hello ) ) )
+        return;
+    socket->flush();
+
+    QByteArray received;
+    while ( socket->state() == QLocalSocket::ConnectedState )
+    {
+        // Only wait when nothing can be produced before the viewer answers
+        const bool idle = m_queued.isEmpty() || m_freeSlots.size() <= m_held.size();
+        if ( socket->bytesAvailable() > 0 || socket->waitForReadyRead( idle ? 100 : 0 ) )
+            received += socket->readAll();
+
+        QByteArray body;
+        while ( BrickProtocol::take( received, &body ) )
+        {
+            if ( !receive( body ) )
+            {
+                qWarning() << "Malformed request, dropping the viewer";
+                return;
+            }
+        }
+
+        produce();
+        const QVector<BrickProtocol::CReply> replies = place();
+        if ( !replies.isEmpty() )
+        {
+            if ( !BrickProtocol::write( socket, BrickProtocol::encode( replies ) ) )
+                return;
+            socket->flush();
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+bool
+CBrickServer::receive( const QByteArray& body )
+{
+    BrickProtocol::CRequest request;
+    if ( !BrickProtocol::decode( body, &request ) )
+        return false;
+
+    for ( int i = 0; i < request.released.size(); ++i )
+    {
+        if ( request.released.at( i ) < quint32( m_slotCount ) )
+            m_freeSlots.enqueue( request.released.at( i ) );
+    }
+
+    for ( int i = 0; i < request.keys.size(); ++i )
+    {
+        CServerBrick item;
+        item.id = request.ids.at( i );
+        item.brick.key = request.keys.at( i );
+        m_queued.append( item );
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void
+CBrickServer::produce()
+{
+    if ( m_queued.isEmpty() )
+        return;
+
+    // Nothing is produced ahead of free slots, the viewer has to catch up first
+    const int count = qMin( qMin( m_queued.size(), maxBatch ), qMax( m_freeSlots.size() - m_held.size(), 0 ) );
+    if ( count == 0 )
+        return;
+
+    QVector<CServerBrick> batch = m_queued.mid( 0, count );
+    m_queued.remove( 0, count );
+    QtConcurrent::blockingMap( batch, CProduceBrick( &m_producer, m_latency ) );
+    for ( int i = 0; i < batch.size(); ++i )
+        m_held.enqueue( batch.at( i ) );
+}
+
+//------------------------------------------------------------------------------
+QVector<BrickProtocol::CReply>
+CBrickServer::place()
+{
+    QVector<BrickProtocol::CReply> replies;
+    char* ring = static_cast<char*>( m_ring.data() );
+    while ( !m_held.isEmpty() )
+    {
+        const CBrick& brick = m_held.head().brick;
+        BrickProtocol::CReply reply;
+        reply.id = m_held.head().id;
+        reply.constant = brick.constant;
+        reply.value = brick.value;
+        if ( !brick.constant )
+        {
+            if ( m_freeSlots.isEmpty() )
+                break;
+            reply.slot = qint32( m_freeSlots.dequeue() );
+            memcpy( ring + qint64( reply.slot ) * slotBytes, brick.voxels.constData(), slotBytes );
+        }
+        replies.append( reply );
+        m_held.dequeue();
+    }
+    return replies;
+}
+
+//------------------------------------------------------------------------------
@@ -0,0 +1,64 @@
+#ifndef C_BRICK_SERVER_H
+#define C_BRICK_SERVER_H
+
+#include "c_brick_producer.h"
+#include "c_brick_protocol.h"
+
+#include <QLocalServer>
+#include <QSharedMemory>
+#include <QQueue>
+#include <QString>
+#include <QVector>
+
+class QLocalSocket;
+
+/**
+  Serves procedural bricks to one viewer at a time over a local socket,
+  with the payloads in a shared memory ring. A configurable delay per
+  brick stands in for an expensive simulation or decoder, so batching
+  and latency hiding in the viewer can be measured without one.
+
+  Produced bricks that find no free ring slot are held back until the
+  viewer releases slots.
+  */
+class CBrickServer
+{
+public:
+    CBrickServer();
+
+    void setSlotCount( int count ) { m_slotCount = qMax( count, 1 ); }
+    void setLatency( int microseconds ) { m_latency = qMax( microseconds, 0 ); }
+
+    bool listen( const QString& name );
+
+    // Accepts viewers one after the other, never returns
+    void serve();
+
+    QString errorString() const { return m_error; }
+
+private:
+    class CServerBrick
+    {
+    public:
+        quint32 id;
+        CBrick brick;
+    };
+
+    void serveClient( QLocalSocket* socket );
+    bool receive( const QByteArray& body );
+    void produce();
+    QVector<BrickProtocol::CReply> place();
+
+    CProceduralBrickProducer m_producer;
+    QLocalServer m_server;
+    QSharedMemory m_ring;
+    int m_slotCount;
+    int m_latency;
+    QString m_error;
+
+    QQueue<quint32> m_freeSlots;
+    QVector<CServerBrick> m_queued;
+    QQueue<CServerBrick> m_held;
+};
+
+#endif // C_BRICK_SERVER_H
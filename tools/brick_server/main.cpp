@@ -0,0 +1,43 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QTextStream>
+#include <QThreadPool>
+
+#include "c_brick_server.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription( "Serves procedural bricks to gigavoxels --brick-server." );
+    parser.addHelpOption();
+
+    QCommandLineOption nameOption( "name", "Local socket name", "name", "gigavoxels-bricks" );
+    QCommandLineOption slotsOption( "slots", "Bricks the shared ring holds", "count", "1024" );
+    QCommandLineOption latencyOption( "latency", "Simulated production time per brick", "microseconds", "0" );
+    QCommandLineOption threadsOption( "threads", "Production threads, 0 for one per core", "count", "0" );
+    parser.addOption( nameOption );
+    parser.addOption( slotsOption );
+    parser.addOption( latencyOption );
+    parser.addOption( threadsOption );
+    parser.process( a );
+
+    if ( parser.value( threadsOption ).toInt() > 0 )
+        QThreadPool::globalInstance()->setMaxThreadCount( parser.value( threadsOption ).toInt() );
+
+    CBrickServer server;
+    server.setSlotCount( parser.value( slotsOption ).toInt() );
+    server.setLatency( parser.value( latencyOption ).toInt() );
+
+    QTextStream out( stdout );
+    if ( !server.listen( parser.value( nameOption ) ) )
+    {
+        QTextStream( stderr ) << server.errorString() << endl;
+        return 1;
+    }
+    out << "Serving bricks on " << parser.value( nameOption ) << endl;
+
+    server.serve();
+    return 0;
+}
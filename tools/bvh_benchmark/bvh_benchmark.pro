@@ -0,0 +1,21 @@
+#-------------------------------------------------
+#
+# Build, refit and traversal timings of the instance BVH
+#
+#-------------------------------------------------
+
+QT -= gui
+QT += concurrent
+
+TARGET = bvh_benchmark
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../../voxels
+
+SOURCES += main.cpp \
+    ../../voxels/c_instance_bvh.cpp
+
+HEADERS += \
+    ../../voxels/c_instance_bvh.h
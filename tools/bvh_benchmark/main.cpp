@@ -0,0 +1,203 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QTextStream>
+#include <QThreadPool>
+
+#include "c_instance_bvh.h"
+
+#include <limits.h>
+
+namespace
+{
+    class CRandom
+    {
+    public:
+        explicit CRandom( quint32 seed ) : m_state( seed ) {}
+
+        float next()
+        {
+            m_state = m_state * 1664525u + 1013904223u;
+            return float( m_state >> 8 ) / 16777216.0f;
+        }
+
+        QVector3D nextVector() { return QVector3D( next(), next(), next() ); }
+
+    private:
+        quint32 m_state;
+    };
+
+    // Instances at constant density, half of them spread out and half
+    // packed into clusters, with sizes varying by a factor of eight like
+    // scattered props would
+    QVector<CBounds>
+    scene( int count, float* extent )
+    {
+        CRandom random( quint32( count ) * 2654435761u );
+        *extent = 20.0f * powf( float( count ), 1.0f / 3.0f );
+
+        QVector<QVector3D> clusters;
+        for ( int i = 0; i < 64; ++i )
+            clusters.append( random.nextVector() * *extent );
+
+        QVector<CBounds> bounds( count );
+        for ( int i = 0; i < count; ++i )
+        {
+            QVector3D center = random.nextVector() * *extent;
+            if ( i & 1 )
+            {
+                const QVector3D spread = random.nextVector() - QVector3D( 0.5f, 0.5f, 0.5f );
+                center = clusters.at( i / 2 % clusters.size() ) + spread * 0.1f * *extent;
+            }
+            const float size = 1.0f + 7.0f * random.next() * random.next();
+            const QVector3D half = 0.5f * size * QVector3D( 1.0f, 1.0f, 1.0f );
+            bounds[i] = CBounds( center - half, center + half );
+        }
+        return bounds;
+    }
+
+    double
+    milliseconds( const QElapsedTimer& timer )
+    {
+        return timer.nsecsElapsed() / 1.0e6;
+    }
+
+    void
+    measure( int count, int rays, QTextStream& out )
+    {
+        float extent = 0.0f;
+        QVector<CBounds> bounds = scene( count, &extent );
+
+        CInstanceBvh bvh;
+        QElapsedTimer timer;
+
+        bvh.setParallelThreshold( INT_MAX );
+        timer.start();
+        bvh.build( bounds );
+        const double serialBuild = milliseconds( timer );
+
+        bvh.setParallelThreshold( 4096 );
+        timer.restart();
+        bvh.build( bounds );
+        const double parallelBuild = milliseconds( timer );
+
+        // Move a few instances, then all of them
+        CRandom random( 7u );
+        const int few = qMax( count / 100, 1 );
+        timer.restart();
+        for ( int i = 0; i < few; ++i )
+        {
+            const int instance = int( random.next() * count ) % count;
+            const QVector3D offset = random.nextVector() - QVector3D( 0.5f, 0.5f, 0.5f );
+            bounds[instance] = CBounds( bounds.at( instance ).min + offset, bounds.at( instance ).max + offset );
+            bvh.setBounds( instance, bounds.at( instance ) );
+        }
+        bvh.refit();
+        const double fewRefit = milliseconds( timer );
+
+        timer.restart();
+        for ( int i = 0; i < count; ++i )
+        {
+            const QVector3D offset = random.nextVector() - QVector3D( 0.5f, 0.5f, 0.5f );
+            bounds[i] = CBounds( bounds.at( i ).min + offset, bounds.at( i ).max + offset );
+            bvh.setBounds( i, bounds.at( i ) );
+        }
+        bvh.refit();
+        const double allRefit = milliseconds( timer );
+
+        // Rays from inside the scene in all directions, each limited to a
+        // fifth of the scene like a view distance would
+        const float tMax = 0.2f * extent;
+        QVector<QVector3D> origins( rays );
+        QVector<QVector3D> directions( rays );
+        for ( int r = 0; r < rays; ++r )
+        {
+            origins[r] = random.nextVector() * extent;
+            directions[r] = ( random.nextVector() - QVector3D( 0.5f, 0.5f, 0.5f ) ).normalized();
+        }
+
+        QVector<int> hits;
+        qint64 visited = 0;
+        qint64 hitCount = 0;
+        timer.restart();
+        for ( int r = 0; r < rays; ++r )
+        {
+            hits.clear();
+            visited += bvh.intersect( origins.at( r ), directions.at( r ), tMax, &hits );
+            hitCount += hits.size();
+        }
+        const double traceSeconds = timer.nsecsElapsed() / 1.0e9;
+
+        // Testing every instance, on a subset of the rays, as the baseline
+        // and to check that the hierarchy misses nothing
+        const int bruteRays = qMax( qMin( rays, int( 2.0e8 / count ) ), 1 );
+        qint64 bruteHits = 0;
+        qint64 bvhHits = 0;
+        timer.restart();
+        for ( int r = 0; r < bruteRays; ++r )
+        {
+            const QVector3D d = directions.at( r );
+            const QVector3D invDir( 1.0f / d.x(), 1.0f / d.y(), 1.0f / d.z() );
+            for ( int i = 0; i < count; ++i )
+            {
+                if ( bounds.at( i ).intersect( origins.at( r ), invDir, tMax ) != FLT_MAX )
+                    ++bruteHits;
+            }
+        }
+        const double bruteSeconds = timer.nsecsElapsed() / 1.0e9;
+        for ( int r = 0; r < bruteRays; ++r )
+        {
+            hits.clear();
+            bvh.intersect( origins.at( r ), directions.at( r ), tMax, &hits );
+            bvhHits += hits.size();
+        }
+
+        out << QString( "%1 %2 %3 %4 %5 %6 %7 %8 %9 %10 %11\n" )
+               .arg( count, 9 )
+               .arg( bvh.nodeCount(), 9 )
+               .arg( serialBuild, 10, 'f', 2 )
+               .arg( parallelBuild, 10, 'f', 2 )
+               .arg( fewRefit, 9, 'f', 3 )
+               .arg( allRefit, 9, 'f', 2 )
+               .arg( rays / traceSeconds / 1.0e6, 8, 'f', 3 )
+               .arg( double( visited ) / rays, 8, 'f', 1 )
+               .arg( double( hitCount ) / rays, 7, 'f', 2 )
+               .arg( bruteRays / bruteSeconds / 1.0e6, 9, 'f', 4 )
+               .arg( bvhHits == bruteHits ? "ok" : "MISMATCH", 6 );
+        out.flush();
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription( "Build, refit and traversal timings of the instance BVH." );
+    parser.addHelpOption();
+
+    QCommandLineOption countOption( "instances", "Comma separated scene sizes", "counts", "10000,100000,1000000" );
+    QCommandLineOption rayOption( "rays", "Rays traced per scene", "count", "200000" );
+    parser.addOption( countOption );
+    parser.addOption( rayOption );
+    parser.process( a );
+
+    const int rays = qMax( parser.value( rayOption ).toInt(), 1 );
+    const QStringList counts = parser.value( countOption ).split( ',' );
+
+    QTextStream out( stdout );
+    out << "Build times in ms on " << QThreadPool::globalInstance()->maxThreadCount() << " threads\n";
+    out << QString( "%1 %2 %3 %4 %5 %6 %7 %8 %9 %10 %11\n" )
+           .arg( "instances", 9 ).arg( "nodes", 9 ).arg( "serial", 10 ).arg( "parallel", 10 )
+           .arg( "refit 1%", 9 ).arg( "refit all", 9 ).arg( "Mrays/s", 8 ).arg( "nodes/r", 8 )
+           .arg( "hits/r", 7 ).arg( "brute M/s", 9 ).arg( "check", 6 );
+
+    for ( int i = 0; i < counts.size(); ++i )
+    {
+        const int count = counts.at( i ).toInt();
+        if ( count > 0 )
+            measure( count, rays, out );
+    }
+    return 0;
+}
@@ -0,0 +1,27 @@
+#-------------------------------------------------
+#
+# Measures brick read throughput of a brick file
+# with the io_uring and the thread pool backends
+#
+#-------------------------------------------------
+
+QT -= gui
+QT += concurrent
+
+TARGET = io_benchmark
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../../voxels
+
+SOURCES += main.cpp \
+    ../../voxels/c_stats.cpp \
+    ../../voxels/c_async_file_reader.cpp \
+    ../../voxels/c_brick_file.cpp
+
+HEADERS += \
+    ../../voxels/c_stats.h \
+    ../../voxels/c_content_hash.h \
+    ../../voxels/c_async_file_reader.h \
+    ../../voxels/c_brick_file.h
@@ -0,0 +1,167 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QThreadPool>
+#include <QtConcurrentMap>
+
+#include <algorithm>
+#include <stdlib.h>
+
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "c_brick_file.h"
+#include "c_stats.h"
+
+namespace
+{
+    typedef QPair<quint64, CNodeKey> StoredBrick;
+
+    bool
+    lowerOffset( const StoredBrick& a, const StoredBrick& b )
+    {
+        return a.first < b.first;
+    }
+
+    class CReadBrick
+    {
+    public:
+        CReadBrick( CBrickFileReader* reader, QAtomicInt* failures )
+            : m_reader( reader ),
+              m_failures( failures )
+        {
+        }
+
+        void operator()( const CNodeKey& key ) const
+        {
+            CBrick brick( key );
+            if ( !m_reader->read( brick ) )
+                m_failures->ref();
+        }
+
+    private:
+        CBrickFileReader* m_reader;
+        QAtomicInt* m_failures;
+    };
+
+    // Evicts the file from the page cache, so the reads go to the device
+    bool
+    dropCache( const QString& fileName )
+    {
+#ifdef Q_OS_LINUX
+        const int fd = ::open( QFile::encodeName( fileName ).constData(), O_RDONLY );
+        if ( fd < 0 )
+            return false;
+        const bool ok = posix_fadvise( fd, 0, 0, POSIX_FADV_DONTNEED ) == 0;
+        ::close( fd );
+        return ok;
+#else
+        Q_UNUSED( fileName );
+        return false;
+#endif
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription( "Reads every brick of a brick file and reports the throughput." );
+    parser.addHelpOption();
+    parser.addPositionalArgument( "file", "Brick file written by voxel_converter" );
+
+    QCommandLineOption backendOption( "backend", "io_uring, threads or both", "backend", "both" );
+    QCommandLineOption threadsOption( "threads", "Threads waiting for bricks, like the scheduler's workers", "count", "64" );
+    QCommandLineOption depthOption( "depth", "Reads kept in flight", "count", "64" );
+    QCommandLineOption coalesceOption( "coalesce", "Largest merged read", "kilobytes", "1024" );
+    QCommandLineOption randomOption( "random", "Request the bricks in random instead of file order" );
+    QCommandLineOption coldOption( "cold", "Evict the file from the page cache before each run" );
+    parser.addOption( backendOption );
+    parser.addOption( threadsOption );
+    parser.addOption( depthOption );
+    parser.addOption( coalesceOption );
+    parser.addOption( randomOption );
+    parser.addOption( coldOption );
+    parser.process( a );
+
+    QTextStream out( stdout );
+    const QStringList files = parser.positionalArguments();
+    if ( files.size() != 1 )
+        parser.showHelp( 1 );
+    const QString fileName = files.first();
+
+    QList<CAsyncFileReader::Backend> backends;
+    const QString backend = parser.value( backendOption );
+    if ( backend == "io_uring" || backend == "both" )
+        backends << CAsyncFileReader::IoUring;
+    if ( backend == "threads" || backend == "both" )
+        backends << CAsyncFileReader::ThreadPool;
+    if ( backends.isEmpty() )
+        parser.showHelp( 1 );
+
+    QThreadPool::globalInstance()->setMaxThreadCount( qMax( parser.value( threadsOption ).toInt(), 1 ) );
+    CStatsCounter* reads = CStats::instance().counter( "io.reads" );
+    CStatsCounter* requests = CStats::instance().counter( "io.requests" );
+    CStatsCounter* bytes = CStats::instance().counter( "io.bytes" );
+
+    for ( int b = 0; b < backends.size(); ++b )
+    {
+        CBrickFileReader reader;
+        reader.setQueueDepth( parser.value( depthOption ).toInt() );
+        reader.setMaxCoalescedBytes( parser.value( coalesceOption ).toInt() * 1024 );
+        if ( !reader.open( fileName, backends.at( b ) ) )
+        {
+            out << CAsyncFileReader::backendName( backends.at( b ) ) << ": not available" << endl;
+            continue;
+        }
+
+        // File order is the order the converter wrote them in
+        QVector<StoredBrick> stored;
+        QHash<CNodeKey, CBrickFileEntry>::const_iterator it = reader.index().constBegin();
+        for ( ; it != reader.index().constEnd(); ++it )
+        {
+            if ( !it.value().constant )
+                stored.append( qMakePair( it.value().offset, it.key() ) );
+        }
+        std::sort( stored.begin(), stored.end(), lowerOffset );
+        if ( parser.isSet( randomOption ) )
+        {
+            srand( 1 );
+            std::random_shuffle( stored.begin(), stored.end() );
+        }
+
+        QVector<CNodeKey> keys;
+        keys.reserve( stored.size() );
+        for ( int i = 0; i < stored.size(); ++i )
+            keys.append( stored.at( i ).second );
+
+        if ( parser.isSet( coldOption ) && !dropCache( fileName ) )
+            out << "Could not evict the page cache, the run may be warm" << endl;
+
+        const qint64 reads0 = reads->value();
+        const qint64 requests0 = requests->value();
+        const qint64 bytes0 = bytes->value();
+        QAtomicInt failures( 0 );
+        QElapsedTimer timer;
+        timer.start();
+        QtConcurrent::blockingMap( keys, CReadBrick( &reader, &failures ) );
+        const double seconds = qMax( timer.nsecsElapsed() / 1.0e9, 1.0e-9 );
+
+        const qint64 n = requests->value() - requests0;
+        const qint64 merged = reads->value() - reads0;
+        const double megabytes = ( bytes->value() - bytes0 ) / ( 1024.0 * 1024.0 );
+        out << CAsyncFileReader::backendName( reader.backend() ) << ": "
+            << n << " bricks in " << seconds << " s, "
+            << megabytes / seconds << " MB/s, "
+            << n / seconds << " bricks/s, "
+            << ( merged > 0 ? double( n ) / merged : 0.0 ) << " bricks per read";
+        if ( failures.load() > 0 )
+            out << ", " << failures.load() << " failed";
+        out << endl;
+    }
+    return 0;
+}
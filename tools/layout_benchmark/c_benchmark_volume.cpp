@@ -0,0 +1,106 @@
+#include "c_benchmark_volume.h"
+
+#include <QFile>
+
+#include <math.h>
+
+//------------------------------------------------------------------------------
+CBenchmarkVolume::CBenchmarkVolume()
+{
+    dimensions[0] = dimensions[1] = dimensions[2] = 0;
+}
+
+//------------------------------------------------------------------------------
+bool
+CBenchmarkVolume::load( const QString& fileName, int x, int y, int z )
+{
+    QFile file( fileName );
+    if ( !file.open( QIODevice::ReadOnly ) )
+        return false;
+
+    dimensions[0] = x;
+    dimensions[1] = y;
+    dimensions[2] = z;
+    voxels.resize( x * y * z );
+    const qint64 size = voxels.size();
+    return file.read( reinterpret_cast<char*>( voxels.data() ), size ) == size;
+}
+
+//------------------------------------------------------------------------------
+void
+CBenchmarkVolume::generate( int size )
+{
+    dimensions[0] = dimensions[1] = dimensions[2] = size;
+    voxels.resize( size * size * size );
+
+    // A few octaves of waves, filled below the surface
+    QVector<float> heights( size * size );
+    for ( int z = 0; z < size; ++z )
+    {
+        for ( int x = 0; x < size; ++x )
+        {
+            const float u = float( x ) / size;
+            const float v = float( z ) / size;
+            float h = 0.3f;
+            float amplitude = 0.1f;
+            for ( int octave = 1; octave <= 5; ++octave )
+            {
+                const float f = 3.0f * float( 1 << octave );
+                h += amplitude * sinf( f * u + 1.7f * octave ) * cosf( f * v - 0.9f * octave );
+                amplitude *= 0.5f;
+            }
+            heights[z * size + x] = h * size;
+        }
+    }
+
+    quint8* out = voxels.data();
+    for ( int z = 0; z < size; ++z )
+    {
+        for ( int y = 0; y < size; ++y )
+        {
+            for ( int x = 0; x < size; ++x )
+            {
+                const float density = heights.at( z * size + x ) - float( y );
+                *out++ = quint8( qBound( 0.0f, density + 0.5f, 1.0f ) * 255.0f );
+            }
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+CBenchmarkVolume
+CBenchmarkVolume::downsampled( int factor ) const
+{
+    CBenchmarkVolume result;
+    for ( int axis = 0; axis < 3; ++axis )
+        result.dimensions[axis] = ( dimensions[axis] + factor - 1 ) / factor;
+    result.voxels.resize( result.dimensions[0] * result.dimensions[1] * result.dimensions[2] );
+
+    quint8* out = result.voxels.data();
+    for ( int z = 0; z < result.dimensions[2]; ++z )
+    {
+        for ( int y = 0; y < result.dimensions[1]; ++y )
+        {
+            for ( int x = 0; x < result.dimensions[0]; ++x )
+            {
+                int sum = 0;
+                int count = 0;
+                for ( int sz = z * factor; sz < qMin( ( z + 1 ) * factor, dimensions[2] ); ++sz )
+                    for ( int sy = y * factor; sy < qMin( ( y + 1 ) * factor, dimensions[1] ); ++sy )
+                        for ( int sx = x * factor; sx < qMin( ( x + 1 ) * factor, dimensions[0] ); ++sx, ++count )
+                            sum += voxels.at( ( sz * dimensions[1] + sy ) * dimensions[0] + sx );
+                *out++ = quint8( ( sum + count / 2 ) / count );
+            }
+        }
+    }
+    return result;
+}
+
+//------------------------------------------------------------------------------
+int
+CBenchmarkVolume::largestDimension() const
+{
+    return qMax( qMax( dimensions[0], dimensions[1] ), dimensions[2] );
+}
+
+//------------------------------------------------------------------------------
@@ -0,0 +1,38 @@
+#ifndef C_BENCHMARK_VOLUME_H
+#define C_BENCHMARK_VOLUME_H
+
+#include <QString>
+#include <QVector>
+
+/**
+  An 8 bit scalar volume held in memory, the input every layout is built
+  from.
+  */
+class CBenchmarkVolume
+{
+public:
+    CBenchmarkVolume();
+
+    bool load( const QString& fileName, int x, int y, int z );
+
+    // Terrain like test volume similar to the procedural producer
+    void generate( int size );
+
+    // Box filters by factor along each axis; samples past the edge are
+    // left out of the average
+    CBenchmarkVolume downsampled( int factor ) const;
+
+    quint8 at( int x, int y, int z ) const
+    {
+        if ( x < 0 || y < 0 || z < 0 || x >= dimensions[0] || y >= dimensions[1] || z >= dimensions[2] )
+            return 0;
+        return voxels.at( ( z * dimensions[1] + y ) * dimensions[0] + x );
+    }
+
+    int largestDimension() const;
+
+    int dimensions[3];
+    QVector<quint8> voxels;
+};
+
+#endif // C_BENCHMARK_VOLUME_H
@@ -0,0 +1,271 @@
+#ifndef C_LAYOUT_BENCHMARK_H
+#define C_LAYOUT_BENCHMARK_H
+
+#include "c_benchmark_volume.h"
+#include "c_voxel_layout.h"
+
+#include <QElapsedTimer>
+#include <QString>
+#include <QVector>
+
+class CLayoutResult
+{
+public:
+    QString name;
+    int depth;
+    int nodes;
+    int bricks;
+    qint64 memoryBytes;
+    double buildMilliseconds;
+    double nodesPerQuery;
+    double nanosecondsPerQuery;
+    double nanosecondsPerSample;
+
+    // Keeps the queries from being optimised away
+    quint64 checksum;
+};
+
+/**
+  Stores the voxels of Layout in 2x2x2 blocks of consecutive voxels, the
+  blocks in turn x fastest, then y, then z. The eight voxels of a trilinear
+  sample then share one or two cache lines at any alignment, where the
+  row order spreads them over four rows and two slices.
+  */
+template<class Layout>
+class CSwizzledLayout : public Layout
+{
+public:
+    Q_STATIC_ASSERT( Layout::storedEdge % 2 == 0 );
+
+    static int index( int i, int j, int k )
+    {
+        const int blocks = Layout::storedEdge / 2;
+        const int block = ( ( k >> 1 ) * blocks + ( j >> 1 ) ) * blocks + ( i >> 1 );
+        return block * 8 + ( k & 1 ) * 4 + ( j & 1 ) * 2 + ( i & 1 );
+    }
+};
+
+/**
+  Builds the sparse tree of one layout over a volume the same way the
+  converter and the procedural producer do, then measures point lookups
+  down to the finest level and trilinear samples along short rays through
+  its bricks. Nodes are stored like CGpuNode, with the children of a node
+  in consecutive records.
+  */
+template<class Layout>
+class CLayoutBenchmark
+{
+public:
+    typedef CBrickStorage<Layout> Brick;
+    typedef typename Layout::VoxelType Voxel;
+
+    CLayoutResult run( const CBenchmarkVolume& volume, int queries, const QString& name )
+    {
+        CLayoutResult result;
+        result.name = name;
+
+        QElapsedTimer timer;
+        timer.start();
+        build( volume );
+        result.buildMilliseconds = timer.nsecsElapsed() / 1.0e6;
+
+        result.depth = m_depth;
+        result.nodes = m_nodes.size();
+        result.bricks = m_bricks.size();
+        result.memoryBytes = qint64( m_nodes.size() ) * sizeof( Node ) + qint64( m_bricks.size() ) * Layout::storedBytes;
+
+        // Fixed seed so every layout answers the same queries
+        quint32 seed = 12345u;
+        quint64 visited = 0;
+        quint64 checksum = 0;
+        timer.restart();
+        for ( int q = 0; q < queries; ++q )
+        {
+            int p[3];
+            for ( int axis = 0; axis < 3; ++axis )
+            {
+                seed = seed * 1664525u + 1013904223u;
+                p[axis] = int( ( seed >> 8 ) % quint32( volume.dimensions[axis] ) );
+            }
+            checksum += lookup( p, visited );
+        }
+        result.nanosecondsPerQuery = double( timer.nsecsElapsed() ) / qMax( queries, 1 );
+        result.nodesPerQuery = double( visited ) / qMax( queries, 1 );
+
+        timer.restart();
+        const int samples = qMax( queries / 4, 1 );
+        checksum += march( samples, seed );
+        result.nanosecondsPerSample = double( timer.nsecsElapsed() ) / samples;
+        result.checksum = checksum;
+
+        m_nodes.clear();
+        m_bricks.clear();
+        m_levels.clear();
+        return result;
+    }
+
+private:
+    class Node
+    {
+    public:
+        qint32 firstChild;
+        qint32 brick;
+        quint32 value;
+    };
+
+    static Voxel widen( quint8 value )
+    {
+        return Voxel( value ) * Voxel( sizeof( Voxel ) == 1 ? 1 : 257 );
+    }
+
+    void build( const CBenchmarkVolume& volume )
+    {
+        m_depth = Layout::levelsFor( volume.largestDimension() );
+
+        // One volume per level, the root level first
+        m_levels.resize( m_depth + 1 );
+        m_levels[m_depth] = volume;
+        for ( int level = m_depth - 1; level >= 0; --level )
+            m_levels[level] = m_levels.at( level + 1 ).downsampled( Layout::branching );
+
+        // Extent of a node of each level, in voxels of the finest level
+        m_extent.resize( m_depth + 1 );
+        m_extent[m_depth] = Layout::edge;
+        for ( int level = m_depth - 1; level >= 0; --level )
+            m_extent[level] = m_extent.at( level + 1 ) * Layout::branching;
+
+        m_nodes.resize( 1 );
+        m_bricks.clear();
+        buildNode( 0, 0, 0, 0, 0 );
+    }
+
+    void buildNode( int index, int level, int x, int y, int z )
+    {
+        const CBenchmarkVolume& source = m_levels.at( level );
+        Brick brick;
+        brick.voxels.resize( Layout::storedVoxels );
+        Voxel* out = brick.voxels.data();
+        const int x0 = x * Layout::edge - Layout::border;
+        const int y0 = y * Layout::edge - Layout::border;
+        const int z0 = z * Layout::edge - Layout::border;
+        for ( int k = 0; k < Layout::storedEdge; ++k )
+            for ( int j = 0; j < Layout::storedEdge; ++j )
+                for ( int i = 0; i < Layout::storedEdge; ++i )
+                    out[Layout::index( i, j, k )] = widen( source.at( x0 + i, y0 + j, z0 + k ) );
+        brick.detectConstant();
+
+        m_nodes[index].firstChild = -1;
+        m_nodes[index].brick = -1;
+        m_nodes[index].value = brick.value;
+        if ( brick.constant )
+            return;
+
+        m_nodes[index].brick = m_bricks.size();
+        m_bricks.append( brick );
+        if ( level == m_depth )
+            return;
+
+        const int first = m_nodes.size();
+        m_nodes[index].firstChild = first;
+        m_nodes.resize( first + Layout::childCount );
+        for ( int k = 0; k < Layout::branching; ++k )
+            for ( int j = 0; j < Layout::branching; ++j )
+                for ( int i = 0; i < Layout::branching; ++i )
+                    buildNode( first + Layout::childIndex( i, j, k ), level + 1,
+                               x * Layout::branching + i, y * Layout::branching + j, z * Layout::branching + k );
+    }
+
+    quint32 lookup( const int p[3], quint64& visited ) const
+    {
+        int index = 0;
+        for ( int level = 0; ; ++level )
+        {
+            ++visited;
+            const Node& node = m_nodes.at( index );
+            if ( node.brick < 0 )
+                return node.value;
+
+            if ( node.firstChild < 0 )
+            {
+                // Sample the brick of the deepest node on the path
+                const int voxel = m_extent.at( level ) / Layout::edge;
+                const Voxel* voxels = m_bricks.at( node.brick ).voxels.constData();
+                return voxels[Layout::index( ( p[0] % m_extent.at( level ) ) / voxel + Layout::border,
+                                             ( p[1] % m_extent.at( level ) ) / voxel + Layout::border,
+                                             ( p[2] % m_extent.at( level ) ) / voxel + Layout::border )];
+            }
+
+            const int child = m_extent.at( level + 1 );
+            index = node.firstChild + Layout::childIndex( ( p[0] / child ) % Layout::branching,
+                                                          ( p[1] / child ) % Layout::branching,
+                                                          ( p[2] / child ) % Layout::branching );
+        }
+    }
+
+    // Marches rays of one brick edge through random bricks, half a voxel
+    // per step, and filters eight voxels per step like the texture units
+    quint64 march( int samples, quint32& seed ) const
+    {
+        if ( m_bricks.isEmpty() )
+            return 0;
+
+        const float lo = float( Layout::border );
+        const float hi = float( Layout::border + Layout::edge ) - 1.001f;
+        const int steps = 2 * Layout::edge;
+        quint64 checksum = 0;
+        for ( int done = 0; done < samples; done += steps )
+        {
+            seed = seed * 1664525u + 1013904223u;
+            const Voxel* voxels = m_bricks.at( int( ( seed >> 8 ) % quint32( m_bricks.size() ) ) ).voxels.constData();
+
+            // From a random voxel towards a random direction, reflected at
+            // the sides of the brick
+            float p[3];
+            float d[3];
+            for ( int axis = 0; axis < 3; ++axis )
+            {
+                seed = seed * 1664525u + 1013904223u;
+                p[axis] = lo + ( hi - lo ) * float( seed >> 8 ) / float( 1 << 24 );
+                seed = seed * 1664525u + 1013904223u;
+                d[axis] = 0.5f * ( float( seed >> 8 ) / float( 1 << 23 ) - 1.0f );
+            }
+
+            for ( int s = 0; s < steps; ++s )
+            {
+                const int i = int( p[0] );
+                const int j = int( p[1] );
+                const int k = int( p[2] );
+                const float fx = p[0] - i;
+                const float fy = p[1] - j;
+                const float fz = p[2] - k;
+                float c[2];
+                for ( int dk = 0; dk < 2; ++dk )
+                {
+                    const float c0 = voxels[Layout::index( i, j, k + dk )] * ( 1.0f - fx ) + voxels[Layout::index( i + 1, j, k + dk )] * fx;
+                    const float c1 = voxels[Layout::index( i, j + 1, k + dk )] * ( 1.0f - fx ) + voxels[Layout::index( i + 1, j + 1, k + dk )] * fx;
+                    c[dk] = c0 * ( 1.0f - fy ) + c1 * fy;
+                }
+                checksum += quint64( c[0] * ( 1.0f - fz ) + c[1] * fz );
+
+                for ( int axis = 0; axis < 3; ++axis )
+                {
+                    p[axis] += d[axis];
+                    if ( p[axis] < lo || p[axis] > hi )
+                    {
+                        d[axis] = -d[axis];
+                        p[axis] = qBound( lo, p[axis], hi );
+                    }
+                }
+            }
+        }
+        return checksum;
+    }
+
+    int m_depth;
+    QVector<int> m_extent;
+    QVector<CBenchmarkVolume> m_levels;
+    QVector<Node> m_nodes;
+    QVector<Brick> m_bricks;
+};
+
+#endif // C_LAYOUT_BENCHMARK_H
@@ -0,0 +1,22 @@
+#-------------------------------------------------
+#
+# Compares voxel tree layouts on a dataset
+#
+#-------------------------------------------------
+
+QT -= gui
+
+TARGET = layout_benchmark
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../../voxels
+
+SOURCES += main.cpp \
+    c_benchmark_volume.cpp
+
+HEADERS += \
+    c_benchmark_volume.h \
+    c_layout_benchmark.h \
+    ../../voxels/c_voxel_layout.h
@@ -0,0 +1,114 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QTextStream>
+
+#include "c_layout_benchmark.h"
+
+namespace
+{
+    template<int Branching, int Edge, typename Voxel>
+    CLayoutResult
+    measure( const CBenchmarkVolume& volume, int queries )
+    {
+        typedef CVoxelLayout<Branching, Edge, 1, Voxel> Layout;
+        const QString name = QString( "%1^3 tree, %2^3 x %3 bit" )
+                             .arg( Branching ).arg( Edge ).arg( int( 8 * sizeof( Voxel ) ) );
+        return CLayoutBenchmark<Layout>().run( volume, queries, name );
+    }
+
+    // The same layout with its voxels in 2x2x2 blocks
+    template<int Branching, int Edge, typename Voxel>
+    CLayoutResult
+    measureSwizzled( const CBenchmarkVolume& volume, int queries )
+    {
+        typedef CSwizzledLayout< CVoxelLayout<Branching, Edge, 1, Voxel> > Layout;
+        const QString name = QString( "%1^3 tree, %2^3 x %3 bit, 2^3 z" )
+                             .arg( Branching ).arg( Edge ).arg( int( 8 * sizeof( Voxel ) ) );
+        return CLayoutBenchmark<Layout>().run( volume, queries, name );
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription( "Compares voxel tree layouts by memory, build time and lookup cost." );
+    parser.addHelpOption();
+    parser.addPositionalArgument( "volume", "Optional 8 bit raw volume, a generated terrain otherwise" );
+
+    QCommandLineOption sizeOption( "size", "Dimensions of the raw volume, or edge of the generated one", "XxYxZ", "256" );
+    QCommandLineOption queryOption( "queries", "Point lookups per layout", "count", "1000000" );
+    parser.addOption( sizeOption );
+    parser.addOption( queryOption );
+    parser.process( a );
+
+    QTextStream out( stdout );
+    CBenchmarkVolume volume;
+    const QStringList size = parser.value( sizeOption ).split( 'x' );
+    if ( parser.positionalArguments().isEmpty() )
+    {
+        volume.generate( size.at( 0 ).toInt() );
+    }
+    else if ( size.size() != 3
+           || !volume.load( parser.positionalArguments().at( 0 ),
+                            size.at( 0 ).toInt(), size.at( 1 ).toInt(), size.at( 2 ).toInt() ) )
+    {
+        out << "Could not load the volume, raw volumes need --size XxYxZ" << endl;
+        return 1;
+    }
+
+    const int queries = parser.value( queryOption ).toInt();
+
+    QVector<CLayoutResult> results;
+    results << measure<2, 8, quint8>( volume, queries )
+            << measure<2, 16, quint8>( volume, queries )
+            << measure<2, 32, quint8>( volume, queries )
+            << measure<4, 8, quint8>( volume, queries )
+            << measure<4, 16, quint8>( volume, queries )
+            << measure<4, 32, quint8>( volume, queries )
+            << measure<8, 8, quint8>( volume, queries )
+            << measure<8, 16, quint8>( volume, queries )
+            << measure<8, 32, quint8>( volume, queries )
+            << measure<2, 8, quint16>( volume, queries )
+            << measureSwizzled<2, 8, quint8>( volume, queries )
+            << measureSwizzled<2, 16, quint8>( volume, queries )
+            << measureSwizzled<2, 32, quint8>( volume, queries )
+            << measureSwizzled<2, 16, quint16>( volume, queries );
+
+    out << QString( "%1 %2 %3 %4 %5 %6 %7 %8 %9\n" )
+           .arg( "layout", -32 ).arg( "depth", 6 ).arg( "nodes", 10 ).arg( "bricks", 9 )
+           .arg( "memory MB", 10 ).arg( "build ms", 10 ).arg( "nodes/query", 12 ).arg( "ns/query", 9 )
+           .arg( "ns/sample", 10 );
+
+    int smallest = 0;
+    int fastestBuild = 0;
+    int fastestLookup = 0;
+    int fastestSample = 0;
+    for ( int i = 0; i < results.size(); ++i )
+    {
+        const CLayoutResult& r = results.at( i );
+        out << QString( "%1 %2 %3 %4 %5 %6 %7 %8 %9\n" )
+               .arg( r.name, -32 ).arg( r.depth, 6 ).arg( r.nodes, 10 ).arg( r.bricks, 9 )
+               .arg( r.memoryBytes / ( 1024.0 * 1024.0 ), 10, 'f', 2 )
+               .arg( r.buildMilliseconds, 10, 'f', 1 )
+               .arg( r.nodesPerQuery, 12, 'f', 2 )
+               .arg( r.nanosecondsPerQuery, 9, 'f', 1 )
+               .arg( r.nanosecondsPerSample, 10, 'f', 2 );
+
+        if ( r.memoryBytes < results.at( smallest ).memoryBytes )
+            smallest = i;
+        if ( r.buildMilliseconds < results.at( fastestBuild ).buildMilliseconds )
+            fastestBuild = i;
+        if ( r.nanosecondsPerQuery < results.at( fastestLookup ).nanosecondsPerQuery )
+            fastestLookup = i;
+        if ( r.nanosecondsPerSample < results.at( fastestSample ).nanosecondsPerSample )
+            fastestSample = i;
+    }
+
+    out << "\nSmallest:       " << results.at( smallest ).name
+        << "\nFastest build:  " << results.at( fastestBuild ).name
+        << "\nFastest lookup: " << results.at( fastestLookup ).name
+        << "\nFastest march:  " << results.at( fastestSample ).name << endl;
+    return 0;
+}
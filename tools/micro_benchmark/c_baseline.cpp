@@ -0,0 +1,52 @@
+#include "c_baseline.h"
+
+#include <QFile>
+#include <QStringList>
+#include <QTextStream>
+
+//------------------------------------------------------------------------------
+CBaseline::CBaseline()
+{
+}
+
+//------------------------------------------------------------------------------
+bool
+CBaseline::load( const QString& fileName )
+{
+    QFile file( fileName );
+    if ( !file.open( QIODevice::ReadOnly | QIODevice::Text ) )
+        return false;
+
+    QTextStream in( &file );
+    while ( !in.atEnd() )
+    {
+        const QString line = in.readLine().trimmed();
+        if ( line.isEmpty() || line.startsWith( '#' ) )
+            continue;
+
+        const QStringList fields = line.split( ' ', QString::SkipEmptyParts );
+        bool ok = false;
+        const double nanoseconds = fields.size() == 2 ? fields.at( 1 ).toDouble( &ok ) : 0.0;
+        if ( ok )
+            m_values.insert( fields.at( 0 ), nanoseconds );
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+bool
+CBaseline::save( const QString& fileName ) const
+{
+    QFile file( fileName );
+    if ( !file.open( QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text ) )
+        return false;
+
+    QTextStream out( &file );
+    out << "# case nanoseconds per iteration\n";
+    QMap<QString, double>::const_iterator it = m_values.constBegin();
+    for ( ; it != m_values.constEnd(); ++it )
+        out << it.key() << ' ' << QString::number( it.value(), 'f', 1 ) << '\n';
+    return true;
+}
+
+//------------------------------------------------------------------------------
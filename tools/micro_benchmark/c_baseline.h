@@ -0,0 +1,30 @@
+#ifndef C_BASELINE_H
+#define C_BASELINE_H
+
+#include <QMap>
+#include <QString>
+
+/**
+  Nanoseconds per iteration of each benchmark case, read from and written
+  to a text file with one "case nanoseconds" pair per line. Lines starting
+  with # are comments.
+  */
+class CBaseline
+{
+public:
+    CBaseline();
+
+    bool load( const QString& fileName );
+    bool save( const QString& fileName ) const;
+
+    bool contains( const QString& name ) const { return m_values.contains( name ); }
+    double value( const QString& name ) const { return m_values.value( name ); }
+    void setValue( const QString& name, double nanoseconds ) { m_values.insert( name, nanoseconds ); }
+
+    bool isEmpty() const { return m_values.isEmpty(); }
+
+private:
+    QMap<QString, double> m_values;
+};
+
+#endif // C_BASELINE_H
@@ -0,0 +1,582 @@
+#include <QGuiApplication>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLTexture>
+#include <QTemporaryDir>
+#include <QtTest>
+
+#include "c_baseline.h"
+#include "camera.h"
+#include "material.h"
+#include "c_block_compression.h"
+#include "c_brick_pool.h"
+#include "c_brick_producer.h"
+#include "c_brick_scheduler.h"
+#include "c_lod_traversal.h"
+#include "c_node_tree.h"
+#include "c_occupancy.h"
+#include "c_transfer_function.h"
+#include "c_view_info.h"
+#include "c_voxel_attributes.h"
+#include "c_volume_converter.h"
+
+#include <math.h>
+
+namespace
+{
+    // Set from the command line before the tests run
+    QString baselineFile( BASELINE_DIR "/reference.baseline" );
+    QString recordFile;
+    double threshold = 0.25;
+
+    // Shorter runs are QBENCHMARK still finding its iteration count
+    const qint64 minimumRunNanoseconds = 20000000;
+
+    const int volumeEdge = 64;
+
+    const char* vertexSource =
+        "#version 430\n"
+        "void main() { gl_Position = vec4( 0.0, 0.0, 0.0, 1.0 ); }\n";
+
+    const char* fragmentSource =
+        "#version 430\n"
+        "uniform sampler3D brick_pool;\n"
+        "uniform sampler3D color_pool;\n"
+        "uniform sampler3D normal_pool;\n"
+        "out vec4 color;\n"
+        "void main() { color = texture( brick_pool, vec3( 0.5 ) ) + texture( color_pool, vec3( 0.5 ) )\n"
+        "                    + texture( normal_pool, vec3( 0.5 ) ); }\n";
+}
+
+/**
+  Times the hot paths of the viewer with QBENCHMARK and fails a case that
+  got slower than its baseline by more than the threshold. Everything but
+  the material case runs on the CPU alone; without an OpenGL context that
+  case is skipped.
+  */
+class CMicroBenchmark : public QObject
+{
+    Q_OBJECT
+
+public:
+    CMicroBenchmark();
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void cameraMatrices();
+    void brickGeneration();
+    void attributePacking();
+    void volumeDownsampling();
+    void occupancyBuild();
+    void blockEncoding();
+    void transferTable();
+    void transferTableDrag();
+    void classification();
+    void traversal();
+    void traversalWithoutOccupancy();
+    void materialBind();
+
+private:
+    void buildTree( const CNodeKey& key );
+    void runTraversal( const char* name, bool occupancy );
+    void check( const char* name, qint64 nanoseconds, qint64 iterations );
+
+    CBaseline m_baseline;
+    CBaseline m_recorded;
+
+    CProceduralBrickProducer m_producer;
+    CBrick m_surfaceBrick;
+
+    CBrickPool m_pool;
+    CNodeTree m_tree;
+    CViewInfo m_view;
+
+    QTemporaryDir m_directory;
+    QString m_volumeFile;
+
+    QOffscreenSurface m_surface;
+    QOpenGLContext m_context;
+    bool m_hasContext;
+
+    // Keeps the measured work from being optimised away
+    volatile float m_sink;
+};
+
+//------------------------------------------------------------------------------
+CMicroBenchmark::CMicroBenchmark()
+    : m_hasContext( false ),
+      m_sink( 0.0f )
+{
+}
+
+//------------------------------------------------------------------------------
+void
+CMicroBenchmark::initTestCase()
+{
+    if ( recordFile.isEmpty() && !m_baseline.load( baselineFile ) )
+        QWARN( qPrintable( QString( "No baseline at %1, nothing can regress" ).arg( baselineFile ) ) );
+
+    // A brick the terrain surface passes through
+    for ( quint32 y = 0; y < 64 && m_surfaceBrick.voxels.isEmpty(); ++y )
+    {
+        m_surfaceBrick = CBrick( CNodeKey( 6, 32, y, 32 ) );
+        m_producer.produce( m_surfaceBrick );
+    }
+    QVERIFY( !m_surfaceBrick.constant );
+
+    // Standing on the terrain and looking across it
+    const QVector3D eye( 0.5f, 0.08f, 0.5f );
+    QMatrix4x4 projection;
+    projection.perspective( 25.0f, 16.0f / 9.0f, 0.0001f, 2.0f );
+    QMatrix4x4 view;
+    view.lookAt( eye, eye + QVector3D( 1.0f, -0.2f, 1.0f ), QVector3D( 0.0f, 1.0f, 0.0f ) );
+    m_view.eye = eye;
+    m_view.pixelScale = 768.0f / ( 2.0f * tanf( 12.5f * float( M_PI ) / 180.0f ) );
+    m_view.pixelError = 2.0f;
+    m_view.maxLevel = qMin( m_producer.maxLevel(), 8 );
+    m_view.setCulling( projection * view, QMatrix4x4() );
+
+    // The tree the viewer would hold for that view, with every brick resident
+    m_pool.create( NULL );
+    buildTree( CNodeKey() );
+    qDebug() << "Traversal tree of" << m_tree.nodeCount() << "nodes," << m_pool.usedSlotCount() << "bricks,"
+             << m_tree.nodeCount() * sizeof( quint64 ) / 1024.0 << "KB of occupancy words against"
+             << m_pool.usedSlotCount() * VoxelConfig::Layout::storedBytes / 1024.0 << "KB of densities";
+
+    // A sphere of rising density
+    QVERIFY( m_directory.isValid() );
+    QVector<quint8> volume( volumeEdge * volumeEdge * volumeEdge );
+    for ( int z = 0; z < volumeEdge; ++z )
+        for ( int y = 0; y < volumeEdge; ++y )
+            for ( int x = 0; x < volumeEdge; ++x )
+            {
+                const QVector3D p = QVector3D( x, y, z ) / ( volumeEdge - 1.0f ) - QVector3D( 0.5f, 0.5f, 0.5f );
+                volume[( z * volumeEdge + y ) * volumeEdge + x] = quint8( qBound( 0.0f, 1.0f - 2.0f * p.length(), 1.0f ) * 255.0f );
+            }
+    m_volumeFile = m_directory.filePath( "sphere.raw" );
+    QFile file( m_volumeFile );
+    QVERIFY( file.open( QIODevice::WriteOnly ) );
+    file.write( reinterpret_cast<const char*>( volume.constData() ), volume.size() );
+    file.close();
+
+    QSurfaceFormat format;
+    format.setMajorVersion( 4 );
+    format.setMinorVersion( 3 );
+    format.setProfile( QSurfaceFormat::CoreProfile );
+    m_surface.setFormat( format );
+    m_surface.create();
+    m_context.setFormat( format );
+    m_hasContext = m_context.create() && m_context.makeCurrent( &m_surface );
+}
+
+//------------------------------------------------------------------------------
+void
+CMicroBenchmark::cleanupTestCase()
+{
+    if ( !recordFile.isEmpty() )
+        QVERIFY2( m_recorded.save( recordFile ), qPrintable( "Could not write " + recordFile ) );
+}
+
+//------------------------------------------------------------------------------
+void
+CMicroBenchmark::cameraMatrices()
+{
+    Camera camera;
+    camera.setPerspectiveProjection( 25.0f, 16.0f / 9.0f, 0.1f, 10240.0f );
+    camera.setPosition( QVector3D( 0.0f, 100.0f, 0.0f ) );
+    camera.setViewCenter( QVector3D( 1.0f, 100.0f, 1.0f ) );
+    camera.setUpVector( QVector3D( 0.0f, 1.0f, 0.0f ) );
+
+    float sink = 0.0f;
+    qint64 iterations = 0;
+    QElapsedTimer timer;
+    timer.start();
+    QBENCHMARK
+    {
+        // Like a frame of the viewer: the camera moved and both matrices
+        // are needed again
+        camera.pan( 0.01f );
+        camera.setAspectRatio( iterations & 1 ? 1.77f : 1.78f );
+        const QMatrix4x4 viewProjection = camera.projectionMatrix() * camera.viewMatrix();
+        sink += viewProjection( 0, 0 );
+        ++iterations;
+    }
+    check( "cameraMatrices", timer.nsecsElapsed(), iterations );
+    m_sink = sink;
+}
+
+//------------------------------------------------------------------------------
+void
+CMicroBenchmark::brickGeneration()
+{
+    float sink = 0.0f;
+    qint64 iterations = 0;
+    QElapsedTimer timer;
+    timer.start();
+    QBENCHMARK
+    {
+        CBrick brick( m_surfaceBrick.key );
+        m_producer.produce( brick );
+        sink += brick.voxels.size();
+        ++iterations;
+    }
+    check( "brickGeneration", timer.nsecsElapsed(), iterations );
+    m_sink = sink;
+}
+
+//------------------------------------------------------------------------------
+void
+CMicroBenchmark::attributePacking()
+{
+    float sink = 0.0f;
+    qint64 iterations = 0;
+    QElapsedTimer timer;
+    timer.start();
+    QBENCHMARK
+    {
+        CBrick brick = m_surfaceBrick;
+        VoxelAttributes::derive( brick, CBrickRegion() );
+        sink += brick.normals.at( 0 );
+        ++iterations;
+    }
+    check( "attributePacking", timer.nsecsElapsed(), iterations );
+    m_sink = sink;
+}
+
+//------------------------------------------------------------------------------
+void
+CMicroBenchmark::volumeDownsampling()
+{
+    const QString output = m_directory.filePath( "sphere.gvb" );
+    qint64 iterations = 0;
+    QElapsedTimer timer;
+    timer.start();
+    QBENCHMARK
+    {
+        // Bricks every level of the pyramid, each one filtered from the last
+        CVolumeConverter converter;
+        converter.setDimensions( volumeEdge, volumeEdge, volumeEdge );
+        converter.setReportProgress( false );
+        QVERIFY2( converter.convert( QStringList() << m_volumeFile, output ), qPrintable( converter.errorString() ) );
+        ++iterations;
+    }
+    check( "volumeDownsampling", timer.nsecsElapsed(), iterations );
+}
+
+//------------------------------------------------------------------------------
+void
+CMicroBenchmark::occupancyBuild()
+{
+    quint64 sink = 0;
+    qint64 iterations = 0;
+    QElapsedTimer timer;
+    timer.start();
+    QBENCHMARK
+    {
+        sink ^= Occupancy::build( m_surfaceBrick );
+        ++iterations;
+    }
+    check( "occupancyBuild", timer.nsecsElapsed(), iterations );
+    m_sink = qPopulationCount( sink );
+}
+
+//------------------------------------------------------------------------------
+void
+CMicroBenchmark::blockEncoding()
+{
+    CBrick brick = m_surfaceBrick;
+    VoxelAttributes::derive( brick, CBrickRegion() );
+
+    QVector<quint32> blocks;
+    int error = 0;
+    qint64 iterations = 0;
+    QElapsedTimer timer;
+    timer.start();
+    QBENCHMARK
+    {
+        error = qMax( error, BlockCompression::encode( brick, blocks ) );
+        ++iterations;
+    }
+    check( "blockEncoding", timer.nsecsElapsed(), iterations );
+
+    // The bound of c_block_compression.h, in whole steps
+    QVERIFY2( error <= 8, qPrintable( QString( "Density error of %1 of 255" ).arg( error ) ) );
+    for ( int k = 0; k < VoxelConfig::storedBrickEdge; ++k )
+        for ( int j = 0; j < VoxelConfig::storedBrickEdge; ++j )
+            for ( int i = 0; i < VoxelConfig::storedBrickEdge; ++i )
+            {
+                const int decoded = BlockCompression::decodeDensity( blocks.constData(), i, j, k );
+                QVERIFY( qAbs( decoded - int( brick.voxels.at( CBrick::index( i, j, k ) ) ) ) <= error );
+            }
+    m_sink = blocks.at( 0 );
+}
+
+//------------------------------------------------------------------------------
+void
+CMicroBenchmark::transferTable()
+{
+    CTransferFunction transfer;
+    transfer.insertPoint( CTransferPoint( 0.4f, QVector3D( 0.9f, 0.3f, 0.2f ), 0.2f ) );
+
+    float sink = 0.0f;
+    qint64 iterations = 0;
+    QElapsedTimer timer;
+    timer.start();
+    QBENCHMARK
+    {
+        // Every entry, as after changing the segment length
+        transfer.setSegmentLength( iterations & 1 ? 2.0f : 1.5f );
+        sink += transfer.update().size();
+        ++iterations;
+    }
+    check( "transferTable", timer.nsecsElapsed(), iterations );
+    m_sink = sink + transfer.table()[0];
+}
+
+//------------------------------------------------------------------------------
+void
+CMicroBenchmark::transferTableDrag()
+{
+    CTransferFunction transfer;
+    transfer.insertPoint( CTransferPoint( 0.4f, QVector3D( 0.9f, 0.3f, 0.2f ), 0.2f ) );
+    const int point = transfer.insertPoint( CTransferPoint( 0.45f, QVector3D( 0.2f, 0.3f, 0.9f ), 0.6f ) );
+    transfer.insertPoint( CTransferPoint( 0.5f, QVector3D( 0.9f, 0.9f, 0.9f ), 0.1f ) );
+    transfer.update();
+
+    float sink = 0.0f;
+    qint64 iterations = 0;
+    QElapsedTimer timer;
+    timer.start();
+    QBENCHMARK
+    {
+        // One mouse move of a point between close neighbours
+        CTransferPoint p = transfer.point( point );
+        p.opacity = iterations & 1 ? 0.5f : 0.6f;
+        transfer.setPoint( point, p );
+        sink += transfer.update().size();
+        ++iterations;
+    }
+    check( "transferTableDrag", timer.nsecsElapsed(), iterations );
+    m_sink = sink + transfer.table()[0];
+}
+
+//------------------------------------------------------------------------------
+void
+CMicroBenchmark::classification()
+{
+    // Dragging the lower end of the ramp above the values of the air and
+    // back, so that a good part of the nodes flips each time. The tree is
+    // flattened once; like in the viewer, only the flags change after.
+    CTransferFunction transfer;
+    const int point = 1;
+    QVector<CGpuNode> nodes;
+    QVector<CNodeKey> keys;
+    m_tree.flatten( nodes, &keys );
+
+    qint64 iterations = 0;
+    qint64 changedNodes = 0;
+    int invisible = 0;
+    QVector<QPair<int, int> > changed;
+    QElapsedTimer timer;
+    timer.start();
+    QBENCHMARK
+    {
+        CTransferPoint p = transfer.point( point );
+        p.value = iterations & 1 ? 0.1f : 0.6f;
+        transfer.setPoint( point, p );
+        m_tree.setVisibleValues( transfer.visibleValues() );
+        changed.clear();
+        m_tree.updateVisibility( nodes, keys, changed );
+        for ( int i = 0; i < changed.size(); ++i )
+            changedNodes += changed.at( i ).second;
+        invisible = m_tree.invisibleCount();
+        ++iterations;
+    }
+    check( "classification", timer.nsecsElapsed(), iterations );
+    qDebug() << "classification hides" << invisible << "of" << nodes.size() << "nodes, uploading"
+             << double( changedNodes ) / qMax( iterations, qint64( 1 ) ) << "nodes in"
+             << changed.size() << "ranges per change";
+
+    m_tree.setVisibleValues( QBitArray() );
+    m_sink = invisible;
+}
+
+//------------------------------------------------------------------------------
+void
+CMicroBenchmark::traversal()
+{
+    runTraversal( "traversal", true );
+}
+
+//------------------------------------------------------------------------------
+void
+CMicroBenchmark::traversalWithoutOccupancy()
+{
+    runTraversal( "traversalWithoutOccupancy", false );
+}
+
+//------------------------------------------------------------------------------
+void
+CMicroBenchmark::runTraversal( const char* name, bool occupancy )
+{
+    CBrickScheduler scheduler( &m_producer, &m_pool, &m_tree );
+    CLodTraversal traversal( &m_tree, &m_pool, &scheduler );
+    traversal.setOccupancySkipping( occupancy );
+
+    int frame = 1;
+    qint64 iterations = 0;
+    QElapsedTimer timer;
+    timer.start();
+    QBENCHMARK
+    {
+        scheduler.beginFrame( frame );
+        traversal.run( m_view, frame );
+        ++frame;
+        ++iterations;
+    }
+    check( name, timer.nsecsElapsed(), iterations );
+    qDebug() << name << "visits" << traversal.visitedCount() << "nodes, skips" << traversal.emptyCount() << "empty ones";
+    m_sink = traversal.visitedCount();
+}
+
+//------------------------------------------------------------------------------
+void
+CMicroBenchmark::materialBind()
+{
+    if ( !m_hasContext )
+        QSKIP( "No OpenGL 4.3 context available" );
+
+    // The three pool textures of the viewer, at a token size
+    Material material;
+    QOpenGLShaderProgramPtr shader = material.shader();
+    QVERIFY( shader->addShaderFromSourceCode( QOpenGLShader::Vertex, vertexSource ) );
+    QVERIFY( shader->addShaderFromSourceCode( QOpenGLShader::Fragment, fragmentSource ) );
+    QVERIFY( shader->link() );
+
+    SamplerPtr sampler( new Sampler );
+    sampler->create();
+    sampler->setMinificationFilter( GL_LINEAR );
+    sampler->setMagnificationFilter( GL_LINEAR );
+    const char* names[] = { "brick_pool", "color_pool", "normal_pool" };
+    for ( int unit = 0; unit < 3; ++unit )
+    {
+        TexturePtr texture( new QOpenGLTexture( QOpenGLTexture::Target3D ) );
+        texture->setSize( 8, 8, 8 );
+        texture->setFormat( QOpenGLTexture::RGBA8_UNorm );
+        texture->allocateStorage();
+        material.setTextureUnitConfiguration( unit, texture, sampler, QByteArray( names[unit] ) );
+    }
+
+    qint64 iterations = 0;
+    QElapsedTimer timer;
+    timer.start();
+    QBENCHMARK
+    {
+        material.bind();
+        ++iterations;
+    }
+    check( "materialBind", timer.nsecsElapsed(), iterations );
+}
+
+//------------------------------------------------------------------------------
+void
+CMicroBenchmark::buildTree( const CNodeKey& key )
+{
+    CBrick brick( key );
+    m_producer.produce( brick );
+    if ( !brick.constant )
+        m_producer.produceAttributes( brick, CBrickRegion() );
+
+    int slot = -1;
+    if ( !brick.constant )
+    {
+        slot = m_pool.share( brick, 0 );
+        if ( slot < 0 )
+        {
+            QVector<CNodeKey> evicted;
+            slot = m_pool.allocate( key, 0, &evicted );
+            for ( int i = 0; i < evicted.size(); ++i )
+                m_tree.evictBrick( evicted.at( i ), slot );
+            m_pool.publish( slot, brick );
+        }
+    }
+    m_tree.insert( brick, slot );
+
+    if ( brick.constant || int( key.level ) >= m_view.maxLevel
+      || m_view.screenSpaceError( key ) <= m_view.pixelError
+      || m_view.frustum.classify( key.origin(), key.origin() + QVector3D( 1.0f, 1.0f, 1.0f ) * key.size() )
+         == CFrustum::Outside )
+    {
+        return;
+    }
+
+    for ( int c = 0; c < 8; ++c )
+        buildTree( key.child( c ) );
+}
+
+//------------------------------------------------------------------------------
+void
+CMicroBenchmark::check( const char* name, qint64 nanoseconds, qint64 iterations )
+{
+    if ( iterations == 0 || nanoseconds < minimumRunNanoseconds )
+        return;
+
+    const double measured = double( nanoseconds ) / iterations;
+    if ( !recordFile.isEmpty() )
+    {
+        m_recorded.setValue( name, measured );
+        return;
+    }
+
+    if ( !m_baseline.contains( name ) )
+    {
+        QWARN( qPrintable( QString( "%1: %2 ns, no baseline" ).arg( name ).arg( measured, 0, 'f', 1 ) ) );
+        return;
+    }
+
+    const double baseline = m_baseline.value( name );
+    const double change = measured / baseline - 1.0;
+    QVERIFY2( change <= threshold,
+              qPrintable( QString( "%1: %2 ns per iteration, %3% slower than the baseline of %4 ns" )
+                          .arg( name )
+                          .arg( measured, 0, 'f', 1 )
+                          .arg( 100.0 * change, 0, 'f', 1 )
+                          .arg( baseline, 0, 'f', 1 ) ) );
+}
+
+//------------------------------------------------------------------------------
+int main( int argc, char* argv[] )
+{
+    // Runs on build machines without a display
+    if ( qEnvironmentVariableIsEmpty( "QT_QPA_PLATFORM" ) )
+        qputenv( "QT_QPA_PLATFORM", "offscreen" );
+    QGuiApplication a( argc, argv );
+
+    // Our options are taken out, QTest gets the rest
+    QStringList arguments = a.arguments();
+    for ( int i = 1; i + 1 < arguments.size(); )
+    {
+        const QString option = arguments.at( i );
+        if ( option == "--baseline" )
+            baselineFile = arguments.at( i + 1 );
+        else if ( option == "--record" )
+            recordFile = arguments.at( i + 1 );
+        else if ( option == "--threshold" )
+            threshold = arguments.at( i + 1 ).toDouble() / 100.0;
+        else
+        {
+            ++i;
+            continue;
+        }
+        arguments.removeAt( i );
+        arguments.removeAt( i );
+    }
+
+    CMicroBenchmark benchmark;
+    return QTest::qExec( &benchmark, arguments );
+}
+
+#include "main.moc"
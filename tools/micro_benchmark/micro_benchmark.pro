@@ -0,0 +1,68 @@
+#-------------------------------------------------
+#
+# Micro benchmarks of the hot paths, compared against
+# recorded baselines. Runs headless; `make check` fails
+# when a case is slower than its baseline allows.
+#
+#-------------------------------------------------
+
+QT += testlib concurrent opengl
+
+TARGET = micro_benchmark
+TEMPLATE = app
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../../common \
+    ../../voxels \
+    ../voxel_converter
+
+DEFINES += BASELINE_DIR=\\\"$$PWD/baselines\\\"
+
+SOURCES += main.cpp \
+    c_baseline.cpp \
+    ../../common/camera.cpp \
+    ../../common/material.cpp \
+    ../../common/sampler.cpp \
+    ../../voxels/c_stats.cpp \
+    ../../voxels/c_brick_producer.cpp \
+    ../../voxels/c_voxel_attributes.cpp \
+    ../../voxels/c_occupancy.cpp \
+    ../../voxels/c_block_compression.cpp \
+    ../../voxels/c_transfer_function.cpp \
+    ../../voxels/c_async_file_reader.cpp \
+    ../../voxels/c_brick_file.cpp \
+    ../../voxels/c_brick_pool.cpp \
+    ../../voxels/c_node_tree.cpp \
+    ../../voxels/c_brick_scheduler.cpp \
+    ../../voxels/c_frustum.cpp \
+    ../../voxels/c_occlusion_buffer.cpp \
+    ../../voxels/c_lod_traversal.cpp \
+    ../voxel_converter/c_volume_converter.cpp
+
+HEADERS += \
+    c_baseline.h \
+    ../../common/camera.h \
+    ../../common/camera_p.h \
+    ../../common/material.h \
+    ../../common/sampler.h \
+    ../../voxels/c_stats.h \
+    ../../voxels/c_content_hash.h \
+    ../../voxels/c_brick_producer.h \
+    ../../voxels/c_voxel_attributes.h \
+    ../../voxels/c_occupancy.h \
+    ../../voxels/c_block_compression.h \
+    ../../voxels/c_transfer_function.h \
+    ../../voxels/c_async_file_reader.h \
+    ../../voxels/c_brick_file.h \
+    ../../voxels/c_morton.h \
+    ../../voxels/c_brick_pool.h \
+    ../../voxels/c_node_tree.h \
+    ../../voxels/c_brick_scheduler.h \
+    ../../voxels/c_frustum.h \
+    ../../voxels/c_occlusion_buffer.h \
+    ../../voxels/c_lod_traversal.h \
+    ../voxel_converter/c_volume_converter.h
+
+OTHER_FILES += \
+    baselines/reference.baseline
@@ -0,0 +1,597 @@
+#include "c_volume_converter.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QtConcurrentMap>
+#include <QtEndian>
+
+#include <math.h>
+#include <string.h>
+
+namespace
+{
+    const int edge = VoxelConfig::brickEdge;
+    const int border = VoxelConfig::brickBorder;
+    const int storedEdge = VoxelConfig::storedBrickEdge;
+
+    int
+    divideUp( int value, int divisor )
+    {
+        return ( value + divisor - 1 ) / divisor;
+    }
+}
+
+/**
+  Fills one brick of a row out of the slice window of its level.
+  */
+class CBrickFill
+{
+public:
+    CBrickFill( const int* dimensions, const QMap<int, QVector<quint8> >* slices )
+        : m_dimensions( dimensions ),
+          m_slices( slices )
+    {
+    }
+
+    void operator()( CBrick& brick ) const
+    {
+        const int dx = m_dimensions[0];
+        const int dy = m_dimensions[1];
+        const int dz = m_dimensions[2];
+
+        brick.voxels.resize( VoxelConfig::storedBrickVoxels );
+        quint8* out = brick.voxels.data();
+        for ( int k = 0; k < storedEdge; ++k )
+        {
+            const int gz = int( brick.key.z ) * edge + k - border;
+            QMap<int, QVector<quint8> >::const_iterator it = m_slices->constFind( gz );
+            const quint8* slice = gz >= 0 && gz < dz && it != m_slices->constEnd() ? it.value().constData() : 0;
+
+            for ( int j = 0; j < storedEdge; ++j )
+            {
+                const int gy = int( brick.key.y ) * edge + j - border;
+                for ( int i = 0; i < storedEdge; ++i )
+                {
+                    // Outside of the volume is empty
+                    const int gx = int( brick.key.x ) * edge + i - border;
+                    const bool inside = slice && gx >= 0 && gx < dx && gy >= 0 && gy < dy;
+                    *out++ = inside ? slice[gy * dx + gx] : 0;
+                }
+            }
+        }
+        brick.detectConstant();
+    }
+
+private:
+    const int* m_dimensions;
+    const QMap<int, QVector<quint8> >* m_slices;
+};
+
+/**
+  Box filters a pair of slices into one row of the next coarser level.
+  Samples beyond the edge of odd sized levels are left out of the average.
+  */
+class CDownsampleRow
+{
+public:
+    CDownsampleRow( const int* source, const int* target, const quint8* even, const quint8* odd, quint8* result )
+        : m_source( source ),
+          m_target( target ),
+          m_even( even ),
+          m_odd( odd ),
+          m_result( result )
+    {
+    }
+
+    void operator()( int y ) const
+    {
+        const int dx = m_source[0];
+        const int dy = m_source[1];
+        for ( int x = 0; x < m_target[0]; ++x )
+        {
+            int sum = 0;
+            int count = 0;
+            for ( int sy = 2 * y; sy < qMin( 2 * y + 2, dy ); ++sy )
+            {
+                for ( int sx = 2 * x; sx < qMin( 2 * x + 2, dx ); ++sx )
+                {
+                    sum += m_even[sy * dx + sx];
+                    ++count;
+                    if ( m_odd )
+                    {
+                        sum += m_odd[sy * dx + sx];
+                        ++count;
+                    }
+                }
+            }
+            m_result[y * m_target[0] + x] = quint8( ( sum + count / 2 ) / count );
+        }
+    }
+
+private:
+    const int* m_source;
+    const int* m_target;
+    const quint8* m_even;
+    const quint8* m_odd;
+    quint8* m_result;
+};
+
+//------------------------------------------------------------------------------
+CVolumeConverter::CVolumeConverter()
+    : m_type( UInt8 ),
+      m_bigEndian( false ),
+      m_dataOffset( 0 ),
+      m_lo( 0.0f ),
+      m_hi( 1.0f ),
+      m_hasRange( false ),
+      m_bricks( 0 ),
+      m_storedBricks( 0 ),
+      m_framesPerSecond( 30 ),
+      m_lastReport( 0 ),
+      m_reportProgress( true )
+{
+    m_dimensions[0] = m_dimensions[1] = m_dimensions[2] = 0;
+}
+
+//------------------------------------------------------------------------------
+void
+CVolumeConverter::setDimensions( int x, int y, int z )
+{
+    m_dimensions[0] = x;
+    m_dimensions[1] = y;
+    m_dimensions[2] = z;
+}
+
+//------------------------------------------------------------------------------
+void
+CVolumeConverter::setValueRange( float lo, float hi )
+{
+    m_lo = lo;
+    m_hi = hi;
+    m_hasRange = true;
+}
+
+//------------------------------------------------------------------------------
+bool
+CVolumeConverter::readNrrdHeader( const QString& fileName, QString* dataFile )
+{
+    QFile file( fileName );
+    if ( !file.open( QIODevice::ReadOnly ) )
+    {
+        m_error = file.errorString();
+        return false;
+    }
+
+    if ( !file.readLine().startsWith( "NRRD" ) )
+    {
+        m_error = "Not a NRRD file";
+        return false;
+    }
+
+    *dataFile = fileName;
+    m_dataOffset = 0;
+    qint64 byteSkip = 0;
+    bool detached = false;
+    bool haveSizes = false;
+    while ( !file.atEnd() )
+    {
+        const QString line = QString::fromLatin1( file.readLine() ).trimmed();
+        if ( line.isEmpty() )
+            break;
+        if ( line.startsWith( '#' ) )
+            continue;
+
+        const int colon = line.indexOf( ':' );
+        if ( colon < 0 )
+            continue;
+        const QString field = line.left( colon ).trimmed().toLower();
+        const QString value = line.mid( colon + 1 ).trimmed();
+
+        if ( field == "type" )
+        {
+            const QString type = value.toLower();
+            if ( type == "uchar" || type == "unsigned char" || type == "uint8" || type == "uint8_t" )
+                m_type = UInt8;
+            else if ( type == "ushort" || type == "unsigned short" || type == "unsigned short int"
+                   || type == "uint16" || type == "uint16_t" )
+                m_type = UInt16;
+            else if ( type == "float" )
+                m_type = Float32;
+            else
+            {
+                m_error = "Unsupported NRRD type " + value;
+                return false;
+            }
+        }
+        else if ( field == "dimension" && value.toInt() != 3 )
+        {
+            m_error = "Only three dimensional NRRD volumes are supported";
+            return false;
+        }
+        else if ( field == "sizes" )
+        {
+            const QStringList sizes = value.split( ' ', QString::SkipEmptyParts );
+            if ( sizes.size() != 3 )
+            {
+                m_error = "Malformed NRRD sizes";
+                return false;
+            }
+            setDimensions( sizes.at( 0 ).toInt(), sizes.at( 1 ).toInt(), sizes.at( 2 ).toInt() );
+            haveSizes = true;
+        }
+        else if ( field == "encoding" && value != "raw" )
+        {
+            m_error = "Only raw NRRD encoding is supported";
+            return false;
+        }
+        else if ( field == "endian" )
+        {
+            m_bigEndian = value == "big";
+        }
+        else if ( field == "data file" || field == "datafile" )
+        {
+            *dataFile = QDir( QFileInfo( fileName ).absolutePath() ).filePath( value );
+            detached = true;
+        }
+        else if ( field == "byte skip" || field == "byteskip" )
+        {
+            byteSkip = value.toLongLong();
+        }
+    }
+
+    if ( !haveSizes )
+    {
+        m_error = "NRRD header has no sizes";
+        return false;
+    }
+
+    m_dataOffset = ( detached ? 0 : file.pos() ) + qMax( byteSkip, qint64( 0 ) );
+    return true;
+}
+
+//------------------------------------------------------------------------------
+bool
+CVolumeConverter::convert( const QStringList& inputs, const QString& output )
+{
+    if ( inputs.isEmpty() )
+    {
+        m_error = "No input volume";
+        return false;
+    }
+
+    QString dataFile;
+    if ( !frameSource( inputs.first(), &dataFile ) )
+        return false;
+
+    const int largest = qMax( qMax( m_dimensions[0], m_dimensions[1] ), m_dimensions[2] );
+    if ( m_dimensions[0] <= 0 || m_dimensions[1] <= 0 || m_dimensions[2] <= 0 )
+    {
+        m_error = "Invalid volume dimensions";
+        return false;
+    }
+
+    // The finest level maps one source voxel to one brick voxel
+    int finestLevel = 0;
+    while ( ( edge << finestLevel ) < largest )
+        ++finestLevel;
+
+    if ( !m_writer.open( output, finestLevel, m_dimensions ) )
+    {
+        m_error = m_writer.errorString();
+        return false;
+    }
+    m_writer.setFramesPerSecond( m_framesPerSecond );
+
+    m_bricks = 0;
+    m_storedBricks = 0;
+    m_lastReport = 0;
+    m_timer.start();
+
+    const int dimensions[3] = { m_dimensions[0], m_dimensions[1], m_dimensions[2] };
+    const qint64 frameBytes = qint64( m_dimensions[0] ) * m_dimensions[1] * m_dimensions[2] * scalarSize();
+    const qint64 total = frameBytes * inputs.size();
+    for ( int frame = 0; frame < inputs.size(); ++frame )
+    {
+        if ( frame > 0 )
+        {
+            if ( !frameSource( inputs.at( frame ), &dataFile ) )
+                return false;
+            if ( m_dimensions[0] != dimensions[0] || m_dimensions[1] != dimensions[1] ||
+                 m_dimensions[2] != dimensions[2] )
+            {
+                m_error = inputs.at( frame ) + " differs in size from the first frame";
+                return false;
+            }
+            m_writer.beginFrame();
+        }
+
+        if ( !convertFrame( dataFile, finestLevel, frame * frameBytes, total ) )
+            return false;
+    }
+
+    if ( !m_writer.close() )
+    {
+        m_error = m_writer.errorString();
+        return false;
+    }
+
+    progress( total, total, true );
+    return true;
+}
+
+//------------------------------------------------------------------------------
+bool
+CVolumeConverter::frameSource( const QString& input, QString* dataFile )
+{
+    *dataFile = input;
+    if ( !input.endsWith( ".nrrd", Qt::CaseInsensitive ) && !input.endsWith( ".nhdr", Qt::CaseInsensitive ) )
+        return true;
+    return readNrrdHeader( input, dataFile );
+}
+
+//------------------------------------------------------------------------------
+bool
+CVolumeConverter::convertFrame( const QString& input, int finestLevel, qint64 done, qint64 total )
+{
+    m_levels.resize( finestLevel + 1 );
+    for ( int i = 0; i <= finestLevel; ++i )
+    {
+        CLevel& level = m_levels[i];
+        level.level = finestLevel - i;
+        for ( int axis = 0; axis < 3; ++axis )
+            level.dimensions[axis] = divideUp( m_dimensions[axis], 1 << i );
+        level.slices.clear();
+        level.nextRow = 0;
+        level.hasPending = false;
+    }
+
+    QFile file( input );
+    if ( !file.open( QIODevice::ReadOnly ) )
+    {
+        m_error = file.errorString();
+        return false;
+    }
+
+    const qint64 sliceVoxels = qint64( m_dimensions[0] ) * m_dimensions[1];
+    const qint64 sliceBytes = sliceVoxels * scalarSize();
+    if ( file.size() < m_dataOffset + sliceBytes * m_dimensions[2] || !file.seek( m_dataOffset ) )
+    {
+        m_error = "Input is smaller than the volume it describes";
+        return false;
+    }
+
+    QByteArray raw;
+    raw.resize( int( sliceBytes ) );
+    QVector<quint8> slice;
+    slice.resize( int( sliceVoxels ) );
+    for ( int z = 0; z < m_dimensions[2]; ++z )
+    {
+        if ( file.read( raw.data(), sliceBytes ) != sliceBytes )
+        {
+            m_error = file.errorString();
+            return false;
+        }
+
+        toBytes( raw.constData(), slice.data() );
+        if ( !push( 0, z, slice ) )
+            return false;
+
+        progress( done + ( z + 1 ) * sliceBytes, total, false );
+    }
+
+    if ( !finish( 0 ) )
+    {
+        m_error = m_writer.errorString();
+        return false;
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+int
+CVolumeConverter::scalarSize() const
+{
+    switch ( m_type )
+    {
+        case UInt16: return 2;
+        case Float32: return 4;
+        default: return 1;
+    }
+}
+
+//------------------------------------------------------------------------------
+void
+CVolumeConverter::toBytes( const char* data, quint8* slice ) const
+{
+    const int count = m_dimensions[0] * m_dimensions[1];
+    const uchar* in = reinterpret_cast<const uchar*>( data );
+
+    if ( m_type == UInt8 && !m_hasRange )
+    {
+        memcpy( slice, in, count );
+        return;
+    }
+
+    float lo = m_lo;
+    float hi = m_hi;
+    if ( !m_hasRange )
+    {
+        lo = 0.0f;
+        hi = m_type == UInt16 ? 65535.0f : 1.0f;
+    }
+    const float scale = hi > lo ? 255.0f / ( hi - lo ) : 0.0f;
+
+    for ( int i = 0; i < count; ++i )
+    {
+        float value;
+        switch ( m_type )
+        {
+            case UInt16:
+                value = m_bigEndian ? qFromBigEndian<quint16>( in + 2 * i ) : qFromLittleEndian<quint16>( in + 2 * i );
+                break;
+
+            case Float32:
+            {
+                const quint32 bits = m_bigEndian ? qFromBigEndian<quint32>( in + 4 * i ) : qFromLittleEndian<quint32>( in + 4 * i );
+                memcpy( &value, &bits, sizeof( value ) );
+                break;
+            }
+
+            default:
+                value = in[i];
+                break;
+        }
+        slice[i] = quint8( qBound( 0.0f, ( value - lo ) * scale + 0.5f, 255.0f ) );
+    }
+}
+
+//------------------------------------------------------------------------------
+bool
+CVolumeConverter::push( int index, int z, const QVector<quint8>& slice )
+{
+    CLevel& level = m_levels[index];
+    level.slices.insert( z, slice );
+    if ( !emitRows( level, false ) )
+        return false;
+
+    if ( index + 1 >= m_levels.size() )
+        return true;
+
+    if ( ( z & 1 ) == 0 )
+    {
+        level.pending = slice;
+        level.hasPending = true;
+        return true;
+    }
+
+    QVector<quint8> coarse;
+    downsample( index, level.pending, &slice, coarse );
+    level.hasPending = false;
+    return push( index + 1, z / 2, coarse );
+}
+
+//------------------------------------------------------------------------------
+bool
+CVolumeConverter::finish( int index )
+{
+    CLevel& level = m_levels[index];
+    if ( !emitRows( level, true ) )
+        return false;
+
+    if ( index + 1 >= m_levels.size() )
+        return true;
+
+    // An odd number of slices leaves the last one without a partner
+    if ( level.hasPending )
+    {
+        QVector<quint8> coarse;
+        downsample( index, level.pending, 0, coarse );
+        level.hasPending = false;
+        if ( !push( index + 1, level.dimensions[2] / 2, coarse ) )
+            return false;
+    }
+
+    return finish( index + 1 );
+}
+
+//------------------------------------------------------------------------------
+bool
+CVolumeConverter::emitRows( CLevel& level, bool final )
+{
+    const int rows = divideUp( level.dimensions[2], edge );
+    const int columns = divideUp( level.dimensions[0], edge );
+    const int lines = divideUp( level.dimensions[1], edge );
+
+    while ( level.nextRow < rows )
+    {
+        // A row needs its own slices plus the border of the next one
+        const int row = level.nextRow;
+        const int last = qMin( ( row + 1 ) * edge + border, level.dimensions[2] ) - 1;
+        if ( !final && ( level.slices.isEmpty() || level.slices.lastKey() < last ) )
+            break;
+
+        QVector<CBrick> bricks;
+        bricks.reserve( columns * lines );
+        for ( int y = 0; y < lines; ++y )
+        {
+            for ( int x = 0; x < columns; ++x )
+                bricks.append( CBrick( CNodeKey( level.level, x, y, row ) ) );
+        }
+        QtConcurrent::blockingMap( bricks, CBrickFill( level.dimensions, &level.slices ) );
+
+        for ( int i = 0; i < bricks.size(); ++i )
+        {
+            if ( !m_writer.write( bricks.at( i ) ) )
+                return false;
+            if ( !bricks.at( i ).constant || bricks.at( i ).value != 0 )
+                ++m_storedBricks;
+        }
+        m_bricks += bricks.size();
+
+        // Keep only what the next row's border still needs
+        const int keep = ( row + 1 ) * edge - border;
+        while ( !level.slices.isEmpty() && level.slices.firstKey() < keep )
+            level.slices.remove( level.slices.firstKey() );
+        ++level.nextRow;
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void
+CVolumeConverter::downsample( int index, const QVector<quint8>& even, const QVector<quint8>* odd,
+                              QVector<quint8>& result ) const
+{
+    const int* source = m_levels.at( index ).dimensions;
+    const int* target = m_levels.at( index + 1 ).dimensions;
+    result.resize( target[0] * target[1] );
+
+    QVector<int> rows( target[1] );
+    for ( int y = 0; y < rows.size(); ++y )
+        rows[y] = y;
+    QtConcurrent::blockingMap( rows, CDownsampleRow( source, target, even.constData(),
+                                                     odd ? odd->constData() : 0, result.data() ) );
+}
+
+//------------------------------------------------------------------------------
+void
+CVolumeConverter::progress( qint64 bytes, qint64 total, bool final )
+{
+    const qint64 elapsed = m_timer.elapsed();
+    if ( !m_reportProgress || ( !final && elapsed - m_lastReport < 1000 ) )
+        return;
+    m_lastReport = elapsed;
+
+    const double gigabytes = double( bytes ) / ( 1024.0 * 1024.0 * 1024.0 );
+    const double minutes = qMax( elapsed, qint64( 1 ) ) / 60000.0;
+
+    QTextStream out( stdout );
+    out << QString( "\r%1% %2 GB %3 GB/min %4 bricks" )
+           .arg( 100.0 * bytes / qMax( total, qint64( 1 ) ), 5, 'f', 1 )
+           .arg( gigabytes, 0, 'f', 2 )
+           .arg( gigabytes / minutes, 0, 'f', 2 )
+           .arg( m_bricks );
+    if ( final )
+    {
+        out << QString( "\nStored %1 of %2 bricks, %3 MB in %4 s\n" )
+               .arg( m_storedBricks )
+               .arg( m_bricks )
+               .arg( m_writer.bytesWritten() / ( 1024 * 1024 ) )
+               .arg( elapsed / 1000.0, 0, 'f', 1 );
+        out << QString( "%1 bricks repeat an earlier payload, %2 MB not written\n" )
+               .arg( m_writer.sharedCount() )
+               .arg( m_writer.sharedBytes() / ( 1024 * 1024 ) );
+        if ( m_writer.frameCount() > 1 )
+        {
+            out << QString( "%1 frames at %2 per second, %3 bricks changed after the first\n" )
+                   .arg( m_writer.frameCount() )
+                   .arg( m_framesPerSecond )
+                   .arg( m_writer.changedCount() );
+        }
+    }
+    out.flush();
+}
+
+//------------------------------------------------------------------------------
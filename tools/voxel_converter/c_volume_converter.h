@@ -0,0 +1,106 @@
+#ifndef C_VOLUME_CONVERTER_H
+#define C_VOLUME_CONVERTER_H
+
+#include "c_brick.h"
+#include "c_brick_file.h"
+
+#include <QElapsedTimer>
+#include <QMap>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+/**
+  Streams a scalar volume from disk into a brick file. The volume is read
+  one z slice at a time and every level of the pyramid only keeps the
+  slices the current row of bricks and its borders need, so memory use
+  grows with the slice size, not with the volume. The bricks of a row
+  are filled in parallel.
+
+  Several inputs make a sequence, one frame each, all of the same size.
+  Frames after the first only store the bricks that changed.
+  */
+class CVolumeConverter
+{
+public:
+    enum ScalarType
+    {
+        UInt8,
+        UInt16,
+        Float32
+    };
+
+    CVolumeConverter();
+
+    void setDimensions( int x, int y, int z );
+    void setScalarType( ScalarType type ) { m_type = type; }
+    void setBigEndian( bool bigEndian ) { m_bigEndian = bigEndian; }
+    void setDataOffset( qint64 offset ) { m_dataOffset = offset; }
+
+    // Input values mapped to 0 and 255. Defaults to the full range of the
+    // integer types and to [0, 1] for floats.
+    void setValueRange( float lo, float hi );
+
+    // Configures the converter from a NRRD header and returns the file that
+    // holds the samples, which is the header itself unless it is detached
+    bool readNrrdHeader( const QString& fileName, QString* dataFile );
+
+    // Inputs ending in .nrrd or .nhdr are read through their header
+    bool convert( const QStringList& inputs, const QString& output );
+    void setFramesPerSecond( int fps ) { m_framesPerSecond = fps; }
+
+    // Progress goes to stdout unless disabled
+    void setReportProgress( bool b ) { m_reportProgress = b; }
+
+    QString errorString() const { return m_error; }
+
+private:
+    class CLevel
+    {
+    public:
+        int level;
+        int dimensions[3];
+
+        // Window of slices around the next brick row, by z
+        QMap<int, QVector<quint8> > slices;
+        int nextRow;
+
+        // Even slice waiting for its odd partner to be downsampled
+        QVector<quint8> pending;
+        bool hasPending;
+    };
+
+    bool frameSource( const QString& input, QString* dataFile );
+    bool convertFrame( const QString& input, int finestLevel, qint64 done, qint64 total );
+
+    int scalarSize() const;
+    void toBytes( const char* data, quint8* slice ) const;
+
+    bool push( int index, int z, const QVector<quint8>& slice );
+    bool finish( int index );
+    bool emitRows( CLevel& level, bool final );
+    void downsample( int index, const QVector<quint8>& even, const QVector<quint8>* odd,
+                     QVector<quint8>& result ) const;
+    void progress( qint64 bytes, qint64 total, bool final );
+
+    int m_dimensions[3];
+    ScalarType m_type;
+    bool m_bigEndian;
+    qint64 m_dataOffset;
+    float m_lo;
+    float m_hi;
+    bool m_hasRange;
+
+    QVector<CLevel> m_levels;
+    CBrickFileWriter m_writer;
+    qint64 m_bricks;
+    qint64 m_storedBricks;
+    int m_framesPerSecond;
+
+    QElapsedTimer m_timer;
+    qint64 m_lastReport;
+    bool m_reportProgress;
+    QString m_error;
+};
+
+#endif // C_VOLUME_CONVERTER_H
@@ -0,0 +1,91 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QTextStream>
+
+#include "c_volume_converter.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription( "Converts raw and NRRD scalar volumes into bricked level of detail files." );
+    parser.addHelpOption();
+    parser.addPositionalArgument( "input", "Raw volume, or NRRD header (.nrrd / .nhdr). More than one "
+                                  "make a sequence, one frame each.", "input..." );
+    parser.addPositionalArgument( "output", "Brick file to write" );
+
+    QCommandLineOption sizeOption( "size", "Dimensions of a raw volume", "XxYxZ" );
+    QCommandLineOption typeOption( "type", "Scalar type of a raw volume: uint8, uint16 or float", "type", "uint8" );
+    QCommandLineOption offsetOption( "offset", "Bytes to skip at the start of a raw volume", "bytes", "0" );
+    QCommandLineOption bigEndianOption( "big-endian", "Samples of a raw volume are big endian" );
+    QCommandLineOption rangeOption( "range", "Values mapped to 0 and 255", "lo:hi" );
+    parser.addOption( sizeOption );
+    parser.addOption( typeOption );
+    parser.addOption( offsetOption );
+    parser.addOption( bigEndianOption );
+    QCommandLineOption fpsOption( "fps", "Playback rate of a sequence", "frames", "30" );
+    parser.addOption( rangeOption );
+    parser.addOption( fpsOption );
+    parser.process( a );
+
+    QTextStream err( stderr );
+    const QStringList files = parser.positionalArguments();
+    if ( files.size() < 2 )
+        parser.showHelp( 1 );
+
+    // NRRD headers are read by the converter, frame by frame
+    CVolumeConverter converter;
+    const QStringList inputs = files.mid( 0, files.size() - 1 );
+    const QString& first = inputs.first();
+    if ( !first.endsWith( ".nrrd", Qt::CaseInsensitive ) && !first.endsWith( ".nhdr", Qt::CaseInsensitive ) )
+    {
+        const QStringList size = parser.value( sizeOption ).split( 'x' );
+        if ( size.size() != 3 )
+        {
+            err << "Raw volumes need --size XxYxZ" << endl;
+            return 1;
+        }
+        converter.setDimensions( size.at( 0 ).toInt(), size.at( 1 ).toInt(), size.at( 2 ).toInt() );
+
+        const QString type = parser.value( typeOption );
+        if ( type == "uint16" )
+            converter.setScalarType( CVolumeConverter::UInt16 );
+        else if ( type == "float" )
+            converter.setScalarType( CVolumeConverter::Float32 );
+        else if ( type != "uint8" )
+        {
+            err << "Unknown scalar type " << type << endl;
+            return 1;
+        }
+
+        converter.setDataOffset( parser.value( offsetOption ).toLongLong() );
+        converter.setBigEndian( parser.isSet( bigEndianOption ) );
+    }
+
+    if ( parser.isSet( rangeOption ) )
+    {
+        const QStringList range = parser.value( rangeOption ).split( ':' );
+        if ( range.size() != 2 )
+        {
+            err << "Malformed --range, expected lo:hi" << endl;
+            return 1;
+        }
+        converter.setValueRange( range.at( 0 ).toFloat(), range.at( 1 ).toFloat() );
+    }
+
+    const int fps = parser.value( fpsOption ).toInt();
+    if ( fps <= 0 )
+    {
+        err << "--fps needs a positive number of frames" << endl;
+        return 1;
+    }
+    converter.setFramesPerSecond( fps );
+
+    if ( !converter.convert( inputs, files.last() ) )
+    {
+        err << converter.errorString() << endl;
+        return 1;
+    }
+    return 0;
+}
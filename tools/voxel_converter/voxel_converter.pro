@@ -0,0 +1,29 @@
+#-------------------------------------------------
+#
+# Converts raw and NRRD scalar volumes into the bricked
+# level of detail format read by CFileBrickProducer
+#
+#-------------------------------------------------
+
+QT -= gui
+QT += concurrent
+
+TARGET = voxel_converter
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../../voxels
+
+SOURCES += main.cpp \
+    c_volume_converter.cpp \
+    ../../voxels/c_stats.cpp \
+    ../../voxels/c_async_file_reader.cpp \
+    ../../voxels/c_brick_file.cpp
+
+HEADERS += \
+    c_volume_converter.h \
+    ../../voxels/c_stats.h \
+    ../../voxels/c_content_hash.h \
+    ../../voxels/c_async_file_reader.h \
+    ../../voxels/c_brick_file.h
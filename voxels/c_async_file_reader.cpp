@@ -0,0 +1,817 @@
+#include "c_async_file_reader.h"
+#include "c_stats.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QList>
+#include <QMutex>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+#include <QVector>
+#include <QWaitCondition>
+
+#include <algorithm>
+#include <string.h>
+
+#ifdef Q_OS_UNIX
+#include <errno.h>
+#include <unistd.h>
+#endif
+
+#if defined( Q_OS_LINUX ) && defined( __has_include )
+#  if __has_include( <linux/io_uring.h> )
+#    include <linux/io_uring.h>
+#    include <poll.h>
+#    include <sys/eventfd.h>
+#    include <sys/mman.h>
+#    include <sys/syscall.h>
+#    include <sys/uio.h>
+#    ifdef __NR_io_uring_setup
+#      define HAVE_IO_URING
+#    endif
+#  endif
+#endif
+
+namespace
+{
+    const int defaultQueueDepth = 64;
+    const int defaultMaxCoalescedBytes = 1024 * 1024;
+
+    class CReadRequest
+    {
+    public:
+        CReadRequest( qint64 o, char* d, qint64 s )
+            : offset( o ),
+              data( d ),
+              size( s ),
+              done( false ),
+              ok( false )
+        {
+        }
+
+        qint64 offset;
+        char* data;
+        qint64 size;
+        bool done;
+        bool ok;
+    };
+
+    // One I/O for requests that follow each other on disk. A lone request
+    // is read straight into its own memory, merged ones through buffer.
+    class CCoalescedRead
+    {
+    public:
+        CCoalescedRead()
+            : offset( 0 ),
+              size( 0 ),
+              completed( 0 ),
+              target( NULL )
+        {
+        }
+
+        qint64 offset;
+        qint64 size;
+        qint64 completed;
+        char* target;
+        QByteArray buffer;
+        QVector<CReadRequest*> requests;
+#ifdef HAVE_IO_URING
+        struct iovec iov;
+#endif
+    };
+
+    bool
+    lowerOffset( const CReadRequest* a, const CReadRequest* b )
+    {
+        return a->offset < b->offset;
+    }
+
+#ifdef HAVE_IO_URING
+    //--------------------------------------------------------------------------
+    // The raw io_uring interface: a submission and a completion ring shared
+    // with the kernel. Only the I/O thread touches it.
+    class CIoUring
+    {
+    public:
+        CIoUring();
+        ~CIoUring();
+
+        bool setup( unsigned entries );
+        bool isValid() const { return m_fd >= 0; }
+
+        // False when the submission ring is full
+        bool prepareRead( int fd, struct iovec* iov, quint64 offset, quint64 userData );
+        bool preparePoll( int fd, quint64 userData );
+
+        // Submits what was prepared and waits for at least minComplete
+        // completions; negative errno on failure
+        int enter( unsigned minComplete );
+
+        bool pop( quint64* userData, int* result );
+
+    private:
+        io_uring_sqe* nextEntry();
+        void push();
+        void release();
+
+        int m_fd;
+        void* m_sqRing;
+        size_t m_sqRingSize;
+        void* m_cqRing;
+        size_t m_cqRingSize;
+        io_uring_sqe* m_sqes;
+        size_t m_sqesSize;
+
+        unsigned* m_sqHead;
+        unsigned* m_sqTail;
+        unsigned* m_sqMask;
+        unsigned* m_sqArray;
+        unsigned m_sqEntries;
+        unsigned* m_cqHead;
+        unsigned* m_cqTail;
+        unsigned* m_cqMask;
+        io_uring_cqe* m_cqes;
+        unsigned m_unsubmitted;
+    };
+
+    //--------------------------------------------------------------------------
+    CIoUring::CIoUring()
+        : m_fd( -1 ),
+          m_sqRing( MAP_FAILED ),
+          m_sqRingSize( 0 ),
+          m_cqRing( MAP_FAILED ),
+          m_cqRingSize( 0 ),
+          m_sqes( static_cast<io_uring_sqe*>( MAP_FAILED ) ),
+          m_sqesSize( 0 ),
+          m_sqHead( NULL ),
+          m_sqTail( NULL ),
+          m_sqMask( NULL ),
+          m_sqArray( NULL ),
+          m_sqEntries( 0 ),
+          m_cqHead( NULL ),
+          m_cqTail( NULL ),
+          m_cqMask( NULL ),
+          m_cqes( NULL ),
+          m_unsubmitted( 0 )
+    {
+    }
+
+    //--------------------------------------------------------------------------
+    CIoUring::~CIoUring()
+    {
+        release();
+    }
+
+    //--------------------------------------------------------------------------
+    bool
+    CIoUring::setup( unsigned entries )
+    {
+        io_uring_params params;
+        memset( &params, 0, sizeof( params ) );
+        m_fd = int( syscall( __NR_io_uring_setup, entries, &params ) );
+        if ( m_fd < 0 )
+            return false;
+
+        m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof( unsigned );
+        m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof( io_uring_cqe );
+        const bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+        if ( single )
+            m_sqRingSize = m_cqRingSize = qMax( m_sqRingSize, m_cqRingSize );
+
+        m_sqRing = mmap( NULL, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd,
+                         IORING_OFF_SQ_RING );
+        if ( m_sqRing == MAP_FAILED )
+        {
+            release();
+            return false;
+        }
+        m_cqRing = single ? m_sqRing
+                          : mmap( NULL, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd,
+                                  IORING_OFF_CQ_RING );
+        m_sqesSize = params.sq_entries * sizeof( io_uring_sqe );
+        m_sqes = static_cast<io_uring_sqe*>( mmap( NULL, m_sqesSize, PROT_READ | PROT_WRITE,
+                                                   MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES ) );
+        if ( m_cqRing == MAP_FAILED || m_sqes == MAP_FAILED )
+        {
+            release();
+            return false;
+        }
+
+        char* sq = static_cast<char*>( m_sqRing );
+        m_sqHead = reinterpret_cast<unsigned*>( sq + params.sq_off.head );
+        m_sqTail = reinterpret_cast<unsigned*>( sq + params.sq_off.tail );
+        m_sqMask = reinterpret_cast<unsigned*>( sq + params.sq_off.ring_mask );
+        m_sqArray = reinterpret_cast<unsigned*>( sq + params.sq_off.array );
+        m_sqEntries = params.sq_entries;
+
+        char* cq = static_cast<char*>( m_cqRing );
+        m_cqHead = reinterpret_cast<unsigned*>( cq + params.cq_off.head );
+        m_cqTail = reinterpret_cast<unsigned*>( cq + params.cq_off.tail );
+        m_cqMask = reinterpret_cast<unsigned*>( cq + params.cq_off.ring_mask );
+        m_cqes = reinterpret_cast<io_uring_cqe*>( cq + params.cq_off.cqes );
+        return true;
+    }
+
+    //--------------------------------------------------------------------------
+    void
+    CIoUring::release()
+    {
+        if ( m_sqes != MAP_FAILED )
+            munmap( m_sqes, m_sqesSize );
+        if ( m_cqRing != MAP_FAILED && m_cqRing != m_sqRing )
+            munmap( m_cqRing, m_cqRingSize );
+        if ( m_sqRing != MAP_FAILED )
+            munmap( m_sqRing, m_sqRingSize );
+        if ( m_fd >= 0 )
+            close( m_fd );
+
+        m_sqes = static_cast<io_uring_sqe*>( MAP_FAILED );
+        m_cqRing = m_sqRing = MAP_FAILED;
+        m_fd = -1;
+    }
+
+    //--------------------------------------------------------------------------
+    io_uring_sqe*
+    CIoUring::nextEntry()
+    {
+        const unsigned tail = *m_sqTail;
+        if ( tail - __atomic_load_n( m_sqHead, __ATOMIC_ACQUIRE ) >= m_sqEntries )
+            return NULL;
+
+        const unsigned index = tail & *m_sqMask;
+        m_sqArray[index] = index;
+        memset( &m_sqes[index], 0, sizeof( io_uring_sqe ) );
+        return &m_sqes[index];
+    }
+
+    //--------------------------------------------------------------------------
+    void
+    CIoUring::push()
+    {
+        __atomic_store_n( m_sqTail, *m_sqTail + 1, __ATOMIC_RELEASE );
+        ++m_unsubmitted;
+    }
+
+    //--------------------------------------------------------------------------
+    bool
+    CIoUring::prepareRead( int fd, struct iovec* iov, quint64 offset, quint64 userData )
+    {
+        io_uring_sqe* sqe = nextEntry();
+        if ( !sqe )
+            return false;
+
+        sqe->opcode = IORING_OP_READV;
+        sqe->fd = fd;
+        sqe->addr = quint64( quintptr( iov ) );
+        sqe->len = 1;
+        sqe->off = offset;
+        sqe->user_data = userData;
+        push();
+        return true;
+    }
+
+    //--------------------------------------------------------------------------
+    bool
+    CIoUring::preparePoll( int fd, quint64 userData )
+    {
+        io_uring_sqe* sqe = nextEntry();
+        if ( !sqe )
+            return false;
+
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = fd;
+        sqe->poll_events = POLLIN;
+        sqe->user_data = userData;
+        push();
+        return true;
+    }
+
+    //--------------------------------------------------------------------------
+    int
+    CIoUring::enter( unsigned minComplete )
+    {
+        const int submitted = int( syscall( __NR_io_uring_enter, m_fd, m_unsubmitted, minComplete,
+                                            minComplete > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0 ) );
+        if ( submitted < 0 )
+            return -errno;
+
+        m_unsubmitted -= unsigned( submitted );
+        return submitted;
+    }
+
+    //--------------------------------------------------------------------------
+    bool
+    CIoUring::pop( quint64* userData, int* result )
+    {
+        const unsigned head = *m_cqHead;
+        if ( head == __atomic_load_n( m_cqTail, __ATOMIC_ACQUIRE ) )
+            return false;
+
+        const io_uring_cqe& cqe = m_cqes[head & *m_cqMask];
+        *userData = cqe.user_data;
+        *result = cqe.res;
+        __atomic_store_n( m_cqHead, head + 1, __ATOMIC_RELEASE );
+        return true;
+    }
+#endif
+}
+
+//------------------------------------------------------------------------------
+// Collects the requests of the calling threads and issues them. Runs the
+// io_uring loop itself, or hands the reads to a thread pool.
+class CAsyncFileReaderEngine : public QThread
+{
+public:
+    CAsyncFileReaderEngine( int queueDepth, int maxCoalescedBytes );
+    virtual ~CAsyncFileReaderEngine();
+
+    bool open( const QString& fileName, CAsyncFileReader::Backend backend );
+    CAsyncFileReader::Backend backend() const { return m_backend; }
+
+    bool read( qint64 offset, char* data, qint64 size );
+
+    // A blocking read on a pool thread
+    void readNow( CCoalescedRead* read );
+
+protected:
+    virtual void run();
+
+private:
+    void runThreadPool();
+    void coalesce( QVector<CReadRequest*>& batch );
+    void submitted( const CCoalescedRead* read );
+    void finish( CCoalescedRead* read, bool ok );
+    void failQueued();
+    void wake();
+
+    QFile m_file;
+    CAsyncFileReader::Backend m_backend;
+    const int m_queueDepth;
+    const qint64 m_maxCoalescedBytes;
+
+    QMutex m_mutex;
+    QWaitCondition m_work;
+    QWaitCondition m_done;
+    bool m_stop;
+    QVector<CReadRequest*> m_pending;
+    int m_inFlight;
+
+    // Merged reads waiting for a free place in the queue, I/O thread only
+    QList<CCoalescedRead*> m_queued;
+
+    QThreadPool m_pool;
+#ifndef Q_OS_UNIX
+    QMutex m_fileMutex;
+#endif
+
+#ifdef HAVE_IO_URING
+    void runIoUring();
+
+    CIoUring m_ring;
+    int m_event;
+#endif
+
+    CStatsCounter* m_requestStat;
+    CStatsCounter* m_readStat;
+    CStatsCounter* m_byteStat;
+    CStatsGauge* m_inFlightStat;
+};
+
+//------------------------------------------------------------------------------
+class CPoolRead : public QRunnable
+{
+public:
+    CPoolRead( CAsyncFileReaderEngine* engine, CCoalescedRead* read )
+        : m_engine( engine ),
+          m_read( read )
+    {
+    }
+
+    virtual void run()
+    {
+        m_engine->readNow( m_read );
+    }
+
+private:
+    CAsyncFileReaderEngine* m_engine;
+    CCoalescedRead* m_read;
+};
+
+//------------------------------------------------------------------------------
+CAsyncFileReaderEngine::CAsyncFileReaderEngine( int queueDepth, int maxCoalescedBytes )
+    : m_backend( CAsyncFileReader::ThreadPool ),
+      m_queueDepth( queueDepth ),
+      m_maxCoalescedBytes( maxCoalescedBytes ),
+      m_stop( false ),
+      m_inFlight( 0 ),
+#ifdef HAVE_IO_URING
+      m_event( -1 ),
+#endif
+      m_requestStat( CStats::instance().counter( "io.requests" ) ),
+      m_readStat( CStats::instance().counter( "io.reads" ) ),
+      m_byteStat( CStats::instance().counter( "io.bytes" ) ),
+      m_inFlightStat( CStats::instance().gauge( "io.inFlight" ) )
+{
+}
+
+//------------------------------------------------------------------------------
+CAsyncFileReaderEngine::~CAsyncFileReaderEngine()
+{
+    {
+        QMutexLocker locker( &m_mutex );
+        m_stop = true;
+        wake();
+    }
+    wait();
+
+#ifdef HAVE_IO_URING
+    if ( m_event >= 0 )
+        close( m_event );
+#endif
+}
+
+//------------------------------------------------------------------------------
+bool
+CAsyncFileReaderEngine::open( const QString& fileName, CAsyncFileReader::Backend backend )
+{
+    m_file.setFileName( fileName );
+    if ( !m_file.open( QIODevice::ReadOnly ) )
+    {
+        qWarning() << "Could not open" << fileName << m_file.errorString();
+        return false;
+    }
+
+    m_backend = CAsyncFileReader::ThreadPool;
+#ifdef HAVE_IO_URING
+    // One more entry for the wake up poll
+    if ( backend != CAsyncFileReader::ThreadPool && m_ring.setup( unsigned( m_queueDepth + 1 ) ) )
+    {
+        m_event = eventfd( 0, EFD_CLOEXEC | EFD_NONBLOCK );
+        if ( m_event >= 0 )
+            m_backend = CAsyncFileReader::IoUring;
+    }
+#endif
+    if ( backend == CAsyncFileReader::IoUring && m_backend != CAsyncFileReader::IoUring )
+    {
+        qWarning() << "io_uring is not available";
+        return false;
+    }
+
+    m_pool.setMaxThreadCount( m_queueDepth );
+    start();
+    return true;
+}
+
+//------------------------------------------------------------------------------
+bool
+CAsyncFileReaderEngine::read( qint64 offset, char* data, qint64 size )
+{
+    CReadRequest request( offset, data, size );
+    QMutexLocker locker( &m_mutex );
+    if ( m_stop )
+        return false;
+
+    // The I/O thread takes all pending requests at once, one wake up will do
+    if ( m_pending.isEmpty() )
+        wake();
+    m_pending.append( &request );
+    m_requestStat->add();
+
+    while ( !request.done )
+        m_done.wait( &m_mutex );
+    return request.ok;
+}
+
+//------------------------------------------------------------------------------
+void
+CAsyncFileReaderEngine::wake()
+{
+    m_work.wakeOne();
+#ifdef HAVE_IO_URING
+    if ( m_event >= 0 )
+        eventfd_write( m_event, 1 );
+#endif
+}
+
+//------------------------------------------------------------------------------
+void
+CAsyncFileReaderEngine::run()
+{
+#ifdef HAVE_IO_URING
+    if ( m_backend == CAsyncFileReader::IoUring )
+    {
+        runIoUring();
+        failQueued();
+        return;
+    }
+#endif
+    runThreadPool();
+    failQueued();
+}
+
+//------------------------------------------------------------------------------
+void
+CAsyncFileReaderEngine::coalesce( QVector<CReadRequest*>& batch )
+{
+    std::sort( batch.begin(), batch.end(), lowerOffset );
+
+    CCoalescedRead* read = NULL;
+    for ( int i = 0; i < batch.size(); ++i )
+    {
+        CReadRequest* request = batch.at( i );
+        if ( !read || request->offset != read->offset + read->size
+          || read->size + request->size > m_maxCoalescedBytes )
+        {
+            read = new CCoalescedRead;
+            read->offset = request->offset;
+            m_queued.append( read );
+        }
+        read->size += request->size;
+        read->requests.append( request );
+    }
+
+    for ( int i = m_queued.size() - 1; i >= 0 && !m_queued.at( i )->target; --i )
+    {
+        read = m_queued.at( i );
+        if ( read->requests.size() == 1 )
+        {
+            read->target = read->requests.first()->data;
+        }
+        else
+        {
+            read->buffer.resize( int( read->size ) );
+            read->target = read->buffer.data();
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+void
+CAsyncFileReaderEngine::submitted( const CCoalescedRead* read )
+{
+    QMutexLocker locker( &m_mutex );
+    ++m_inFlight;
+    m_inFlightStat->set( m_inFlight );
+    m_readStat->add();
+    m_byteStat->add( read->size );
+}
+
+//------------------------------------------------------------------------------
+void
+CAsyncFileReaderEngine::finish( CCoalescedRead* read, bool ok )
+{
+    // The callers are still blocked, their memory can be written unlocked
+    if ( ok && read->requests.size() > 1 )
+    {
+        for ( int i = 0; i < read->requests.size(); ++i )
+        {
+            CReadRequest* request = read->requests.at( i );
+            memcpy( request->data, read->target + ( request->offset - read->offset ), size_t( request->size ) );
+        }
+    }
+
+    QMutexLocker locker( &m_mutex );
+    for ( int i = 0; i < read->requests.size(); ++i )
+    {
+        read->requests.at( i )->ok = ok;
+        read->requests.at( i )->done = true;
+    }
+    --m_inFlight;
+    m_inFlightStat->set( m_inFlight );
+    m_done.wakeAll();
+    m_work.wakeOne();
+    delete read;
+}
+
+//------------------------------------------------------------------------------
+void
+CAsyncFileReaderEngine::failQueued()
+{
+    QMutexLocker locker( &m_mutex );
+    for ( int i = 0; i < m_queued.size(); ++i )
+    {
+        CCoalescedRead* read = m_queued.at( i );
+        for ( int j = 0; j < read->requests.size(); ++j )
+            read->requests.at( j )->done = true;
+        delete read;
+    }
+    m_queued.clear();
+
+    for ( int i = 0; i < m_pending.size(); ++i )
+        m_pending.at( i )->done = true;
+    m_pending.clear();
+    m_done.wakeAll();
+}
+
+//------------------------------------------------------------------------------
+void
+CAsyncFileReaderEngine::runThreadPool()
+{
+    while ( true )
+    {
+        QVector<CReadRequest*> batch;
+        {
+            QMutexLocker locker( &m_mutex );
+            while ( m_pending.isEmpty() && ( m_queued.isEmpty() || m_inFlight >= m_queueDepth )
+                 && !( m_stop && m_queued.isEmpty() ) )
+                m_work.wait( &m_mutex );
+
+            // Callers still waiting are served before the thread ends
+            if ( m_stop && m_pending.isEmpty() && m_queued.isEmpty() )
+                break;
+            batch.swap( m_pending );
+        }
+        coalesce( batch );
+
+        while ( !m_queued.isEmpty() )
+        {
+            {
+                QMutexLocker locker( &m_mutex );
+                if ( m_inFlight >= m_queueDepth )
+                    break;
+            }
+            CCoalescedRead* read = m_queued.takeFirst();
+            submitted( read );
+            m_pool.start( new CPoolRead( this, read ) );
+        }
+    }
+    m_pool.waitForDone();
+}
+
+//------------------------------------------------------------------------------
+void
+CAsyncFileReaderEngine::readNow( CCoalescedRead* read )
+{
+    bool ok = true;
+#ifdef Q_OS_UNIX
+    while ( ok && read->completed < read->size )
+    {
+        const ssize_t n = pread( m_file.handle(), read->target + read->completed,
+                                 size_t( read->size - read->completed ), off_t( read->offset + read->completed ) );
+        if ( n < 0 && errno == EINTR )
+            continue;
+        ok = n > 0;
+        if ( ok )
+            read->completed += n;
+    }
+#else
+    {
+        QMutexLocker locker( &m_fileMutex );
+        ok = m_file.seek( read->offset ) && m_file.read( read->target, read->size ) == read->size;
+    }
+#endif
+    finish( read, ok );
+}
+
+#ifdef HAVE_IO_URING
+//------------------------------------------------------------------------------
+void
+CAsyncFileReaderEngine::runIoUring()
+{
+    // Completions of the eventfd poll carry this instead of a read
+    const quint64 wakeUp = 0;
+    bool armed = false;
+    while ( true )
+    {
+        QVector<CReadRequest*> batch;
+        bool stopping;
+        int inFlight;
+        {
+            QMutexLocker locker( &m_mutex );
+            batch.swap( m_pending );
+            stopping = m_stop;
+            inFlight = m_inFlight;
+        }
+
+        coalesce( batch );
+        while ( !m_queued.isEmpty() )
+        {
+            // The rest of a short read is still counted as in flight
+            CCoalescedRead* read = m_queued.first();
+            if ( read->completed == 0 && inFlight >= m_queueDepth )
+                break;
+
+            read->iov.iov_base = read->target + read->completed;
+            read->iov.iov_len = size_t( read->size - read->completed );
+            if ( !m_ring.prepareRead( m_file.handle(), &read->iov, quint64( read->offset + read->completed ),
+                                      quint64( quintptr( read ) ) ) )
+                break;
+            m_queued.removeFirst();
+            if ( read->completed == 0 )
+            {
+                submitted( read );
+                ++inFlight;
+            }
+        }
+
+        // Callers still waiting are served before the thread ends
+        if ( stopping && inFlight == 0 && m_queued.isEmpty() )
+            break;
+
+        if ( !armed )
+            armed = m_ring.preparePoll( m_event, wakeUp );
+
+        const int result = m_ring.enter( 1 );
+        if ( result < 0 && result != -EINTR && result != -EAGAIN && result != -EBUSY )
+        {
+            qWarning() << "io_uring failed:" << strerror( -result );
+            break;
+        }
+
+        quint64 userData;
+        int res;
+        while ( m_ring.pop( &userData, &res ) )
+        {
+            if ( userData == wakeUp )
+            {
+                eventfd_t value;
+                eventfd_read( m_event, &value );
+                armed = false;
+                continue;
+            }
+
+            // Short reads continue where they stopped
+            CCoalescedRead* read = reinterpret_cast<CCoalescedRead*>( quintptr( userData ) );
+            if ( res > 0 && read->completed + res < read->size )
+            {
+                read->completed += res;
+                m_queued.prepend( read );
+                continue;
+            }
+            finish( read, res >= 0 && read->completed + res == read->size );
+        }
+    }
+}
+#endif
+
+//------------------------------------------------------------------------------
+CAsyncFileReader::CAsyncFileReader()
+    : m_engine(),
+      m_queueDepth( defaultQueueDepth ),
+      m_maxCoalescedBytes( defaultMaxCoalescedBytes )
+{
+}
+
+//------------------------------------------------------------------------------
+CAsyncFileReader::~CAsyncFileReader()
+{
+}
+
+//------------------------------------------------------------------------------
+bool
+CAsyncFileReader::open( const QString& fileName, Backend backend )
+{
+    m_engine.reset( new CAsyncFileReaderEngine( m_queueDepth, m_maxCoalescedBytes ) );
+    if ( !m_engine->open( fileName, backend ) )
+    {
+        m_engine.reset();
+        return false;
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void
+CAsyncFileReader::close()
+{
+    m_engine.reset();
+}
+
+//------------------------------------------------------------------------------
+bool
+CAsyncFileReader::isOpen() const
+{
+    return m_engine;
+}
+
+//------------------------------------------------------------------------------
+CAsyncFileReader::Backend
+CAsyncFileReader::backend() const
+{
+    return m_engine ? m_engine->backend() : Automatic;
+}
+
+//------------------------------------------------------------------------------
+bool
+CAsyncFileReader::read( qint64 offset, char* data, qint64 size )
+{
+    return m_engine && m_engine->read( offset, data, size );
+}
+
+//------------------------------------------------------------------------------
+QString
+CAsyncFileReader::backendName( Backend backend )
+{
+    switch ( backend )
+    {
+    case IoUring:
+        return "io_uring";
+    case ThreadPool:
+        return "thread pool";
+    default:
+        return "automatic";
+    }
+}
+
+//------------------------------------------------------------------------------
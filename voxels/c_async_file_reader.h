@@ -0,0 +1,56 @@
+#ifndef C_ASYNC_FILE_READER_H
+#define C_ASYNC_FILE_READER_H
+
+#include <QScopedPointer>
+#include <QString>
+
+class CAsyncFileReaderEngine;
+
+/**
+  Reads pieces of one file for many threads at once. Callers block in
+  read() while a single I/O thread collects their requests, merges the
+  ones that are adjacent on disk into larger reads and keeps up to
+  queueDepth() of those in flight.
+
+  On Linux the reads go through io_uring. Where it is missing or not
+  permitted, a thread pool issues ordinary positioned reads instead.
+  */
+class CAsyncFileReader
+{
+public:
+    enum Backend
+    {
+        Automatic,
+        IoUring,
+        ThreadPool
+    };
+
+    CAsyncFileReader();
+    ~CAsyncFileReader();
+
+    // Automatic picks io_uring when the kernel allows it
+    bool open( const QString& fileName, Backend backend = Automatic );
+    void close();
+    bool isOpen() const;
+    Backend backend() const;
+
+    // Takes effect on the next open()
+    void setQueueDepth( int depth ) { m_queueDepth = qMax( depth, 1 ); }
+    int queueDepth() const { return m_queueDepth; }
+
+    // Largest read adjacent requests are merged into
+    void setMaxCoalescedBytes( int bytes ) { m_maxCoalescedBytes = qMax( bytes, 1 ); }
+    int maxCoalescedBytes() const { return m_maxCoalescedBytes; }
+
+    // Blocks until size bytes at offset are in data. Thread safe.
+    bool read( qint64 offset, char* data, qint64 size );
+
+    static QString backendName( Backend backend );
+
+private:
+    QScopedPointer<CAsyncFileReaderEngine> m_engine;
+    int m_queueDepth;
+    int m_maxCoalescedBytes;
+};
+
+#endif // C_ASYNC_FILE_READER_H
@@ -0,0 +1,170 @@
+#include "c_block_compression.h"
+
+#include <string.h>
+
+namespace
+{
+    const int blockVoxels = BlockCompression::blockEdge * BlockCompression::blockEdge * BlockCompression::blockEdge;
+
+    // Stored voxel of a block voxel, repeating the last voxel into the
+    // padding of the last block
+    inline int stored( int block, int voxel )
+    {
+        return qMin( block * BlockCompression::blockEdge + voxel, VoxelConfig::storedBrickEdge - 1 );
+    }
+
+    // Endpoints in the first word and an index of bits bits per value after
+    // it. Returns the largest error.
+    int encodeRamp( const quint8* values, int bits, quint32* words, quint32 extra = 0 )
+    {
+        int lo = 255;
+        int hi = 0;
+        for ( int i = 0; i < blockVoxels; ++i )
+        {
+            lo = qMin( lo, int( values[i] ) );
+            hi = qMax( hi, int( values[i] ) );
+        }
+
+        const int steps = ( 1 << bits ) - 1;
+        const int range = hi - lo;
+        memset( words, 0, ( 1 + 2 * bits ) * sizeof( quint32 ) );
+        words[0] = quint32( lo ) | ( quint32( hi ) << 8 ) | ( extra << 16 );
+
+        int error = 0;
+        for ( int i = 0; range > 0 && i < blockVoxels; ++i )
+        {
+            const int k = ( ( values[i] - lo ) * steps + range / 2 ) / range;
+            const int decoded = lo + ( range * k + steps / 2 ) / steps;
+            error = qMax( error, qAbs( decoded - int( values[i] ) ) );
+
+            const int bit = bits * i;
+            const int shift = bit & 31;
+            words[1 + ( bit >> 5 )] |= quint32( k ) << shift;
+            if ( shift + bits > 32 )
+                words[2 + ( bit >> 5 )] |= quint32( k ) >> ( 32 - shift );
+        }
+        return error;
+    }
+
+    inline quint32 to565( const int rgb[3] )
+    {
+        return quint32( ( rgb[0] * 31 + 511 ) / 1023 )
+             | ( quint32( ( rgb[1] * 63 + 511 ) / 1023 ) << 5 )
+             | ( quint32( ( rgb[2] * 31 + 511 ) / 1023 ) << 11 );
+    }
+
+    inline void from565( quint32 c, float rgb[3] )
+    {
+        rgb[0] = float( c & 31 ) / 31.0f;
+        rgb[1] = float( ( c >> 5 ) & 63 ) / 63.0f;
+        rgb[2] = float( c >> 11 ) / 31.0f;
+    }
+
+    // Corners of the bounding box as endpoints, each voxel to the nearest
+    // of four steps along the diagonal
+    void encodeColors( const quint32* colors, quint32* words )
+    {
+        int lo[3] = { 1023, 1023, 1023 };
+        int hi[3] = { 0, 0, 0 };
+        for ( int i = 0; i < blockVoxels; ++i )
+            for ( int c = 0; c < 3; ++c )
+            {
+                const int v = int( ( colors[i] >> ( 10 * c ) ) & 0x3ff );
+                lo[c] = qMin( lo[c], v );
+                hi[c] = qMax( hi[c], v );
+            }
+
+        const quint32 c0 = to565( lo );
+        const quint32 c1 = to565( hi );
+        memset( words, 0, BlockCompression::colorWords * sizeof( quint32 ) );
+        words[0] = c0 | ( c1 << 16 );
+
+        float e0[3];
+        float e1[3];
+        from565( c0, e0 );
+        from565( c1, e1 );
+        float axis[3];
+        float length = 0.0f;
+        for ( int c = 0; c < 3; ++c )
+        {
+            axis[c] = e1[c] - e0[c];
+            length += axis[c] * axis[c];
+        }
+        if ( length <= 0.0f )
+            return;
+
+        for ( int i = 0; i < blockVoxels; ++i )
+        {
+            float t = 0.0f;
+            for ( int c = 0; c < 3; ++c )
+                t += ( float( ( colors[i] >> ( 10 * c ) ) & 0x3ff ) / 1023.0f - e0[c] ) * axis[c];
+            const int k = qBound( 0, int( t / length * 3.0f + 0.5f ), 3 );
+            words[1 + i / 16] |= quint32( k ) << ( 2 * ( i % 16 ) );
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+int
+BlockCompression::encodeBlock( const CBrick& brick, int i, int j, int k, quint32* words )
+{
+    quint8 density[blockVoxels];
+    quint8 normalU[blockVoxels];
+    quint8 normalV[blockVoxels];
+    quint8 visibility[blockVoxels];
+    quint32 colors[blockVoxels];
+    int distance = 255;
+
+    for ( int z = 0; z < blockEdge; ++z )
+        for ( int y = 0; y < blockEdge; ++y )
+            for ( int x = 0; x < blockEdge; ++x )
+            {
+                const int v = x + blockEdge * ( y + blockEdge * z );
+                const int index = CBrick::index( stored( i, x ), stored( j, y ), stored( k, z ) );
+                const quint32 normal = brick.normals.at( index );
+                density[v] = brick.voxels.at( index );
+                normalU[v] = quint8( normal );
+                normalV[v] = quint8( normal >> 8 );
+                visibility[v] = quint8( normal >> 16 );
+                colors[v] = brick.colors.at( index );
+
+                // Leaping by the smallest distance of the block never
+                // goes further than from any voxel of it
+                distance = qMin( distance, int( normal >> 24 ) );
+            }
+
+    const int error = encodeRamp( density, 4, words, quint32( distance ) );
+    encodeRamp( normalU, 3, words + normalUOffset );
+    encodeRamp( normalV, 3, words + normalVOffset );
+    encodeRamp( visibility, 3, words + visibilityOffset );
+    encodeColors( colors, words + colorOffset );
+    return error;
+}
+
+//------------------------------------------------------------------------------
+int
+BlockCompression::encode( const CBrick& brick, QVector<quint32>& blocks )
+{
+    blocks.resize( brickWords );
+    quint32* words = blocks.data();
+    int error = 0;
+    for ( int k = 0; k < blocksPerAxis; ++k )
+        for ( int j = 0; j < blocksPerAxis; ++j )
+            for ( int i = 0; i < blocksPerAxis; ++i )
+                error = qMax( error, encodeBlock( brick, i, j, k, words + blockIndex( i, j, k ) * blockWords ) );
+    return error;
+}
+
+//------------------------------------------------------------------------------
+quint8
+BlockCompression::decodeDensity( const quint32* words, int x, int y, int z )
+{
+    const quint32* block = words + blockIndex( x / blockEdge, y / blockEdge, z / blockEdge ) * blockWords;
+    const int v = x % blockEdge + blockEdge * ( y % blockEdge + blockEdge * ( z % blockEdge ) );
+    const int lo = int( block[0] & 0xff );
+    const int hi = int( ( block[0] >> 8 ) & 0xff );
+    const int k = int( ( block[1 + v / 8] >> ( 4 * ( v % 8 ) ) ) & 15 );
+    return quint8( lo + ( ( hi - lo ) * k + 7 ) / 15 );
+}
+
+//------------------------------------------------------------------------------
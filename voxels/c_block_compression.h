@@ -0,0 +1,60 @@
+#ifndef C_BLOCK_COMPRESSION_H
+#define C_BLOCK_COMPRESSION_H
+
+#include "c_brick.h"
+
+/**
+  Block compressed bricks for the compressed brick pool, decoded by the
+  marcher in gigavoxels.frag. A stored brick is cut into 4x4x4 blocks,
+  the last ones padded by repeating the edge voxels. Each block is 35
+  words:
+
+    0..8    density, endpoints in bits 0..15 of the first word and the
+            smallest empty space distance of the block in bits 16..23,
+            then a 4 bit index per voxel into the 16 steps between them
+    9..15   normal u, endpoints and a 3 bit index per voxel, the indices
+            packed across word boundaries
+    16..22  normal v, the same way
+    23..29  visibility, the same way
+    30..34  colour, two RGB565 endpoints and a 2 bit index per voxel
+
+  Voxels are numbered x + 4 * y + 16 * z within their block. Endpoints
+  are the smallest and largest value of the block, so a decoded density
+  is never further than 1/30 of the block's range, or 8.5 of 255, from
+  the original. Bricks take 3780 bytes instead of 9000.
+  */
+namespace BlockCompression
+{
+    const int blockEdge = 4;
+    const int blocksPerAxis = ( VoxelConfig::storedBrickEdge + blockEdge - 1 ) / blockEdge;
+    const int blocksPerBrick = blocksPerAxis * blocksPerAxis * blocksPerAxis;
+
+    // Offsets of the channels in a block, in words
+    const int densityWords = 9;
+    const int rampWords = 7;
+    const int colorWords = 5;
+    const int normalUOffset = densityWords;
+    const int normalVOffset = normalUOffset + rampWords;
+    const int visibilityOffset = normalVOffset + rampWords;
+    const int colorOffset = visibilityOffset + rampWords;
+    const int blockWords = colorOffset + colorWords;
+    const int brickWords = blocksPerBrick * blockWords;
+
+    inline int blockIndex( int i, int j, int k )
+    {
+        return ( k * blocksPerAxis + j ) * blocksPerAxis + i;
+    }
+
+    // Encodes block ( i, j, k ) of a derived brick into blockWords words and
+    // returns the largest density error, in steps of 255
+    int encodeBlock( const CBrick& brick, int i, int j, int k, quint32* words );
+
+    // Every block of the brick, see CBrick::blocks
+    int encode( const CBrick& brick, QVector<quint32>& blocks );
+
+    // The density of stored voxel ( x, y, z ) of an encoded brick, like the
+    // marcher decodes it
+    quint8 decodeDensity( const quint32* words, int x, int y, int z );
+}
+
+#endif // C_BLOCK_COMPRESSION_H
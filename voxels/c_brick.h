@@ -0,0 +1,97 @@
+#ifndef C_BRICK_H
+#define C_BRICK_H
+
+#include "c_node_key.h"
+#include "c_voxel_config.h"
+
+#include <QVector>
+
+/**
+  A box of voxels [lo, hi) inside a stored brick, border included.
+  */
+class CBrickRegion
+{
+public:
+    CBrickRegion()
+    {
+        lo[0] = lo[1] = lo[2] = 0;
+        hi[0] = hi[1] = hi[2] = VoxelConfig::storedBrickEdge;
+    }
+
+    bool isEmpty() const { return hi[0] <= lo[0] || hi[1] <= lo[1] || hi[2] <= lo[2]; }
+    int voxelCount() const { return isEmpty() ? 0 : ( hi[0] - lo[0] ) * ( hi[1] - lo[1] ) * ( hi[2] - lo[2] ); }
+
+    // Grown by n voxels on every side, clamped to the stored brick
+    CBrickRegion grown( int n ) const
+    {
+        CBrickRegion region;
+        for ( int axis = 0; axis < 3; ++axis )
+        {
+            region.lo[axis] = qMax( lo[axis] - n, 0 );
+            region.hi[axis] = qMin( hi[axis] + n, int( VoxelConfig::storedBrickEdge ) );
+        }
+        return region;
+    }
+
+    int lo[3];
+    int hi[3];
+};
+
+/**
+  The voxel payload of one octree node, including its border, together
+  with the scheduling state it travels with.
+  */
+class CBrick : public CBrickStorage<VoxelConfig::Layout>
+{
+public:
+    CBrick()
+        : key(),
+          priority( 0.0f ),
+          prefetch( false ),
+          occupancy( ~quint64( 0 ) ),
+          minValue( 0 ),
+          maxValue( 255 ),
+          contentHash( 0 )
+    {
+    }
+
+    explicit CBrick( const CNodeKey& k, float p = 0.0f )
+        : key( k ),
+          priority( p ),
+          prefetch( false ),
+          occupancy( ~quint64( 0 ) ),
+          minValue( 0 ),
+          maxValue( 255 ),
+          contentHash( 0 )
+    {
+    }
+
+    CNodeKey key;
+    float priority;
+    bool prefetch;
+
+    // Packed shading attributes, see c_voxel_attributes.h. Only non-constant
+    // bricks carry them.
+    QVector<quint32> colors;
+    QVector<quint32> normals;
+
+    // Cells that can hold density, see c_occupancy.h. Derived with the
+    // attributes; until then every cell counts as occupied.
+    quint64 occupancy;
+
+    // Values anywhere in the brick or, for the editor, in edits below it.
+    // Derived with the attributes; until then the full range.
+    quint8 minValue;
+    quint8 maxValue;
+
+    // Of the densities and attributes, see c_content_hash.h. Derived with
+    // the attributes.
+    quint64 contentHash;
+
+    // The densities and attributes block compressed, see
+    // c_block_compression.h. Only encoded for a compressed brick pool, and
+    // dropped whenever the attributes are derived again.
+    QVector<quint32> blocks;
+};
+
+#endif // C_BRICK_H
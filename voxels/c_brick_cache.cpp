@@ -0,0 +1,180 @@
+#include "c_brick_cache.h"
+#include "c_stats.h"
+
+#include <QReadLocker>
+#include <QWriteLocker>
+
+//------------------------------------------------------------------------------
+CBrickCache::CBrickCache( qint64 budgetBytes )
+    : m_hand( 0 ),
+      m_bytes( 0 ),
+      m_budget( budgetBytes ),
+      m_hitStat( CStats::instance().counter( "hostCache.hits" ) ),
+      m_missStat( CStats::instance().counter( "hostCache.misses" ) ),
+      m_evictionStat( CStats::instance().counter( "hostCache.evictions" ) ),
+      m_bytesStat( CStats::instance().gauge( "hostCache.bytes" ) )
+{
+}
+
+//------------------------------------------------------------------------------
+void
+CBrickCache::setBudget( qint64 bytes )
+{
+    QWriteLocker locker( &m_lock );
+    m_budget = bytes;
+    evict( 0 );
+}
+
+//------------------------------------------------------------------------------
+qint64
+CBrickCache::bytes() const
+{
+    QReadLocker locker( &m_lock );
+    return m_bytes;
+}
+
+//------------------------------------------------------------------------------
+int
+CBrickCache::count() const
+{
+    QReadLocker locker( &m_lock );
+    return m_index.size();
+}
+
+//------------------------------------------------------------------------------
+bool
+CBrickCache::find( CBrick& brick ) const
+{
+    QReadLocker locker( &m_lock );
+    QHash<CNodeKey, int>::const_iterator it = m_index.constFind( brick.key );
+    if ( it == m_index.constEnd() )
+    {
+        m_misses.fetchAndAddRelaxed( 1 );
+        m_missStat->add();
+        return false;
+    }
+
+    // The voxels are shared with the cache until someone writes to them
+    const Entry& entry = m_entries.at( it.value() );
+    entry.referenced.store( 1 );
+    static_cast<Payload&>( brick ) = entry.payload;
+    m_hits.fetchAndAddRelaxed( 1 );
+    m_hitStat->add();
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void
+CBrickCache::insert( const CBrick& brick )
+{
+    const qint64 size = entryBytes( brick );
+    QWriteLocker locker( &m_lock );
+    if ( size > m_budget )
+        return;
+
+    QHash<CNodeKey, int>::const_iterator it = m_index.constFind( brick.key );
+    if ( it != m_index.constEnd() )
+        removeEntry( it.value() );
+    evict( size );
+
+    int slot;
+    if ( !m_free.isEmpty() )
+    {
+        slot = m_free.last();
+        m_free.removeLast();
+    }
+    else
+    {
+        slot = m_entries.size();
+        m_entries.resize( slot + 1 );
+    }
+
+    // New entries start unreferenced, so bricks read once and never again
+    // are the first to go
+    Entry& entry = m_entries[slot];
+    entry.key = brick.key;
+    entry.payload = brick;
+    entry.bytes = size;
+    entry.used = true;
+    entry.referenced.store( 0 );
+    m_index.insert( brick.key, slot );
+    m_bytes += size;
+    m_bytesStat->set( m_bytes );
+}
+
+//------------------------------------------------------------------------------
+void
+CBrickCache::remove( const CNodeKey& key )
+{
+    QWriteLocker locker( &m_lock );
+    QHash<CNodeKey, int>::const_iterator it = m_index.constFind( key );
+    if ( it != m_index.constEnd() )
+        removeEntry( it.value() );
+}
+
+//------------------------------------------------------------------------------
+void
+CBrickCache::clear()
+{
+    QWriteLocker locker( &m_lock );
+    m_index.clear();
+    m_entries.clear();
+    m_free.clear();
+    m_hand = 0;
+    m_bytes = 0;
+    m_bytesStat->set( 0 );
+}
+
+//------------------------------------------------------------------------------
+void
+CBrickCache::resetStatistics()
+{
+    m_hits.store( 0 );
+    m_misses.store( 0 );
+    m_evictions.store( 0 );
+}
+
+//------------------------------------------------------------------------------
+qint64
+CBrickCache::entryBytes( const Payload& payload )
+{
+    // Bookkeeping of an entry, which is all a constant brick costs
+    const qint64 overhead = sizeof( Entry ) + 2 * sizeof( void* );
+    return overhead + qint64( payload.voxels.size() ) * sizeof( Payload::Voxel );
+}
+
+//------------------------------------------------------------------------------
+void
+CBrickCache::evict( qint64 needed )
+{
+    // Each pass of the hand clears the bits it sees, so two full turns
+    // always find enough unreferenced entries
+    int steps = 2 * m_entries.size();
+    while ( m_bytes + needed > m_budget && !m_index.isEmpty() && steps-- >= 0 )
+    {
+        m_hand = m_hand % m_entries.size();
+        Entry& entry = m_entries[m_hand];
+        if ( entry.used && !entry.referenced.fetchAndStoreRelaxed( 0 ) )
+        {
+            removeEntry( m_hand );
+            m_evictions.fetchAndAddRelaxed( 1 );
+            m_evictionStat->add();
+        }
+        ++m_hand;
+    }
+}
+
+//------------------------------------------------------------------------------
+void
+CBrickCache::removeEntry( int slot )
+{
+    Entry& entry = m_entries[slot];
+    m_index.remove( entry.key );
+    m_bytes -= entry.bytes;
+    entry.payload = Payload();
+    entry.used = false;
+    m_free.append( slot );
+    m_bytesStat->set( m_bytes );
+}
+
+//------------------------------------------------------------------------------
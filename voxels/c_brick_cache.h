@@ -0,0 +1,86 @@
+#ifndef C_BRICK_CACHE_H
+#define C_BRICK_CACHE_H
+
+#include "c_brick.h"
+
+#include <QAtomicInteger>
+#include <QHash>
+#include <QReadWriteLock>
+#include <QVector>
+
+class CStatsCounter;
+class CStatsGauge;
+
+/**
+  Host memory tier between the producers and the GPU brick pool. Keeps
+  the voxel payloads of produced bricks up to a byte budget, so bricks
+  evicted from the pool come back without another read from storage.
+
+  Lookups from producer threads share a read lock and only set a
+  reference bit. Inserts evict with the CLOCK policy, weighed by size:
+  the hand keeps sweeping until enough bytes are free, so one large brick
+  displaces several small unreferenced ones rather than one hot one.
+  */
+class CBrickCache
+{
+public:
+    typedef CBrickStorage<VoxelConfig::Layout> Payload;
+
+    explicit CBrickCache( qint64 budgetBytes = 256 * 1024 * 1024 );
+
+    // Shrinking the budget evicts right away
+    void setBudget( qint64 bytes );
+    qint64 budget() const { return m_budget; }
+    qint64 bytes() const;
+    int count() const;
+
+    // Fills the payload of brick if its key is cached
+    bool find( CBrick& brick ) const;
+    void insert( const CBrick& brick );
+    void remove( const CNodeKey& key );
+    void clear();
+
+    qint64 hitCount() const { return m_hits.load(); }
+    qint64 missCount() const { return m_misses.load(); }
+    qint64 evictionCount() const { return m_evictions.load(); }
+    void resetStatistics();
+
+private:
+    class Entry
+    {
+    public:
+        Entry() : bytes( 0 ), used( false ) {}
+
+        CNodeKey key;
+        Payload payload;
+        qint64 bytes;
+        bool used;
+
+        // Set by lookups, cleared as the hand passes
+        mutable QAtomicInt referenced;
+    };
+
+    static qint64 entryBytes( const Payload& payload );
+    void evict( qint64 needed );
+    void removeEntry( int slot );
+
+    mutable QReadWriteLock m_lock;
+    QHash<CNodeKey, int> m_index;
+    QVector<Entry> m_entries;
+    QVector<int> m_free;
+    int m_hand;
+    qint64 m_bytes;
+    qint64 m_budget;
+
+    mutable QAtomicInteger<qint64> m_hits;
+    mutable QAtomicInteger<qint64> m_misses;
+    QAtomicInteger<qint64> m_evictions;
+
+    // Totals since startup, unlike the counts above
+    CStatsCounter* m_hitStat;
+    CStatsCounter* m_missStat;
+    CStatsCounter* m_evictionStat;
+    CStatsGauge* m_bytesStat;
+};
+
+#endif // C_BRICK_CACHE_H
@@ -0,0 +1,380 @@
+#include "c_brick_file.h"
+#include "c_content_hash.h"
+
+#include <QDataStream>
+#include <QDebug>
+
+#include <string.h>
+
+//------------------------------------------------------------------------------
+CBrickFileHeader::CBrickFileHeader()
+    : version( currentVersion ),
+      brickEdge( VoxelConfig::brickEdge ),
+      brickBorder( VoxelConfig::brickBorder ),
+      finestLevel( 0 ),
+      indexOffset( 0 ),
+      brickCount( 0 ),
+      frameCount( 1 ),
+      framesPerSecond( 30 )
+{
+    dimensions[0] = dimensions[1] = dimensions[2] = 0;
+}
+
+//------------------------------------------------------------------------------
+static QDataStream&
+operator<<( QDataStream& stream, const CBrickFileHeader& header )
+{
+    stream.writeRawData( CBrickFileHeader::magic(), 8 );
+    stream << header.version << header.brickEdge << header.brickBorder << header.finestLevel
+           << header.dimensions[0] << header.dimensions[1] << header.dimensions[2]
+           << header.indexOffset << header.brickCount << header.frameCount << header.framesPerSecond;
+
+    // Pad to the fixed header size
+    const int used = 8 + 9 * 4 + 2 * 8;
+    const QByteArray padding( CBrickFileHeader::size - used, '\0' );
+    stream.writeRawData( padding.constData(), padding.size() );
+    return stream;
+}
+
+//------------------------------------------------------------------------------
+static bool
+readHeader( QDataStream& stream, CBrickFileHeader& header )
+{
+    char magic[8];
+    if ( stream.readRawData( magic, 8 ) != 8 || memcmp( magic, CBrickFileHeader::magic(), 8 ) != 0 )
+        return false;
+
+    stream >> header.version >> header.brickEdge >> header.brickBorder >> header.finestLevel
+           >> header.dimensions[0] >> header.dimensions[1] >> header.dimensions[2]
+           >> header.indexOffset >> header.brickCount;
+
+    // Single volumes before version 2
+    header.frameCount = 1;
+    header.framesPerSecond = 30;
+    if ( header.version >= 2 )
+        stream >> header.frameCount >> header.framesPerSecond;
+    return stream.status() == QDataStream::Ok && header.frameCount > 0;
+}
+
+//------------------------------------------------------------------------------
+static CBrickFileEntry
+emptyEntry()
+{
+    CBrickFileEntry entry;
+    entry.constant = true;
+    entry.value = 0;
+    return entry;
+}
+
+//------------------------------------------------------------------------------
+CBrickFileWriter::CBrickFileWriter()
+    : m_offset( 0 ),
+      m_sharedCount( 0 ),
+      m_sharedBytes( 0 ),
+      m_frame( 0 ),
+      m_changedCount( 0 )
+{
+}
+
+//------------------------------------------------------------------------------
+CBrickFileWriter::~CBrickFileWriter()
+{
+    if ( m_file.isOpen() )
+        close();
+}
+
+//------------------------------------------------------------------------------
+bool
+CBrickFileWriter::open( const QString& fileName, int finestLevel, const int dimensions[3] )
+{
+    // Read back to compare payloads whose hashes match
+    m_file.setFileName( fileName );
+    if ( !m_file.open( QIODevice::ReadWrite | QIODevice::Truncate ) )
+        return false;
+
+    m_header = CBrickFileHeader();
+    m_header.finestLevel = finestLevel;
+    for ( int axis = 0; axis < 3; ++axis )
+        m_header.dimensions[axis] = dimensions[axis];
+    m_index.clear();
+    m_offset = CBrickFileHeader::size;
+    m_payloads.clear();
+    m_sharedCount = 0;
+    m_sharedBytes = 0;
+    m_frame = 0;
+    m_previous.clear();
+    m_changedCount = 0;
+
+    // Placeholder until the index offset is known
+    return writeHeader();
+}
+
+//------------------------------------------------------------------------------
+bool
+CBrickFileWriter::write( const CBrick& brick )
+{
+    CBrickFileEntry entry;
+    entry.constant = brick.constant;
+    entry.value = brick.value;
+    entry.frame = quint32( m_frame );
+
+    // Empty nodes are implied by their absence
+    if ( m_frame == 0 && entry.isEmpty() )
+        return true;
+
+    if ( !brick.constant )
+    {
+        const qint64 size = brick.voxels.size();
+        const quint64 hash = ContentHash::hash( brick.voxels.constData(), int( size ) );
+        const qint64 earlier = findPayload( brick, hash );
+        if ( earlier >= 0 )
+        {
+            entry.offset = quint64( earlier );
+            ++m_sharedCount;
+            m_sharedBytes += size;
+        }
+        else
+        {
+            entry.offset = m_offset;
+            if ( m_file.write( reinterpret_cast<const char*>( brick.voxels.constData() ), size ) != size )
+                return false;
+            m_payloads.insert( hash, m_offset );
+            m_offset += size;
+        }
+    }
+
+    // Equal payloads share their offset, so an unchanged brick has the
+    // offset it had
+    if ( m_frame > 0 )
+    {
+        const CBrickFileEntry previous = m_previous.value( brick.key, emptyEntry() );
+        if ( previous.constant == entry.constant
+          && ( entry.constant ? previous.value == entry.value : previous.offset == entry.offset ) )
+        {
+            return true;
+        }
+        m_previous.insert( brick.key, entry );
+        ++m_changedCount;
+    }
+
+    m_index.append( qMakePair( brick.key, entry ) );
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void
+CBrickFileWriter::beginFrame()
+{
+    if ( m_frame == 0 )
+    {
+        for ( int i = 0; i < m_index.size(); ++i )
+            m_previous.insert( m_index.at( i ).first, m_index.at( i ).second );
+    }
+    ++m_frame;
+    m_header.frameCount = quint32( m_frame + 1 );
+}
+
+//------------------------------------------------------------------------------
+bool
+CBrickFileWriter::close()
+{
+    m_header.indexOffset = m_offset;
+    m_header.brickCount = m_index.size();
+
+    QDataStream stream( &m_file );
+    stream.setByteOrder( QDataStream::LittleEndian );
+    for ( int i = 0; i < m_index.size(); ++i )
+    {
+        const CNodeKey& key = m_index.at( i ).first;
+        const CBrickFileEntry& entry = m_index.at( i ).second;
+        stream << key.level << key.x << key.y << key.z << entry.offset
+               << quint8( entry.constant ) << entry.value << entry.frame;
+    }
+
+    const bool ok = stream.status() == QDataStream::Ok && writeHeader();
+    m_file.close();
+    return ok;
+}
+
+//------------------------------------------------------------------------------
+qint64
+CBrickFileWriter::findPayload( const CBrick& brick, quint64 hash )
+{
+    const qint64 size = brick.voxels.size();
+    QByteArray written;
+    for ( QMultiHash<quint64, quint64>::const_iterator it = m_payloads.constFind( hash );
+          it != m_payloads.constEnd() && it.key() == hash; ++it )
+    {
+        // Hashes only point at candidates
+        if ( !m_file.seek( qint64( it.value() ) ) )
+            break;
+        written = m_file.read( size );
+        if ( written.size() == size && memcmp( written.constData(), brick.voxels.constData(), size_t( size ) ) == 0 )
+        {
+            m_file.seek( qint64( m_offset ) );
+            return qint64( it.value() );
+        }
+    }
+
+    m_file.seek( qint64( m_offset ) );
+    return -1;
+}
+
+//------------------------------------------------------------------------------
+bool
+CBrickFileWriter::writeHeader()
+{
+    const qint64 end = m_file.pos();
+    if ( !m_file.seek( 0 ) )
+        return false;
+
+    QDataStream stream( &m_file );
+    stream.setByteOrder( QDataStream::LittleEndian );
+    stream << m_header;
+
+    return stream.status() == QDataStream::Ok && m_file.seek( qMax( end, qint64( CBrickFileHeader::size ) ) );
+}
+
+//------------------------------------------------------------------------------
+CBrickFileReader::CBrickFileReader()
+    : m_frame( 0 )
+{
+}
+
+//------------------------------------------------------------------------------
+bool
+CBrickFileReader::open( const QString& fileName, CAsyncFileReader::Backend backend )
+{
+    m_file.setFileName( fileName );
+    if ( !m_file.open( QIODevice::ReadOnly ) )
+    {
+        qWarning() << "Could not open brick file" << fileName << m_file.errorString();
+        return false;
+    }
+
+    QDataStream stream( &m_file );
+    stream.setByteOrder( QDataStream::LittleEndian );
+    if ( !readHeader( stream, m_header )
+      || m_header.version < 1 || m_header.version > CBrickFileHeader::currentVersion
+      || m_header.brickEdge != quint32( VoxelConfig::brickEdge )
+      || m_header.brickBorder != quint32( VoxelConfig::brickBorder ) )
+    {
+        qWarning() << "Unsupported brick file" << fileName;
+        return false;
+    }
+
+    m_file.seek( m_header.indexOffset );
+    m_index.clear();
+    m_index.reserve( int( m_header.brickCount ) );
+    m_changes.clear();
+    m_changes.resize( int( m_header.frameCount ) );
+    m_frame = 0;
+    for ( quint64 i = 0; i < m_header.brickCount; ++i )
+    {
+        CNodeKey key;
+        CBrickFileEntry entry;
+        quint8 constant;
+        stream >> key.level >> key.x >> key.y >> key.z >> entry.offset >> constant >> entry.value;
+        if ( m_header.version >= 2 )
+            stream >> entry.frame;
+        entry.constant = constant != 0;
+
+        if ( entry.frame == 0 )
+        {
+            m_index.insert( key, entry );
+        }
+        else if ( entry.frame < m_header.frameCount )
+        {
+            CChange change;
+            change.key = key;
+            change.after = entry;
+            m_changes[int( entry.frame )].append( change );
+        }
+    }
+
+    // Play the sequence through once to learn what each change replaces,
+    // then rewind to the first frame
+    for ( int frame = 1; frame < m_changes.size(); ++frame )
+    {
+        QVector<CChange>& changes = m_changes[frame];
+        for ( int i = 0; i < changes.size(); ++i )
+        {
+            changes[i].before = m_index.value( changes.at( i ).key, emptyEntry() );
+            apply( changes.at( i ).key, changes.at( i ).after );
+        }
+    }
+    for ( int frame = m_changes.size() - 1; frame > 0; --frame )
+    {
+        const QVector<CChange>& changes = m_changes.at( frame );
+        for ( int i = changes.size() - 1; i >= 0; --i )
+            apply( changes.at( i ).key, changes.at( i ).before );
+    }
+
+    return stream.status() == QDataStream::Ok && m_payloads.open( fileName, backend );
+}
+
+//------------------------------------------------------------------------------
+void
+CBrickFileReader::setFrame( int frame, QVector<CNodeKey>* changed )
+{
+    frame = qBound( 0, frame, frameCount() - 1 );
+
+    QWriteLocker locker( &m_lock );
+    while ( m_frame < frame )
+    {
+        const QVector<CChange>& changes = m_changes.at( ++m_frame );
+        for ( int i = 0; i < changes.size(); ++i )
+        {
+            apply( changes.at( i ).key, changes.at( i ).after );
+            changed->append( changes.at( i ).key );
+        }
+    }
+    while ( m_frame > frame )
+    {
+        const QVector<CChange>& changes = m_changes.at( m_frame-- );
+        for ( int i = changes.size() - 1; i >= 0; --i )
+        {
+            apply( changes.at( i ).key, changes.at( i ).before );
+            changed->append( changes.at( i ).key );
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+void
+CBrickFileReader::apply( const CNodeKey& key, const CBrickFileEntry& entry )
+{
+    if ( entry.isEmpty() )
+        m_index.remove( key );
+    else
+        m_index.insert( key, entry );
+}
+
+//------------------------------------------------------------------------------
+bool
+CBrickFileReader::read( CBrick& brick )
+{
+    CBrickFileEntry entry = emptyEntry();
+    {
+        QReadLocker locker( &m_lock );
+        QHash<CNodeKey, CBrickFileEntry>::const_iterator it = m_index.constFind( brick.key );
+        if ( it != m_index.constEnd() )
+            entry = it.value();
+    }
+
+    if ( entry.constant )
+    {
+        brick.constant = true;
+        brick.value = entry.value;
+        brick.voxels.clear();
+        return true;
+    }
+
+    brick.constant = false;
+    brick.voxels.resize( VoxelConfig::storedBrickVoxels );
+
+    return m_payloads.read( qint64( entry.offset ), reinterpret_cast<char*>( brick.voxels.data() ),
+                            brick.voxels.size() * sizeof( CBrick::Voxel ) );
+}
+
+//------------------------------------------------------------------------------
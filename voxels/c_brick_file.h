@@ -0,0 +1,181 @@
+#ifndef C_BRICK_FILE_H
+#define C_BRICK_FILE_H
+
+#include "c_async_file_reader.h"
+#include "c_brick.h"
+
+#include <QFile>
+#include <QHash>
+#include <QReadWriteLock>
+#include <QString>
+#include <QVector>
+
+/**
+  Bricked level of detail volume on disk. The file starts with a fixed
+  header, followed by the payloads of the non-constant bricks, and ends
+  with an index of every stored node. Nodes missing from the index are
+  empty. Nodes with identical payloads may point at the same one.
+
+  A file may hold a sequence of frames of the same volume. The index then
+  lists every node of frame 0, and after that only the nodes that changed
+  from one frame to the next, with the frame they changed in. A node that
+  became empty is listed as constant zero.
+  */
+class CBrickFileHeader
+{
+public:
+    CBrickFileHeader();
+
+    static const char* magic() { return "GVBRICKS"; }
+    static const quint32 currentVersion = 2;
+    static const int size = 64;
+
+    quint32 version;
+    quint32 brickEdge;
+    quint32 brickBorder;
+
+    // Level whose voxels match the source volume one to one
+    quint32 finestLevel;
+
+    // Source volume size in voxels
+    quint32 dimensions[3];
+
+    quint64 indexOffset;
+    quint64 brickCount;
+
+    // Since version 2
+    quint32 frameCount;
+    quint32 framesPerSecond;
+};
+
+class CBrickFileEntry
+{
+public:
+    CBrickFileEntry()
+        : offset( 0 ),
+          constant( false ),
+          value( 0 ),
+          frame( 0 )
+    {
+    }
+
+    bool isEmpty() const { return constant && value == 0; }
+
+    quint64 offset;
+    bool constant;
+    quint8 value;
+
+    // First frame of a sequence the entry holds for
+    quint32 frame;
+};
+
+/**
+  Appends bricks in any order and writes the index when closed. A payload
+  equal to one written before is not written again; the node points at
+  the earlier one instead.
+
+  Sequences write every brick of each frame after beginFrame(). From the
+  second frame on, bricks equal to the brick of the same node in the
+  frame before are left out.
+  */
+class CBrickFileWriter
+{
+public:
+    CBrickFileWriter();
+    ~CBrickFileWriter();
+
+    bool open( const QString& fileName, int finestLevel, const int dimensions[3] );
+    bool write( const CBrick& brick );
+    bool close();
+
+    // Starts the next frame of a sequence, see above
+    void beginFrame();
+    void setFramesPerSecond( int fps ) { m_header.framesPerSecond = quint32( fps ); }
+    int frameCount() const { return int( m_header.frameCount ); }
+
+    // Bricks of later frames written because they changed
+    qint64 changedCount() const { return m_changedCount; }
+
+    QString errorString() const { return m_file.errorString(); }
+    qint64 bytesWritten() const { return m_offset; }
+
+    // Payloads that pointed at an earlier one, and the bytes they saved
+    qint64 sharedCount() const { return m_sharedCount; }
+    qint64 sharedBytes() const { return m_sharedBytes; }
+
+private:
+    bool writeHeader();
+    qint64 findPayload( const CBrick& brick, quint64 hash );
+
+    QFile m_file;
+    CBrickFileHeader m_header;
+    QVector<QPair<CNodeKey, CBrickFileEntry> > m_index;
+    quint64 m_offset;
+
+    // Offsets of the payloads written so far, by content hash
+    QMultiHash<quint64, quint64> m_payloads;
+    qint64 m_sharedCount;
+    qint64 m_sharedBytes;
+
+    // Every node as of the frame before, once there is a second frame
+    int m_frame;
+    QHash<CNodeKey, CBrickFileEntry> m_previous;
+    qint64 m_changedCount;
+};
+
+/**
+  Loads the index up front and reads payloads on demand. read() may be
+  called from several threads; their reads are queued together, see
+  CAsyncFileReader.
+
+  Reads come from the current frame of a sequence. setFrame() moves to
+  another frame by applying the changes in between, forwards or
+  backwards, and lists the nodes they touched.
+  */
+class CBrickFileReader
+{
+public:
+    CBrickFileReader();
+
+    bool open( const QString& fileName, CAsyncFileReader::Backend backend = CAsyncFileReader::Automatic );
+    const CBrickFileHeader& header() const { return m_header; }
+
+    // Of the current frame; not to be used while reads are going on
+    const QHash<CNodeKey, CBrickFileEntry>& index() const { return m_index; }
+
+    int frameCount() const { return int( m_header.frameCount ); }
+    int frame() const { return m_frame; }
+    void setFrame( int frame, QVector<CNodeKey>* changed );
+    CAsyncFileReader::Backend backend() const { return m_payloads.backend(); }
+
+    // Take effect on the next open()
+    void setQueueDepth( int depth ) { m_payloads.setQueueDepth( depth ); }
+    void setMaxCoalescedBytes( int bytes ) { m_payloads.setMaxCoalescedBytes( bytes ); }
+
+    bool read( CBrick& brick );
+
+private:
+    class CChange
+    {
+    public:
+        CNodeKey key;
+        CBrickFileEntry before;
+        CBrickFileEntry after;
+    };
+
+    void apply( const CNodeKey& key, const CBrickFileEntry& entry );
+
+    QFile m_file;
+    CAsyncFileReader m_payloads;
+    CBrickFileHeader m_header;
+
+    // Guards the index of the current frame against setFrame()
+    mutable QReadWriteLock m_lock;
+    QHash<CNodeKey, CBrickFileEntry> m_index;
+
+    // The changes into each frame, none into frame 0
+    QVector<QVector<CChange> > m_changes;
+    int m_frame;
+};
+
+#endif // C_BRICK_FILE_H
@@ -0,0 +1,452 @@
+#include "c_brick_pool.h"
+#include "c_block_compression.h"
+#include "c_morton.h"
+#include "c_stats.h"
+
+#include <QDebug>
+#include <QOpenGLFunctions_4_3_Core>
+#include <QtAlgorithms>
+
+namespace
+{
+    // Slot numbers are Z-order codes of whole slot coordinates
+    Q_STATIC_ASSERT( ( VoxelConfig::poolSlotsPerAxis & ( VoxelConfig::poolSlotsPerAxis - 1 ) ) == 0 );
+    Q_STATIC_ASSERT( VoxelConfig::poolSlotsPerAxis <= 1024 );
+}
+
+//------------------------------------------------------------------------------
+CBrickPool::CBrickPool()
+    : m_funcs( NULL ),
+      m_storage( TextureStorage ),
+      m_blockBuffer( 0 ),
+      m_ownerTotal( 0 ),
+      m_slotOrder( MortonSlots ),
+      m_freeCount( 0 ),
+      m_head( -1 ),
+      m_tail( -1 ),
+      m_uploadedBytes( 0 ),
+      m_uploadedStat( CStats::instance().counter( "pool.uploadedBytes" ) ),
+      m_sharedStat( CStats::instance().counter( "pool.sharedBricks" ) ),
+      m_collisionStat( CStats::instance().counter( "pool.hashCollisions" ) ),
+      m_blockErrorStat( CStats::instance().histogram( "pool.blockError" ) )
+{
+}
+
+//------------------------------------------------------------------------------
+void
+CBrickPool::create( QOpenGLFunctions_4_3_Core* funcs )
+{
+    // Compressed bricks take less than half the memory, so twice as many
+    // fit in what the textures would have taken
+    int count = VoxelConfig::poolSlotsPerAxis
+              * VoxelConfig::poolSlotsPerAxis
+              * VoxelConfig::poolSlotsPerAxis;
+    if ( m_storage == BlockStorage )
+        count *= 2;
+
+    m_funcs = funcs;
+    if ( m_funcs )
+    {
+        createTextures();
+        if ( m_storage == BlockStorage )
+            count = createBlockBuffer( count );
+    }
+    m_owners.fill( QVector<CNodeKey>(), count );
+    m_ownerTotal = 0;
+    m_lastUsed.fill( -1, count );
+    m_prev.fill( -1, count );
+    m_next.fill( -1, count );
+    m_freeBits.fill( ~quint64( 0 ), ( count + 63 ) / 64 );
+    if ( count % 64 )
+        m_freeBits.last() = ( quint64( 1 ) << ( count % 64 ) ) - 1;
+    m_freeCount = count;
+    m_head = m_tail = -1;
+    m_contentSlots.clear();
+    m_contents.fill( QVector<quint8>(), count );
+    m_contentColors.fill( QVector<quint32>(), count );
+    m_contentNormals.fill( QVector<quint32>(), count );
+    m_contentHashes.fill( 0, count );
+}
+
+//------------------------------------------------------------------------------
+void
+CBrickPool::createTextures()
+{
+    // Compressed pools leave the samplers a single texel to be bound to
+    const int size = m_storage == BlockStorage ? 1 : VoxelConfig::poolSlotsPerAxis * VoxelConfig::storedBrickEdge;
+    m_texture = TexturePtr( new QOpenGLTexture( QOpenGLTexture::Target3D ) );
+    m_texture->setAutoMipMapGenerationEnabled( false );
+    m_texture->setSize( size, size, size );
+    m_texture->setFormat( QOpenGLTexture::R8_UNorm );
+    m_texture->allocateStorage();
+
+    m_colorTexture = TexturePtr( new QOpenGLTexture( QOpenGLTexture::Target3D ) );
+    m_colorTexture->setAutoMipMapGenerationEnabled( false );
+    m_colorTexture->setSize( size, size, size );
+    m_colorTexture->setFormat( QOpenGLTexture::RGB10A2 );
+    m_colorTexture->allocateStorage();
+
+    m_normalTexture = TexturePtr( new QOpenGLTexture( QOpenGLTexture::Target3D ) );
+    m_normalTexture->setAutoMipMapGenerationEnabled( false );
+    m_normalTexture->setSize( size, size, size );
+    m_normalTexture->setFormat( QOpenGLTexture::RGBA8_UNorm );
+    m_normalTexture->allocateStorage();
+}
+
+//------------------------------------------------------------------------------
+int
+CBrickPool::createBlockBuffer( int count )
+{
+    // Storage blocks only have to be 128 MB, most drivers allow far more
+    GLint64 limit = 0;
+    m_funcs->glGetInteger64v( GL_MAX_SHADER_STORAGE_BLOCK_SIZE, &limit );
+    const qint64 slotBytes = qint64( BlockCompression::brickWords ) * sizeof( quint32 );
+    if ( limit > 0 && count * slotBytes > limit )
+    {
+        qWarning() << "Compressed brick pool limited to" << limit / slotBytes << "of" << count << "slots";
+        count = int( limit / slotBytes );
+    }
+
+    m_funcs->glGenBuffers( 1, &m_blockBuffer );
+    m_funcs->glBindBuffer( GL_SHADER_STORAGE_BUFFER, m_blockBuffer );
+    m_funcs->glBufferData( GL_SHADER_STORAGE_BUFFER, count * slotBytes, NULL, GL_DYNAMIC_DRAW );
+    m_funcs->glBindBuffer( GL_SHADER_STORAGE_BUFFER, 0 );
+    return count;
+}
+
+//------------------------------------------------------------------------------
+int
+CBrickPool::allocate( const CNodeKey& key, int frame, QVector<CNodeKey>* evictedKeys )
+{
+    evictedKeys->clear();
+
+    int slot = -1;
+    if ( m_freeCount > 0 )
+    {
+        // Where the node lies in the volume, folded into the pool
+        const quint32 mask = VoxelConfig::poolSlotsPerAxis - 1;
+        const qint64 code = m_slotOrder == MortonSlots ? Morton::encode( key.x & mask, key.y & mask, key.z & mask ) : 0;
+        const qint64 codes = qint64( mask + 1 ) * ( mask + 1 ) * ( mask + 1 );
+        slot = takeFree( int( code * slotCount() / codes ) );
+    }
+    else
+    {
+        // Everything left in the pool is needed to draw the current frame
+        if ( m_tail < 0 || m_lastUsed.at( m_tail ) >= frame )
+            return -1;
+
+        slot = m_tail;
+        unlink( slot );
+        unpublish( slot );
+        *evictedKeys = m_owners.at( slot );
+        m_ownerTotal -= evictedKeys->size();
+    }
+
+    m_owners[slot].clear();
+    m_owners[slot].append( key );
+    ++m_ownerTotal;
+    m_lastUsed[slot] = frame;
+    pushFront( slot );
+    return slot;
+}
+
+//------------------------------------------------------------------------------
+void
+CBrickPool::release( int slot, const CNodeKey& key )
+{
+    const int owner = m_owners.at( slot ).indexOf( key );
+    if ( owner < 0 )
+        return;
+    m_owners[slot].remove( owner );
+    --m_ownerTotal;
+    if ( !m_owners.at( slot ).isEmpty() )
+        return;
+
+    unpublish( slot );
+    unlink( slot );
+    m_lastUsed[slot] = -1;
+    addFree( slot );
+}
+
+//------------------------------------------------------------------------------
+void
+CBrickPool::touch( int slot, int frame )
+{
+    if ( m_lastUsed.at( slot ) == frame )
+        return;
+    m_lastUsed[slot] = frame;
+    unlink( slot );
+    pushFront( slot );
+}
+
+//------------------------------------------------------------------------------
+int
+CBrickPool::share( const CBrick& brick, int frame )
+{
+    if ( brick.constant )
+        return -1;
+
+    const QHash<quint64, int>::const_iterator it = m_contentSlots.constFind( brick.contentHash );
+    if ( it == m_contentSlots.constEnd() )
+        return -1;
+
+    // Attributes do not follow from the densities alone: they depend on
+    // the height of the node and on edits, so they are compared as well
+    const int slot = it.value();
+    if ( m_contents.at( slot ) != brick.voxels
+      || m_contentColors.at( slot ) != brick.colors
+      || m_contentNormals.at( slot ) != brick.normals )
+    {
+        m_collisionStat->add();
+        return -1;
+    }
+
+    m_owners[slot].append( brick.key );
+    ++m_ownerTotal;
+    touch( slot, frame );
+    m_sharedStat->add();
+    return slot;
+}
+
+//------------------------------------------------------------------------------
+void
+CBrickPool::publish( int slot, const CBrick& brick )
+{
+    Q_ASSERT( m_owners.at( slot ).size() == 1 );
+    unpublish( slot );
+    if ( brick.constant || m_contentSlots.contains( brick.contentHash ) )
+        return;
+
+    m_contentSlots.insert( brick.contentHash, slot );
+    m_contents[slot] = brick.voxels;
+    m_contentColors[slot] = brick.colors;
+    m_contentNormals[slot] = brick.normals;
+    m_contentHashes[slot] = brick.contentHash;
+}
+
+//------------------------------------------------------------------------------
+bool
+CBrickPool::published( int slot, CBrick& brick ) const
+{
+    if ( m_contents.at( slot ).isEmpty() )
+        return false;
+
+    brick.voxels = m_contents.at( slot );
+    brick.colors = m_contentColors.at( slot );
+    brick.normals = m_contentNormals.at( slot );
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void
+CBrickPool::slotOrigin( int slot, int origin[3] ) const
+{
+    const int n = VoxelConfig::poolSlotsPerAxis;
+    if ( m_slotOrder == MortonSlots )
+    {
+        Morton::decode( quint32( slot ), origin[0], origin[1], origin[2] );
+    }
+    else
+    {
+        origin[0] = slot % n;
+        origin[1] = ( slot / n ) % n;
+        origin[2] = slot / ( n * n );
+    }
+
+    for ( int axis = 0; axis < 3; ++axis )
+        origin[axis] *= VoxelConfig::storedBrickEdge;
+}
+
+//------------------------------------------------------------------------------
+void
+CBrickPool::upload( int slot, const CBrick& brick )
+{
+    uploadRegion( slot, brick, CBrickRegion() );
+}
+
+//------------------------------------------------------------------------------
+void
+CBrickPool::uploadRegion( int slot, const CBrick& brick, const CBrickRegion& region )
+{
+    if ( region.isEmpty() )
+        return;
+
+    if ( m_storage == BlockStorage )
+    {
+        // Bricks usually arrive encoded by the thread that produced them.
+        // Edits encode only the blocks their region touches.
+        const bool encoded = brick.blocks.size() == BlockCompression::brickWords;
+        if ( region.voxelCount() == VoxelConfig::storedBrickVoxels )
+        {
+            const quint32* words = brick.blocks.constData();
+            if ( !encoded )
+            {
+                m_blockErrorStat->record( BlockCompression::encode( brick, m_blockScratch ) );
+                words = m_blockScratch.constData();
+            }
+            uploadBlocks( slot, 0, BlockCompression::blocksPerBrick, words );
+            return;
+        }
+
+        int first[3];
+        int last[3];
+        for ( int axis = 0; axis < 3; ++axis )
+        {
+            first[axis] = region.lo[axis] / BlockCompression::blockEdge;
+            last[axis] = ( region.hi[axis] - 1 ) / BlockCompression::blockEdge;
+        }
+        m_blockScratch.resize( BlockCompression::brickWords );
+        const quint32* words = encoded ? brick.blocks.constData() : m_blockScratch.constData();
+        for ( int k = first[2]; k <= last[2]; ++k )
+        {
+            for ( int j = first[1]; j <= last[1]; ++j )
+            {
+                for ( int i = first[0]; !encoded && i <= last[0]; ++i )
+                {
+                    const int block = BlockCompression::blockIndex( i, j, k );
+                    m_blockErrorStat->record( BlockCompression::encodeBlock( brick, i, j, k,
+                                                  m_blockScratch.data() + block * BlockCompression::blockWords ) );
+                }
+
+                // Blocks along x are consecutive and go up together
+                const int row = BlockCompression::blockIndex( first[0], j, k );
+                uploadBlocks( slot, row, last[0] - first[0] + 1, words + row * BlockCompression::blockWords );
+            }
+        }
+        return;
+    }
+
+    uploadBox( m_texture, GL_RED, GL_UNSIGNED_BYTE, brick.voxels.constData(), 1, slot, region );
+    if ( !brick.colors.isEmpty() )
+    {
+        uploadBox( m_colorTexture, GL_RGBA, GL_UNSIGNED_INT_2_10_10_10_REV, brick.colors.constData(), 4, slot, region );
+        uploadBox( m_normalTexture, GL_RGBA, GL_UNSIGNED_BYTE, brick.normals.constData(), 4, slot, region );
+    }
+}
+
+//------------------------------------------------------------------------------
+void
+CBrickPool::uploadBox( const TexturePtr& texture, GLenum format, GLenum type, const void* data,
+                       int bytesPerVoxel, int slot, const CBrickRegion& region )
+{
+    const int e = VoxelConfig::storedBrickEdge;
+    int origin[3];
+    slotOrigin( slot, origin );
+
+    // Let GL pick the region straight out of the full brick
+    texture->bind();
+    m_funcs->glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+    m_funcs->glPixelStorei( GL_UNPACK_ROW_LENGTH, e );
+    m_funcs->glPixelStorei( GL_UNPACK_IMAGE_HEIGHT, e );
+    m_funcs->glTexSubImage3D( GL_TEXTURE_3D, 0,
+                              origin[0] + region.lo[0],
+                              origin[1] + region.lo[1],
+                              origin[2] + region.lo[2],
+                              region.hi[0] - region.lo[0],
+                              region.hi[1] - region.lo[1],
+                              region.hi[2] - region.lo[2],
+                              format, type,
+                              static_cast<const char*>( data )
+                              + bytesPerVoxel * CBrick::index( region.lo[0], region.lo[1], region.lo[2] ) );
+    m_funcs->glPixelStorei( GL_UNPACK_ROW_LENGTH, 0 );
+    m_funcs->glPixelStorei( GL_UNPACK_IMAGE_HEIGHT, 0 );
+    m_uploadedBytes += qint64( bytesPerVoxel ) * region.voxelCount();
+    m_uploadedStat->add( qint64( bytesPerVoxel ) * region.voxelCount() );
+}
+
+//------------------------------------------------------------------------------
+void
+CBrickPool::uploadBlocks( int slot, int firstBlock, int count, const quint32* words )
+{
+    const qint64 blockBytes = qint64( BlockCompression::blockWords ) * sizeof( quint32 );
+    const qint64 bytes = count * blockBytes;
+    const qint64 offset = ( qint64( slot ) * BlockCompression::blocksPerBrick + firstBlock ) * blockBytes;
+    m_funcs->glBindBuffer( GL_SHADER_STORAGE_BUFFER, m_blockBuffer );
+    m_funcs->glBufferSubData( GL_SHADER_STORAGE_BUFFER, offset, bytes, words );
+    m_funcs->glBindBuffer( GL_SHADER_STORAGE_BUFFER, 0 );
+    m_uploadedBytes += bytes;
+    m_uploadedStat->add( bytes );
+}
+
+//------------------------------------------------------------------------------
+qint64
+CBrickPool::memoryBytes() const
+{
+    if ( m_storage == BlockStorage )
+        return qint64( slotCount() ) * BlockCompression::brickWords * sizeof( quint32 );
+    return qint64( slotCount() ) * VoxelConfig::storedBrickVoxels * ( 1 + 4 + 4 );
+}
+
+//------------------------------------------------------------------------------
+void
+CBrickPool::unlink( int slot )
+{
+    const int prev = m_prev.at( slot );
+    const int next = m_next.at( slot );
+    if ( prev >= 0 )
+        m_next[prev] = next;
+    else if ( m_head == slot )
+        m_head = next;
+    if ( next >= 0 )
+        m_prev[next] = prev;
+    else if ( m_tail == slot )
+        m_tail = prev;
+    m_prev[slot] = m_next[slot] = -1;
+}
+
+//------------------------------------------------------------------------------
+void
+CBrickPool::pushFront( int slot )
+{
+    m_prev[slot] = -1;
+    m_next[slot] = m_head;
+    if ( m_head >= 0 )
+        m_prev[m_head] = slot;
+    m_head = slot;
+    if ( m_tail < 0 )
+        m_tail = slot;
+}
+
+//------------------------------------------------------------------------------
+int
+CBrickPool::takeFree( int hint )
+{
+    // The first free slot at or after hint, wrapping around
+    const int words = m_freeBits.size();
+    int word = hint / 64;
+    quint64 bits = m_freeBits.at( word ) & ( ~quint64( 0 ) << ( hint % 64 ) );
+    for ( int i = 0; bits == 0 && i < words; ++i )
+    {
+        word = ( word + 1 ) % words;
+        bits = m_freeBits.at( word );
+    }
+    Q_ASSERT( bits != 0 );
+
+    const int slot = word * 64 + int( qCountTrailingZeroBits( bits ) );
+    m_freeBits[word] &= ~( quint64( 1 ) << ( slot % 64 ) );
+    --m_freeCount;
+    return slot;
+}
+
+//------------------------------------------------------------------------------
+void
+CBrickPool::addFree( int slot )
+{
+    m_freeBits[slot / 64] |= quint64( 1 ) << ( slot % 64 );
+    ++m_freeCount;
+}
+
+//------------------------------------------------------------------------------
+void
+CBrickPool::unpublish( int slot )
+{
+    if ( m_contents.at( slot ).isEmpty() )
+        return;
+
+    m_contentSlots.remove( m_contentHashes.at( slot ) );
+    m_contents[slot].clear();
+    m_contentColors[slot].clear();
+    m_contentNormals[slot].clear();
+}
+
+//------------------------------------------------------------------------------
@@ -0,0 +1,162 @@
+#ifndef C_BRICK_POOL_H
+#define C_BRICK_POOL_H
+
+#include "c_brick.h"
+#include "material.h"
+
+#include <QHash>
+#include <QVector>
+
+class CStatsCounter;
+class CStatsHistogram;
+class QOpenGLFunctions_4_3_Core;
+
+/**
+  Fixed size cache of bricks in one 3D texture. Slots are recycled in least
+  recently used order; a slot touched during the current frame is never
+  evicted. The packed shading attributes of a slot live at the same
+  texels of two more textures.
+
+  By default slot numbers run along a Z-order curve through the texture,
+  and a new brick takes the free slot that follows the position of its
+  node in the volume, wrapped around the pool, most closely along the
+  curve. Bricks that are neighbours in the volume then tend to be
+  neighbours in the texture, which keeps rays crossing between them in
+  the texture caches. Evicted slots go to whatever needs one next, so
+  the order decays while the pool is full.
+
+  Nodes whose bricks are identical share one slot, see share(). A shared
+  slot is evicted for all of its nodes at once and freed when the last
+  of them releases it.
+
+  Block compressed storage keeps the bricks in one storage buffer instead
+  of the textures, brickWords words per slot, see c_block_compression.h.
+  The marcher decodes and filters them itself, which costs sample
+  throughput but fits twice the slots in less memory.
+  */
+class CBrickPool
+{
+public:
+    enum SlotOrder
+    {
+        LinearSlots,
+        MortonSlots
+    };
+
+    enum Storage
+    {
+        TextureStorage,
+        BlockStorage
+    };
+
+    CBrickPool();
+
+    // Only before create(), which lays the slots out and allocates them
+    void setSlotOrder( SlotOrder order ) { Q_ASSERT( !isCreated() ); m_slotOrder = order; }
+    SlotOrder slotOrder() const { return m_slotOrder; }
+    void setStorage( Storage storage ) { Q_ASSERT( !isCreated() ); m_storage = storage; }
+    Storage storage() const { return m_storage; }
+
+    // Without functions only the slots are set up, for tools that walk the
+    // tree without a GPU; nothing may be uploaded then
+    void create( QOpenGLFunctions_4_3_Core* funcs );
+    bool isCreated() const { return !m_owners.isEmpty(); }
+
+    TexturePtr texture() const { return m_texture; }
+    TexturePtr colorTexture() const { return m_colorTexture; }
+    TexturePtr normalTexture() const { return m_normalTexture; }
+    GLuint blockBuffer() const { return m_blockBuffer; }
+
+    int slotCount() const { return m_owners.size(); }
+    int usedSlotCount() const { return m_owners.size() - m_freeCount; }
+
+    // Nodes with a resident brick, counting each node of a shared slot
+    int brickCount() const { return m_ownerTotal; }
+    int ownerCount( int slot ) const { return m_owners.at( slot ).size(); }
+
+    // Corner of the slot in the textures, in texels
+    void slotOrigin( int slot, int origin[3] ) const;
+
+    // Returns a slot for key, or -1 if every slot is in use this frame. If a
+    // resident brick had to be evicted, the keys of the nodes that held it
+    // are stored in evictedKeys.
+    int allocate( const CNodeKey& key, int frame, QVector<CNodeKey>* evictedKeys );
+    void release( int slot, const CNodeKey& key );
+    void touch( int slot, int frame );
+    int lastUsed( int slot ) const { return m_lastUsed.at( slot ); }
+
+    // Adds brick.key to the nodes of a published slot holding the same
+    // densities and attributes and returns that slot, or -1 if there is
+    // none. Bricks must have been derived, see CBrick::contentHash.
+    int share( const CBrick& brick, int frame );
+
+    // Lets later bricks share slot, whose content is brick from now on. A
+    // slot rewritten for one of its nodes must only have that node left.
+    void publish( int slot, const CBrick& brick );
+
+    // Fills the densities and attributes slot was published with into
+    // brick, or returns false if it is not published
+    bool published( int slot, CBrick& brick ) const;
+
+    // Bricks stored compressed are encoded here unless their blocks came
+    // encoded already
+    void upload( int slot, const CBrick& brick );
+    void uploadRegion( int slot, const CBrick& brick, const CBrickRegion& region );
+    qint64 uploadedBytes() const { return m_uploadedBytes; }
+
+    // GPU memory of the density and attribute textures, or of the blocks
+    qint64 memoryBytes() const;
+
+private:
+    void createTextures();
+    int createBlockBuffer( int count );
+    void uploadBlocks( int slot, int firstBlock, int count, const quint32* words );
+    void uploadBox( const TexturePtr& texture, GLenum format, GLenum type, const void* data,
+                    int bytesPerVoxel, int slot, const CBrickRegion& region );
+    void unlink( int slot );
+    void pushFront( int slot );
+    int takeFree( int hint );
+    void addFree( int slot );
+    void unpublish( int slot );
+
+    QOpenGLFunctions_4_3_Core* m_funcs;
+    TexturePtr m_texture;
+    TexturePtr m_colorTexture;
+    TexturePtr m_normalTexture;
+    Storage m_storage;
+    GLuint m_blockBuffer;
+    QVector<quint32> m_blockScratch;
+
+    QVector<QVector<CNodeKey> > m_owners;
+    QVector<int> m_lastUsed;
+    int m_ownerTotal;
+    SlotOrder m_slotOrder;
+
+    // One bit per free slot, searched from the slot a brick would like
+    QVector<quint64> m_freeBits;
+    int m_freeCount;
+
+    // Doubly linked LRU list over the occupied slots, most recent first
+    QVector<int> m_prev;
+    QVector<int> m_next;
+    int m_head;
+    int m_tail;
+
+    // Published slots by content hash, with the densities and attributes
+    // kept to compare bricks whose hashes match. The densities mostly
+    // share their memory with the host cache; the attributes take 8 bytes
+    // per voxel of every published slot.
+    QHash<quint64, int> m_contentSlots;
+    QVector<QVector<quint8> > m_contents;
+    QVector<QVector<quint32> > m_contentColors;
+    QVector<QVector<quint32> > m_contentNormals;
+    QVector<quint64> m_contentHashes;
+
+    qint64 m_uploadedBytes;
+    CStatsCounter* m_uploadedStat;
+    CStatsCounter* m_sharedStat;
+    CStatsCounter* m_collisionStat;
+    CStatsHistogram* m_blockErrorStat;
+};
+
+#endif // C_BRICK_POOL_H
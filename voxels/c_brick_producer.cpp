@@ -0,0 +1,130 @@
+#include "c_brick_producer.h"
+#include "c_content_hash.h"
+#include "c_occupancy.h"
+#include "c_voxel_attributes.h"
+
+#include <math.h>
+
+//------------------------------------------------------------------------------
+static inline float
+hash2( int x, int z )
+{
+    quint32 h = quint32( x ) * 374761393u + quint32( z ) * 668265263u;
+    h = ( h ^ ( h >> 13 ) ) * 1274126177u;
+    return float( h ^ ( h >> 16 ) ) / 4294967295.0f;
+}
+
+//------------------------------------------------------------------------------
+static inline float
+smooth( float t )
+{
+    return t * t * ( 3.0f - 2.0f * t );
+}
+
+//------------------------------------------------------------------------------
+void
+CBrickProducer::produceRegion( CBrick& brick, const CBrickRegion& region ) const
+{
+    CBrick full( brick.key, brick.priority );
+    produce( full );
+    if ( full.constant )
+        full.voxels.fill( full.value, VoxelConfig::storedBrickVoxels );
+
+    for ( int k = region.lo[2]; k < region.hi[2]; ++k )
+        for ( int j = region.lo[1]; j < region.hi[1]; ++j )
+            for ( int i = region.lo[0]; i < region.hi[0]; ++i )
+                brick.voxels[CBrick::index( i, j, k )] = full.voxels.at( CBrick::index( i, j, k ) );
+}
+
+//------------------------------------------------------------------------------
+void
+CBrickProducer::produceAttributes( CBrick& brick, const CBrickRegion& region ) const
+{
+    VoxelAttributes::derive( brick, region );
+    brick.occupancy = Occupancy::build( brick );
+    brick.valueRange( brick.minValue, brick.maxValue );
+
+    // Identical bricks share a pool slot, see CBrickPool::share()
+    quint64 hash = ContentHash::hash( brick.voxels.constData(), brick.voxels.size() );
+    hash = ContentHash::hash( brick.colors.constData(), brick.colors.size() * int( sizeof( quint32 ) ), hash );
+    brick.contentHash = ContentHash::hash( brick.normals.constData(), brick.normals.size() * int( sizeof( quint32 ) ), hash );
+    brick.blocks.clear();
+}
+
+//------------------------------------------------------------------------------
+CProceduralBrickProducer::CProceduralBrickProducer()
+{
+}
+
+//------------------------------------------------------------------------------
+void
+CProceduralBrickProducer::produce( CBrick& brick ) const
+{
+    brick.voxels.resize( VoxelConfig::storedBrickVoxels );
+    produceRegion( brick, CBrickRegion() );
+    brick.detectConstant();
+}
+
+//------------------------------------------------------------------------------
+void
+CProceduralBrickProducer::produceRegion( CBrick& brick, const CBrickRegion& region ) const
+{
+    const float voxelSize = brick.key.size() / VoxelConfig::brickEdge;
+    const QVector3D origin = brick.key.origin()
+                           - QVector3D( 1.0f, 1.0f, 1.0f ) * ( VoxelConfig::brickBorder * voxelSize );
+    quint8* data = brick.voxels.data();
+
+    // The density ramps from empty to full over one voxel of this level, so
+    // coarse levels are a filtered version of the fine ones
+    for ( int k = region.lo[2]; k < region.hi[2]; ++k )
+    {
+        const float z = origin.z() + ( k + 0.5f ) * voxelSize;
+        for ( int i = region.lo[0]; i < region.hi[0]; ++i )
+        {
+            const float x = origin.x() + ( i + 0.5f ) * voxelSize;
+            const float h = height( x, z );
+            for ( int j = region.lo[1]; j < region.hi[1]; ++j )
+            {
+                const float y = origin.y() + ( j + 0.5f ) * voxelSize;
+                const float d = qBound( 0.0f, 0.5f + ( h - y ) / voxelSize, 1.0f );
+                data[CBrick::index( i, j, k )] = quint8( d * 255.0f + 0.5f );
+            }
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+float
+CProceduralBrickProducer::height( float x, float z ) const
+{
+    float h = 0.04f;
+    float amplitude = 0.04f;
+    float frequency = 8.0f;
+    for ( int octave = 0; octave < 10; ++octave )
+    {
+        h += amplitude * ( noise( x * frequency, z * frequency ) - 0.5f );
+        amplitude *= 0.5f;
+        frequency *= 2.0f;
+    }
+    return h;
+}
+
+//------------------------------------------------------------------------------
+float
+CProceduralBrickProducer::noise( float x, float z ) const
+{
+    const float fx = floorf( x );
+    const float fz = floorf( z );
+    const int ix = int( fx );
+    const int iz = int( fz );
+    const float tx = smooth( x - fx );
+    const float tz = smooth( z - fz );
+
+    const float a = hash2( ix, iz );
+    const float b = hash2( ix + 1, iz );
+    const float c = hash2( ix, iz + 1 );
+    const float d = hash2( ix + 1, iz + 1 );
+    return ( a + ( b - a ) * tx ) + ( ( c + ( d - c ) * tx ) - ( a + ( b - a ) * tx ) ) * tz;
+}
+
+//------------------------------------------------------------------------------
@@ -0,0 +1,53 @@
+#ifndef C_BRICK_PRODUCER_H
+#define C_BRICK_PRODUCER_H
+
+#include "c_brick.h"
+
+/**
+  Fills bricks on request. Producers are called from worker threads and
+  must therefore be reentrant.
+  */
+class CBrickProducer
+{
+public:
+    virtual ~CBrickProducer() {}
+
+    virtual void produce( CBrick& brick ) const = 0;
+
+    // Recomputes the voxels of region only. The brick must hold a full,
+    // non-constant payload; voxels outside the region are left untouched.
+    virtual void produceRegion( CBrick& brick, const CBrickRegion& region ) const;
+
+    // Fills the shading attributes of region from the densities around it,
+    // and the occupancy and value range of the whole brick. The default
+    // derives them from the density field alone.
+    virtual void produceAttributes( CBrick& brick, const CBrickRegion& region ) const;
+
+    // Deepest level that holds more detail than its parent
+    virtual int maxLevel() const { return VoxelConfig::maxLevel; }
+
+    // Whether the same key may produce different bricks over time, which
+    // makes caching them by key unsafe
+    virtual bool isAnimated() const { return false; }
+};
+
+/**
+  Generates a rolling terrain from a height function, so the viewer has
+  an unbounded amount of detail to stream without any dataset on disk.
+  */
+class CProceduralBrickProducer : public CBrickProducer
+{
+public:
+    CProceduralBrickProducer();
+
+    virtual void produce( CBrick& brick ) const;
+    virtual void produceRegion( CBrick& brick, const CBrickRegion& region ) const;
+
+    // Terrain height at (x, z) in unit cube space
+    float height( float x, float z ) const;
+
+private:
+    float noise( float x, float z ) const;
+};
+
+#endif // C_BRICK_PRODUCER_H
@@ -0,0 +1,187 @@
+#include "c_brick_protocol.h"
+
+#include <QDataStream>
+#include <QIODevice>
+#include <QtEndian>
+
+namespace BrickProtocol
+{
+    // Bodies larger than this are a broken peer, not a big batch
+    const quint32 maxBodySize = 16 * 1024 * 1024;
+
+    //--------------------------------------------------------------------------
+    static void
+    writeType( QDataStream& stream, MessageType type )
+    {
+        stream.setByteOrder( QDataStream::LittleEndian );
+        stream << quint32( type );
+    }
+
+    //--------------------------------------------------------------------------
+    static bool
+    readType( QDataStream& stream, MessageType expected )
+    {
+        stream.setByteOrder( QDataStream::LittleEndian );
+        quint32 t = 0;
+        stream >> t;
+        return stream.status() == QDataStream::Ok && t == quint32( expected );
+    }
+
+    //--------------------------------------------------------------------------
+    QByteArray
+    encode( const CHello& hello )
+    {
+        QByteArray body;
+        QDataStream stream( &body, QIODevice::WriteOnly );
+        writeType( stream, Hello );
+        stream << magic << version << hello.slotCount << hello.slotBytes << hello.maxLevel << hello.ringKey;
+        return body;
+    }
+
+    //--------------------------------------------------------------------------
+    QByteArray
+    encode( const CRequest& request )
+    {
+        Q_ASSERT( request.ids.size() == request.keys.size() );
+
+        QByteArray body;
+        QDataStream stream( &body, QIODevice::WriteOnly );
+        writeType( stream, Request );
+        stream << quint32( request.released.size() );
+        for ( int i = 0; i < request.released.size(); ++i )
+            stream << request.released.at( i );
+        stream << quint32( request.keys.size() );
+        for ( int i = 0; i < request.keys.size(); ++i )
+        {
+            const CNodeKey& key = request.keys.at( i );
+            stream << request.ids.at( i ) << key.level << key.x << key.y << key.z;
+        }
+        return body;
+    }
+
+    //--------------------------------------------------------------------------
+    QByteArray
+    encode( const QVector<CReply>& replies )
+    {
+        QByteArray body;
+        QDataStream stream( &body, QIODevice::WriteOnly );
+        writeType( stream, Bricks );
+        stream << quint32( replies.size() );
+        for ( int i = 0; i < replies.size(); ++i )
+        {
+            const CReply& reply = replies.at( i );
+            stream << reply.id << reply.slot << quint8( reply.constant ) << reply.value;
+        }
+        return body;
+    }
+
+    //--------------------------------------------------------------------------
+    MessageType
+    type( const QByteArray& body )
+    {
+        return body.size() >= 4 ? MessageType( qFromLittleEndian<quint32>( reinterpret_cast<const uchar*>( body.constData() ) ) )
+                                : MessageType( 0 );
+    }
+
+    //--------------------------------------------------------------------------
+    bool
+    decode( const QByteArray& body, CHello* hello )
+    {
+        QDataStream stream( body );
+        if ( !readType( stream, Hello ) )
+            return false;
+
+        quint32 m = 0;
+        quint32 v = 0;
+        stream >> m >> v >> hello->slotCount >> hello->slotBytes >> hello->maxLevel >> hello->ringKey;
+        return stream.status() == QDataStream::Ok && m == magic && v == version;
+    }
+
+    //--------------------------------------------------------------------------
+    bool
+    decode( const QByteArray& body, CRequest* request )
+    {
+        QDataStream stream( body );
+        if ( !readType( stream, Request ) )
+            return false;
+
+        // Counts are checked against the body so a bad one cannot allocate much
+        quint32 count = 0;
+        stream >> count;
+        if ( count > quint32( body.size() ) / 4 )
+            return false;
+        request->released.resize( int( count ) );
+        for ( quint32 i = 0; i < count; ++i )
+            stream >> request->released[int( i )];
+
+        stream >> count;
+        if ( count > quint32( body.size() ) / 20 )
+            return false;
+        request->ids.resize( int( count ) );
+        request->keys.resize( int( count ) );
+        for ( quint32 i = 0; i < count; ++i )
+        {
+            CNodeKey& key = request->keys[int( i )];
+            stream >> request->ids[int( i )] >> key.level >> key.x >> key.y >> key.z;
+        }
+        return stream.status() == QDataStream::Ok;
+    }
+
+    //--------------------------------------------------------------------------
+    bool
+    decode( const QByteArray& body, QVector<CReply>* replies )
+    {
+        QDataStream stream( body );
+        if ( !readType( stream, Bricks ) )
+            return false;
+
+        quint32 count = 0;
+        stream >> count;
+        if ( count > quint32( body.size() ) / 10 )
+            return false;
+        replies->resize( int( count ) );
+        for ( quint32 i = 0; i < count; ++i )
+        {
+            CReply& reply = ( *replies )[int( i )];
+            quint8 constant = 0;
+            stream >> reply.id >> reply.slot >> constant >> reply.value;
+            reply.constant = constant != 0;
+        }
+        return stream.status() == QDataStream::Ok;
+    }
+
+    //--------------------------------------------------------------------------
+    bool
+    write( QIODevice* device, const QByteArray& body )
+    {
+        uchar size[4];
+        qToLittleEndian<quint32>( quint32( body.size() ), size );
+        return device->write( reinterpret_cast<const char*>( size ), 4 ) == 4
+            && device->write( body ) == body.size();
+    }
+
+    //--------------------------------------------------------------------------
+    bool
+    take( QByteArray& received, QByteArray* body )
+    {
+        if ( received.size() < 4 )
+            return false;
+
+        const quint32 size = qFromLittleEndian<quint32>( reinterpret_cast<const uchar*>( received.constData() ) );
+        if ( size > maxBodySize )
+        {
+            // Unrecoverable, drop everything so the caller sees garbage
+            *body = QByteArray();
+            received.clear();
+            return true;
+        }
+        if ( quint32( received.size() ) < 4 + size )
+            return false;
+
+        *body = received.mid( 4, int( size ) );
+        received.remove( 0, int( 4 + size ) );
+        return true;
+    }
+}
+
+//------------------------------------------------------------------------------
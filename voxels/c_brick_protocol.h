@@ -0,0 +1,82 @@
+#ifndef C_BRICK_PROTOCOL_H
+#define C_BRICK_PROTOCOL_H
+
+#include "c_node_key.h"
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+class QIODevice;
+
+/**
+  Messages between the viewer and an out of process brick server. They
+  travel over a local socket as a little endian quint32 length followed
+  by the body; the voxel payloads do not, they are written by the server
+  into a ring of fixed size slots in shared memory. The server hands a
+  slot out with the brick, and the viewer gives it back with its next
+  request once the voxels were taken out.
+  */
+namespace BrickProtocol
+{
+    const quint32 magic = 0x53425647; // "GVBS"
+    const quint32 version = 1;
+
+    enum MessageType
+    {
+        Hello = 1,
+        Request = 2,
+        Bricks = 3
+    };
+
+    // Sent by the server once a viewer connects
+    class CHello
+    {
+    public:
+        CHello() : slotCount( 0 ), slotBytes( 0 ), maxLevel( 0 ) {}
+
+        quint32 slotCount;
+        quint32 slotBytes;
+        quint32 maxLevel;
+        QString ringKey;
+    };
+
+    // A batch of bricks the viewer waits for, and the ring slots it is done with
+    class CRequest
+    {
+    public:
+        QVector<quint32> released;
+        QVector<quint32> ids;
+        QVector<CNodeKey> keys;
+    };
+
+    // Produced bricks; slot is -1 for constant bricks, which have no payload
+    class CReply
+    {
+    public:
+        CReply() : id( 0 ), slot( -1 ), constant( false ), value( 0 ) {}
+
+        quint32 id;
+        qint32 slot;
+        bool constant;
+        quint8 value;
+    };
+
+    QByteArray encode( const CHello& hello );
+    QByteArray encode( const CRequest& request );
+    QByteArray encode( const QVector<CReply>& replies );
+
+    // The type of a message body, and its contents if it has that type
+    MessageType type( const QByteArray& body );
+    bool decode( const QByteArray& body, CHello* hello );
+    bool decode( const QByteArray& body, CRequest* request );
+    bool decode( const QByteArray& body, QVector<CReply>* replies );
+
+    // Frames a body onto the socket
+    bool write( QIODevice* device, const QByteArray& body );
+
+    // Takes the first complete message out of the bytes received so far
+    bool take( QByteArray& received, QByteArray* body );
+}
+
+#endif // C_BRICK_PROTOCOL_H
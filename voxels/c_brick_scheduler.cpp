@@ -0,0 +1,444 @@
+#include "c_brick_scheduler.h"
+#include "c_block_compression.h"
+#include "c_brick_pool.h"
+#include "c_brick_producer.h"
+#include "c_node_tree.h"
+#include "c_stats.h"
+
+#include <QPair>
+#include <QRunnable>
+
+#include <algorithm>
+
+//------------------------------------------------------------------------------
+class CBrickProductionTask : public QRunnable
+{
+public:
+    CBrickProductionTask( CBrickScheduler* scheduler, const CBrick& brick, const CancelTokenPtr& token )
+        : m_scheduler( scheduler ),
+          m_brick( brick ),
+          m_token( token )
+    {
+    }
+
+    virtual void run()
+    {
+        // The camera may have moved on while the task was queued
+        if ( m_token->load() )
+        {
+            m_scheduler->cancelled( m_brick.key );
+            return;
+        }
+
+        QElapsedTimer timer;
+        timer.start();
+        m_scheduler->m_producer->produce( m_brick );
+        if ( !m_brick.constant )
+        {
+            m_scheduler->m_producer->produceAttributes( m_brick, CBrickRegion() );
+
+            // Encoded here, on as many threads as produce bricks, rather
+            // than by the pool while uploading
+            if ( m_scheduler->m_pool->storage() == CBrickPool::BlockStorage )
+                m_scheduler->m_blockErrorStat->record( BlockCompression::encode( m_brick, m_brick.blocks ) );
+        }
+        m_scheduler->m_producedStat->add();
+        m_scheduler->m_produceTimeStat->record( timer.nsecsElapsed() / 1.0e6 );
+        m_scheduler->finished( m_brick );
+    }
+
+private:
+    CBrickScheduler* m_scheduler;
+    CBrick m_brick;
+    CancelTokenPtr m_token;
+};
+
+//------------------------------------------------------------------------------
+typedef QPair<float, CNodeKey> PrioritizedKey;
+
+static bool
+higherPriority( const PrioritizedKey& a, const PrioritizedKey& b )
+{
+    return a.first > b.first;
+}
+
+static bool
+higherBrickPriority( const CBrick& a, const CBrick& b )
+{
+    if ( a.prefetch != b.prefetch )
+        return !a.prefetch;
+    return a.priority > b.priority;
+}
+
+//------------------------------------------------------------------------------
+CBrickScheduler::CBrickScheduler( CBrickProducer* producer, CBrickPool* pool, CNodeTree* tree )
+    : m_producer( producer ),
+      m_pool( pool ),
+      m_tree( tree ),
+      m_budget( 4.0f ),
+      m_frame( 0 ),
+      m_uploads( 0 ),
+      m_cancels( 0 ),
+      m_producedStat( CStats::instance().counter( "scheduler.bricksProduced" ) ),
+      m_produceTimeStat( CStats::instance().histogram( "scheduler.produceMilliseconds" ) ),
+      m_uploadStat( CStats::instance().counter( "scheduler.uploads" ) ),
+      m_cancelStat( CStats::instance().counter( "scheduler.cancels" ) ),
+      m_requestStat( CStats::instance().gauge( "scheduler.requests" ) ),
+      m_prefetchStat( CStats::instance().gauge( "scheduler.prefetches" ) ),
+      m_refreshStat( CStats::instance().gauge( "scheduler.refreshes" ) ),
+      m_inFlightStat( CStats::instance().gauge( "scheduler.inFlight" ) ),
+      m_finishedStat( CStats::instance().gauge( "scheduler.finishedQueue" ) ),
+      m_blockErrorStat( CStats::instance().histogram( "pool.blockError" ) )
+{
+}
+
+//------------------------------------------------------------------------------
+CBrickScheduler::~CBrickScheduler()
+{
+    // Tasks still reference the scheduler
+    m_threadPool.waitForDone();
+}
+
+//------------------------------------------------------------------------------
+void
+CBrickScheduler::beginFrame( int frame )
+{
+    m_frame = frame;
+    m_requests.clear();
+    m_prefetches.clear();
+}
+
+//------------------------------------------------------------------------------
+void
+CBrickScheduler::request( const CNodeKey& key, float priority )
+{
+    QHash<CNodeKey, float>::iterator it = m_requests.find( key );
+    if ( it == m_requests.end() )
+        m_requests.insert( key, priority );
+    else if ( it.value() < priority )
+        it.value() = priority;
+}
+
+//------------------------------------------------------------------------------
+void
+CBrickScheduler::prefetch( const CNodeKey& key, float priority )
+{
+    QHash<CNodeKey, float>::iterator it = m_prefetches.find( key );
+    if ( it == m_prefetches.end() )
+        m_prefetches.insert( key, priority );
+    else if ( it.value() < priority )
+        it.value() = priority;
+}
+
+//------------------------------------------------------------------------------
+void
+CBrickScheduler::update()
+{
+    m_timer.start();
+    m_uploads = 0;
+    m_cancels = 0;
+
+    dropEvictedRefreshes();
+    cancelObsolete();
+    dispatch();
+
+    QVector<CBrick> finished;
+    QVector<CNodeKey> cancelled;
+    {
+        QMutexLocker locker( &m_finishedMutex );
+        finished.swap( m_finished );
+        cancelled.swap( m_cancelled );
+    }
+
+    for ( int i = 0; i < cancelled.size(); ++i )
+    {
+        m_inFlight.remove( cancelled.at( i ) );
+        m_stale.remove( cancelled.at( i ) );
+    }
+
+    // Refresh the priorities with this frame's view. Bricks nobody asked for
+    // any more were made obsolete by the camera and are dropped.
+    for ( int i = finished.size() - 1; i >= 0; --i )
+    {
+        CBrick& brick = finished[i];
+        if ( m_stale.remove( brick.key ) )
+        {
+            m_inFlight.remove( brick.key );
+            finished.remove( i );
+            continue;
+        }
+
+        QHash<CNodeKey, float>::const_iterator it = m_requests.constFind( brick.key );
+        if ( it != m_requests.constEnd() )
+        {
+            brick.priority = it.value();
+            brick.prefetch = false;
+            continue;
+        }
+
+        it = m_refreshes.constFind( brick.key );
+        if ( it != m_refreshes.constEnd() )
+        {
+            brick.priority = it.value();
+            brick.prefetch = false;
+            continue;
+        }
+
+        it = m_prefetches.constFind( brick.key );
+        if ( it != m_prefetches.constEnd() )
+        {
+            brick.priority = it.value();
+            brick.prefetch = true;
+            continue;
+        }
+
+        m_inFlight.remove( brick.key );
+        finished.remove( i );
+    }
+    std::sort( finished.begin(), finished.end(), higherBrickPriority );
+
+    // Upload at least one brick per frame so we always make progress. When
+    // the pool is full of visible bricks the rest waits, which also stops
+    // further dispatching until the camera frees some slots.
+    const qint64 budget = qint64( m_budget * 1.0e6f );
+    int i = 0;
+    for ( ; i < finished.size(); ++i )
+    {
+        if ( i > 0 && m_timer.nsecsElapsed() > budget )
+            break;
+        if ( !commit( finished.at( i ) ) )
+            break;
+        m_refreshes.remove( finished.at( i ).key );
+    }
+
+    if ( i < finished.size() )
+    {
+        QMutexLocker locker( &m_finishedMutex );
+        m_finished += finished.mid( i );
+    }
+
+    // Queue depths after this frame's work
+    m_uploadStat->add( m_uploads );
+    m_cancelStat->add( m_cancels );
+    m_requestStat->set( m_requests.size() );
+    m_prefetchStat->set( m_prefetches.size() );
+    m_refreshStat->set( m_refreshes.size() );
+    m_inFlightStat->set( m_inFlight.size() );
+    m_finishedStat->set( finished.size() - i );
+}
+
+//------------------------------------------------------------------------------
+void
+CBrickScheduler::invalidate( const CVoxelEdit& edit )
+{
+    // The stale bricks are dropped when they come back and requested anew
+    QHash<CNodeKey, CancelTokenPtr>::const_iterator it = m_inFlight.constBegin();
+    for ( ; it != m_inFlight.constEnd(); ++it )
+    {
+        if ( edit.overlaps( it.key() ) )
+            m_stale.insert( it.key() );
+    }
+}
+
+//------------------------------------------------------------------------------
+void
+CBrickScheduler::refresh( const QVector<CNodeKey>& keys )
+{
+    for ( int i = 0; i < keys.size(); ++i )
+    {
+        const CNodeKey& key = keys.at( i );
+        if ( m_inFlight.contains( key ) )
+            m_stale.insert( key );
+
+        // Nodes the tree never saw are produced from the new source anyway,
+        // and so are the ones it forgets
+        const CNodeInfo* info = m_tree->find( key );
+        if ( info && info->brickSlot >= 0 )
+            m_refreshes.insert( key, -float( key.level ) );
+        else if ( info )
+            m_tree->remove( key );
+    }
+}
+
+//------------------------------------------------------------------------------
+int
+CBrickScheduler::visibleRefreshCount() const
+{
+    int count = 0;
+    QHash<CNodeKey, float>::const_iterator it = m_refreshes.constBegin();
+    for ( ; it != m_refreshes.constEnd(); ++it )
+    {
+        const CNodeInfo* info = m_tree->find( it.key() );
+        if ( info && info->brickSlot >= 0 && m_pool->lastUsed( info->brickSlot ) >= m_frame )
+            ++count;
+    }
+    return count;
+}
+
+//------------------------------------------------------------------------------
+void
+CBrickScheduler::dropEvictedRefreshes()
+{
+    // A refresh whose brick was evicted meanwhile has nothing left to keep
+    // drawing; the node is requested like any other once it is needed
+    QHash<CNodeKey, float>::iterator it = m_refreshes.begin();
+    while ( it != m_refreshes.end() )
+    {
+        const CNodeInfo* info = m_tree->find( it.key() );
+        if ( m_inFlight.contains( it.key() ) || ( info && info->brickSlot >= 0 ) )
+        {
+            ++it;
+            continue;
+        }
+        if ( info )
+            m_tree->remove( it.key() );
+        it = m_refreshes.erase( it );
+    }
+}
+
+//------------------------------------------------------------------------------
+void
+CBrickScheduler::cancelObsolete()
+{
+    QHash<CNodeKey, CancelTokenPtr>::const_iterator it = m_inFlight.constBegin();
+    for ( ; it != m_inFlight.constEnd(); ++it )
+    {
+        // Revive work that is wanted again before it was dropped
+        if ( m_requests.contains( it.key() ) || m_refreshes.contains( it.key() )
+          || m_prefetches.contains( it.key() ) )
+        {
+            it.value()->store( 0 );
+            continue;
+        }
+        if ( !it.value()->load() )
+        {
+            it.value()->store( 1 );
+            ++m_cancels;
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+void
+CBrickScheduler::dispatch()
+{
+    // Bound the work in flight so finished bricks cannot pile up faster
+    // than the budget allows us to upload them
+    int capacity = 2 * m_threadPool.maxThreadCount() - m_inFlight.size();
+    dispatch( m_requests, false, &capacity );
+    dispatch( m_refreshes, false, &capacity );
+    dispatch( m_prefetches, true, &capacity );
+}
+
+//------------------------------------------------------------------------------
+void
+CBrickScheduler::dispatch( const QHash<CNodeKey, float>& requests, bool prefetch, int* capacity )
+{
+    if ( *capacity <= 0 )
+        return;
+
+    QVector<PrioritizedKey> pending;
+    pending.reserve( requests.size() );
+    QHash<CNodeKey, float>::const_iterator it = requests.constBegin();
+    for ( ; it != requests.constEnd(); ++it )
+    {
+        if ( m_inFlight.contains( it.key() ) )
+            continue;
+        if ( prefetch && m_requests.contains( it.key() ) )
+            continue;
+        pending.append( PrioritizedKey( it.value(), it.key() ) );
+    }
+
+    const int count = qMin( *capacity, pending.size() );
+    std::partial_sort( pending.begin(), pending.begin() + count, pending.end(), higherPriority );
+    for ( int i = 0; i < count; ++i )
+    {
+        CBrick brick( pending.at( i ).second, pending.at( i ).first );
+        brick.prefetch = prefetch;
+
+        CancelTokenPtr token( new QAtomicInt( 0 ) );
+        m_inFlight.insert( brick.key, token );
+        m_threadPool.start( new CBrickProductionTask( this, brick, token ) );
+    }
+    *capacity -= count;
+}
+
+//------------------------------------------------------------------------------
+void
+CBrickScheduler::finished( const CBrick& brick )
+{
+    QMutexLocker locker( &m_finishedMutex );
+    m_finished.append( brick );
+}
+
+//------------------------------------------------------------------------------
+void
+CBrickScheduler::cancelled( const CNodeKey& key )
+{
+    QMutexLocker locker( &m_finishedMutex );
+    m_cancelled.append( key );
+}
+
+//------------------------------------------------------------------------------
+bool
+CBrickScheduler::commit( const CBrick& brick )
+{
+    // A node produced again gives up the slot of its old brick, but only
+    // once the new one has a place, so that a full pool keeps the old one
+    const CNodeInfo* info = m_tree->find( brick.key );
+    int old = info ? info->brickSlot : -1;
+
+    if ( brick.constant )
+    {
+        releaseOld( brick.key, old );
+        m_inFlight.remove( brick.key );
+        m_tree->insert( brick, -1 );
+        return true;
+    }
+
+    // Identical bricks take no upload and no slot of their own. Sharing
+    // the old slot again only added the node as its owner a second time.
+    int slot = m_pool->share( brick, m_frame );
+    if ( slot >= 0 )
+    {
+        if ( slot == old )
+            m_pool->release( old, brick.key );
+        else
+            releaseOld( brick.key, old );
+        m_tree->insert( brick, slot );
+        m_inFlight.remove( brick.key );
+        return true;
+    }
+
+    QVector<CNodeKey> evicted;
+    slot = m_pool->allocate( brick.key, m_frame, &evicted );
+    if ( slot < 0 )
+        return false;
+
+    // The old slot itself may have been the one evicted
+    for ( int i = 0; i < evicted.size(); ++i )
+    {
+        m_tree->evictBrick( evicted.at( i ), slot );
+        if ( evicted.at( i ) == brick.key )
+            old = -1;
+    }
+    releaseOld( brick.key, old );
+    m_pool->upload( slot, brick );
+    m_pool->publish( slot, brick );
+    m_tree->insert( brick, slot );
+    m_inFlight.remove( brick.key );
+    ++m_uploads;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void
+CBrickScheduler::releaseOld( const CNodeKey& key, int slot )
+{
+    if ( slot < 0 )
+        return;
+    m_pool->release( slot, key );
+    m_tree->evictBrick( key, slot );
+}
+
+//------------------------------------------------------------------------------
@@ -0,0 +1,134 @@
+#ifndef C_BRICK_SCHEDULER_H
+#define C_BRICK_SCHEDULER_H
+
+#include "c_brick.h"
+#include "c_voxel_edit.h"
+
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QSet>
+#include <QSharedPointer>
+#include <QThreadPool>
+#include <QVector>
+
+class CBrickPool;
+class CBrickProducer;
+class CNodeTree;
+class CStatsCounter;
+class CStatsGauge;
+class CStatsHistogram;
+
+typedef QSharedPointer<QAtomicInt> CancelTokenPtr;
+
+/**
+  Turns the brick requests of a frame into resident bricks without blowing
+  the frame time. Requests are served in order of their screen-space error:
+  production runs on a thread pool and finished bricks are uploaded until
+  the per-frame budget is spent. Whatever does not fit waits for the next
+  frame, while the renderer keeps drawing the coarser ancestors.
+
+  Prefetches are only served once every request of the frame is in flight.
+  Work for keys that were neither requested nor prefetched in the current
+  frame is cancelled.
+
+  Refreshes produce resident bricks again whose source changed, such as
+  the bricks of the next frame of a sequence. The old brick is drawn
+  until the new one is committed, so they rank below every request: their
+  priority is minus their level, which keeps coarse levels first and
+  under any screen-space error. Nodes that lose their brick before that
+  are forgotten by the tree and come back through the requests. Other
+  nodes the tree knows are forgotten right away.
+  */
+class CBrickScheduler
+{
+public:
+    CBrickScheduler( CBrickProducer* producer, CBrickPool* pool, CNodeTree* tree );
+    ~CBrickScheduler();
+
+    // Milliseconds per frame spent on dispatching and uploading bricks
+    void setFrameBudget( float milliseconds ) { m_budget = milliseconds; }
+    float frameBudget() const { return m_budget; }
+
+    // Producers that mostly wait for I/O want more threads than cores, so
+    // that enough reads are in flight to keep the storage busy
+    void setThreadCount( int count ) { m_threadPool.setMaxThreadCount( qMax( count, 1 ) ); }
+    int threadCount() const { return m_threadPool.maxThreadCount(); }
+
+    void beginFrame( int frame );
+    void request( const CNodeKey& key, float priority );
+    void prefetch( const CNodeKey& key, float priority );
+    void update();
+
+    // Drops work in flight that was produced without the given edit
+    void invalidate( const CVoxelEdit& edit );
+
+    // Produces the resident bricks of the given nodes again, makes the
+    // tree forget the others and drops work in flight for any of them
+    void refresh( const QVector<CNodeKey>& keys );
+
+    int requestCount() const { return m_requests.size(); }
+    int prefetchCount() const { return m_prefetches.size(); }
+    int refreshCount() const { return m_refreshes.size(); }
+
+    // Refreshes whose old brick was drawn in the last frame
+    int visibleRefreshCount() const;
+    int inFlightCount() const { return m_inFlight.size(); }
+    int uploadCount() const { return m_uploads; }
+    int cancelCount() const { return m_cancels; }
+
+private:
+    friend class CBrickProductionTask;
+
+    void cancelObsolete();
+    void dropEvictedRefreshes();
+    void dispatch();
+    void dispatch( const QHash<CNodeKey, float>& requests, bool prefetch, int* capacity );
+    void finished( const CBrick& brick );
+    void cancelled( const CNodeKey& key );
+    bool commit( const CBrick& brick );
+    void releaseOld( const CNodeKey& key, int slot );
+
+    CBrickProducer* m_producer;
+    CBrickPool* m_pool;
+    CNodeTree* m_tree;
+
+    // Requests and prefetches of the current frame, with their screen-space error
+    QHash<CNodeKey, float> m_requests;
+    QHash<CNodeKey, float> m_prefetches;
+
+    // Resident nodes to produce again until committed, by priority
+    QHash<CNodeKey, float> m_refreshes;
+
+    // Dispatched and not yet committed
+    QHash<CNodeKey, CancelTokenPtr> m_inFlight;
+
+    // In flight, but outdated by an edit or a refresh
+    QSet<CNodeKey> m_stale;
+
+    QMutex m_finishedMutex;
+    QVector<CBrick> m_finished;
+    QVector<CNodeKey> m_cancelled;
+
+    QThreadPool m_threadPool;
+    QElapsedTimer m_timer;
+    float m_budget;
+    int m_frame;
+    int m_uploads;
+    int m_cancels;
+
+    // Published to the statistics registry
+    CStatsCounter* m_producedStat;
+    CStatsHistogram* m_produceTimeStat;
+    CStatsCounter* m_uploadStat;
+    CStatsCounter* m_cancelStat;
+    CStatsGauge* m_requestStat;
+    CStatsGauge* m_prefetchStat;
+    CStatsGauge* m_refreshStat;
+    CStatsGauge* m_inFlightStat;
+    CStatsGauge* m_finishedStat;
+    CStatsHistogram* m_blockErrorStat;
+};
+
+#endif // C_BRICK_SCHEDULER_H
@@ -0,0 +1,61 @@
+#include "c_cached_brick_producer.h"
+#include "c_brick_cache.h"
+
+//------------------------------------------------------------------------------
+CCachedBrickProducer::CCachedBrickProducer( const CBrickProducer* base, CBrickCache* cache )
+    : m_base( base ),
+      m_cache( cache )
+{
+}
+
+//------------------------------------------------------------------------------
+void
+CCachedBrickProducer::produce( CBrick& brick ) const
+{
+    if ( m_base->isAnimated() )
+    {
+        m_base->produce( brick );
+        return;
+    }
+
+    if ( m_cache->find( brick ) )
+        return;
+
+    m_base->produce( brick );
+    m_cache->insert( brick );
+}
+
+//------------------------------------------------------------------------------
+void
+CCachedBrickProducer::produceRegion( CBrick& brick, const CBrickRegion& region ) const
+{
+    // A miss is left to the base, which may be able to fill the region alone
+    CBrick cached( brick.key );
+    if ( m_base->isAnimated() || !m_cache->find( cached ) )
+    {
+        m_base->produceRegion( brick, region );
+        return;
+    }
+
+    for ( int k = region.lo[2]; k < region.hi[2]; ++k )
+        for ( int j = region.lo[1]; j < region.hi[1]; ++j )
+            for ( int i = region.lo[0]; i < region.hi[0]; ++i )
+                brick.voxels[CBrick::index( i, j, k )] = cached.constant ? cached.value
+                                                       : cached.voxels.at( CBrick::index( i, j, k ) );
+}
+
+//------------------------------------------------------------------------------
+void
+CCachedBrickProducer::produceAttributes( CBrick& brick, const CBrickRegion& region ) const
+{
+    m_base->produceAttributes( brick, region );
+}
+
+//------------------------------------------------------------------------------
+int
+CCachedBrickProducer::maxLevel() const
+{
+    return m_base->maxLevel();
+}
+
+//------------------------------------------------------------------------------
@@ -0,0 +1,35 @@
+#ifndef C_CACHED_BRICK_PRODUCER_H
+#define C_CACHED_BRICK_PRODUCER_H
+
+#include "c_brick_producer.h"
+
+class CBrickCache;
+
+/**
+  Serves voxel payloads from a host cache and falls back to the base
+  producer on a miss. Only densities are cached; attributes are cheap to
+  derive again and depend on edits applied above this producer. Animated
+  bases bypass the cache: a brick in flight while its frame changes would
+  otherwise land there after the change.
+  */
+class CCachedBrickProducer : public CBrickProducer
+{
+public:
+    CCachedBrickProducer( const CBrickProducer* base, CBrickCache* cache );
+
+    // The cache must be cleared by the caller when the base changes
+    void setBase( const CBrickProducer* base ) { m_base = base; }
+    const CBrickProducer* base() const { return m_base; }
+
+    virtual void produce( CBrick& brick ) const;
+    virtual void produceRegion( CBrick& brick, const CBrickRegion& region ) const;
+    virtual void produceAttributes( CBrick& brick, const CBrickRegion& region ) const;
+    virtual int maxLevel() const;
+    virtual bool isAnimated() const { return m_base->isAnimated(); }
+
+private:
+    const CBrickProducer* m_base;
+    CBrickCache* m_cache;
+};
+
+#endif // C_CACHED_BRICK_PRODUCER_H
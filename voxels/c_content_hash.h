@@ -0,0 +1,58 @@
+#ifndef C_CONTENT_HASH_H
+#define C_CONTENT_HASH_H
+
+#include <QtGlobal>
+
+#include <string.h>
+
+/**
+  Fast 64 bit hash of brick payloads, eight bytes per step with the
+  MurmurHash3 mixing constants. Not cryptographic: bricks with the same
+  hash must still be compared byte by byte before they are treated as
+  the same.
+  */
+namespace ContentHash
+{
+    inline quint64 rotate( quint64 v, int bits )
+    {
+        return ( v << bits ) | ( v >> ( 64 - bits ) );
+    }
+
+    inline quint64 finish( quint64 h )
+    {
+        h ^= h >> 33;
+        h *= Q_UINT64_C( 0xff51afd7ed558ccd );
+        h ^= h >> 33;
+        h *= Q_UINT64_C( 0xc4ceb9fe1a85ec53 );
+        h ^= h >> 33;
+        return h;
+    }
+
+    // Chain payloads by passing the hash of the previous one as seed
+    inline quint64 hash( const void* data, int bytes, quint64 seed = 0 )
+    {
+        const quint64 k1 = Q_UINT64_C( 0x87c37b91114253d5 );
+        const quint64 k2 = Q_UINT64_C( 0x4cf5ad432745937f );
+        const char* p = static_cast<const char*>( data );
+
+        quint64 h = seed ^ ( quint64( bytes ) * k2 );
+        int i = 0;
+        for ( ; i + 8 <= bytes; i += 8 )
+        {
+            quint64 w;
+            memcpy( &w, p + i, 8 );
+            h ^= rotate( w * k1, 31 ) * k2;
+            h = rotate( h, 27 ) * 5 + 0x52dce729;
+        }
+
+        if ( i < bytes )
+        {
+            quint64 tail = 0;
+            memcpy( &tail, p + i, bytes - i );
+            h ^= rotate( tail * k1, 31 ) * k2;
+        }
+        return finish( h );
+    }
+}
+
+#endif // C_CONTENT_HASH_H
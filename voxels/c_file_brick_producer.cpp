@@ -0,0 +1,37 @@
+#include "c_file_brick_producer.h"
+
+#include <QDebug>
+
+//------------------------------------------------------------------------------
+CFileBrickProducer::CFileBrickProducer()
+{
+}
+
+//------------------------------------------------------------------------------
+bool
+CFileBrickProducer::open( const QString& fileName )
+{
+    return m_reader.open( fileName );
+}
+
+//------------------------------------------------------------------------------
+void
+CFileBrickProducer::produce( CBrick& brick ) const
+{
+    if ( !m_reader.read( brick ) )
+    {
+        qWarning() << "Could not read brick" << brick.key.level << brick.key.x << brick.key.y << brick.key.z;
+        brick.constant = true;
+        brick.value = 0;
+        brick.voxels.clear();
+    }
+}
+
+//------------------------------------------------------------------------------
+int
+CFileBrickProducer::maxLevel() const
+{
+    return qMin( int( m_reader.header().finestLevel ), VoxelConfig::maxLevel );
+}
+
+//------------------------------------------------------------------------------
@@ -0,0 +1,34 @@
+#ifndef C_FILE_BRICK_PRODUCER_H
+#define C_FILE_BRICK_PRODUCER_H
+
+#include "c_brick_file.h"
+#include "c_brick_producer.h"
+
+/**
+  Serves bricks out of a file written by the volume converter, from the
+  current frame if it holds a sequence.
+  */
+class CFileBrickProducer : public CBrickProducer
+{
+public:
+    CFileBrickProducer();
+
+    bool open( const QString& fileName );
+
+    virtual void produce( CBrick& brick ) const;
+    virtual int maxLevel() const;
+    virtual bool isAnimated() const { return frameCount() > 1; }
+
+    int frameCount() const { return m_reader.frameCount(); }
+    int framesPerSecond() const { return int( m_reader.header().framesPerSecond ); }
+    int frame() const { return m_reader.frame(); }
+
+    // Bricks in flight may still come from the frame before, see
+    // CBrickScheduler::refresh()
+    void setFrame( int frame, QVector<CNodeKey>* changed ) { m_reader.setFrame( frame, changed ); }
+
+private:
+    mutable CBrickFileReader m_reader;
+};
+
+#endif // C_FILE_BRICK_PRODUCER_H
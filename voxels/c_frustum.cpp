@@ -0,0 +1,52 @@
+#include "c_frustum.h"
+
+//------------------------------------------------------------------------------
+CFrustum::CFrustum()
+    : m_enabled( false )
+{
+}
+
+//------------------------------------------------------------------------------
+CFrustum::CFrustum( const QMatrix4x4& clipFromSpace )
+    : m_enabled( true )
+{
+    // A point is inside when -w <= x, y, z <= w in clip space, which gives
+    // the planes as sums and differences of the matrix rows
+    const QVector4D w = clipFromSpace.row( 3 );
+    for ( int axis = 0; axis < 3; ++axis )
+    {
+        const QVector4D row = clipFromSpace.row( axis );
+        m_planes[2 * axis] = w + row;
+        m_planes[2 * axis + 1] = w - row;
+    }
+}
+
+//------------------------------------------------------------------------------
+CFrustum::Containment
+CFrustum::classify( const QVector3D& lo, const QVector3D& hi ) const
+{
+    if ( !m_enabled )
+        return Inside;
+
+    Containment result = Inside;
+    for ( int i = 0; i < 6; ++i )
+    {
+        const QVector4D& plane = m_planes[i];
+
+        // The corners furthest along and against the plane normal
+        const QVector3D positive( plane.x() >= 0.0f ? hi.x() : lo.x(),
+                                  plane.y() >= 0.0f ? hi.y() : lo.y(),
+                                  plane.z() >= 0.0f ? hi.z() : lo.z() );
+        if ( QVector3D::dotProduct( plane.toVector3D(), positive ) + plane.w() < 0.0f )
+            return Outside;
+
+        const QVector3D negative( plane.x() >= 0.0f ? lo.x() : hi.x(),
+                                  plane.y() >= 0.0f ? lo.y() : hi.y(),
+                                  plane.z() >= 0.0f ? lo.z() : hi.z() );
+        if ( QVector3D::dotProduct( plane.toVector3D(), negative ) + plane.w() < 0.0f )
+            result = Intersecting;
+    }
+    return result;
+}
+
+//------------------------------------------------------------------------------
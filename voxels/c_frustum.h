@@ -0,0 +1,37 @@
+#ifndef C_FRUSTUM_H
+#define C_FRUSTUM_H
+
+#include <QMatrix4x4>
+#include <QVector3D>
+#include <QVector4D>
+
+/**
+  The six planes of a view frustum, extracted from a matrix that maps some
+  space to OpenGL clip space, so the planes live in that space. A default
+  constructed frustum is disabled and contains everything.
+  */
+class CFrustum
+{
+public:
+    enum Containment
+    {
+        Outside,
+        Intersecting,
+        Inside
+    };
+
+    CFrustum();
+    explicit CFrustum( const QMatrix4x4& clipFromSpace );
+
+    bool isEnabled() const { return m_enabled; }
+
+    // Conservative: boxes near a corner of the frustum may be reported as
+    // intersecting although they are outside
+    Containment classify( const QVector3D& lo, const QVector3D& hi ) const;
+
+private:
+    QVector4D m_planes[6];
+    bool m_enabled;
+};
+
+#endif // C_FRUSTUM_H
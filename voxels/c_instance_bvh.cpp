@@ -0,0 +1,330 @@
+#include "c_instance_bvh.h"
+
+#include <QFuture>
+#include <QtConcurrentRun>
+
+#include <algorithm>
+
+namespace
+{
+    const int binCount = 16;
+
+    // Leaves this small are not worth splitting any further
+    const int minLeafSize = 2;
+
+    // Leaves larger than this are split even when the heuristic disagrees,
+    // which keeps the per-ray work in the shaders bounded
+    const int maxLeafSize = 8;
+
+    // Keeps the traversal stacks of the CPU and the shaders bounded
+    const int maxDepth = 48;
+
+    class CBin
+    {
+    public:
+        CBin() : count( 0 ) {}
+
+        CBounds bounds;
+        int count;
+    };
+
+    class CAxisLess
+    {
+    public:
+        CAxisLess( const QVector<QVector3D>* centers, int axis, float position )
+            : m_centers( centers ), m_axis( axis ), m_position( position )
+        {
+        }
+
+        bool operator()( qint32 instance ) const { return ( *m_centers ).at( instance )[m_axis] < m_position; }
+
+    private:
+        const QVector<QVector3D>* m_centers;
+        int m_axis;
+        float m_position;
+    };
+}
+
+//------------------------------------------------------------------------------
+CInstanceBvh::CInstanceBvh()
+    : m_nodesUsed( 0 ),
+      m_parallelThreshold( 4096 ),
+      m_dirty( false )
+{
+}
+
+//------------------------------------------------------------------------------
+void
+CInstanceBvh::build( const QVector<CBounds>& bounds )
+{
+    m_bounds = bounds;
+    m_moved.clear();
+    m_dirty = true;
+
+    const int count = bounds.size();
+    if ( count == 0 )
+    {
+        m_nodes.clear();
+        m_indices.clear();
+        m_parents.clear();
+        m_leafOf.clear();
+        return;
+    }
+
+    m_centers.resize( count );
+    m_indices.resize( count );
+    for ( int i = 0; i < count; ++i )
+    {
+        m_centers[i] = bounds.at( i ).center();
+        m_indices[i] = i;
+    }
+
+    // A binary tree over n leaves never needs more than 2n - 1 nodes
+    m_nodes.resize( 2 * count - 1 );
+    m_nodesUsed.store( 1 );
+    subdivide( 0, 0, count, 0 );
+    m_nodes.resize( m_nodesUsed.load() );
+
+    fixParents();
+}
+
+//------------------------------------------------------------------------------
+void
+CInstanceBvh::subdivide( int node, int begin, int end, int depth )
+{
+    CBounds bounds;
+    for ( int i = begin; i < end; ++i )
+        bounds.grow( m_bounds.at( m_indices.at( i ) ) );
+    setNodeBounds( node, bounds );
+
+    const int count = end - begin;
+    m_nodes[node].leftOrFirst = begin;
+    m_nodes[node].count = count;
+    if ( count <= minLeafSize || depth >= maxDepth )
+        return;
+
+    int axis = 0;
+    float position = 0.0f;
+    float cost = 0.0f;
+    const bool found = findSplit( begin, end, bounds, &axis, &position, &cost );
+    if ( ( !found || cost >= count * bounds.area() ) && count <= maxLeafSize )
+        return;
+
+    // Instances sharing one center can only be split by count
+    int middle = begin + count / 2;
+    if ( found )
+    {
+        qint32* indices = m_indices.data();
+        middle = int( std::partition( indices + begin, indices + end,
+                                      CAxisLess( &m_centers, axis, position ) ) - indices );
+        if ( middle == begin || middle == end )
+            middle = begin + count / 2;
+    }
+
+    const int left = m_nodesUsed.fetchAndAddOrdered( 2 );
+    m_nodes[node].leftOrFirst = left;
+    m_nodes[node].count = 0;
+
+    if ( count > m_parallelThreshold )
+    {
+        // Hand one half to the thread pool; waiting steals it back if no
+        // worker has picked it up yet
+        QFuture<void> future = QtConcurrent::run( this, &CInstanceBvh::subdivide, left, begin, middle, depth + 1 );
+        subdivide( left + 1, middle, end, depth + 1 );
+        future.waitForFinished();
+    }
+    else
+    {
+        subdivide( left, begin, middle, depth + 1 );
+        subdivide( left + 1, middle, end, depth + 1 );
+    }
+}
+
+//------------------------------------------------------------------------------
+bool
+CInstanceBvh::findSplit( int begin, int end, const CBounds& bounds, int* axis, float* position, float* cost ) const
+{
+    Q_UNUSED( bounds );
+
+    CBounds centers;
+    for ( int i = begin; i < end; ++i )
+        centers.grow( m_centers.at( m_indices.at( i ) ) );
+
+    bool found = false;
+    for ( int a = 0; a < 3; ++a )
+    {
+        const float lo = centers.min[a];
+        const float extent = centers.max[a] - lo;
+        if ( extent <= 0.0f )
+            continue;
+
+        CBin bins[binCount];
+        const float scale = binCount / extent;
+        for ( int i = begin; i < end; ++i )
+        {
+            const int instance = m_indices.at( i );
+            const int b = qMin( binCount - 1, int( ( m_centers.at( instance )[a] - lo ) * scale ) );
+            ++bins[b].count;
+            bins[b].bounds.grow( m_bounds.at( instance ) );
+        }
+
+        // Sweep from both sides to get the cost of every plane between bins
+        float leftArea[binCount - 1];
+        int leftCount[binCount - 1];
+        CBounds sweep;
+        int sum = 0;
+        for ( int b = 0; b < binCount - 1; ++b )
+        {
+            sweep.grow( bins[b].bounds );
+            sum += bins[b].count;
+            leftArea[b] = sweep.area();
+            leftCount[b] = sum;
+        }
+
+        sweep = CBounds();
+        sum = 0;
+        for ( int b = binCount - 1; b > 0; --b )
+        {
+            sweep.grow( bins[b].bounds );
+            sum += bins[b].count;
+            if ( leftCount[b - 1] == 0 || sum == 0 )
+                continue;
+
+            const float c = leftCount[b - 1] * leftArea[b - 1] + sum * sweep.area();
+            if ( !found || c < *cost )
+            {
+                found = true;
+                *cost = c;
+                *axis = a;
+                *position = lo + b / scale;
+            }
+        }
+    }
+    return found;
+}
+
+//------------------------------------------------------------------------------
+void
+CInstanceBvh::setNodeBounds( int node, const CBounds& bounds )
+{
+    CGpuBvhNode& n = m_nodes[node];
+    for ( int axis = 0; axis < 3; ++axis )
+    {
+        n.min[axis] = bounds.min[axis];
+        n.max[axis] = bounds.max[axis];
+    }
+}
+
+//------------------------------------------------------------------------------
+CBounds
+CInstanceBvh::nodeBounds( int node ) const
+{
+    const CGpuBvhNode& n = m_nodes.at( node );
+    return CBounds( QVector3D( n.min[0], n.min[1], n.min[2] ), QVector3D( n.max[0], n.max[1], n.max[2] ) );
+}
+
+//------------------------------------------------------------------------------
+void
+CInstanceBvh::fixParents()
+{
+    m_parents.fill( -1, m_nodes.size() );
+    m_leafOf.resize( m_bounds.size() );
+    for ( int i = 0; i < m_nodes.size(); ++i )
+    {
+        const CGpuBvhNode& node = m_nodes.at( i );
+        if ( node.count == 0 )
+        {
+            m_parents[node.leftOrFirst] = i;
+            m_parents[node.leftOrFirst + 1] = i;
+        }
+        else
+        {
+            for ( int j = 0; j < node.count; ++j )
+                m_leafOf[m_indices.at( node.leftOrFirst + j )] = i;
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+void
+CInstanceBvh::setBounds( int instance, const CBounds& bounds )
+{
+    m_bounds[instance] = bounds;
+    m_moved.append( instance );
+}
+
+//------------------------------------------------------------------------------
+void
+CInstanceBvh::refit()
+{
+    if ( m_moved.isEmpty() || m_nodes.isEmpty() )
+        return;
+
+    for ( int i = 0; i < m_moved.size(); ++i )
+    {
+        const int leaf = m_leafOf.at( m_moved.at( i ) );
+        const CGpuBvhNode& node = m_nodes.at( leaf );
+        CBounds bounds;
+        for ( int j = 0; j < node.count; ++j )
+            bounds.grow( m_bounds.at( m_indices.at( node.leftOrFirst + j ) ) );
+        setNodeBounds( leaf, bounds );
+
+        // Ancestors stop changing as soon as one already covers its children
+        for ( int parent = m_parents.at( leaf ); parent >= 0; parent = m_parents.at( parent ) )
+        {
+            const int left = m_nodes.at( parent ).leftOrFirst;
+            CBounds merged = nodeBounds( left );
+            merged.grow( nodeBounds( left + 1 ) );
+            const CBounds old = nodeBounds( parent );
+            if ( merged.min == old.min && merged.max == old.max )
+                break;
+            setNodeBounds( parent, merged );
+        }
+    }
+
+    m_moved.clear();
+    m_dirty = true;
+}
+
+//------------------------------------------------------------------------------
+int
+CInstanceBvh::intersect( const QVector3D& origin, const QVector3D& dir, float tMax, QVector<int>* hits ) const
+{
+    if ( m_nodes.isEmpty() )
+        return 0;
+
+    const QVector3D invDir( 1.0f / ( dir.x() != 0.0f ? dir.x() : 1.0e-30f ),
+                            1.0f / ( dir.y() != 0.0f ? dir.y() : 1.0e-30f ),
+                            1.0f / ( dir.z() != 0.0f ? dir.z() : 1.0e-30f ) );
+
+    int visited = 0;
+    int stack[64];
+    int top = 0;
+    stack[top++] = 0;
+    while ( top > 0 )
+    {
+        const int index = stack[--top];
+        ++visited;
+        if ( nodeBounds( index ).intersect( origin, invDir, tMax ) == FLT_MAX )
+            continue;
+
+        const CGpuBvhNode& node = m_nodes.at( index );
+        if ( node.count > 0 )
+        {
+            for ( int i = 0; i < node.count; ++i )
+            {
+                const int instance = m_indices.at( node.leftOrFirst + i );
+                if ( m_bounds.at( instance ).intersect( origin, invDir, tMax ) != FLT_MAX )
+                    hits->append( instance );
+            }
+        }
+        else
+        {
+            stack[top++] = node.leftOrFirst + 1;
+            stack[top++] = node.leftOrFirst;
+        }
+    }
+    return visited;
+}
+
+//------------------------------------------------------------------------------
@@ -0,0 +1,187 @@
+#ifndef C_INSTANCE_BVH_H
+#define C_INSTANCE_BVH_H
+
+#include <QAtomicInt>
+#include <QVector>
+#include <QVector3D>
+
+#include <float.h>
+#include <math.h>
+
+/**
+  Axis aligned box in world space.
+  */
+class CBounds
+{
+public:
+    CBounds()
+        : min( FLT_MAX, FLT_MAX, FLT_MAX ),
+          max( -FLT_MAX, -FLT_MAX, -FLT_MAX )
+    {
+    }
+
+    CBounds( const QVector3D& lo, const QVector3D& hi )
+        : min( lo ),
+          max( hi )
+    {
+    }
+
+    bool isEmpty() const { return min.x() > max.x(); }
+
+    void grow( const QVector3D& p )
+    {
+        min = QVector3D( qMin( min.x(), p.x() ), qMin( min.y(), p.y() ), qMin( min.z(), p.z() ) );
+        max = QVector3D( qMax( max.x(), p.x() ), qMax( max.y(), p.y() ), qMax( max.z(), p.z() ) );
+    }
+
+    void grow( const CBounds& b )
+    {
+        if ( b.isEmpty() )
+            return;
+        grow( b.min );
+        grow( b.max );
+    }
+
+    QVector3D center() const { return 0.5f * ( min + max ); }
+    QVector3D extent() const { return max - min; }
+
+    float area() const
+    {
+        if ( isEmpty() )
+            return 0.0f;
+        const QVector3D e = extent();
+        return 2.0f * ( e.x() * e.y() + e.y() * e.z() + e.z() * e.x() );
+    }
+
+    // Distance from p to the box, zero inside
+    float distance( const QVector3D& p ) const
+    {
+        const float dx = qMax( qMax( min.x() - p.x(), p.x() - max.x() ), 0.0f );
+        const float dy = qMax( qMax( min.y() - p.y(), p.y() - max.y() ), 0.0f );
+        const float dz = qMax( qMax( min.z() - p.z(), p.z() - max.z() ), 0.0f );
+        return sqrtf( dx * dx + dy * dy + dz * dz );
+    }
+
+    // Slab test; returns the entry distance or FLT_MAX on a miss
+    float intersect( const QVector3D& origin, const QVector3D& invDir, float tMax ) const
+    {
+        float t0 = 0.0f;
+        float t1 = tMax;
+        for ( int axis = 0; axis < 3; ++axis )
+        {
+            float tNear = ( min[axis] - origin[axis] ) * invDir[axis];
+            float tFar = ( max[axis] - origin[axis] ) * invDir[axis];
+            if ( tNear > tFar )
+                qSwap( tNear, tFar );
+            t0 = qMax( t0, tNear );
+            t1 = qMin( t1, tFar );
+        }
+        return t0 <= t1 ? t0 : FLT_MAX;
+    }
+
+    QVector3D min;
+    QVector3D max;
+};
+
+/**
+  BVH node as uploaded to the shaders, std430 layout. Inner nodes have
+  count 0 and their children at leftOrFirst and leftOrFirst + 1; leaves
+  cover count entries of the instance index list from leftOrFirst on.
+  */
+struct CGpuBvhNode
+{
+    float min[3];
+    qint32 leftOrFirst;
+    float max[3];
+    qint32 count;
+};
+
+/**
+  Bounding volume hierarchy over instance bounds. Built with a binned
+  surface area heuristic, with large subtrees split off to the global
+  thread pool. Moving instances refits only the leaves that hold them
+  and their ancestors.
+  */
+class CInstanceBvh
+{
+public:
+    CInstanceBvh();
+
+    void build( const QVector<CBounds>& bounds );
+
+    // Updates the bounds of instance; takes effect with the next refit()
+    void setBounds( int instance, const CBounds& bounds );
+    void refit();
+
+    // Subtrees below this many instances are built on the calling thread
+    void setParallelThreshold( int instances ) { m_parallelThreshold = instances; }
+
+    const QVector<CGpuBvhNode>& nodes() const { return m_nodes; }
+    const QVector<qint32>& indices() const { return m_indices; }
+    int nodeCount() const { return m_nodes.size(); }
+    bool isEmpty() const { return m_nodes.isEmpty(); }
+
+    // Set when the flat arrays changed since the last clearDirty()
+    bool isDirty() const { return m_dirty; }
+    void clearDirty() { m_dirty = false; }
+
+    CBounds nodeBounds( int node ) const;
+
+    // Collects every instance whose bounds the ray hits; returns the number
+    // of nodes visited
+    int intersect( const QVector3D& origin, const QVector3D& dir, float tMax, QVector<int>* hits ) const;
+
+    // Depth first walk. Visitor::enter( const CBounds& ) decides whether to
+    // descend, Visitor::instance( int ) receives the instances of the
+    // leaves reached.
+    template<class Visitor>
+    void traverse( Visitor& visitor ) const
+    {
+        if ( m_nodes.isEmpty() )
+            return;
+
+        int stack[64];
+        int top = 0;
+        stack[top++] = 0;
+        while ( top > 0 )
+        {
+            const CGpuBvhNode& node = m_nodes.at( stack[--top] );
+            if ( !visitor.enter( CBounds( QVector3D( node.min[0], node.min[1], node.min[2] ),
+                                          QVector3D( node.max[0], node.max[1], node.max[2] ) ) ) )
+                continue;
+
+            if ( node.count > 0 )
+            {
+                for ( int i = 0; i < node.count; ++i )
+                    visitor.instance( m_indices.at( node.leftOrFirst + i ) );
+            }
+            else
+            {
+                stack[top++] = node.leftOrFirst + 1;
+                stack[top++] = node.leftOrFirst;
+            }
+        }
+    }
+
+private:
+    void subdivide( int node, int begin, int end, int depth );
+    bool findSplit( int begin, int end, const CBounds& bounds, int* axis, float* position, float* cost ) const;
+    void setNodeBounds( int node, const CBounds& bounds );
+    void fixParents();
+
+    QVector<CBounds> m_bounds;
+    QVector<QVector3D> m_centers;
+    QVector<CGpuBvhNode> m_nodes;
+    QVector<qint32> m_indices;
+
+    // For refitting: the parent of each node and the leaf of each instance
+    QVector<qint32> m_parents;
+    QVector<qint32> m_leafOf;
+    QVector<int> m_moved;
+
+    QAtomicInt m_nodesUsed;
+    int m_parallelThreshold;
+    bool m_dirty;
+};
+
+#endif // C_INSTANCE_BVH_H
@@ -0,0 +1,359 @@
+#include "c_lod_traversal.h"
+#include "c_brick_pool.h"
+#include "c_brick_scheduler.h"
+#include "c_node_tree.h"
+#include "c_occupancy.h"
+
+#include <QPair>
+#include <QtAlgorithms>
+#include <QtConcurrentMap>
+
+#include <algorithm>
+
+namespace
+{
+    // Subtrees below this level are walked as jobs of their own
+    const int splitLevel = 2;
+
+    // Largest occluders kept for the next frame
+    const int maxOccluders = 256;
+
+    class CLargerError
+    {
+    public:
+        bool operator()( const COccluder& a, const COccluder& b ) const { return a.error > b.error; }
+    };
+}
+
+//------------------------------------------------------------------------------
+// One subtree walk for one view. Everything it finds is recorded here and
+// applied by CLodTraversal::merge(), so jobs may run on any thread.
+class CTraversalJob
+{
+public:
+    CTraversalJob()
+        : traversal( NULL ),
+          view( NULL ),
+          occlusion( NULL ),
+          inside( false ),
+          prefetch( false ),
+          visited( 0 ),
+          culled( 0 ),
+          occluded( 0 ),
+          empty( 0 )
+    {
+    }
+
+    CTraversalJob( const CLodTraversal* owner, const CViewInfo* viewInfo, const COcclusionBuffer* buffer,
+                   bool prefetching )
+        : traversal( owner ),
+          view( viewInfo ),
+          occlusion( buffer ),
+          inside( false ),
+          prefetch( prefetching ),
+          visited( 0 ),
+          culled( 0 ),
+          occluded( 0 ),
+          empty( 0 )
+    {
+        if ( occlusion )
+            clipFromLocal = view->viewProjection * view->model;
+    }
+
+    // A job for a subtree found by parent, with the same settings
+    CTraversalJob subtree( const CNodeKey& subtreeKey, bool subtreeInside ) const
+    {
+        CTraversalJob job;
+        job.traversal = traversal;
+        job.view = view;
+        job.occlusion = occlusion;
+        job.clipFromLocal = clipFromLocal;
+        job.prefetch = prefetch;
+        job.key = subtreeKey;
+        job.inside = subtreeInside;
+        return job;
+    }
+
+    void run()
+    {
+        traversal->visit( key, inside, *this, NULL );
+    }
+
+    const CLodTraversal* traversal;
+    const CViewInfo* view;
+    const COcclusionBuffer* occlusion;
+    QMatrix4x4 clipFromLocal;
+    CNodeKey key;
+    bool inside;
+    bool prefetch;
+
+    QVector<QPair<CNodeKey, float> > requests;
+    QVector<int> touched;
+    QVector<QPair<CNodeKey, bool> > reached;
+    QVector<COccluder> occluders;
+    int visited;
+    int culled;
+    int occluded;
+    int empty;
+};
+
+//------------------------------------------------------------------------------
+CLodTraversal::CLodTraversal( CNodeTree* tree, CBrickPool* pool, CBrickScheduler* scheduler )
+    : m_tree( tree ),
+      m_pool( pool ),
+      m_scheduler( scheduler ),
+      m_frame( 0 ),
+      m_visited( 0 ),
+      m_touched( 0 ),
+      m_missed( 0 ),
+      m_culled( 0 ),
+      m_occluded( 0 ),
+      m_empty( 0 ),
+      m_occlusionCulling( false ),
+      m_occupancySkipping( true ),
+      m_firstVisible( 0 ),
+      m_firstVisibleMisses( 0 )
+{
+    m_occlusion.resize( 128, 72 );
+}
+
+//------------------------------------------------------------------------------
+void
+CLodTraversal::run( const CViewInfo& view, int frame )
+{
+    run( QVector<CViewInfo>() << view, frame );
+}
+
+//------------------------------------------------------------------------------
+void
+CLodTraversal::run( const QVector<CViewInfo>& views, int frame )
+{
+    m_frame = frame;
+    m_visited = 0;
+    m_touched = 0;
+    m_missed = 0;
+    m_culled = 0;
+    m_occluded = 0;
+    m_empty = 0;
+    m_seen.swap( m_reached );
+    m_reached.clear();
+
+    prepareOcclusion( views );
+    traverse( views, false );
+}
+
+//------------------------------------------------------------------------------
+void
+CLodTraversal::prefetch( const CViewInfo& view )
+{
+    prefetch( QVector<CViewInfo>() << view );
+}
+
+//------------------------------------------------------------------------------
+void
+CLodTraversal::prefetch( const QVector<CViewInfo>& views )
+{
+    traverse( views, true );
+}
+
+//------------------------------------------------------------------------------
+void
+CLodTraversal::setOcclusionCulling( bool b )
+{
+    m_occlusionCulling = b;
+    m_occluders.clear();
+    m_occlusion.clear();
+}
+
+//------------------------------------------------------------------------------
+void
+CLodTraversal::setOpaqueValues( const QBitArray& values )
+{
+    // Last frame's occluders may have turned transparent
+    m_opaqueValues = values;
+    m_occluders.clear();
+}
+
+//------------------------------------------------------------------------------
+void
+CLodTraversal::resetStatistics()
+{
+    m_seen.clear();
+    m_reached.clear();
+    m_firstVisible = 0;
+    m_firstVisibleMisses = 0;
+}
+
+//------------------------------------------------------------------------------
+void
+CLodTraversal::prepareOcclusion( const QVector<CViewInfo>& views )
+{
+    m_occlusion.clear();
+    if ( m_occlusionCulling && !views.isEmpty() && views.first().frustum.isEnabled() )
+    {
+        // All views share the camera
+        const QMatrix4x4& viewProjection = views.first().viewProjection;
+        for ( int i = 0; i < m_occluders.size(); ++i )
+            m_occlusion.rasterize( viewProjection, m_occluders.at( i ) );
+    }
+    m_occluders.clear();
+}
+
+//------------------------------------------------------------------------------
+void
+CLodTraversal::traverse( const QVector<CViewInfo>& views, bool prefetch )
+{
+    // The first levels are walked here, the subtrees below them in parallel
+    QVector<CTraversalJob> jobs;
+    for ( int i = 0; i < views.size(); ++i )
+    {
+        const bool occlusion = !prefetch && m_occlusionCulling && views.at( i ).frustum.isEnabled();
+        CTraversalJob root( this, &views.at( i ), occlusion ? &m_occlusion : NULL, prefetch );
+        visit( CNodeKey(), false, root, &jobs );
+        merge( root );
+    }
+
+    QtConcurrent::blockingMap( jobs, &CTraversalJob::run );
+    for ( int i = 0; i < jobs.size(); ++i )
+        merge( jobs.at( i ) );
+
+    if ( m_occluders.size() > maxOccluders )
+    {
+        std::nth_element( m_occluders.begin(), m_occluders.begin() + maxOccluders, m_occluders.end(),
+                          CLargerError() );
+        m_occluders.resize( maxOccluders );
+    }
+}
+
+//------------------------------------------------------------------------------
+void
+CLodTraversal::visit( const CNodeKey& key, bool inside, CTraversalJob& job,
+                      QVector<CTraversalJob>* deferred ) const
+{
+    if ( deferred && int( key.level ) == splitLevel )
+    {
+        deferred->append( job.subtree( key, inside ) );
+        return;
+    }
+
+    const CViewInfo& view = *job.view;
+    const QVector3D lo = key.origin();
+    const QVector3D hi = lo + QVector3D( 1.0f, 1.0f, 1.0f ) * key.size();
+
+    // Once a node is inside the frustum, so are all of its children
+    if ( !inside )
+    {
+        const CFrustum::Containment containment = view.frustum.classify( lo, hi );
+        if ( containment == CFrustum::Outside )
+        {
+            ++job.culled;
+            return;
+        }
+        inside = containment == CFrustum::Inside;
+    }
+
+    if ( job.occlusion && job.occlusion->isOccluded( job.clipFromLocal, lo, hi ) )
+    {
+        ++job.occluded;
+        return;
+    }
+
+    const float error = view.screenSpaceError( key );
+    const CNodeInfo* info = m_tree->find( key );
+
+    // Nothing below an invisible node shows, so it needs no brick either
+    if ( info && !m_tree->isVisible( *info ) )
+    {
+        ++job.empty;
+        return;
+    }
+
+    const bool missing = !info || ( !info->constant && info->brickSlot < 0 );
+    if ( job.prefetch )
+    {
+        if ( missing )
+            job.requests.append( qMakePair( key, error ) );
+    }
+    else
+    {
+        ++job.visited;
+        job.reached.append( qMakePair( key, missing ) );
+
+        // Ancestors stay in use, they are the fallback while children stream in
+        if ( missing )
+            job.requests.append( qMakePair( key, error ) );
+        else if ( info->brickSlot >= 0 )
+            job.touched.append( info->brickSlot );
+
+        if ( job.occlusion && info && info->constant && isOpaque( info->value ) )
+        {
+            COccluder occluder;
+            for ( int c = 0; c < 8; ++c )
+            {
+                const QVector3D p( c & 1 ? hi.x() : lo.x(), c & 2 ? hi.y() : lo.y(), c & 4 ? hi.z() : lo.z() );
+                occluder.corners[c] = view.model * p;
+            }
+            occluder.error = error;
+            job.occluders.append( occluder );
+        }
+    }
+
+    if ( !info || info->constant )
+        return;
+
+    if ( int( key.level ) >= view.maxLevel || error <= view.pixelError )
+        return;
+
+    // Visit the children that can hold density, lowest index first
+    const quint32 children = m_occupancySkipping ? Occupancy::occupiedChildren( info->occupancy ) : 0xffu;
+    job.empty += 8 - qPopulationCount( children );
+    for ( quint32 bits = children; bits != 0; bits &= bits - 1 )
+        visit( key.child( int( qCountTrailingZeroBits( bits ) ) ), inside, job, deferred );
+}
+
+//------------------------------------------------------------------------------
+void
+CLodTraversal::merge( const CTraversalJob& job )
+{
+    for ( int i = 0; i < job.requests.size(); ++i )
+    {
+        if ( job.prefetch )
+            m_scheduler->prefetch( job.requests.at( i ).first, job.requests.at( i ).second );
+        else
+            m_scheduler->request( job.requests.at( i ).first, job.requests.at( i ).second );
+    }
+
+    for ( int i = 0; i < job.touched.size(); ++i )
+        m_pool->touch( job.touched.at( i ), m_frame );
+    m_touched += job.touched.size();
+    if ( !job.prefetch )
+        m_missed += job.requests.size();
+
+    for ( int i = 0; i < job.reached.size(); ++i )
+        firstVisible( job.reached.at( i ).first, job.reached.at( i ).second );
+
+    m_occluders += job.occluders;
+    m_visited += job.visited;
+    m_culled += job.culled;
+    m_occluded += job.occluded;
+    m_empty += job.empty;
+}
+
+//------------------------------------------------------------------------------
+void
+CLodTraversal::firstVisible( const CNodeKey& key, bool missing )
+{
+    // Views of several instances may reach the same node
+    if ( m_reached.contains( key ) )
+        return;
+
+    m_reached.insert( key );
+    if ( m_seen.contains( key ) )
+        return;
+
+    ++m_firstVisible;
+    if ( missing )
+        ++m_firstVisibleMisses;
+}
+
+//------------------------------------------------------------------------------
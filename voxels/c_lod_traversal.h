@@ -0,0 +1,117 @@
+#ifndef C_LOD_TRAVERSAL_H
+#define C_LOD_TRAVERSAL_H
+
+#include "c_occlusion_buffer.h"
+#include "c_view_info.h"
+
+#include <QBitArray>
+#include <QSet>
+#include <QVector>
+
+class CBrickPool;
+class CBrickScheduler;
+class CNodeTree;
+class CTraversalJob;
+
+/**
+  Walks the octree from the root and refines every node whose voxels
+  project to more than the view's pixel error. Resident bricks on the
+  way are marked as used; missing ones are requested with their
+  screen-space error as the priority.
+
+  Views with culling enabled skip nodes outside the frustum and, if
+  occlusion culling is on, nodes hidden behind solid nodes found in the
+  previous frame. Skipped nodes are neither touched nor requested. The
+  subtrees below the first levels are walked in parallel; the results are
+  applied to the pool and scheduler on the calling thread.
+
+  Children whose cells in the occupancy of their parent are all empty are
+  skipped as well, like constant empty nodes, without looking at their
+  bricks or requesting them. So are nodes the tree reports invisible.
+
+  A prefetch pass walks the tree for a predicted view instead. It leaves
+  the pool untouched and only issues prefetches. It culls by frustum only,
+  since the occluders were seen from the current view.
+  */
+class CLodTraversal
+{
+public:
+    CLodTraversal( CNodeTree* tree, CBrickPool* pool, CBrickScheduler* scheduler );
+
+    void run( const CViewInfo& view, int frame );
+
+    // One walk per view of the shared asset, typically one per instance;
+    // the statistics cover all of them
+    void run( const QVector<CViewInfo>& views, int frame );
+    void prefetch( const CViewInfo& view );
+    void prefetch( const QVector<CViewInfo>& views );
+
+    void setOcclusionCulling( bool b );
+    bool isOcclusionCulling() const { return m_occlusionCulling; }
+
+    // One bit per value at which a constant node blocks every ray that
+    // enters it, and may occlude; an empty array takes full density only
+    void setOpaqueValues( const QBitArray& values );
+
+    void setOccupancySkipping( bool b ) { m_occupancySkipping = b; }
+    bool isOccupancySkipping() const { return m_occupancySkipping; }
+
+    int visitedCount() const { return m_visited; }
+    int touchedCount() const { return m_touched; }
+
+    // Bricks the visible pass needed but found neither resident nor constant
+    int missedCount() const { return m_missed; }
+
+    // Nodes skipped this frame, by the visible and prefetch passes together
+    int culledCount() const { return m_culled; }
+    int occludedCount() const { return m_occluded; }
+    int emptyCount() const { return m_empty; }
+
+    // Nodes needed that were not needed the frame before, and how many of
+    // those were not ready
+    qint64 firstVisibleCount() const { return m_firstVisible; }
+    qint64 firstVisibleMissCount() const { return m_firstVisibleMisses; }
+    void resetStatistics();
+
+private:
+    friend class CTraversalJob;
+
+    void traverse( const QVector<CViewInfo>& views, bool prefetch );
+    void visit( const CNodeKey& key, bool inside, CTraversalJob& job, QVector<CTraversalJob>* deferred ) const;
+    void merge( const CTraversalJob& job );
+    void prepareOcclusion( const QVector<CViewInfo>& views );
+    void firstVisible( const CNodeKey& key, bool missing );
+    bool isOpaque( quint8 value ) const
+    {
+        return m_opaqueValues.isEmpty() ? value == 255 : m_opaqueValues.testBit( value );
+    }
+
+    CNodeTree* m_tree;
+    CBrickPool* m_pool;
+    CBrickScheduler* m_scheduler;
+
+    int m_frame;
+    int m_visited;
+    int m_touched;
+    int m_missed;
+    int m_culled;
+    int m_occluded;
+    int m_empty;
+
+    // Solid nodes seen last frame, drawn into the buffer before the walk
+    bool m_occlusionCulling;
+    COcclusionBuffer m_occlusion;
+    QVector<COccluder> m_occluders;
+    QBitArray m_opaqueValues;
+
+    bool m_occupancySkipping;
+
+    // Nodes the visible pass reached last frame and this frame; both only
+    // hold the nodes of one view
+    QSet<CNodeKey> m_seen;
+    QSet<CNodeKey> m_reached;
+    qint64 m_firstVisible;
+    qint64 m_firstVisibleMisses;
+};
+
+#endif // C_LOD_TRAVERSAL_H
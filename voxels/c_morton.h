@@ -0,0 +1,48 @@
+#ifndef C_MORTON_H
+#define C_MORTON_H
+
+#include <QtGlobal>
+
+/**
+  Z-order codes of 3D cell coordinates of up to 10 bits each: the bits of
+  x, y and z interleaved, x in the lowest. Cells close in space get close
+  codes, so walking them in code order stays within small cubes.
+  */
+namespace Morton
+{
+    // Spreads the low 10 bits of v out to every third bit
+    inline quint32 spread( quint32 v )
+    {
+        v &= 0x000003ffu;
+        v = ( v | ( v << 16 ) ) & 0x030000ffu;
+        v = ( v | ( v << 8 ) ) & 0x0300f00fu;
+        v = ( v | ( v << 4 ) ) & 0x030c30c3u;
+        v = ( v | ( v << 2 ) ) & 0x09249249u;
+        return v;
+    }
+
+    // Inverse of spread(), gathers every third bit
+    inline quint32 compact( quint32 v )
+    {
+        v &= 0x09249249u;
+        v = ( v ^ ( v >> 2 ) ) & 0x030c30c3u;
+        v = ( v ^ ( v >> 4 ) ) & 0x0300f00fu;
+        v = ( v ^ ( v >> 8 ) ) & 0x030000ffu;
+        v = ( v ^ ( v >> 16 ) ) & 0x000003ffu;
+        return v;
+    }
+
+    inline quint32 encode( quint32 x, quint32 y, quint32 z )
+    {
+        return spread( x ) | ( spread( y ) << 1 ) | ( spread( z ) << 2 );
+    }
+
+    inline void decode( quint32 code, int& x, int& y, int& z )
+    {
+        x = int( compact( code ) );
+        y = int( compact( code >> 1 ) );
+        z = int( compact( code >> 2 ) );
+    }
+}
+
+#endif // C_MORTON_H
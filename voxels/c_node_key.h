@@ -0,0 +1,65 @@
+#ifndef C_NODE_KEY_H
+#define C_NODE_KEY_H
+
+#include <QtGlobal>
+#include <QVector3D>
+
+/**
+  Addresses an octree node by its level and integer cell coordinates.
+  At level l the unit cube is split into 2^l cells along each axis.
+  */
+class CNodeKey
+{
+public:
+    CNodeKey()
+        : level( 0 ), x( 0 ), y( 0 ), z( 0 )
+    {
+    }
+
+    CNodeKey( quint32 l, quint32 cx, quint32 cy, quint32 cz )
+        : level( l ), x( cx ), y( cy ), z( cz )
+    {
+    }
+
+    bool isRoot() const { return level == 0; }
+
+    CNodeKey parent() const { return CNodeKey( level - 1, x >> 1, y >> 1, z >> 1 ); }
+
+    // Children are numbered with bit 0 for x, bit 1 for y and bit 2 for z
+    CNodeKey child( int i ) const
+    {
+        return CNodeKey( level + 1,
+                         ( x << 1 ) | ( i & 1 ),
+                         ( y << 1 ) | ( ( i >> 1 ) & 1 ),
+                         ( z << 1 ) | ( ( i >> 2 ) & 1 ) );
+    }
+
+    int childIndex() const { return int( ( x & 1 ) | ( ( y & 1 ) << 1 ) | ( ( z & 1 ) << 2 ) ); }
+
+    // Edge length and minimum corner in unit cube space
+    float size() const { return 1.0f / float( 1u << level ); }
+    QVector3D origin() const { return QVector3D( float( x ), float( y ), float( z ) ) * size(); }
+    QVector3D center() const { return origin() + QVector3D( 0.5f, 0.5f, 0.5f ) * size(); }
+
+    quint32 level;
+    quint32 x;
+    quint32 y;
+    quint32 z;
+};
+
+inline bool operator==( const CNodeKey& a, const CNodeKey& b )
+{
+    return a.level == b.level && a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+inline bool operator!=( const CNodeKey& a, const CNodeKey& b )
+{
+    return !( a == b );
+}
+
+inline uint qHash( const CNodeKey& key )
+{
+    return ( key.x * 73856093u ) ^ ( key.y * 19349663u ) ^ ( key.z * 83492791u ) ^ ( key.level * 2654435761u );
+}
+
+#endif // C_NODE_KEY_H
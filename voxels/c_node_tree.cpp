@@ -0,0 +1,255 @@
+#include "c_node_tree.h"
+#include "c_occupancy.h"
+
+//------------------------------------------------------------------------------
+CNodeTree::CNodeTree()
+    : m_dirty( true ),
+      m_visibilityDirty( false ),
+      m_invisible( 0 )
+{
+}
+
+//------------------------------------------------------------------------------
+const CNodeInfo*
+CNodeTree::find( const CNodeKey& key ) const
+{
+    QHash<CNodeKey, CNodeInfo>::const_iterator it = m_nodes.constFind( key );
+    return it == m_nodes.constEnd() ? NULL : &it.value();
+}
+
+//------------------------------------------------------------------------------
+void
+CNodeTree::insert( const CBrick& brick, int slot )
+{
+    quint8 lo = brick.value;
+    quint8 hi = brick.value;
+    if ( !brick.constant )
+    {
+        lo = brick.minValue;
+        hi = brick.maxValue;
+    }
+
+    // A node produced again keeps what its descendants added to its range
+    QHash<CNodeKey, CNodeInfo>::iterator it = m_nodes.find( brick.key );
+    if ( it == m_nodes.end() )
+    {
+        CNodeInfo info;
+        info.minValue = lo;
+        info.maxValue = hi;
+        for ( int c = 0; c < 8; ++c )
+        {
+            const CNodeInfo* child = find( brick.key.child( c ) );
+            if ( child )
+            {
+                info.minValue = qMin( info.minValue, child->minValue );
+                info.maxValue = qMax( info.maxValue, child->maxValue );
+            }
+        }
+        it = m_nodes.insert( brick.key, info );
+    }
+
+    CNodeInfo& info = it.value();
+    info.brickSlot = slot;
+    info.constant = brick.constant;
+    info.value = brick.value;
+    info.occupancy = brick.constant ? Occupancy::build( brick ) : brick.occupancy;
+    info.minValue = qMin( info.minValue, lo );
+    info.maxValue = qMax( info.maxValue, hi );
+    widenAncestors( brick.key, info.minValue, info.maxValue );
+    m_dirty = true;
+}
+
+//------------------------------------------------------------------------------
+void
+CNodeTree::evictBrick( const CNodeKey& key, int slot )
+{
+    QHash<CNodeKey, CNodeInfo>::iterator it = m_nodes.find( key );
+    if ( it == m_nodes.end() || it.value().brickSlot != slot )
+        return;
+    it.value().brickSlot = -1;
+    m_dirty = true;
+}
+
+//------------------------------------------------------------------------------
+void
+CNodeTree::update( const CBrick& brick )
+{
+    QHash<CNodeKey, CNodeInfo>::iterator it = m_nodes.find( brick.key );
+    if ( it == m_nodes.end() )
+        return;
+
+    // Ranges only grow, so removed material leaves them conservative
+    CNodeInfo& info = it.value();
+    const quint8 lo = qMin( info.minValue, brick.minValue );
+    const quint8 hi = qMax( info.maxValue, brick.maxValue );
+    if ( info.occupancy == brick.occupancy && info.minValue == lo && info.maxValue == hi )
+        return;
+
+    info.occupancy = brick.occupancy;
+    info.minValue = lo;
+    info.maxValue = hi;
+    widenAncestors( brick.key, lo, hi );
+    m_dirty = true;
+}
+
+//------------------------------------------------------------------------------
+void
+CNodeTree::remove( const CNodeKey& key )
+{
+    if ( m_nodes.remove( key ) )
+        m_dirty = true;
+}
+
+//------------------------------------------------------------------------------
+void
+CNodeTree::setVisibleValues( const QBitArray& values )
+{
+    if ( values == m_visibleValues )
+        return;
+
+    m_visibleValues = values;
+    m_visiblePrefix.clear();
+    if ( !values.isEmpty() )
+    {
+        Q_ASSERT( values.size() == 256 );
+        m_visiblePrefix.resize( 257 );
+        m_visiblePrefix[0] = 0;
+        for ( int v = 0; v < 256; ++v )
+            m_visiblePrefix[v + 1] = m_visiblePrefix.at( v ) + ( values.testBit( v ) ? 1 : 0 );
+    }
+
+    m_visibilityDirty = true;
+}
+
+//------------------------------------------------------------------------------
+void
+CNodeTree::flatten( QVector<CGpuNode>& nodes, QVector<CNodeKey>* keysOut )
+{
+    QVector<CNodeKey> keys;
+    keys.reserve( m_nodes.size() + 8 );
+    nodes.clear();
+    nodes.reserve( m_nodes.size() + 8 );
+
+    m_invisible = 0;
+    keys.append( CNodeKey() );
+    nodes.append( gpuNode( CNodeKey() ) );
+
+    // nodes and keys grow in lockstep, so index i describes keys[i]
+    for ( int i = 0; i < keys.size(); ++i )
+    {
+        const CNodeKey key = keys.at( i );
+        if ( !hasKnownChild( key ) )
+            continue;
+
+        nodes[i].firstChild = nodes.size();
+        for ( int c = 0; c < 8; ++c )
+        {
+            const CNodeKey child = key.child( c );
+            keys.append( child );
+            nodes.append( gpuNode( child ) );
+        }
+    }
+
+    if ( keysOut )
+        keysOut->swap( keys );
+    m_dirty = false;
+    m_visibilityDirty = false;
+}
+
+//------------------------------------------------------------------------------
+void
+CNodeTree::updateVisibility( QVector<CGpuNode>& nodes, const QVector<CNodeKey>& keys,
+                             QVector<QPair<int, int> >& changed )
+{
+    Q_ASSERT( !m_dirty && nodes.size() == keys.size() );
+
+    // Runs of changed nodes closer than this go up as one range, unchanged
+    // nodes between them included
+    const int gap = 16;
+    const int first = changed.size();
+
+    m_invisible = 0;
+    for ( int i = 0; i < nodes.size(); ++i )
+    {
+        const CNodeInfo* info = find( keys.at( i ) );
+        if ( !info )
+            continue;
+
+        const bool invisible = !isVisible( *info );
+        m_invisible += invisible ? 1 : 0;
+        if ( invisible == ( ( nodes.at( i ).flags & CGpuNode::Invisible ) != 0 ) )
+            continue;
+
+        nodes[i].flags ^= CGpuNode::Invisible;
+        if ( changed.size() > first && i - ( changed.last().first + changed.last().second ) < gap )
+            changed.last().second = i + 1 - changed.last().first;
+        else
+            changed.append( qMakePair( i, 1 ) );
+    }
+    m_visibilityDirty = false;
+}
+
+//------------------------------------------------------------------------------
+CGpuNode
+CNodeTree::gpuNode( const CNodeKey& key )
+{
+    CGpuNode node;
+    node.firstChild = -1;
+    node.brick = -1;
+    node.flags = 0;
+    node.reserved = 0;
+    node.occupancy = ~quint64( 0 );
+
+    const CNodeInfo* info = find( key );
+    if ( info )
+    {
+        node.brick = info->brickSlot;
+        node.flags = CGpuNode::Known;
+        node.occupancy = info->occupancy;
+        if ( info->constant )
+            node.flags |= CGpuNode::Constant | ( quint32( info->value ) << 8 );
+        if ( !isVisible( *info ) )
+        {
+            node.flags |= CGpuNode::Invisible;
+            ++m_invisible;
+        }
+    }
+    return node;
+}
+
+//------------------------------------------------------------------------------
+bool
+CNodeTree::hasKnownChild( const CNodeKey& key ) const
+{
+    const CNodeInfo* info = find( key );
+    if ( !info || info->constant || int( key.level ) >= VoxelConfig::maxLevel )
+        return false;
+
+    for ( int c = 0; c < 8; ++c )
+    {
+        if ( m_nodes.contains( key.child( c ) ) )
+            return true;
+    }
+    return false;
+}
+
+//------------------------------------------------------------------------------
+void
+CNodeTree::widenAncestors( const CNodeKey& key, quint8 lo, quint8 hi )
+{
+    for ( CNodeKey k = key; !k.isRoot(); )
+    {
+        k = k.parent();
+        QHash<CNodeKey, CNodeInfo>::iterator it = m_nodes.find( k );
+        if ( it == m_nodes.end() )
+            return;
+
+        CNodeInfo& info = it.value();
+        if ( info.minValue <= lo && info.maxValue >= hi )
+            return;
+        info.minValue = qMin( info.minValue, lo );
+        info.maxValue = qMax( info.maxValue, hi );
+    }
+}
+
+//------------------------------------------------------------------------------
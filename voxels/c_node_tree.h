@@ -0,0 +1,127 @@
+#ifndef C_NODE_TREE_H
+#define C_NODE_TREE_H
+
+#include "c_brick.h"
+
+#include <QBitArray>
+#include <QHash>
+#include <QPair>
+#include <QVector>
+
+/**
+  What the renderer knows about a node once its brick was produced.
+  */
+class CNodeInfo
+{
+public:
+    CNodeInfo()
+        : brickSlot( -1 ),
+          constant( false ),
+          value( 0 ),
+          occupancy( ~quint64( 0 ) ),
+          minValue( 0 ),
+          maxValue( 255 )
+    {
+    }
+
+    // Pool slot of the brick, -1 while it is not resident
+    int brickSlot;
+
+    bool constant;
+    quint8 value;
+
+    // Cells that can hold density, kept while the brick is not resident
+    quint64 occupancy;
+
+    // Values in the brick and in every brick produced below it so far
+    quint8 minValue;
+    quint8 maxValue;
+};
+
+/**
+  One node as the shader reads it from the node buffer (std430).
+  */
+struct CGpuNode
+{
+    enum Flags
+    {
+        Known     = 0x1,
+        Constant  = 0x2,
+        Invisible = 0x4
+    };
+
+    qint32 firstChild;  // first of eight consecutive children, -1 if none
+    qint32 brick;       // pool slot, -1 if none
+    quint32 flags;      // Flags, constant value in bits 8..15
+    quint32 reserved;
+    quint64 occupancy;  // see c_occupancy.h, read as a uvec2 low word first
+};
+
+/**
+  Sparse octree of every node that has been produced so far. Bricks come and
+  go with the pool; the node structure stays so it can be re-requested.
+
+  Each node keeps the range of values below it. A node whose range holds
+  no visible value is invisible and, like a constant empty node, skipped
+  with its whole subtree. The range of a coarse node comes from filtered
+  data and may miss the extremes of the detail below it, so the ranges of
+  nodes are merged into their ancestors as they are produced. Changing
+  the visible values only flips the Invisible flags of the flattened
+  nodes; nothing is produced or flattened again.
+  */
+class CNodeTree
+{
+public:
+    CNodeTree();
+
+    // Returns NULL if the node has not been produced yet
+    const CNodeInfo* find( const CNodeKey& key ) const;
+
+    void insert( const CBrick& brick, int slot );
+    // Only if the node still uses slot
+    void evictBrick( const CNodeKey& key, int slot );
+    void update( const CBrick& brick );
+    void remove( const CNodeKey& key );
+
+    int nodeCount() const { return m_nodes.size(); }
+
+    // One bit per value, set for the values the renderer shows; an empty
+    // array shows everything
+    void setVisibleValues( const QBitArray& values );
+    bool isVisible( const CNodeInfo& info ) const
+    {
+        return m_visiblePrefix.isEmpty() || m_visiblePrefix.at( info.maxValue + 1 ) > m_visiblePrefix.at( info.minValue );
+    }
+
+    // Invisible nodes as of the last flatten() or updateVisibility()
+    int invisibleCount() const { return m_invisible; }
+
+    // Linearises the tree breadth first for the shader; keys, if given,
+    // receives the key of each node
+    bool isDirty() const { return m_dirty; }
+    void flatten( QVector<CGpuNode>& nodes, QVector<CNodeKey>* keys = NULL );
+
+    // Whether the visible values changed since the tree was flattened.
+    // Unless the tree is dirty as well, updateVisibility() then sets the
+    // Invisible flags of the nodes and keys flatten() produced in place,
+    // and appends the ranges of nodes that changed as first and count.
+    bool isVisibilityDirty() const { return m_visibilityDirty; }
+    void updateVisibility( QVector<CGpuNode>& nodes, const QVector<CNodeKey>& keys,
+                           QVector<QPair<int, int> >& changed );
+
+private:
+    CGpuNode gpuNode( const CNodeKey& key );
+    bool hasKnownChild( const CNodeKey& key ) const;
+    void widenAncestors( const CNodeKey& key, quint8 lo, quint8 hi );
+
+    QHash<CNodeKey, CNodeInfo> m_nodes;
+    bool m_dirty;
+    bool m_visibilityDirty;
+
+    // Visible values below each value, so a range is tested in O(1)
+    QBitArray m_visibleValues;
+    QVector<int> m_visiblePrefix;
+    int m_invisible;
+};
+
+#endif // C_NODE_TREE_H
@@ -0,0 +1,157 @@
+#include "c_occlusion_buffer.h"
+
+#include <QVector2D>
+#include <QVector4D>
+
+#include <float.h>
+#include <math.h>
+
+namespace
+{
+    // Corners of each face of a box, in order around the face
+    const int faces[6][4] = {
+        { 0, 2, 3, 1 }, { 4, 5, 7, 6 },
+        { 0, 4, 6, 2 }, { 1, 3, 7, 5 },
+        { 0, 1, 5, 4 }, { 2, 6, 7, 3 }
+    };
+
+    inline float
+    edge( const QVector2D& a, const QVector2D& b, float x, float y )
+    {
+        return ( b.x() - a.x() ) * ( y - a.y() ) - ( b.y() - a.y() ) * ( x - a.x() );
+    }
+}
+
+//------------------------------------------------------------------------------
+COcclusionBuffer::COcclusionBuffer()
+    : m_width( 0 ),
+      m_height( 0 ),
+      m_empty( true )
+{
+}
+
+//------------------------------------------------------------------------------
+void
+COcclusionBuffer::resize( int width, int height )
+{
+    m_width = width;
+    m_height = height;
+    clear();
+}
+
+//------------------------------------------------------------------------------
+void
+COcclusionBuffer::clear()
+{
+    m_depth.fill( FLT_MAX, m_width * m_height );
+    m_empty = true;
+}
+
+//------------------------------------------------------------------------------
+void
+COcclusionBuffer::rasterize( const QMatrix4x4& viewProjection, const COccluder& occluder )
+{
+    // Occluders reaching in front of the near plane are partly clipped away
+    // when drawn, so they are not used at all
+    QVector2D screen[8];
+    float farthest = 0.0f;
+    for ( int c = 0; c < 8; ++c )
+    {
+        const QVector4D clip = viewProjection * QVector4D( occluder.corners[c], 1.0f );
+        if ( clip.z() < -clip.w() )
+            return;
+        screen[c] = QVector2D( ( 0.5f + 0.5f * clip.x() / clip.w() ) * m_width,
+                               ( 0.5f + 0.5f * clip.y() / clip.w() ) * m_height );
+        farthest = qMax( farthest, clip.w() );
+    }
+
+    // The faces cover the silhouette of the box; a pixel is written when
+    // all four of its corners are inside one face
+    for ( int f = 0; f < 6; ++f )
+    {
+        const QVector2D q[4] = { screen[faces[f][0]], screen[faces[f][1]],
+                                 screen[faces[f][2]], screen[faces[f][3]] };
+        const float area = edge( q[0], q[1], q[2].x(), q[2].y() ) + edge( q[0], q[2], q[3].x(), q[3].y() );
+        if ( fabsf( area ) < 1.0f )
+            continue;
+        const float sign = area > 0.0f ? 1.0f : -1.0f;
+
+        float minX = q[0].x(), maxX = q[0].x(), minY = q[0].y(), maxY = q[0].y();
+        for ( int i = 1; i < 4; ++i )
+        {
+            minX = qMin( minX, q[i].x() );
+            maxX = qMax( maxX, q[i].x() );
+            minY = qMin( minY, q[i].y() );
+            maxY = qMax( maxY, q[i].y() );
+        }
+        const int x0 = qMax( int( ceilf( minX ) ), 0 );
+        const int x1 = qMin( int( floorf( maxX ) ), m_width );
+        const int y0 = qMax( int( ceilf( minY ) ), 0 );
+        const int y1 = qMin( int( floorf( maxY ) ), m_height );
+
+        for ( int y = y0; y < y1; ++y )
+            for ( int x = x0; x < x1; ++x )
+            {
+                bool covered = true;
+                for ( int e = 0; e < 4 && covered; ++e )
+                {
+                    const QVector2D& a = q[e];
+                    const QVector2D& b = q[( e + 1 ) & 3];
+                    covered = sign * edge( a, b, float( x ), float( y ) ) >= 0.0f
+                           && sign * edge( a, b, x + 1.0f, float( y ) ) >= 0.0f
+                           && sign * edge( a, b, float( x ), y + 1.0f ) >= 0.0f
+                           && sign * edge( a, b, x + 1.0f, y + 1.0f ) >= 0.0f;
+                }
+                if ( covered )
+                {
+                    float& depth = m_depth[y * m_width + x];
+                    depth = qMin( depth, farthest );
+                    m_empty = false;
+                }
+            }
+    }
+}
+
+//------------------------------------------------------------------------------
+bool
+COcclusionBuffer::isOccluded( const QMatrix4x4& clipFromLocal, const QVector3D& lo, const QVector3D& hi ) const
+{
+    if ( m_empty )
+        return false;
+
+    float nearest = FLT_MAX;
+    float minX = FLT_MAX, maxX = -FLT_MAX, minY = FLT_MAX, maxY = -FLT_MAX;
+    for ( int c = 0; c < 8; ++c )
+    {
+        const QVector3D p( c & 1 ? hi.x() : lo.x(), c & 2 ? hi.y() : lo.y(), c & 4 ? hi.z() : lo.z() );
+        const QVector4D clip = clipFromLocal * QVector4D( p, 1.0f );
+        if ( clip.z() < -clip.w() )
+            return false;
+
+        const float x = ( 0.5f + 0.5f * clip.x() / clip.w() ) * m_width;
+        const float y = ( 0.5f + 0.5f * clip.y() / clip.w() ) * m_height;
+        minX = qMin( minX, x );
+        maxX = qMax( maxX, x );
+        minY = qMin( minY, y );
+        maxY = qMax( maxY, y );
+        nearest = qMin( nearest, clip.w() );
+    }
+
+    // Parts off the screen are not visible anyway
+    const int x0 = qMax( int( floorf( minX ) ), 0 );
+    const int x1 = qMin( int( ceilf( maxX ) ), m_width );
+    const int y0 = qMax( int( floorf( minY ) ), 0 );
+    const int y1 = qMin( int( ceilf( maxY ) ), m_height );
+    if ( x0 >= x1 || y0 >= y1 )
+        return false;
+
+    for ( int y = y0; y < y1; ++y )
+        for ( int x = x0; x < x1; ++x )
+        {
+            if ( m_depth.at( y * m_width + x ) >= nearest )
+                return false;
+        }
+    return true;
+}
+
+//------------------------------------------------------------------------------
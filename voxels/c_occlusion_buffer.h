@@ -0,0 +1,55 @@
+#ifndef C_OCCLUSION_BUFFER_H
+#define C_OCCLUSION_BUFFER_H
+
+#include <QMatrix4x4>
+#include <QVector>
+#include <QVector3D>
+
+/**
+  A box known to be opaque, by its corners in world space. Corner c is at
+  ( c & 1, ( c >> 1 ) & 1, c >> 2 ) in the box's own frame.
+  */
+class COccluder
+{
+public:
+    COccluder() : error( 0.0f ) {}
+
+    QVector3D corners[8];
+
+    // Screen-space error of the node, larger for nearer and bigger boxes
+    float error;
+};
+
+/**
+  Coarse software depth buffer of view distances. Occluders are written
+  only into pixels they cover completely, at their farthest distance, so
+  a box is only reported hidden when it is hidden for certain.
+  */
+class COcclusionBuffer
+{
+public:
+    COcclusionBuffer();
+
+    void resize( int width, int height );
+    void clear();
+
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+
+    void rasterize( const QMatrix4x4& viewProjection, const COccluder& occluder );
+
+    // Whether the box lo..hi, mapped by clipFromLocal, lies behind the
+    // occluders in every pixel it touches
+    bool isOccluded( const QMatrix4x4& clipFromLocal, const QVector3D& lo, const QVector3D& hi ) const;
+
+    // Nothing rasterized since the last clear()
+    bool isEmpty() const { return m_empty; }
+
+private:
+    QVector<float> m_depth;
+    int m_width;
+    int m_height;
+    bool m_empty;
+};
+
+#endif // C_OCCLUSION_BUFFER_H
@@ -0,0 +1,118 @@
+#include "c_occupancy.h"
+
+#include <math.h>
+
+namespace
+{
+    Q_STATIC_ASSERT( Occupancy::voxelsPerCell * Occupancy::cellsPerAxis == VoxelConfig::brickEdge );
+    Q_STATIC_ASSERT( Occupancy::cellsPerChild * VoxelConfig::Layout::branching == Occupancy::cellsPerAxis );
+
+    // The cells of each child, worked out once
+    class CChildCells
+    {
+    public:
+        CChildCells()
+        {
+            for ( int c = 0; c < VoxelConfig::Layout::childCount; ++c )
+                cells[c] = 0;
+
+            const int n = Occupancy::cellsPerChild;
+            for ( int k = 0; k < Occupancy::cellsPerAxis; ++k )
+                for ( int j = 0; j < Occupancy::cellsPerAxis; ++j )
+                    for ( int i = 0; i < Occupancy::cellsPerAxis; ++i )
+                        cells[VoxelConfig::Layout::childIndex( i / n, j / n, k / n )] |= quint64( 1 ) << Occupancy::cellBit( i, j, k );
+        }
+
+        quint64 cells[VoxelConfig::Layout::childCount];
+    };
+
+    const CChildCells childCellTable;
+}
+
+//------------------------------------------------------------------------------
+quint64
+Occupancy::build( const CBrick& brick )
+{
+    if ( brick.constant || brick.voxels.isEmpty() )
+        return brick.value > 0 ? ~quint64( 0 ) : 0;
+
+    // A filtered sample inside a cell reads the voxels of the cell and the
+    // ones next to it, which the border provides at the edges of the brick
+    const int e = VoxelConfig::storedBrickEdge;
+    const quint8* density = brick.voxels.constData();
+    quint64 occupancy = 0;
+    for ( int k = 0; k < cellsPerAxis; ++k )
+    {
+        const int z0 = qMax( VoxelConfig::brickBorder + k * voxelsPerCell - 1, 0 );
+        const int z1 = qMin( VoxelConfig::brickBorder + ( k + 1 ) * voxelsPerCell, e - 1 );
+        for ( int j = 0; j < cellsPerAxis; ++j )
+        {
+            const int y0 = qMax( VoxelConfig::brickBorder + j * voxelsPerCell - 1, 0 );
+            const int y1 = qMin( VoxelConfig::brickBorder + ( j + 1 ) * voxelsPerCell, e - 1 );
+            for ( int i = 0; i < cellsPerAxis; ++i )
+            {
+                const int x0 = qMax( VoxelConfig::brickBorder + i * voxelsPerCell - 1, 0 );
+                const int x1 = qMin( VoxelConfig::brickBorder + ( i + 1 ) * voxelsPerCell, e - 1 );
+
+                // Any voxel will do, so OR whole rows together
+                quint8 any = 0;
+                for ( int z = z0; z <= z1 && !any; ++z )
+                    for ( int y = y0; y <= y1; ++y )
+                        for ( int x = x0; x <= x1; ++x )
+                            any |= density[CBrick::index( x, y, z )];
+                if ( any )
+                    occupancy |= quint64( 1 ) << cellBit( i, j, k );
+            }
+        }
+    }
+    return occupancy;
+}
+
+//------------------------------------------------------------------------------
+quint64
+Occupancy::childCells( int child )
+{
+    return childCellTable.cells[child];
+}
+
+//------------------------------------------------------------------------------
+quint32
+Occupancy::occupiedChildren( quint64 occupancy )
+{
+    quint32 children = 0;
+    for ( int c = 0; c < VoxelConfig::Layout::childCount; ++c )
+    {
+        if ( occupancy & childCellTable.cells[c] )
+            children |= 1u << c;
+    }
+    return children;
+}
+
+//------------------------------------------------------------------------------
+quint64
+Occupancy::overlappingCells( const CNodeKey& key, const QVector3D& lo, const QVector3D& hi )
+{
+    const QVector3D origin = key.origin();
+    const float cellSize = key.size() / cellsPerAxis;
+
+    int first[3];
+    int last[3];
+    for ( int axis = 0; axis < 3; ++axis )
+    {
+        first[axis] = int( floorf( ( lo[axis] - origin[axis] ) / cellSize ) );
+        last[axis] = int( floorf( ( hi[axis] - origin[axis] ) / cellSize ) );
+        if ( last[axis] < 0 || first[axis] >= cellsPerAxis )
+            return 0;
+        first[axis] = qMax( first[axis], 0 );
+        last[axis] = qMin( last[axis], cellsPerAxis - 1 );
+    }
+
+    quint64 cells = 0;
+    for ( int k = first[2]; k <= last[2]; ++k )
+        for ( int j = first[1]; j <= last[1]; ++j )
+            for ( int i = first[0]; i <= last[0]; ++i )
+                cells |= quint64( 1 ) << cellBit( i, j, k );
+    return cells;
+}
+
+//------------------------------------------------------------------------------
@@ -0,0 +1,45 @@
+#ifndef C_OCCUPANCY_H
+#define C_OCCUPANCY_H
+
+#include "c_brick.h"
+
+#include <QVector3D>
+
+/**
+  Which parts of a node hold any density, as one 64 bit word per node: the
+  node is split into 4x4x4 cells and bit ( k * 4 + j ) * 4 + i is set when
+  cell (i, j, k) does. Along the octree the words form a hierarchy, each
+  level resolving four times finer than the node above it.
+
+  A cell counts as occupied when a filtered sample anywhere inside it can
+  be above zero, so it includes the voxels one beyond the cell. Like a
+  constant empty node, an empty cell is taken to be empty in the whole
+  subtree below it. The traversal and the shader both skip such cells
+  without looking at the brick. sampleVolume() in gigavoxels.frag mirrors
+  the layout.
+  */
+namespace Occupancy
+{
+    const int cellsPerAxis = 4;
+    const int voxelsPerCell = VoxelConfig::brickEdge / cellsPerAxis;
+    const int cellsPerChild = cellsPerAxis / VoxelConfig::Layout::branching;
+
+    inline int cellBit( int i, int j, int k )
+    {
+        return ( k * cellsPerAxis + j ) * cellsPerAxis + i;
+    }
+
+    // Every cell that can hold density, from the voxels of the brick
+    quint64 build( const CBrick& brick );
+
+    // The cells a child of the node covers
+    quint64 childCells( int child );
+
+    // One bit per child whose cells are not all empty
+    quint32 occupiedChildren( quint64 occupancy );
+
+    // The cells of the node at key that overlap the box [lo, hi]
+    quint64 overlappingCells( const CNodeKey& key, const QVector3D& lo, const QVector3D& hi );
+}
+
+#endif // C_OCCUPANCY_H
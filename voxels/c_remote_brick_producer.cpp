@@ -0,0 +1,369 @@
+#include "c_remote_brick_producer.h"
+#include "c_brick_protocol.h"
+#include "c_stats.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QLocalSocket>
+#include <QMutex>
+#include <QSharedMemory>
+#include <QThread>
+#include <QWaitCondition>
+
+#include <string.h>
+
+//------------------------------------------------------------------------------
+class CRemoteRequest
+{
+public:
+    explicit CRemoteRequest( CBrick* b )
+        : brick( b ),
+          done( false ),
+          failed( false )
+    {
+    }
+
+    CBrick* brick;
+    bool done;
+    bool failed;
+};
+
+//------------------------------------------------------------------------------
+class CRemoteBrickConnection : public QThread
+{
+public:
+    enum State
+    {
+        Connecting,
+        Connected,
+        Failed
+    };
+
+    explicit CRemoteBrickConnection( const QString& name );
+    virtual ~CRemoteBrickConnection();
+
+    bool waitForConnected( int milliseconds );
+    bool isConnected() const;
+    int maxLevel() const { return m_maxLevel; }
+
+    // Blocks until the brick arrived; false once the server is gone
+    bool fetch( CBrick& brick );
+
+protected:
+    virtual void run();
+
+private:
+    bool handshake( QLocalSocket& socket, QByteArray& received );
+    bool deliver( const QByteArray& body );
+    void fail();
+
+    const QString m_name;
+    QSharedMemory m_ring;
+    quint32 m_slotCount;
+    quint32 m_slotBytes;
+    int m_maxLevel;
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_work;
+    QWaitCondition m_done;
+    QWaitCondition m_stateChanged;
+    State m_state;
+    bool m_stop;
+    quint32 m_nextId;
+
+    // Not sent yet, sent and waiting for the reply, and ring slots to give back
+    QVector<CRemoteRequest*> m_pending;
+    QHash<quint32, CRemoteRequest*> m_outstanding;
+    QVector<quint32> m_released;
+
+    CStatsCounter* m_batchStat;
+    CStatsHistogram* m_batchSizeStat;
+    CStatsCounter* m_brickStat;
+};
+
+//------------------------------------------------------------------------------
+CRemoteBrickConnection::CRemoteBrickConnection( const QString& name )
+    : m_name( name ),
+      m_slotCount( 0 ),
+      m_slotBytes( 0 ),
+      m_maxLevel( 0 ),
+      m_state( Connecting ),
+      m_stop( false ),
+      m_nextId( 0 ),
+      m_batchStat( CStats::instance().counter( "remote.batches" ) ),
+      m_batchSizeStat( CStats::instance().histogram( "remote.batchSize" ) ),
+      m_brickStat( CStats::instance().counter( "remote.bricks" ) )
+{
+}
+
+//------------------------------------------------------------------------------
+CRemoteBrickConnection::~CRemoteBrickConnection()
+{
+    {
+        QMutexLocker locker( &m_mutex );
+        m_stop = true;
+        m_work.wakeAll();
+    }
+    wait();
+}
+
+//------------------------------------------------------------------------------
+bool
+CRemoteBrickConnection::waitForConnected( int milliseconds )
+{
+    QElapsedTimer timer;
+    timer.start();
+    QMutexLocker locker( &m_mutex );
+    while ( m_state == Connecting && timer.elapsed() < milliseconds )
+        m_stateChanged.wait( &m_mutex, qMax( milliseconds - timer.elapsed(), qint64( 1 ) ) );
+    return m_state == Connected;
+}
+
+//------------------------------------------------------------------------------
+bool
+CRemoteBrickConnection::isConnected() const
+{
+    QMutexLocker locker( &m_mutex );
+    return m_state == Connected;
+}
+
+//------------------------------------------------------------------------------
+bool
+CRemoteBrickConnection::fetch( CBrick& brick )
+{
+    CRemoteRequest request( &brick );
+    QMutexLocker locker( &m_mutex );
+    if ( m_state != Connected )
+        return false;
+
+    m_pending.append( &request );
+    m_work.wakeOne();
+    while ( !request.done )
+        m_done.wait( &m_mutex );
+    return !request.failed;
+}
+
+//------------------------------------------------------------------------------
+void
+CRemoteBrickConnection::run()
+{
+    QLocalSocket socket;
+    QByteArray received;
+    socket.connectToServer( m_name );
+    if ( !socket.waitForConnected( 3000 ) || !handshake( socket, received ) )
+    {
+        qWarning() << "Could not connect to brick server" << m_name << socket.errorString();
+        fail();
+        return;
+    }
+
+    while ( true )
+    {
+        BrickProtocol::CRequest request;
+        bool waiting = false;
+        {
+            QMutexLocker locker( &m_mutex );
+            while ( !m_stop && m_pending.isEmpty() && m_released.isEmpty() && m_outstanding.isEmpty() )
+                m_work.wait( &m_mutex );
+            if ( m_stop )
+                break;
+
+            // Everything asked for since the last round goes out together
+            request.released.swap( m_released );
+            for ( int i = 0; i < m_pending.size(); ++i )
+            {
+                const quint32 id = m_nextId++;
+                request.ids.append( id );
+                request.keys.append( m_pending.at( i )->brick->key );
+                m_outstanding.insert( id, m_pending.at( i ) );
+            }
+            m_pending.clear();
+            waiting = !m_outstanding.isEmpty();
+        }
+
+        if ( !request.keys.isEmpty() || !request.released.isEmpty() )
+        {
+            if ( !BrickProtocol::write( &socket, BrickProtocol::encode( request ) ) )
+                break;
+            socket.flush();
+            if ( !request.keys.isEmpty() )
+            {
+                m_batchStat->add();
+                m_batchSizeStat->record( request.keys.size() );
+            }
+        }
+
+        // Short waits, so requests made in the meantime are not held back
+        if ( waiting && ( socket.bytesAvailable() > 0 || socket.waitForReadyRead( 1 ) ) )
+            received += socket.readAll();
+
+        QByteArray body;
+        bool ok = true;
+        while ( ok && BrickProtocol::take( received, &body ) )
+            ok = deliver( body );
+        if ( !ok || socket.state() != QLocalSocket::ConnectedState )
+        {
+            qWarning() << "Lost the brick server" << m_name;
+            break;
+        }
+    }
+    fail();
+}
+
+//------------------------------------------------------------------------------
+bool
+CRemoteBrickConnection::handshake( QLocalSocket& socket, QByteArray& received )
+{
+    QByteArray body;
+    while ( !BrickProtocol::take( received, &body ) )
+    {
+        if ( !socket.waitForReadyRead( 3000 ) )
+            return false;
+        received += socket.readAll();
+    }
+
+    BrickProtocol::CHello hello;
+    const quint32 brickBytes = VoxelConfig::storedBrickVoxels * sizeof( CBrick::Voxel );
+    if ( !BrickProtocol::decode( body, &hello ) || hello.slotBytes < brickBytes || hello.slotCount == 0 )
+        return false;
+
+    m_ring.setKey( hello.ringKey );
+    if ( !m_ring.attach( QSharedMemory::ReadOnly )
+      || quint64( m_ring.size() ) < quint64( hello.slotCount ) * hello.slotBytes )
+    {
+        qWarning() << "Could not map the brick ring" << hello.ringKey << m_ring.errorString();
+        return false;
+    }
+
+    QMutexLocker locker( &m_mutex );
+    m_slotCount = hello.slotCount;
+    m_slotBytes = hello.slotBytes;
+    m_maxLevel = int( hello.maxLevel );
+    m_state = Connected;
+    m_stateChanged.wakeAll();
+    return true;
+}
+
+//------------------------------------------------------------------------------
+bool
+CRemoteBrickConnection::deliver( const QByteArray& body )
+{
+    QVector<BrickProtocol::CReply> replies;
+    if ( !BrickProtocol::decode( body, &replies ) )
+        return false;
+
+    const char* ring = static_cast<const char*>( m_ring.constData() );
+    QMutexLocker locker( &m_mutex );
+    for ( int i = 0; i < replies.size(); ++i )
+    {
+        const BrickProtocol::CReply& reply = replies.at( i );
+        const bool validSlot = reply.slot >= 0 && quint32( reply.slot ) < m_slotCount;
+        CRemoteRequest* request = m_outstanding.take( reply.id );
+        if ( !request )
+        {
+            if ( validSlot )
+                m_released.append( quint32( reply.slot ) );
+            continue;
+        }
+
+        // The one copy of the payload, into the brick the pool uploads from
+        CBrick& brick = *request->brick;
+        brick.constant = reply.constant;
+        brick.value = reply.value;
+        if ( reply.constant )
+        {
+            brick.voxels.clear();
+        }
+        else if ( validSlot )
+        {
+            brick.voxels.resize( VoxelConfig::storedBrickVoxels );
+            memcpy( brick.voxels.data(), ring + qint64( reply.slot ) * m_slotBytes,
+                    brick.voxels.size() * sizeof( CBrick::Voxel ) );
+        }
+        else
+        {
+            request->failed = true;
+        }
+
+        if ( validSlot )
+            m_released.append( quint32( reply.slot ) );
+        request->done = true;
+    }
+    m_brickStat->add( replies.size() );
+    m_done.wakeAll();
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void
+CRemoteBrickConnection::fail()
+{
+    QMutexLocker locker( &m_mutex );
+    m_state = Failed;
+    for ( int i = 0; i < m_pending.size(); ++i )
+        m_pending.at( i )->done = m_pending.at( i )->failed = true;
+    QHash<quint32, CRemoteRequest*>::const_iterator it = m_outstanding.constBegin();
+    for ( ; it != m_outstanding.constEnd(); ++it )
+        it.value()->done = it.value()->failed = true;
+    m_pending.clear();
+    m_outstanding.clear();
+    m_done.wakeAll();
+    m_stateChanged.wakeAll();
+}
+
+//------------------------------------------------------------------------------
+CRemoteBrickProducer::CRemoteBrickProducer( const CBrickProducer* fallback )
+    : m_connection(),
+      m_fallback( fallback )
+{
+}
+
+//------------------------------------------------------------------------------
+CRemoteBrickProducer::~CRemoteBrickProducer()
+{
+}
+
+//------------------------------------------------------------------------------
+bool
+CRemoteBrickProducer::connectToServer( const QString& name, int milliseconds )
+{
+    m_connection.reset( new CRemoteBrickConnection( name ) );
+    m_connection->start();
+    return m_connection->waitForConnected( milliseconds );
+}
+
+//------------------------------------------------------------------------------
+bool
+CRemoteBrickProducer::isConnected() const
+{
+    return m_connection && m_connection->isConnected();
+}
+
+//------------------------------------------------------------------------------
+void
+CRemoteBrickProducer::produce( CBrick& brick ) const
+{
+    if ( m_connection && m_connection->fetch( brick ) )
+        return;
+
+    if ( m_fallback )
+    {
+        m_fallback->produce( brick );
+        return;
+    }
+    brick.constant = true;
+    brick.value = 0;
+    brick.voxels.clear();
+}
+
+//------------------------------------------------------------------------------
+int
+CRemoteBrickProducer::maxLevel() const
+{
+    if ( isConnected() )
+        return m_connection->maxLevel();
+    return m_fallback ? m_fallback->maxLevel() : CBrickProducer::maxLevel();
+}
+
+//------------------------------------------------------------------------------
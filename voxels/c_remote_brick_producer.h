@@ -0,0 +1,40 @@
+#ifndef C_REMOTE_BRICK_PRODUCER_H
+#define C_REMOTE_BRICK_PRODUCER_H
+
+#include "c_brick_producer.h"
+
+#include <QScopedPointer>
+#include <QString>
+
+class CRemoteBrickConnection;
+
+/**
+  Fetches bricks from a brick server in another process, see
+  c_brick_protocol.h. Worker threads block in produce() while one I/O
+  thread sends whatever they asked for since the last round trip as a
+  single batch, so the number of messages does not grow with the number
+  of workers. The payloads are copied straight out of the shared ring
+  into the brick that is later uploaded.
+
+  When the server goes away, bricks come from the fallback producer, or
+  are empty if there is none.
+  */
+class CRemoteBrickProducer : public CBrickProducer
+{
+public:
+    explicit CRemoteBrickProducer( const CBrickProducer* fallback = 0 );
+    virtual ~CRemoteBrickProducer();
+
+    // Blocks until the server answered or the timeout passed
+    bool connectToServer( const QString& name, int milliseconds = 3000 );
+    bool isConnected() const;
+
+    virtual void produce( CBrick& brick ) const;
+    virtual int maxLevel() const;
+
+private:
+    QScopedPointer<CRemoteBrickConnection> m_connection;
+    const CBrickProducer* m_fallback;
+};
+
+#endif // C_REMOTE_BRICK_PRODUCER_H
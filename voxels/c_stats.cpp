@@ -0,0 +1,249 @@
+#include "c_stats.h"
+
+#include <QDateTime>
+#include <QJsonDocument>
+#include <QMutexLocker>
+#include <QtAlgorithms>
+#include <QSaveFile>
+
+#include <math.h>
+#include <string.h>
+
+//------------------------------------------------------------------------------
+void
+CStatsGauge::set( double value )
+{
+    quint64 bits;
+    memcpy( &bits, &value, sizeof( bits ) );
+    m_bits.store( bits );
+}
+
+//------------------------------------------------------------------------------
+double
+CStatsGauge::value() const
+{
+    const quint64 bits = m_bits.load();
+    double value;
+    memcpy( &value, &bits, sizeof( value ) );
+    return value;
+}
+
+//------------------------------------------------------------------------------
+CStatsHistogram::CStatsHistogram()
+    : m_count( 0 ),
+      m_sum( 0 ),
+      m_max( 0 )
+{
+    for ( int i = 0; i < bucketCount; ++i )
+        m_buckets[i].store( 0 );
+}
+
+//------------------------------------------------------------------------------
+void
+CStatsHistogram::record( double value )
+{
+    value = qMax( value, 0.0 );
+    m_buckets[bucket( value )].fetchAndAddRelaxed( 1 );
+    m_count.fetchAndAddRelaxed( 1 );
+
+    const qint64 fixed = qint64( value * 1024.0 + 0.5 );
+    m_sum.fetchAndAddRelaxed( fixed );
+    qint64 current = m_max.load();
+    while ( fixed > current && !m_max.testAndSetRelaxed( current, fixed ) )
+        current = m_max.load();
+}
+
+//------------------------------------------------------------------------------
+double
+CStatsHistogram::mean() const
+{
+    const qint64 n = count();
+    return n > 0 ? m_sum.load() / 1024.0 / n : 0.0;
+}
+
+//------------------------------------------------------------------------------
+double
+CStatsHistogram::max() const
+{
+    return m_max.load() / 1024.0;
+}
+
+//------------------------------------------------------------------------------
+double
+CStatsHistogram::quantile( double q ) const
+{
+    // Buckets keep counting while we read, so the total is recounted
+    qint64 counts[bucketCount];
+    qint64 total = 0;
+    for ( int i = 0; i < bucketCount; ++i )
+    {
+        counts[i] = m_buckets[i].load();
+        total += counts[i];
+    }
+    if ( total == 0 )
+        return 0.0;
+
+    const qint64 rank = qint64( ceil( qBound( 0.0, q, 1.0 ) * total ) );
+    qint64 seen = 0;
+    for ( int i = 0; i < bucketCount; ++i )
+    {
+        seen += counts[i];
+        if ( seen >= qMax( rank, qint64( 1 ) ) )
+            return qMin( bucketValue( i ), max() );
+    }
+    return max();
+}
+
+//------------------------------------------------------------------------------
+int
+CStatsHistogram::bucket( double value )
+{
+    if ( value <= 0.0 )
+        return 0;
+    const int i = int( floor( 4.0 * log2( value ) ) ) + bucketCount / 2;
+    return qBound( 0, i, bucketCount - 1 );
+}
+
+//------------------------------------------------------------------------------
+double
+CStatsHistogram::bucketValue( int bucket )
+{
+    // Geometric middle of the bucket
+    return pow( 2.0, ( bucket - bucketCount / 2 + 0.5 ) / 4.0 );
+}
+
+//------------------------------------------------------------------------------
+CStats&
+CStats::instance()
+{
+    static CStats stats;
+    return stats;
+}
+
+//------------------------------------------------------------------------------
+CStats::CStats()
+{
+    m_uptime.start();
+}
+
+//------------------------------------------------------------------------------
+CStats::~CStats()
+{
+    qDeleteAll( m_counters );
+    qDeleteAll( m_gauges );
+    qDeleteAll( m_histograms );
+}
+
+//------------------------------------------------------------------------------
+CStatsCounter*
+CStats::counter( const QString& name )
+{
+    QMutexLocker locker( &m_mutex );
+    CStatsCounter*& counter = m_counters[name];
+    if ( !counter )
+        counter = new CStatsCounter;
+    return counter;
+}
+
+//------------------------------------------------------------------------------
+CStatsGauge*
+CStats::gauge( const QString& name )
+{
+    QMutexLocker locker( &m_mutex );
+    CStatsGauge*& gauge = m_gauges[name];
+    if ( !gauge )
+        gauge = new CStatsGauge;
+    return gauge;
+}
+
+//------------------------------------------------------------------------------
+CStatsHistogram*
+CStats::histogram( const QString& name )
+{
+    QMutexLocker locker( &m_mutex );
+    CStatsHistogram*& histogram = m_histograms[name];
+    if ( !histogram )
+        histogram = new CStatsHistogram;
+    return histogram;
+}
+
+//------------------------------------------------------------------------------
+QJsonObject
+CStats::toJson() const
+{
+    QMutexLocker locker( &m_mutex );
+
+    QJsonObject counters;
+    QMap<QString, CStatsCounter*>::const_iterator c = m_counters.constBegin();
+    for ( ; c != m_counters.constEnd(); ++c )
+        counters.insert( c.key(), double( c.value()->value() ) );
+
+    QJsonObject gauges;
+    QMap<QString, CStatsGauge*>::const_iterator g = m_gauges.constBegin();
+    for ( ; g != m_gauges.constEnd(); ++g )
+        gauges.insert( g.key(), g.value()->value() );
+
+    QJsonObject histograms;
+    QMap<QString, CStatsHistogram*>::const_iterator h = m_histograms.constBegin();
+    for ( ; h != m_histograms.constEnd(); ++h )
+    {
+        const CStatsHistogram* histogram = h.value();
+        QJsonObject object;
+        object.insert( "count", double( histogram->count() ) );
+        object.insert( "mean", histogram->mean() );
+        object.insert( "p50", histogram->quantile( 0.5 ) );
+        object.insert( "p90", histogram->quantile( 0.9 ) );
+        object.insert( "p99", histogram->quantile( 0.99 ) );
+        object.insert( "max", histogram->max() );
+        histograms.insert( h.key(), object );
+    }
+
+    QJsonObject root;
+    root.insert( "timestamp", QDateTime::currentDateTimeUtc().toString( Qt::ISODate ) );
+    root.insert( "uptimeSeconds", m_uptime.elapsed() / 1000.0 );
+    root.insert( "counters", counters );
+    root.insert( "gauges", gauges );
+    root.insert( "histograms", histograms );
+    return root;
+}
+
+//------------------------------------------------------------------------------
+bool
+CStats::writeJson( const QString& fileName ) const
+{
+    QSaveFile file( fileName );
+    if ( !file.open( QIODevice::WriteOnly ) )
+        return false;
+
+    file.write( QJsonDocument( toJson() ).toJson() );
+    return file.commit();
+}
+
+//------------------------------------------------------------------------------
+QStringList
+CStats::summary() const
+{
+    QMutexLocker locker( &m_mutex );
+
+    QStringList lines;
+    QMap<QString, CStatsHistogram*>::const_iterator h = m_histograms.constBegin();
+    for ( ; h != m_histograms.constEnd(); ++h )
+    {
+        lines << QString( "%1  p50 %2  p99 %3  max %4" )
+                 .arg( h.key(), -28 )
+                 .arg( h.value()->quantile( 0.5 ), 0, 'f', 2 )
+                 .arg( h.value()->quantile( 0.99 ), 0, 'f', 2 )
+                 .arg( h.value()->max(), 0, 'f', 2 );
+    }
+
+    QMap<QString, CStatsGauge*>::const_iterator g = m_gauges.constBegin();
+    for ( ; g != m_gauges.constEnd(); ++g )
+        lines << QString( "%1  %2" ).arg( g.key(), -28 ).arg( g.value()->value(), 0, 'g', 6 );
+
+    QMap<QString, CStatsCounter*>::const_iterator c = m_counters.constBegin();
+    for ( ; c != m_counters.constEnd(); ++c )
+        lines << QString( "%1  %2" ).arg( c.key(), -28 ).arg( c.value()->value() );
+    return lines;
+}
+
+//------------------------------------------------------------------------------
@@ -0,0 +1,111 @@
+#ifndef C_STATS_H
+#define C_STATS_H
+
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QMap>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+
+/**
+  Monotonic event count, such as bricks produced or bytes uploaded.
+  */
+class CStatsCounter
+{
+public:
+    CStatsCounter() : m_value( 0 ) {}
+
+    void add( qint64 n = 1 ) { m_value.fetchAndAddRelaxed( n ); }
+    qint64 value() const { return m_value.load(); }
+
+private:
+    QAtomicInteger<qint64> m_value;
+};
+
+/**
+  Last value of a quantity that goes up and down, such as a queue depth.
+  */
+class CStatsGauge
+{
+public:
+    CStatsGauge() : m_bits( 0 ) {}
+
+    void set( double value );
+    double value() const;
+
+private:
+    QAtomicInteger<quint64> m_bits;
+};
+
+/**
+  Distribution of a positive quantity in buckets a quarter octave wide,
+  between 2^-16 and 2^16. Recording is a few relaxed atomic adds, so it is
+  cheap enough for every frame and every brick; quantiles are accurate to
+  the bucket width.
+  */
+class CStatsHistogram
+{
+public:
+    enum { bucketCount = 128 };
+
+    CStatsHistogram();
+
+    void record( double value );
+
+    qint64 count() const { return m_count.load(); }
+    double mean() const;
+    double max() const;
+    double quantile( double q ) const;
+
+private:
+    static int bucket( double value );
+    static double bucketValue( int bucket );
+
+    QAtomicInteger<qint64> m_buckets[bucketCount];
+    QAtomicInteger<qint64> m_count;
+
+    // In units of 2^-10, so values well below one still add up
+    QAtomicInteger<qint64> m_sum;
+    QAtomicInteger<qint64> m_max;
+};
+
+/**
+  Process wide registry the subsystems publish their statistics to. Names
+  are dotted paths like "pool.uploadedBytes". Looking a statistic up takes
+  a lock and should be done once; the returned object lives as long as the
+  registry and is updated without locking from any thread.
+  */
+class CStats
+{
+public:
+    static CStats& instance();
+
+    ~CStats();
+
+    CStatsCounter* counter( const QString& name );
+    CStatsGauge* gauge( const QString& name );
+    CStatsHistogram* histogram( const QString& name );
+
+    // Snapshot of every statistic, for monitoring
+    QJsonObject toJson() const;
+
+    // Replaces fileName atomically, so a scraper never reads half a file
+    bool writeJson( const QString& fileName ) const;
+
+    // One line per statistic, for the overlay
+    QStringList summary() const;
+
+private:
+    CStats();
+    Q_DISABLE_COPY( CStats )
+
+    mutable QMutex m_mutex;
+    QMap<QString, CStatsCounter*> m_counters;
+    QMap<QString, CStatsGauge*> m_gauges;
+    QMap<QString, CStatsHistogram*> m_histograms;
+    QElapsedTimer m_uptime;
+};
+
+#endif // C_STATS_H
@@ -0,0 +1,313 @@
+#include "c_transfer_function.h"
+#include "c_stats.h"
+
+#include <QElapsedTimer>
+
+#include <math.h>
+
+#if defined( __SSE2__ )
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    const int n = CTransferFunction::tableSize;
+
+    // Opacities of one are clamped, they would need an infinite extinction
+    const float maxOpacity = 0.999f;
+
+#if defined( __SSE2__ )
+    // 2^x for x in [-126, 0], to within a few ulps of float
+    inline __m128 exp2Negative( __m128 x )
+    {
+        x = _mm_max_ps( x, _mm_set1_ps( -126.0f ) );
+
+        // Split into an integer and a fraction in [0, 1)
+        __m128i i = _mm_cvttps_epi32( x );
+        __m128 fi = _mm_cvtepi32_ps( i );
+        const __m128 above = _mm_cmpgt_ps( fi, x );
+        fi = _mm_sub_ps( fi, _mm_and_ps( above, _mm_set1_ps( 1.0f ) ) );
+        i = _mm_cvttps_epi32( fi );
+        const __m128 f = _mm_sub_ps( x, fi );
+
+        __m128 p = _mm_set1_ps( 1.3333558e-3f );
+        p = _mm_add_ps( _mm_mul_ps( p, f ), _mm_set1_ps( 9.6181291e-3f ) );
+        p = _mm_add_ps( _mm_mul_ps( p, f ), _mm_set1_ps( 5.5504109e-2f ) );
+        p = _mm_add_ps( _mm_mul_ps( p, f ), _mm_set1_ps( 2.4022651e-1f ) );
+        p = _mm_add_ps( _mm_mul_ps( p, f ), _mm_set1_ps( 6.9314718e-1f ) );
+        p = _mm_add_ps( _mm_mul_ps( p, f ), _mm_set1_ps( 1.0f ) );
+
+        const __m128i exponent = _mm_slli_epi32( _mm_add_epi32( i, _mm_set1_epi32( 127 ) ), 23 );
+        return _mm_mul_ps( p, _mm_castsi128_ps( exponent ) );
+    }
+#endif
+}
+
+//------------------------------------------------------------------------------
+CTransferFunction::CTransferFunction()
+    : m_segmentLength( 1.0f ),
+      m_extinction( n ),
+      m_color( 3 * n ),
+      m_integral( 4 * n ),
+      m_dirtyLo( 0 ),
+      m_dirtyHi( n - 1 ),
+      m_table( 4 * n * n ),
+      m_revision( 0 ),
+      m_rebuiltStat( CStats::instance().counter( "transfer.rebuiltEntries" ) ),
+      m_rebuildTimeStat( CStats::instance().histogram( "transfer.rebuildMicroseconds" ) )
+{
+    m_points.append( CTransferPoint( 0.0f, QVector3D( 0.0f, 0.0f, 0.0f ), 0.0f ) );
+    m_points.append( CTransferPoint( 0.1f, QVector3D( 0.6f, 0.55f, 0.5f ), 0.0f ) );
+    m_points.append( CTransferPoint( 1.0f, QVector3D( 1.0f, 1.0f, 1.0f ), 1.0f ) );
+}
+
+//------------------------------------------------------------------------------
+void
+CTransferFunction::setPoint( int i, const CTransferPoint& point )
+{
+    const int last = m_points.size() - 1;
+    const float lo = i > 0 ? m_points.at( i - 1 ).value : 0.0f;
+    const float hi = i < last ? m_points.at( i + 1 ).value : 1.0f;
+
+    CTransferPoint& p = m_points[i];
+    p = point;
+    p.value = i == 0 ? 0.0f : ( i == last ? 1.0f : qBound( lo, point.value, hi ) );
+    p.opacity = qBound( 0.0f, point.opacity, 1.0f );
+    invalidate( lo, hi );
+}
+
+//------------------------------------------------------------------------------
+int
+CTransferFunction::insertPoint( const CTransferPoint& point )
+{
+    const float value = qBound( 0.0f, point.value, 1.0f );
+    int i = 1;
+    while ( i < m_points.size() - 1 && m_points.at( i ).value < value )
+        ++i;
+
+    m_points.insert( i, point );
+    m_points[i].value = value;
+    m_points[i].opacity = qBound( 0.0f, point.opacity, 1.0f );
+    invalidate( m_points.at( i - 1 ).value, m_points.at( i + 1 ).value );
+    return i;
+}
+
+//------------------------------------------------------------------------------
+void
+CTransferFunction::removePoint( int i )
+{
+    if ( i <= 0 || i >= m_points.size() - 1 )
+        return;
+
+    invalidate( m_points.at( i - 1 ).value, m_points.at( i + 1 ).value );
+    m_points.remove( i );
+}
+
+//------------------------------------------------------------------------------
+void
+CTransferFunction::setSegmentLength( float voxels )
+{
+    m_segmentLength = qMax( voxels, 1.0e-3f );
+    invalidate( 0.0f, 1.0f );
+}
+
+//------------------------------------------------------------------------------
+QVector3D
+CTransferFunction::color( float value ) const
+{
+    int i = 1;
+    while ( i < m_points.size() - 1 && m_points.at( i ).value < value )
+        ++i;
+
+    const CTransferPoint& a = m_points.at( i - 1 );
+    const CTransferPoint& b = m_points.at( i );
+    const float f = b.value > a.value ? qBound( 0.0f, ( value - a.value ) / ( b.value - a.value ), 1.0f ) : 1.0f;
+    return a.color + ( b.color - a.color ) * f;
+}
+
+//------------------------------------------------------------------------------
+float
+CTransferFunction::opacity( float value ) const
+{
+    int i = 1;
+    while ( i < m_points.size() - 1 && m_points.at( i ).value < value )
+        ++i;
+
+    const CTransferPoint& a = m_points.at( i - 1 );
+    const CTransferPoint& b = m_points.at( i );
+    const float f = b.value > a.value ? qBound( 0.0f, ( value - a.value ) / ( b.value - a.value ), 1.0f ) : 1.0f;
+    return a.opacity + ( b.opacity - a.opacity ) * f;
+}
+
+//------------------------------------------------------------------------------
+QBitArray
+CTransferFunction::visibleValues() const
+{
+    // The table only sees the opacity at its own values, so this is
+    // exactly where it is not transparent
+    QBitArray values( n );
+    for ( int i = 0; i < n; ++i )
+        values.setBit( i, opacity( float( i ) / ( n - 1 ) ) > 0.0f );
+    return values;
+}
+
+//------------------------------------------------------------------------------
+QBitArray
+CTransferFunction::opaqueValues() const
+{
+    QBitArray values( n );
+    for ( int i = 0; i < n; ++i )
+        values.setBit( i, opacity( float( i ) / ( n - 1 ) ) >= 1.0f );
+    return values;
+}
+
+//------------------------------------------------------------------------------
+QVector<QRect>
+CTransferFunction::update()
+{
+    QVector<QRect> rects;
+    if ( !isDirty() )
+        return rects;
+
+    QElapsedTimer timer;
+    timer.start();
+    integrate();
+
+    // Entries change where [min(front, back), max(front, back)] overlaps
+    // the dirty values: rows before them from the first dirty column on,
+    // their own rows completely, the rows after them up to the last one
+    const int lo = m_dirtyLo;
+    const int hi = m_dirtyHi;
+    if ( lo > 0 )
+        rects.append( QRect( lo, 0, n - lo, lo ) );
+    rects.append( QRect( 0, lo, n, hi - lo + 1 ) );
+    if ( hi < n - 1 )
+        rects.append( QRect( 0, hi + 1, hi + 1, n - 1 - hi ) );
+
+    qint64 entries = 0;
+    for ( int r = 0; r < rects.size(); ++r )
+    {
+        const QRect& rect = rects.at( r );
+        for ( int front = rect.top(); front <= rect.bottom(); ++front )
+            buildRow( front, rect.left(), rect.right() );
+        entries += qint64( rect.width() ) * rect.height();
+    }
+
+    m_dirtyLo = n;
+    m_dirtyHi = -1;
+    m_rebuiltStat->add( entries );
+    m_rebuildTimeStat->record( timer.nsecsElapsed() / 1.0e3 );
+    return rects;
+}
+
+//------------------------------------------------------------------------------
+void
+CTransferFunction::invalidate( float lo, float hi )
+{
+    m_dirtyLo = qMin( m_dirtyLo, qBound( 0, int( floorf( lo * ( n - 1 ) ) ), n - 1 ) );
+    m_dirtyHi = qMax( m_dirtyHi, qBound( 0, int( ceilf( hi * ( n - 1 ) ) ), n - 1 ) );
+    ++m_revision;
+}
+
+//------------------------------------------------------------------------------
+void
+CTransferFunction::integrate()
+{
+    for ( int i = 0; i < n; ++i )
+    {
+        const float value = float( i ) / ( n - 1 );
+        const QVector3D c = color( value );
+        m_extinction[i] = -logf( 1.0f - qMin( opacity( value ), maxOpacity ) );
+        m_color[3 * i + 0] = c.x();
+        m_color[3 * i + 1] = c.y();
+        m_color[3 * i + 2] = c.z();
+    }
+
+    // Trapezoids of extinction and of extinction weighted colour, one
+    // channel after the other so that rows can load four columns at once
+    float* extinction = m_integral.data();
+    float* red = extinction + n;
+    float* green = red + n;
+    float* blue = green + n;
+    extinction[0] = red[0] = green[0] = blue[0] = 0.0f;
+    for ( int i = 1; i < n; ++i )
+    {
+        const float a = m_extinction.at( i - 1 );
+        const float b = m_extinction.at( i );
+        extinction[i] = extinction[i - 1] + 0.5f * ( a + b );
+        red[i] = red[i - 1] + 0.5f * ( a * m_color.at( 3 * i - 3 ) + b * m_color.at( 3 * i ) );
+        green[i] = green[i - 1] + 0.5f * ( a * m_color.at( 3 * i - 2 ) + b * m_color.at( 3 * i + 1 ) );
+        blue[i] = blue[i - 1] + 0.5f * ( a * m_color.at( 3 * i - 1 ) + b * m_color.at( 3 * i + 2 ) );
+    }
+}
+
+//------------------------------------------------------------------------------
+void
+CTransferFunction::buildRow( int front, int first, int last )
+{
+    // The segment averages the extinction over the scalars it passes;
+    // its colour is the extinction weighted mean of theirs
+    const float* extinction = m_integral.constData();
+    const float* red = extinction + n;
+    const float* green = red + n;
+    const float* blue = green + n;
+    float* row = m_table.data() + 4 * n * front;
+
+    int back = first;
+#if defined( __SSE2__ )
+    const __m128 signMask = _mm_set1_ps( -0.0f );
+    const __m128 one = _mm_set1_ps( 1.0f );
+    const __m128 scale = _mm_set1_ps( -m_segmentLength * 1.44269504f );
+    const __m128 frontValue = _mm_set1_ps( float( front ) );
+    const __m128 frontExtinction = _mm_set1_ps( extinction[front] );
+    const __m128 frontRed = _mm_set1_ps( red[front] );
+    const __m128 frontGreen = _mm_set1_ps( green[front] );
+    const __m128 frontBlue = _mm_set1_ps( blue[front] );
+    for ( ; back + 3 <= last; back += 4 )
+    {
+        const __m128 backValue = _mm_add_ps( _mm_set1_ps( float( back ) ), _mm_set_ps( 3.0f, 2.0f, 1.0f, 0.0f ) );
+        const __m128 span = _mm_max_ps( _mm_andnot_ps( signMask, _mm_sub_ps( backValue, frontValue ) ), one );
+        const __m128 tau = _mm_andnot_ps( signMask, _mm_sub_ps( _mm_loadu_ps( extinction + back ), frontExtinction ) );
+        __m128 r = _mm_andnot_ps( signMask, _mm_sub_ps( _mm_loadu_ps( red + back ), frontRed ) );
+        __m128 g = _mm_andnot_ps( signMask, _mm_sub_ps( _mm_loadu_ps( green + back ), frontGreen ) );
+        __m128 b = _mm_andnot_ps( signMask, _mm_sub_ps( _mm_loadu_ps( blue + back ), frontBlue ) );
+
+        __m128 a = _mm_sub_ps( one, exp2Negative( _mm_mul_ps( scale, _mm_div_ps( tau, span ) ) ) );
+        const __m128 weight = _mm_and_ps( _mm_cmpgt_ps( tau, _mm_setzero_ps() ),
+                                          _mm_div_ps( a, _mm_max_ps( tau, _mm_set1_ps( 1.0e-30f ) ) ) );
+        r = _mm_mul_ps( r, weight );
+        g = _mm_mul_ps( g, weight );
+        b = _mm_mul_ps( b, weight );
+
+        // Four columns of each channel into four RGBA entries
+        _MM_TRANSPOSE4_PS( r, g, b, a );
+        _mm_storeu_ps( row + 4 * back, r );
+        _mm_storeu_ps( row + 4 * back + 4, g );
+        _mm_storeu_ps( row + 4 * back + 8, b );
+        _mm_storeu_ps( row + 4 * back + 12, a );
+    }
+#endif
+    for ( ; back <= last; ++back )
+    {
+        const float span = qMax( float( qAbs( back - front ) ), 1.0f );
+        const float tau = qAbs( extinction[back] - extinction[front] );
+        const float a = 1.0f - expf( -m_segmentLength * tau / span );
+        const float weight = tau > 0.0f ? a / tau : 0.0f;
+        row[4 * back + 0] = qAbs( red[back] - red[front] ) * weight;
+        row[4 * back + 1] = qAbs( green[back] - green[front] ) * weight;
+        row[4 * back + 2] = qAbs( blue[back] - blue[front] ) * weight;
+        row[4 * back + 3] = a;
+    }
+
+    // A segment of constant scalar has nothing to integrate over
+    if ( front >= first && front <= last )
+    {
+        const float a = 1.0f - expf( -m_segmentLength * m_extinction.at( front ) );
+        row[4 * front + 0] = m_color.at( 3 * front + 0 ) * a;
+        row[4 * front + 1] = m_color.at( 3 * front + 1 ) * a;
+        row[4 * front + 2] = m_color.at( 3 * front + 2 ) * a;
+        row[4 * front + 3] = a;
+    }
+}
+
+//------------------------------------------------------------------------------
@@ -0,0 +1,122 @@
+#ifndef C_TRANSFER_FUNCTION_H
+#define C_TRANSFER_FUNCTION_H
+
+#include <QBitArray>
+#include <QRect>
+#include <QVector>
+#include <QVector3D>
+
+class CStatsCounter;
+class CStatsHistogram;
+
+/**
+  A control point of a transfer function. opacity is what one voxel of
+  material with this value lets through, colour is not premultiplied.
+  */
+class CTransferPoint
+{
+public:
+    CTransferPoint()
+        : value( 0.0f ),
+          opacity( 0.0f )
+    {
+    }
+
+    CTransferPoint( float v, const QVector3D& c, float o )
+        : value( v ),
+          color( c ),
+          opacity( o )
+    {
+    }
+
+    float value;
+    QVector3D color;
+    float opacity;
+};
+
+/**
+  Classifies the R8 scalars of the volume: colour and opacity are linear
+  between control points ordered by value in [0, 1].
+
+  The renderer looks classified ray segments up in a pre-integration
+  table instead of classifying single samples. Entry (back, front), row
+  front, holds the premultiplied colour and opacity of a segment
+  segmentLength() voxels long over which the scalar goes linearly from
+  front to back. Every scalar in between contributes, so the segments
+  can be much longer than a voxel without missing thin features of the
+  transfer function.
+
+  An entry only depends on the transfer function between its two
+  scalars. When a control point moves, update() recomputes the entries
+  whose range overlaps the values that changed and reports them as a
+  few rectangles, for uploading only those.
+  */
+class CTransferFunction
+{
+public:
+    enum
+    {
+        tableSize = 256
+    };
+
+    // A grey ramp, transparent at zero
+    CTransferFunction();
+
+    int pointCount() const { return m_points.size(); }
+    const CTransferPoint& point( int i ) const { return m_points.at( i ); }
+
+    // Values are clamped between the neighbouring points, so the order
+    // stays the same; the first and last point stay at 0 and 1
+    void setPoint( int i, const CTransferPoint& point );
+    int insertPoint( const CTransferPoint& point );
+    void removePoint( int i );
+
+    // Length of the ray segments the table is integrated for, in voxels
+    void setSegmentLength( float voxels );
+    float segmentLength() const { return m_segmentLength; }
+
+    // Colour and opacity of one value, not integrated
+    QVector3D color( float value ) const;
+    float opacity( float value ) const;
+
+    // Recomputes what changed since the last update and returns the
+    // rectangles of the table that did, x along back and y along front
+    bool isDirty() const { return m_dirtyLo <= m_dirtyHi; }
+    QVector<QRect> update();
+
+    // tableSize * tableSize premultiplied RGBA entries
+    const float* table() const { return m_table.constData(); }
+
+    // One bit per table value whose opacity is above zero. revision()
+    // changes with every edit, for noticing when to ask again.
+    QBitArray visibleValues() const;
+
+    // One bit per table value whose opacity is one, so that a voxel of it
+    // lets nothing through
+    QBitArray opaqueValues() const;
+    int revision() const { return m_revision; }
+
+private:
+    void invalidate( float lo, float hi );
+    void integrate();
+    void buildRow( int front, int first, int last );
+
+    QVector<CTransferPoint> m_points;
+    float m_segmentLength;
+
+    // Colour and extinction per table value, and their running integrals
+    QVector<float> m_extinction;
+    QVector<float> m_color;
+    QVector<float> m_integral;
+
+    // Table values changed since the last update, empty when lo > hi
+    int m_dirtyLo;
+    int m_dirtyHi;
+    QVector<float> m_table;
+    int m_revision;
+
+    CStatsCounter* m_rebuiltStat;
+    CStatsHistogram* m_rebuildTimeStat;
+};
+
+#endif // C_TRANSFER_FUNCTION_H
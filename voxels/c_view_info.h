@@ -0,0 +1,69 @@
+#ifndef C_VIEW_INFO_H
+#define C_VIEW_INFO_H
+
+#include "c_frustum.h"
+#include "c_node_key.h"
+#include "c_voxel_config.h"
+
+#include <QMatrix4x4>
+#include <QVector3D>
+
+#include <math.h>
+
+/**
+  The parts of the camera that level of detail selection depends on,
+  expressed in the unit cube space of the volume.
+  */
+class CViewInfo
+{
+public:
+    CViewInfo()
+        : eye(),
+          pixelScale( 0.0f ),
+          pixelError( 1.0f ),
+          maxLevel( VoxelConfig::maxLevel )
+    {
+    }
+
+    // Enables culling against the camera's frustum for a volume placed in
+    // the world by model
+    void setCulling( const QMatrix4x4& cameraViewProjection, const QMatrix4x4& volumeModel )
+    {
+        viewProjection = cameraViewProjection;
+        model = volumeModel;
+        frustum = CFrustum( viewProjection * model );
+    }
+
+    // Projected size in pixels of one voxel of the node, measured at the
+    // point of the node closest to the eye
+    float screenSpaceError( const CNodeKey& key ) const
+    {
+        const QVector3D lo = key.origin();
+        const float size = key.size();
+        const float dx = qMax( qMax( lo.x() - eye.x(), eye.x() - lo.x() - size ), 0.0f );
+        const float dy = qMax( qMax( lo.y() - eye.y(), eye.y() - lo.y() - size ), 0.0f );
+        const float dz = qMax( qMax( lo.z() - eye.z(), eye.z() - lo.z() - size ), 0.0f );
+        const float voxelSize = size / VoxelConfig::brickEdge;
+        const float distance = qMax( sqrtf( dx * dx + dy * dy + dz * dz ), voxelSize );
+        return voxelSize * pixelScale / distance;
+    }
+
+    QVector3D eye;
+
+    // Viewport height / ( 2 tan( fov / 2 ) )
+    float pixelScale;
+
+    // Nodes are refined while their voxels project to more pixels than this
+    float pixelError;
+
+    // Deepest level the data provides
+    int maxLevel;
+
+    // Culling, disabled unless setCulling() was called. The frustum is in
+    // the unit cube space of the volume.
+    CFrustum frustum;
+    QMatrix4x4 viewProjection;
+    QMatrix4x4 model;
+};
+
+#endif // C_VIEW_INFO_H
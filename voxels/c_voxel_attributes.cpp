@@ -0,0 +1,195 @@
+#include "c_voxel_attributes.h"
+
+//------------------------------------------------------------------------------
+void
+VoxelAttributes::derive( CBrick& brick, const CBrickRegion& region )
+{
+    const int e = VoxelConfig::storedBrickEdge;
+    brick.colors.resize( VoxelConfig::storedBrickVoxels );
+    brick.normals.resize( VoxelConfig::storedBrickVoxels );
+
+    const quint8* density = brick.voxels.constData();
+    const float voxelSize = brick.key.size() / VoxelConfig::brickEdge;
+    const float originY = brick.key.origin().y() - VoxelConfig::brickBorder * voxelSize;
+
+    const QVector3D grass( 0.25f, 0.45f, 0.2f );
+    const QVector3D soil( 0.55f, 0.5f, 0.45f );
+    const QVector3D rock( 0.45f, 0.43f, 0.42f );
+
+    for ( int k = region.lo[2]; k < region.hi[2]; ++k )
+    {
+        const int k0 = qMax( k - 1, 0 );
+        const int k1 = qMin( k + 1, e - 1 );
+        for ( int j = region.lo[1]; j < region.hi[1]; ++j )
+        {
+            const int j0 = qMax( j - 1, 0 );
+            const int j1 = qMin( j + 1, e - 1 );
+            for ( int i = region.lo[0]; i < region.hi[0]; ++i )
+            {
+                const int i0 = qMax( i - 1, 0 );
+                const int i1 = qMin( i + 1, e - 1 );
+
+                // Density grows into the solid, the normal points out of it
+                const QVector3D gradient( float( density[CBrick::index( i1, j, k )] ) - density[CBrick::index( i0, j, k )],
+                                          float( density[CBrick::index( i, j1, k )] ) - density[CBrick::index( i, j0, k )],
+                                          float( density[CBrick::index( i, j, k1 )] ) - density[CBrick::index( i, j, k0 )] );
+                const QVector3D normal = gradient.lengthSquared() > 0.0f ? -gradient.normalized()
+                                                                        : QVector3D( 0.0f, 1.0f, 0.0f );
+
+                // The fuller the neighbourhood, the less ambient light arrives;
+                // on a flat surface half of it is filled
+                int sum = 0;
+                int count = 0;
+                for ( int z = k0; z <= k1; ++z )
+                    for ( int y = j0; y <= j1; ++y )
+                        for ( int x = i0; x <= i1; ++x, ++count )
+                            sum += density[CBrick::index( x, y, z )];
+                const float visibility = 1.0f - float( sum ) / ( 255.0f * count );
+
+                // Grass in the valleys, soil higher up and rock on steep slopes
+                const float height = originY + ( j + 0.5f ) * voxelSize;
+                const QVector3D ground = grass + ( soil - grass ) * qBound( 0.0f, height * 12.0f, 1.0f );
+                const float steep = qBound( 0.0f, ( 0.8f - normal.y() ) * 2.5f, 1.0f );
+                const QVector3D color = ground + ( rock - ground ) * steep;
+
+                const int index = CBrick::index( i, j, k );
+                brick.colors[index] = packColor( color );
+                brick.normals[index] = packNormalVisibility( encodeNormal( normal ), 2.0f * visibility );
+            }
+        }
+    }
+
+    if ( region.voxelCount() == VoxelConfig::storedBrickVoxels )
+        deriveDistance( brick );
+    else
+        updateDistance( brick, region );
+}
+
+//------------------------------------------------------------------------------
+void
+VoxelAttributes::deriveDistance( CBrick& brick )
+{
+    const int e = VoxelConfig::storedBrickEdge;
+    const quint8* density = brick.voxels.constData();
+
+    // Start from the distance to the outside, or zero where occupied
+    QVector<int> distance( VoxelConfig::storedBrickVoxels );
+    for ( int k = 0; k < e; ++k )
+    {
+        for ( int j = 0; j < e; ++j )
+        {
+            for ( int i = 0; i < e; ++i )
+            {
+                const int index = CBrick::index( i, j, k );
+                const int outside = qMin( qMin( qMin( i + 1, e - i ), qMin( j + 1, e - j ) ), qMin( k + 1, e - k ) );
+                distance[index] = density[index] > 0 ? 0 : outside;
+            }
+        }
+    }
+
+    // Two chamfer passes over all 26 neighbours with unit weights give the
+    // exact chessboard distance: first from the neighbours before a voxel
+    // in scan order, then from the ones after it
+    for ( int pass = 0; pass < 2; ++pass )
+    {
+        const int step = pass == 0 ? 1 : -1;
+        const int first = pass == 0 ? 0 : e - 1;
+        for ( int k = first; k >= 0 && k < e; k += step )
+        {
+            for ( int j = first; j >= 0 && j < e; j += step )
+            {
+                for ( int i = first; i >= 0 && i < e; i += step )
+                {
+                    int& d = distance[CBrick::index( i, j, k )];
+                    for ( int n = 0; n < 13 && d > 0; ++n )
+                    {
+                        // The 13 neighbours that precede in scan order
+                        const int dz = n < 9 ? -1 : 0;
+                        const int dy = n < 9 ? n / 3 - 1 : ( n < 12 ? -1 : 0 );
+                        const int dx = n < 9 ? n % 3 - 1 : ( n < 12 ? n - 10 : -1 );
+                        const int x = i + step * dx;
+                        const int y = j + step * dy;
+                        const int z = k + step * dz;
+                        if ( x < 0 || y < 0 || z < 0 || x >= e || y >= e || z >= e )
+                            continue;
+                        d = qMin( d, distance.at( CBrick::index( x, y, z ) ) + 1 );
+                    }
+                }
+            }
+        }
+    }
+
+    for ( int index = 0; index < VoxelConfig::storedBrickVoxels; ++index )
+        brick.normals[index] = ( brick.normals.at( index ) & 0x00ffffffu ) | ( quint32( qMin( distance.at( index ), 255 ) ) << 24 );
+}
+
+//------------------------------------------------------------------------------
+void
+VoxelAttributes::updateDistance( CBrick& brick, const CBrickRegion& region )
+{
+    const int e = VoxelConfig::storedBrickEdge;
+    const quint8* density = brick.voxels.constData();
+
+    // A distance only changes if the voxel it measured to, or a new one
+    // closer than that, lies in region. Those voxels start again from the
+    // distance to the outside, or zero where occupied; the others keep
+    // theirs.
+    QVector<int> distance( VoxelConfig::storedBrickVoxels );
+    QVector<int> affected;
+    for ( int k = 0; k < e; ++k )
+    {
+        for ( int j = 0; j < e; ++j )
+        {
+            for ( int i = 0; i < e; ++i )
+            {
+                const int index = CBrick::index( i, j, k );
+                const int c[3] = { i, j, k };
+                int reach = 0;
+                for ( int axis = 0; axis < 3; ++axis )
+                    reach = qMax( reach, qMax( region.lo[axis] - c[axis], c[axis] - region.hi[axis] + 1 ) );
+
+                distance[index] = unpackDistance( brick.normals.at( index ) );
+                if ( reach > distance.at( index ) )
+                    continue;
+
+                const int outside = qMin( qMin( qMin( i + 1, e - i ), qMin( j + 1, e - j ) ), qMin( k + 1, e - k ) );
+                distance[index] = density[index] > 0 ? 0 : outside;
+                affected << i << j << k;
+            }
+        }
+    }
+
+    // Relax the affected voxels from all 26 neighbours until nothing
+    // changes; every sweep carries the distances one voxel further
+    bool changed = !affected.isEmpty();
+    while ( changed )
+    {
+        changed = false;
+        for ( int a = 0; a < affected.size(); a += 3 )
+        {
+            const int i = affected.at( a );
+            const int j = affected.at( a + 1 );
+            const int k = affected.at( a + 2 );
+            int& d = distance[CBrick::index( i, j, k )];
+            for ( int z = qMax( k - 1, 0 ); z <= qMin( k + 1, e - 1 ) && d > 0; ++z )
+                for ( int y = qMax( j - 1, 0 ); y <= qMin( j + 1, e - 1 ); ++y )
+                    for ( int x = qMax( i - 1, 0 ); x <= qMin( i + 1, e - 1 ); ++x )
+                    {
+                        const int n = distance.at( CBrick::index( x, y, z ) ) + 1;
+                        if ( n < d )
+                        {
+                            d = n;
+                            changed = true;
+                        }
+                    }
+        }
+    }
+
+    for ( int a = 0; a < affected.size(); a += 3 )
+    {
+        const int index = CBrick::index( affected.at( a ), affected.at( a + 1 ), affected.at( a + 2 ) );
+        brick.normals[index] = ( brick.normals.at( index ) & 0x00ffffffu ) | ( quint32( qMin( distance.at( index ), 255 ) ) << 24 );
+    }
+}
+
+//------------------------------------------------------------------------------
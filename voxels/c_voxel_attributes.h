@@ -0,0 +1,97 @@
+#ifndef C_VOXEL_ATTRIBUTES_H
+#define C_VOXEL_ATTRIBUTES_H
+
+#include "c_brick.h"
+
+#include <QVector3D>
+
+#include <math.h>
+
+/**
+  Packed per voxel shading attributes, 8 bytes next to the density:
+
+    colour      RGB10A2, stored as GL_UNSIGNED_INT_2_10_10_10_REV
+    normal      octahedral, 8 bits per component in R and G of an RGBA8
+    visibility  8 bits in B of the same RGBA8, 1 where nothing occludes
+    distance    8 bits in A of the same RGBA8, see deriveDistance()
+
+  The decoders in gigavoxels.frag mirror the ones below.
+  */
+namespace VoxelAttributes
+{
+    inline quint32 packColor( const QVector3D& rgb, float alpha = 1.0f )
+    {
+        const quint32 r = quint32( qBound( 0.0f, rgb.x(), 1.0f ) * 1023.0f + 0.5f );
+        const quint32 g = quint32( qBound( 0.0f, rgb.y(), 1.0f ) * 1023.0f + 0.5f );
+        const quint32 b = quint32( qBound( 0.0f, rgb.z(), 1.0f ) * 1023.0f + 0.5f );
+        const quint32 a = quint32( qBound( 0.0f, alpha, 1.0f ) * 3.0f + 0.5f );
+        return r | ( g << 10 ) | ( b << 20 ) | ( a << 30 );
+    }
+
+    inline QVector3D unpackColor( quint32 packed )
+    {
+        return QVector3D( float( packed & 0x3ff ), float( ( packed >> 10 ) & 0x3ff ),
+                          float( ( packed >> 20 ) & 0x3ff ) ) / 1023.0f;
+    }
+
+    // Projects the unit sphere onto an octahedron and unfolds its lower
+    // half over the corners of the square
+    inline quint16 encodeNormal( const QVector3D& n )
+    {
+        const float l1 = fabsf( n.x() ) + fabsf( n.y() ) + fabsf( n.z() );
+        if ( l1 <= 0.0f )
+            return encodeNormal( QVector3D( 0.0f, 0.0f, 1.0f ) );
+
+        float u = n.x() / l1;
+        float v = n.y() / l1;
+        if ( n.z() < 0.0f )
+        {
+            const float fu = ( 1.0f - fabsf( v ) ) * ( u >= 0.0f ? 1.0f : -1.0f );
+            const float fv = ( 1.0f - fabsf( u ) ) * ( v >= 0.0f ? 1.0f : -1.0f );
+            u = fu;
+            v = fv;
+        }
+        const quint16 eu = quint16( qBound( 0.0f, u * 0.5f + 0.5f, 1.0f ) * 255.0f + 0.5f );
+        const quint16 ev = quint16( qBound( 0.0f, v * 0.5f + 0.5f, 1.0f ) * 255.0f + 0.5f );
+        return eu | quint16( ev << 8 );
+    }
+
+    inline QVector3D decodeNormal( quint16 packed )
+    {
+        const float u = float( packed & 0xff ) / 255.0f * 2.0f - 1.0f;
+        const float v = float( packed >> 8 ) / 255.0f * 2.0f - 1.0f;
+        QVector3D n( u, v, 1.0f - fabsf( u ) - fabsf( v ) );
+        const float t = qMax( -n.z(), 0.0f );
+        n.setX( n.x() + ( n.x() >= 0.0f ? -t : t ) );
+        n.setY( n.y() + ( n.y() >= 0.0f ? -t : t ) );
+        return n.normalized();
+    }
+
+    inline quint32 packNormalVisibility( quint16 normal, float visibility )
+    {
+        return quint32( normal ) | ( quint32( qBound( 0.0f, visibility, 1.0f ) * 255.0f + 0.5f ) << 16 );
+    }
+
+    // Derives normals from the density gradient, visibility from the
+    // density of the neighbourhood and colour from height and slope, for
+    // the voxels of region. Voxels one beyond region must hold valid
+    // densities, except at the edges of the stored brick. Unless region
+    // is the whole brick, the distances are updated from the ones the
+    // brick holds, see updateDistance().
+    void derive( CBrick& brick, const CBrickRegion& region );
+
+    // Stores the Chebyshev distance, in voxels, from every voxel to the
+    // nearest one with a density above zero. Everything outside the stored
+    // brick counts as occupied, so a ray that leaps by the distance never
+    // leaves the brick.
+    void deriveDistance( CBrick& brick );
+
+    // Brings the distances of a brick whose densities changed only inside
+    // region up to date. Only voxels no further from region than their old
+    // distance can change, and only those are computed again.
+    void updateDistance( CBrick& brick, const CBrickRegion& region );
+
+    inline int unpackDistance( quint32 packed ) { return int( packed >> 24 ); }
+}
+
+#endif // C_VOXEL_ATTRIBUTES_H
@@ -0,0 +1,29 @@
+#ifndef C_VOXEL_CONFIG_H
+#define C_VOXEL_CONFIG_H
+
+#include "c_voxel_layout.h"
+
+namespace VoxelConfig
+{
+    // Octree of 8^3 voxel bricks with a one voxel border, stored as R8 to
+    // match the brick pool texture. tools/layout_benchmark compares other
+    // instantiations.
+    typedef CVoxelLayout<2, 8, 1, quint8> Layout;
+
+    // Voxels along one axis of a brick, without its border
+    const int brickEdge = Layout::edge;
+
+    // Voxels duplicated from the neighbours on each side, for filtering
+    const int brickBorder = Layout::border;
+
+    const int storedBrickEdge = Layout::storedEdge;
+    const int storedBrickVoxels = Layout::storedVoxels;
+
+    // Deepest octree level, the root is level 0
+    const int maxLevel = 10;
+
+    // The brick pool is a cube of poolSlotsPerAxis^3 bricks
+    const int poolSlotsPerAxis = 32;
+}
+
+#endif // C_VOXEL_CONFIG_H
@@ -0,0 +1,99 @@
+#ifndef C_VOXEL_EDIT_H
+#define C_VOXEL_EDIT_H
+
+#include "c_node_key.h"
+#include "c_voxel_config.h"
+
+#include <QVector3D>
+
+#include <math.h>
+
+/**
+  One CSG operation on the volume, in unit cube space. The edit covers the
+  voxels inside its shape, with a one voxel ramp at the surface so that it
+  filters like the rest of the data.
+  */
+class CVoxelEdit
+{
+public:
+    enum Shape
+    {
+        Sphere,
+        Box
+    };
+
+    enum Operation
+    {
+        Add,
+        Remove
+    };
+
+    CVoxelEdit()
+        : shape( Sphere ),
+          operation( Add )
+    {
+    }
+
+    CVoxelEdit( Shape s, Operation o, const QVector3D& c, const QVector3D& e )
+        : shape( s ),
+          operation( o ),
+          center( c ),
+          extent( e )
+    {
+    }
+
+    // Signed distance to the surface, negative inside. The radius of a
+    // sphere is extent.x(), a box spans center +- extent.
+    float distance( const QVector3D& p ) const
+    {
+        const QVector3D d = p - center;
+        if ( shape == Sphere )
+            return d.length() - extent.x();
+
+        const float qx = fabsf( d.x() ) - extent.x();
+        const float qy = fabsf( d.y() ) - extent.y();
+        const float qz = fabsf( d.z() ) - extent.z();
+        const QVector3D outside( qMax( qx, 0.0f ), qMax( qy, 0.0f ), qMax( qz, 0.0f ) );
+        return outside.length() + qMin( qMax( qx, qMax( qy, qz ) ), 0.0f );
+    }
+
+    quint8 apply( quint8 value, const QVector3D& p, float voxelSize ) const
+    {
+        const float coverage = qBound( 0.0f, 0.5f - distance( p ) / voxelSize, 1.0f );
+        const quint8 v = quint8( coverage * 255.0f + 0.5f );
+        return operation == Add ? qMax( value, v ) : qMin( value, quint8( 255 - v ) );
+    }
+
+    QVector3D boundsMin() const
+    {
+        return center - ( shape == Sphere ? QVector3D( extent.x(), extent.x(), extent.x() ) : extent );
+    }
+
+    QVector3D boundsMax() const
+    {
+        return center + ( shape == Sphere ? QVector3D( extent.x(), extent.x(), extent.x() ) : extent );
+    }
+
+    // Whether the edit reaches into the stored brick of the node, border and
+    // surface ramp included
+    bool overlaps( const CNodeKey& key ) const
+    {
+        const float voxelSize = key.size() / VoxelConfig::brickEdge;
+        const float margin = ( VoxelConfig::brickBorder + 1 ) * voxelSize;
+        const QVector3D lo = key.origin() - QVector3D( margin, margin, margin );
+        const QVector3D hi = key.origin() + QVector3D( 1.0f, 1.0f, 1.0f ) * key.size()
+                           + QVector3D( margin, margin, margin );
+        const QVector3D emin = boundsMin();
+        const QVector3D emax = boundsMax();
+        return emin.x() < hi.x() && emax.x() > lo.x()
+            && emin.y() < hi.y() && emax.y() > lo.y()
+            && emin.z() < hi.z() && emax.z() > lo.z();
+    }
+
+    Shape shape;
+    Operation operation;
+    QVector3D center;
+    QVector3D extent;
+};
+
+#endif // C_VOXEL_EDIT_H
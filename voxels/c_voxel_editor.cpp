@@ -0,0 +1,378 @@
+#include "c_voxel_editor.h"
+#include "c_brick_pool.h"
+#include "c_brick_scheduler.h"
+#include "c_node_tree.h"
+#include "c_occupancy.h"
+
+#include <QElapsedTimer>
+#include <QtConcurrentMap>
+
+#include <math.h>
+
+// Deepest level of the edit index, 32^3 cells
+static const int indexLevel = 5;
+
+//------------------------------------------------------------------------------
+class CEditJob
+{
+public:
+    CEditJob()
+        : editor( NULL ),
+          slot( -1 )
+    {
+    }
+
+    // Resident bricks start from the content their slot was published
+    // with and recompute the dirty region only, constant ones are produced
+    // in full since they may need a slot from now on. Attributes depend on
+    // the neighbouring densities, so they are refreshed one voxel beyond
+    // the dirty region, from densities recomputed two voxels beyond. The
+    // empty space distances that changed may reach further, so the region
+    // grows over them before it is uploaded. Slots that were not published
+    // have nothing to start from and are recomputed in full.
+    void run()
+    {
+        if ( slot >= 0 && !brick.voxels.isEmpty() )
+        {
+            const QVector<quint32> before = brick.normals;
+            region = region.grown( 1 );
+            editor->produceRegion( brick, region.grown( 1 ) );
+            editor->produceAttributes( brick, region );
+            growOverDistances( before );
+        }
+        else if ( slot >= 0 )
+        {
+            region = CBrickRegion();
+            brick.voxels.resize( VoxelConfig::storedBrickVoxels );
+            editor->produceRegion( brick, region );
+            editor->produceAttributes( brick, region );
+        }
+        else
+        {
+            editor->produce( brick );
+            if ( !brick.constant )
+                editor->produceAttributes( brick, CBrickRegion() );
+        }
+    }
+
+    void growOverDistances( const QVector<quint32>& before )
+    {
+        const int e = VoxelConfig::storedBrickEdge;
+        for ( int k = 0; k < e; ++k )
+            for ( int j = 0; j < e; ++j )
+                for ( int i = 0; i < e; ++i )
+                {
+                    const int index = CBrick::index( i, j, k );
+                    if ( ( ( before.at( index ) ^ brick.normals.at( index ) ) >> 24 ) == 0 )
+                        continue;
+
+                    const int c[3] = { i, j, k };
+                    for ( int axis = 0; axis < 3; ++axis )
+                    {
+                        region.lo[axis] = qMin( region.lo[axis], c[axis] );
+                        region.hi[axis] = qMax( region.hi[axis], c[axis] + 1 );
+                    }
+                }
+    }
+
+    const CVoxelEditor* editor;
+    CBrick brick;
+    CBrickRegion region;
+    int slot;
+};
+
+//------------------------------------------------------------------------------
+static CBrickRegion
+dirtyRegion( const CVoxelEdit& edit, const CNodeKey& key )
+{
+    const float voxelSize = key.size() / VoxelConfig::brickEdge;
+    const QVector3D origin = key.origin()
+                           - QVector3D( 1.0f, 1.0f, 1.0f ) * ( VoxelConfig::brickBorder * voxelSize );
+    const QVector3D lo = ( edit.boundsMin() - origin ) / voxelSize;
+    const QVector3D hi = ( edit.boundsMax() - origin ) / voxelSize;
+
+    // One extra voxel for the surface ramp
+    CBrickRegion region;
+    for ( int axis = 0; axis < 3; ++axis )
+    {
+        region.lo[axis] = qBound( 0, int( floorf( lo[axis] ) ) - 1, VoxelConfig::storedBrickEdge );
+        region.hi[axis] = qBound( 0, int( ceilf( hi[axis] ) ) + 1, VoxelConfig::storedBrickEdge );
+    }
+    return region;
+}
+
+//------------------------------------------------------------------------------
+static void
+collect( const CVoxelEdit& edit, const CNodeKey& key, const CNodeTree* tree,
+         const CVoxelEditor* editor, QVector<CEditJob>& jobs )
+{
+    if ( !edit.overlaps( key ) )
+        return;
+
+    // Nodes that were never produced will see the edit when they are
+    const CNodeInfo* info = tree->find( key );
+    if ( !info )
+        return;
+
+    if ( info->constant || info->brickSlot >= 0 )
+    {
+        CEditJob job;
+        job.editor = editor;
+        job.brick = CBrick( key );
+        job.slot = info->constant ? -1 : info->brickSlot;
+        job.region = dirtyRegion( edit, key );
+        jobs.append( job );
+    }
+
+    if ( int( key.level ) < VoxelConfig::maxLevel )
+    {
+        for ( int c = 0; c < 8; ++c )
+            collect( edit, key.child( c ), tree, editor, jobs );
+    }
+}
+
+//------------------------------------------------------------------------------
+CVoxelEditor::CVoxelEditor( const CBrickProducer* base )
+    : m_base( base ),
+      m_lastBricks( 0 ),
+      m_lastMilliseconds( 0.0f )
+{
+}
+
+//------------------------------------------------------------------------------
+void
+CVoxelEditor::produce( CBrick& brick ) const
+{
+    m_base->produce( brick );
+
+    const QVector<CVoxelEdit> edits = overlapping( brick.key );
+    if ( edits.isEmpty() )
+        return;
+
+    if ( brick.constant )
+    {
+        brick.voxels.fill( brick.value, VoxelConfig::storedBrickVoxels );
+        brick.constant = false;
+    }
+    applyEdits( brick, CBrickRegion(), edits );
+    brick.detectConstant();
+
+    // An added shape smaller than a voxel of this level may not show up in
+    // its samples; the node must still be refined to reach it
+    if ( brick.constant && brick.value == 0 )
+    {
+        for ( int i = 0; i < edits.size(); ++i )
+        {
+            if ( edits.at( i ).operation == CVoxelEdit::Add )
+            {
+                brick.voxels.fill( 0, VoxelConfig::storedBrickVoxels );
+                brick.constant = false;
+                break;
+            }
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+void
+CVoxelEditor::produceRegion( CBrick& brick, const CBrickRegion& region ) const
+{
+    m_base->produceRegion( brick, region );
+    applyEdits( brick, region, overlapping( brick.key ) );
+}
+
+//------------------------------------------------------------------------------
+void
+CVoxelEditor::produceAttributes( CBrick& brick, const CBrickRegion& region ) const
+{
+    m_base->produceAttributes( brick, region );
+
+    // Like in produce(), an added shape smaller than a voxel may not show
+    // up in the densities; its cells stay occupied and its full density in
+    // range so that the traversal still refines towards it
+    const QVector<CVoxelEdit> edits = overlapping( brick.key );
+    for ( int i = 0; i < edits.size(); ++i )
+    {
+        if ( edits.at( i ).operation == CVoxelEdit::Add )
+        {
+            brick.occupancy |= Occupancy::overlappingCells( brick.key, edits.at( i ).boundsMin(), edits.at( i ).boundsMax() );
+            brick.maxValue = 255;
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+int
+CVoxelEditor::maxLevel() const
+{
+    return m_base->maxLevel();
+}
+
+//------------------------------------------------------------------------------
+void
+CVoxelEditor::apply( const CVoxelEdit& edit, CNodeTree* tree, CBrickPool* pool,
+                     CBrickScheduler* scheduler, int frame )
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    {
+        QMutexLocker locker( &m_mutex );
+        m_edits.append( edit );
+        index( m_edits.size() - 1 );
+    }
+    scheduler->invalidate( edit );
+
+    // Recompute the affected bricks of every level in parallel
+    QVector<CEditJob> jobs;
+    collect( edit, CNodeKey(), tree, this, jobs );
+    for ( int i = 0; i < jobs.size(); ++i )
+    {
+        if ( jobs.at( i ).slot >= 0 )
+            pool->published( jobs.at( i ).slot, jobs[i].brick );
+    }
+    QtConcurrent::blockingMap( jobs, &CEditJob::run );
+
+    for ( int i = 0; i < jobs.size(); ++i )
+    {
+        CEditJob& job = jobs[i];
+
+        // Earlier jobs may have evicted the brick or taken it out of a
+        // slot it shared with this one
+        const CNodeInfo* info = tree->find( job.brick.key );
+        const int current = info ? info->brickSlot : -1;
+        if ( job.slot >= 0 && current == job.slot && pool->ownerCount( job.slot ) == 1 )
+        {
+            pool->uploadRegion( job.slot, job.brick, job.region );
+            pool->publish( job.slot, job.brick );
+            tree->update( job.brick );
+            continue;
+        }
+
+        // The other nodes of a shared slot keep its old content
+        if ( current >= 0 )
+        {
+            pool->release( current, job.brick.key );
+            tree->evictBrick( job.brick.key, current );
+        }
+
+        if ( job.brick.constant )
+        {
+            tree->insert( job.brick, -1 );
+            continue;
+        }
+
+        // The node needs a brick of its own: a constant node gained detail,
+        // or the slot it had was shared or is gone
+        int slot = pool->share( job.brick, frame );
+        if ( slot < 0 )
+        {
+            QVector<CNodeKey> evicted;
+            slot = pool->allocate( job.brick.key, frame, &evicted );
+            if ( slot < 0 )
+            {
+                tree->remove( job.brick.key );
+                continue;
+            }
+            for ( int e = 0; e < evicted.size(); ++e )
+                tree->evictBrick( evicted.at( e ), slot );
+            pool->upload( slot, job.brick );
+            pool->publish( slot, job.brick );
+        }
+        tree->insert( job.brick, slot );
+    }
+
+    m_lastBricks = jobs.size();
+    m_lastMilliseconds = timer.nsecsElapsed() / 1.0e6f;
+}
+
+//------------------------------------------------------------------------------
+int
+CVoxelEditor::editCount() const
+{
+    QMutexLocker locker( &m_mutex );
+    return m_edits.size();
+}
+
+//------------------------------------------------------------------------------
+QVector<CVoxelEdit>
+CVoxelEditor::overlapping( const CNodeKey& key ) const
+{
+    CNodeKey cell = key;
+    while ( int( cell.level ) > qMin( indexLevel, VoxelConfig::maxLevel ) )
+        cell = cell.parent();
+
+    QVector<CVoxelEdit> edits;
+    QMutexLocker locker( &m_mutex );
+    const QHash<CNodeKey, QVector<int> >::const_iterator it = m_editIndex.constFind( cell );
+    if ( it == m_editIndex.constEnd() )
+        return edits;
+
+    const QVector<int>& indices = it.value();
+    for ( int i = 0; i < indices.size(); ++i )
+    {
+        const CVoxelEdit& edit = m_edits.at( indices.at( i ) );
+        if ( cell == key || edit.overlaps( key ) )
+            edits.append( edit );
+    }
+    return edits;
+}
+
+//------------------------------------------------------------------------------
+void
+CVoxelEditor::index( int edit )
+{
+    // Only the cells around the bounds of the edit can overlap it, one more
+    // on each side keeps rounding to overlaps()
+    const CVoxelEdit& e = m_edits.at( edit );
+    const QVector3D emin = e.boundsMin();
+    const QVector3D emax = e.boundsMax();
+    for ( int level = 0; level <= qMin( indexLevel, VoxelConfig::maxLevel ); ++level )
+    {
+        const int cells = 1 << level;
+        const float margin = ( VoxelConfig::brickBorder + 1 ) / float( cells * VoxelConfig::brickEdge );
+        int lo[3];
+        int hi[3];
+        for ( int axis = 0; axis < 3; ++axis )
+        {
+            lo[axis] = qBound( 0, int( floorf( ( emin[axis] - margin ) * cells ) ) - 1, cells - 1 );
+            hi[axis] = qBound( 0, int( floorf( ( emax[axis] + margin ) * cells ) ) + 1, cells - 1 );
+        }
+
+        for ( int z = lo[2]; z <= hi[2]; ++z )
+            for ( int y = lo[1]; y <= hi[1]; ++y )
+                for ( int x = lo[0]; x <= hi[0]; ++x )
+                {
+                    const CNodeKey key( level, x, y, z );
+                    if ( e.overlaps( key ) )
+                        m_editIndex[key].append( edit );
+                }
+    }
+}
+
+//------------------------------------------------------------------------------
+void
+CVoxelEditor::applyEdits( CBrick& brick, const CBrickRegion& region,
+                          const QVector<CVoxelEdit>& edits ) const
+{
+    if ( edits.isEmpty() )
+        return;
+
+    const float voxelSize = brick.key.size() / VoxelConfig::brickEdge;
+    const QVector3D origin = brick.key.origin()
+                           - QVector3D( 1.0f, 1.0f, 1.0f ) * ( VoxelConfig::brickBorder * voxelSize );
+    quint8* data = brick.voxels.data();
+
+    // Edits are applied in the order they were made
+    for ( int k = region.lo[2]; k < region.hi[2]; ++k )
+        for ( int j = region.lo[1]; j < region.hi[1]; ++j )
+            for ( int i = region.lo[0]; i < region.hi[0]; ++i )
+            {
+                const QVector3D p = origin + QVector3D( i + 0.5f, j + 0.5f, k + 0.5f ) * voxelSize;
+                quint8& v = data[CBrick::index( i, j, k )];
+                for ( int e = 0; e < edits.size(); ++e )
+                    v = edits.at( e ).apply( v, p, voxelSize );
+            }
+}
+
+//------------------------------------------------------------------------------
@@ -0,0 +1,66 @@
+#ifndef C_VOXEL_EDITOR_H
+#define C_VOXEL_EDITOR_H
+
+#include "c_brick_producer.h"
+#include "c_voxel_edit.h"
+
+#include <QHash>
+#include <QMutex>
+#include <QVector>
+
+class CBrickPool;
+class CBrickScheduler;
+class CNodeTree;
+
+/**
+  Layers CSG edits on top of another producer. Bricks produced later see
+  every edit made so far; apply() patches the bricks that are already
+  resident instead, recomputing and re-uploading only the voxels an edit
+  touches, on every level of the tree.
+  */
+class CVoxelEditor : public CBrickProducer
+{
+public:
+    explicit CVoxelEditor( const CBrickProducer* base );
+
+    virtual void produce( CBrick& brick ) const;
+    virtual void produceRegion( CBrick& brick, const CBrickRegion& region ) const;
+    virtual void produceAttributes( CBrick& brick, const CBrickRegion& region ) const;
+    virtual int maxLevel() const;
+    virtual bool isAnimated() const { return m_base->isAnimated(); }
+
+    // Only valid before any brick has been produced
+    void setBase( const CBrickProducer* base ) { m_base = base; }
+
+    void apply( const CVoxelEdit& edit, CNodeTree* tree, CBrickPool* pool,
+                CBrickScheduler* scheduler, int frame );
+
+    int editCount() const;
+
+    // Statistics of the last apply()
+    int lastBrickCount() const { return m_lastBricks; }
+    float lastMilliseconds() const { return m_lastMilliseconds; }
+
+private:
+    friend class CEditJob;
+
+    QVector<CVoxelEdit> overlapping( const CNodeKey& key ) const;
+    void index( int edit );
+    void applyEdits( CBrick& brick, const CBrickRegion& region,
+                     const QVector<CVoxelEdit>& edits ) const;
+
+    const CBrickProducer* m_base;
+
+    mutable QMutex m_mutex;
+    QVector<CVoxelEdit> m_edits;
+
+    // Indices into m_edits, in the order the edits were made, by the nodes
+    // down to indexLevel that they overlap. A deeper node only sees edits
+    // its ancestor on that level sees, so it filters the ancestor's list.
+    QHash<CNodeKey, QVector<int> > m_editIndex;
+
+    int m_lastBricks;
+    float m_lastMilliseconds;
+};
+
+#endif // C_VOXEL_EDITOR_H
@@ -0,0 +1,66 @@
+#include "c_voxel_instances.h"
+
+#include <string.h>
+
+//------------------------------------------------------------------------------
+CVoxelInstances::CVoxelInstances()
+    : m_dirty( true )
+{
+}
+
+//------------------------------------------------------------------------------
+void
+CVoxelInstances::clear()
+{
+    m_models.clear();
+    m_inverses.clear();
+    m_dirty = true;
+}
+
+//------------------------------------------------------------------------------
+int
+CVoxelInstances::append( const QMatrix4x4& model )
+{
+    m_models.append( model );
+    m_inverses.append( model.inverted() );
+    m_dirty = true;
+    return m_models.size() - 1;
+}
+
+//------------------------------------------------------------------------------
+bool
+CVoxelInstances::setTransform( int i, const QMatrix4x4& model )
+{
+    if ( m_models.at( i ) == model )
+        return false;
+    m_models[i] = model;
+    m_inverses[i] = model.inverted();
+    m_dirty = true;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+CBounds
+CVoxelInstances::bounds( int i ) const
+{
+    const QMatrix4x4& model = m_models.at( i );
+    CBounds box;
+    for ( int corner = 0; corner < 8; ++corner )
+        box.grow( model * QVector3D( float( corner & 1 ), float( ( corner >> 1 ) & 1 ), float( corner >> 2 ) ) );
+    return box;
+}
+
+//------------------------------------------------------------------------------
+void
+CVoxelInstances::flatten( QVector<CGpuInstance>& instances )
+{
+    instances.resize( m_models.size() );
+    for ( int i = 0; i < m_models.size(); ++i )
+    {
+        memcpy( instances[i].model, m_models.at( i ).constData(), sizeof( instances[i].model ) );
+        memcpy( instances[i].inverseModel, m_inverses.at( i ).constData(), sizeof( instances[i].inverseModel ) );
+    }
+    m_dirty = false;
+}
+
+//------------------------------------------------------------------------------
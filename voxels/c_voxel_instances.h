@@ -0,0 +1,52 @@
+#ifndef C_VOXEL_INSTANCES_H
+#define C_VOXEL_INSTANCES_H
+
+#include "c_instance_bvh.h"
+
+#include <QMatrix4x4>
+#include <QVector>
+
+/**
+  Mirrors the Instance struct of the shaders, std430 layout. Both
+  matrices are column major.
+  */
+struct CGpuInstance
+{
+    float model[16];
+    float inverseModel[16];
+};
+
+/**
+  Placements of the shared voxel asset. Every instance maps the unit cube
+  of the asset into the world with its own transform, which must scale
+  uniformly so that screen-space errors stay comparable. All instances
+  draw from the one node tree and brick pool.
+  */
+class CVoxelInstances
+{
+public:
+    CVoxelInstances();
+
+    void clear();
+    int append( const QMatrix4x4& model );
+    // Returns whether the transform actually changed
+    bool setTransform( int i, const QMatrix4x4& model );
+
+    int count() const { return m_models.size(); }
+    const QMatrix4x4& transform( int i ) const { return m_models.at( i ); }
+    const QMatrix4x4& inverseTransform( int i ) const { return m_inverses.at( i ); }
+
+    // World space box around the unit cube of instance i
+    CBounds bounds( int i ) const;
+
+    // Set whenever the GPU copy is out of date, cleared by flatten()
+    bool isDirty() const { return m_dirty; }
+    void flatten( QVector<CGpuInstance>& instances );
+
+private:
+    QVector<QMatrix4x4> m_models;
+    QVector<QMatrix4x4> m_inverses;
+    bool m_dirty;
+};
+
+#endif // C_VOXEL_INSTANCES_H
@@ -0,0 +1,115 @@
+#ifndef C_VOXEL_LAYOUT_H
+#define C_VOXEL_LAYOUT_H
+
+#include <QtGlobal>
+#include <QVector>
+
+/**
+  Compile time geometry of a sparse voxel tree. Every node splits into
+  Branching^3 children and owns a brick of Edge^3 voxels surrounded by a
+  Border voxels wide apron copied from its neighbours. Loops over a brick
+  see constant bounds and can be unrolled and vectorised.
+  */
+template<int Branching, int Edge, int Border, typename Voxel>
+class CVoxelLayout
+{
+public:
+    typedef Voxel VoxelType;
+
+    enum
+    {
+        branching = Branching,
+        childCount = Branching * Branching * Branching,
+        edge = Edge,
+        border = Border,
+        storedEdge = Edge + 2 * Border,
+        storedVoxels = storedEdge * storedEdge * storedEdge,
+        storedBytes = storedVoxels * int( sizeof( Voxel ) )
+    };
+
+    // Voxels are stored x fastest, then y, then z
+    static int index( int i, int j, int k )
+    {
+        return ( k * storedEdge + j ) * storedEdge + i;
+    }
+
+    static int childIndex( int i, int j, int k )
+    {
+        return ( k * Branching + j ) * Branching + i;
+    }
+
+    // Levels below the root until one brick voxel covers one of the
+    // given number of voxels along an axis
+    static int levelsFor( int voxels )
+    {
+        int levels = 0;
+        for ( qint64 extent = Edge; extent < voxels; extent *= Branching )
+            ++levels;
+        return levels;
+    }
+};
+
+/**
+  The voxel payload of one node of a tree with the given layout.
+  */
+template<class Layout>
+class CBrickStorage
+{
+public:
+    typedef typename Layout::VoxelType Voxel;
+
+    CBrickStorage()
+        : constant( false ),
+          value( 0 )
+    {
+    }
+
+    static int index( int i, int j, int k ) { return Layout::index( i, j, k ); }
+
+    // Collapses the payload if every voxel holds the same value. The
+    // payload is either empty or holds the full stored brick.
+    void detectConstant()
+    {
+        constant = true;
+        value = 0;
+        if ( voxels.isEmpty() )
+            return;
+
+        Q_ASSERT( voxels.size() == Layout::storedVoxels );
+        const Voxel* v = voxels.constData();
+        value = v[0];
+        for ( int i = 1; i < Layout::storedVoxels; ++i )
+        {
+            if ( v[i] != value )
+            {
+                constant = false;
+                return;
+            }
+        }
+        voxels.clear();
+    }
+
+    // Smallest and largest value of the payload, border included
+    void valueRange( Voxel& lo, Voxel& hi ) const
+    {
+        lo = hi = value;
+        if ( constant || voxels.isEmpty() )
+            return;
+
+        const Voxel* v = voxels.constData();
+        lo = hi = v[0];
+        for ( int i = 1; i < voxels.size(); ++i )
+        {
+            lo = qMin( lo, v[i] );
+            hi = qMax( hi, v[i] );
+        }
+    }
+
+    // A constant brick needs no pool slot and is never refined
+    bool constant;
+    Voxel value;
+
+    QVector<Voxel> voxels;
+};
+
+#endif // C_VOXEL_LAYOUT_H
@@ -0,0 +1,59 @@
+# For the parallel brick updates
+QT += concurrent
+
+# For the out of process brick server
+QT += network
+
+HEADERS += $$PWD/c_stats.h \
+           $$PWD/c_voxel_config.h \
+           $$PWD/c_voxel_layout.h \
+           $$PWD/c_voxel_attributes.h \
+           $$PWD/c_occupancy.h \
+           $$PWD/c_block_compression.h \
+           $$PWD/c_transfer_function.h \
+           $$PWD/c_node_key.h \
+           $$PWD/c_content_hash.h \
+           $$PWD/c_brick.h \
+           $$PWD/c_brick_producer.h \
+           $$PWD/c_async_file_reader.h \
+           $$PWD/c_brick_file.h \
+           $$PWD/c_file_brick_producer.h \
+           $$PWD/c_brick_cache.h \
+           $$PWD/c_cached_brick_producer.h \
+           $$PWD/c_brick_protocol.h \
+           $$PWD/c_remote_brick_producer.h \
+           $$PWD/c_morton.h \
+           $$PWD/c_brick_pool.h \
+           $$PWD/c_node_tree.h \
+           $$PWD/c_brick_scheduler.h \
+           $$PWD/c_frustum.h \
+           $$PWD/c_occlusion_buffer.h \
+           $$PWD/c_view_info.h \
+           $$PWD/c_lod_traversal.h \
+           $$PWD/c_voxel_edit.h \
+           $$PWD/c_voxel_editor.h \
+           $$PWD/c_voxel_instances.h \
+           $$PWD/c_instance_bvh.h
+
+SOURCES += $$PWD/c_stats.cpp \
+           $$PWD/c_brick_producer.cpp \
+           $$PWD/c_voxel_attributes.cpp \
+           $$PWD/c_occupancy.cpp \
+           $$PWD/c_block_compression.cpp \
+           $$PWD/c_transfer_function.cpp \
+           $$PWD/c_async_file_reader.cpp \
+           $$PWD/c_brick_file.cpp \
+           $$PWD/c_file_brick_producer.cpp \
+           $$PWD/c_brick_cache.cpp \
+           $$PWD/c_cached_brick_producer.cpp \
+           $$PWD/c_brick_protocol.cpp \
+           $$PWD/c_remote_brick_producer.cpp \
+           $$PWD/c_brick_pool.cpp \
+           $$PWD/c_node_tree.cpp \
+           $$PWD/c_brick_scheduler.cpp \
+           $$PWD/c_frustum.cpp \
+           $$PWD/c_occlusion_buffer.cpp \
+           $$PWD/c_lod_traversal.cpp \
+           $$PWD/c_voxel_editor.cpp \
+           $$PWD/c_voxel_instances.cpp \
+           $$PWD/c_instance_bvh.cpp